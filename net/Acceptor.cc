@@ -3,43 +3,162 @@
 #include "include/Channel.h"
 #include "include/Socket.h"
 #include "include/SocketAddress.h"
+#include <algorithm>
+#include <cerrno>
 #include <cstdlib>
 #include <exception>
 #include <memory>
 #include <stdexcept>
+#include <sys/socket.h>
 #include <unistd.h>
 
 
 using namespace Cloo;
 
 Acceptor::Acceptor(std::shared_ptr<EventLoop> owner_loop, const SocketAddress& listen_addr)
-    : owner_loop_(owner_loop),
-      accept_socket_(Socket::CreateNonblockSocket()),
-      channel_(Channel::Create(owner_loop, static_cast<int>(accept_socket_->Fd()))),
-      listenning_(false)
+    : Acceptor(owner_loop, Socket::CreateNonblockSocket())
 {
     accept_socket_->SetReuseAddr(true);
     accept_socket_->Bind(listen_addr);
+}
+
+Acceptor::Acceptor(std::shared_ptr<EventLoop> owner_loop, SocketFd listen_fd)
+    : Acceptor(owner_loop, Socket::FromFd(listen_fd))
+{
+    // O_NONBLOCK属于共享的文件描述, 旧进程已经设置过; FD_CLOEXEC属于本进程的fd, 这里都再设置一次
+    accept_socket_->SetNonblockAndCloseOnExec();
+}
+
+Acceptor::Acceptor(std::shared_ptr<EventLoop> owner_loop, std::unique_ptr<Socket> accept_socket)
+    : owner_loop_(owner_loop.get()),
+      accept_socket_(std::move(accept_socket)),
+      channel_(Channel::Create(owner_loop, static_cast<int>(accept_socket_->Fd()))),
+      listenning_(false),
+      active_connections_(0),
+      paused_(false),
+      alive_(std::make_shared<bool>(true))
+{
     channel_->SetReadCallBack(std::bind(&Acceptor::HandleRead,this));
 }
 
+Acceptor::~Acceptor()
+{
+    channel_->DisableAll();
+    channel_->Remove();
+}
+
 
 void Acceptor::Listen()
 {
-    if(auto loop = owner_loop_.lock())
-    {
-        loop->AssertInLoopTread();
-    }
+    owner_loop_->AssertInLoopTread();
     listenning_ = true;
     accept_socket_->Listen();
     channel_->EnableReading();
 } 
 
+void Acceptor::StopListening()
+{
+    owner_loop_->AssertInLoopTread();
+    // listenning_为false后, 暂停后的定时器也不会再开启读事件
+    listenning_ = false;
+    channel_->DisableAll();
+}
+
+void Acceptor::SetAdmissionOptions(const AdmissionOptions& options)
+{
+    owner_loop_->AssertInLoopTread();
+    admission_ = options;
+    admission_.burst = std::max<size_t>(admission_.burst, 1);
+    accept_bucket_.Configure(admission_.accepts_per_second, admission_.burst);
+}
+
+void Acceptor::ConnectionClosed()
+{
+    owner_loop_->AssertInLoopTread();
+    if(active_connections_ > 0)
+    {
+        --active_connections_;
+    }
+}
+
+bool Acceptor::Admit(std::chrono::milliseconds* retry_after)
+{
+    if(accept_bucket_.Available() == 0)
+    {
+        // 等到下一个令牌产生
+        *retry_after = accept_bucket_.TimeUntil(1);
+        return false;
+    }
+    if((admission_.max_connections > 0 && active_connections_ >= admission_.max_connections) ||
+       (capacity_cb_ && !capacity_cb_()))
+    {
+        *retry_after = std::chrono::milliseconds(std::max(1L, admission_.retry_ms));
+        return false;
+    }
+    return true;
+}
+
+void Acceptor::PauseAccepting(std::chrono::milliseconds retry_after)
+{
+    if(paused_)
+    {
+        return;
+    }
+    paused_ = true;
+    ++stats_.pauses;
+    // 新连接留在backlog中, 水平触发的监听fd不会在暂停期间反复唤醒IO线程
+    channel_->DisableReading();
+    std::weak_ptr<bool> alive = alive_;
+    owner_loop_->RunAfter(retry_after.count(), [this, alive]
+    {
+        if(alive.lock())
+        {
+            ResumeAccepting();
+        }
+    });
+}
+
+void Acceptor::ResumeAccepting()
+{
+    paused_ = false;
+    if(listenning_)
+    {
+        // 仍然不满足准入条件时, 下一次HandleRead会再次暂停
+        channel_->EnableReading();
+    }
+}
+
+void Acceptor::RejectOne()
+{
+    std::unique_ptr<SocketAddress> peer_addr;
+    SocketFd conn_fd = accept_socket_->Accept(peer_addr);
+    if(conn_fd == SocketFd::invalid)
+    {
+        return;
+    }
+    // SO_LINGER为0时close直接发送RST, 服务端不会为被拒绝的连接保留TIME_WAIT
+    linger lg {1, 0};
+    ::setsockopt(static_cast<int>(conn_fd), SOL_SOCKET, SO_LINGER, &lg, sizeof lg);
+    ::close(static_cast<int>(conn_fd));
+    ++stats_.rejected;
+}
+
 void Acceptor::HandleRead()
 {
-    if(auto loop = owner_loop_.lock())
+    owner_loop_->AssertInLoopTread();
+
+    std::chrono::milliseconds retry_after {0};
+    if(!Admit(&retry_after))
     {
-        loop->AssertInLoopTread();
+        if(admission_.overflow == AdmissionOverflow::kPauseAccept)
+        {
+            PauseAccepting(retry_after);
+        }
+        else
+        {
+            RejectOne();
+        }
+        return;
     }
 
     std::unique_ptr<SocketAddress> peer_addr;
@@ -54,8 +173,11 @@ void Acceptor::HandleRead()
     
     if(conn_fd != SocketFd::invalid)
     {
+        accept_bucket_.Consume(1);
+        ++stats_.accepted;
         if(cb_)
         {
+            ++active_connections_;
             cb_(conn_fd, *peer_addr);
         }
         else
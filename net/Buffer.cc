@@ -0,0 +1,284 @@
+#include "include/Buffer.h"
+#include "include/LoopMemory.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <linux/errqueue.h>
+#include <new>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+using namespace Cloo;
+using namespace std;
+
+const size_t Buffer::kCheapPrepend;
+const size_t Buffer::kInitialSize;
+const size_t Buffer::kExtraBufferSize;
+
+Buffer::Buffer(size_t initial_size)
+    : data_(static_cast<char*>(::operator new(kCheapPrepend + initial_size))),
+      capacity_(kCheapPrepend + initial_size),
+      memory_(nullptr),
+      chunk_(false),
+      reader_index_(kCheapPrepend),
+      writer_index_(kCheapPrepend),
+      read_hint_(0)
+{
+
+}
+
+Buffer::Buffer(LoopMemory* memory)
+    : data_(EmptyStorage()),
+      capacity_(kCheapPrepend),
+      memory_(memory),
+      chunk_(false),
+      reader_index_(kCheapPrepend),
+      writer_index_(kCheapPrepend),
+      read_hint_(0)
+{
+    static_assert(LoopMemory::kBufferChunkSize >= kCheapPrepend + kInitialSize);
+}
+
+Buffer::~Buffer()
+{
+    ReleaseStorage();
+}
+
+char* Buffer::EmptyStorage()
+{
+    static char empty[kCheapPrepend];
+    return empty;
+}
+
+void Buffer::ReleaseStorage()
+{
+    if(data_ == EmptyStorage())
+    {
+        return;
+    }
+    if(chunk_)
+    {
+        memory_->DeallocateChunk(data_);
+    }
+    else
+    {
+        ::operator delete(data_);
+    }
+}
+
+void Buffer::Reallocate(size_t capacity)
+{
+    const size_t readable = ReadableBytes();
+    assert(capacity >= kCheapPrepend + readable);
+    // chunk只能在LoopMemory所属的线程中分配
+    const bool use_chunk = memory_ != nullptr && capacity <= LoopMemory::kBufferChunkSize && memory_->IsOwnerThread();
+    char* new_data = use_chunk ? static_cast<char*>(memory_->AllocateChunk()) : static_cast<char*>(::operator new(capacity));
+    memcpy(new_data + kCheapPrepend, Peek(), readable);
+    ReleaseStorage();
+    data_ = new_data;
+    capacity_ = use_chunk ? LoopMemory::kBufferChunkSize : capacity;
+    chunk_ = use_chunk;
+    reader_index_ = kCheapPrepend;
+    writer_index_ = kCheapPrepend + readable;
+}
+
+void Buffer::Shrink()
+{
+    if(ReadableBytes() == 0)
+    {
+        ReleaseStorage();
+        data_ = EmptyStorage();
+        capacity_ = kCheapPrepend;
+        chunk_ = false;
+        RetrieveAll();
+    }
+    else if(capacity_ > LoopMemory::kBufferChunkSize && capacity_ > 2 * (kCheapPrepend + ReadableBytes()))
+    {
+        Reallocate(kCheapPrepend + ReadableBytes());
+    }
+    read_hint_ /= 2;
+}
+
+void Buffer::Rebind(LoopMemory* memory)
+{
+    if(memory == memory_)
+    {
+        return;
+    }
+    LoopMemory* old_memory = memory_;
+    char* old_chunk = chunk_ ? data_ : nullptr;
+    memory_ = memory;
+    if(old_chunk == nullptr)
+    {
+        return;
+    }
+    const size_t readable = ReadableBytes();
+    if(readable == 0)
+    {
+        data_ = EmptyStorage();
+        capacity_ = kCheapPrepend;
+        chunk_ = false;
+        RetrieveAll();
+    }
+    else
+    {
+        // 可读数据来自一个chunk, 新的存储也总能放进一个chunk
+        chunk_ = memory_ != nullptr && memory_->IsOwnerThread();
+        data_ = chunk_ ? static_cast<char*>(memory_->AllocateChunk()) : static_cast<char*>(::operator new(capacity_));
+        capacity_ = chunk_ ? LoopMemory::kBufferChunkSize : capacity_;
+        memcpy(data_ + kCheapPrepend, old_chunk + reader_index_, readable);
+        reader_index_ = kCheapPrepend;
+        writer_index_ = kCheapPrepend + readable;
+    }
+    old_memory->DeallocateChunk(old_chunk);
+}
+
+void Buffer::Retrieve(size_t len)
+{
+    assert(len <= ReadableBytes());
+    if(len < ReadableBytes())
+    {
+        reader_index_ += len;
+    }
+    else
+    {
+        RetrieveAll();
+    }
+}
+
+void Buffer::RetrieveAll()
+{
+    reader_index_ = kCheapPrepend;
+    writer_index_ = kCheapPrepend;
+}
+
+string Buffer::RetrieveAsString(size_t len)
+{
+    assert(len <= ReadableBytes());
+    string result(Peek(), len);
+    Retrieve(len);
+    return result;
+}
+
+string Buffer::RetrieveAllAsString()
+{
+    return RetrieveAsString(ReadableBytes());
+}
+
+void Buffer::Append(const char* data, size_t len)
+{
+    EnsureWritableBytes(len);
+    copy(data, data + len, BeginWrite());
+    HasWritten(len);
+}
+
+void Buffer::EnsureWritableBytes(size_t len)
+{
+    if(WritableBytes() < len)
+    {
+        MakeSpace(len);
+    }
+    assert(WritableBytes() >= len);
+}
+
+void Buffer::MakeSpace(size_t len)
+{
+    if(data_ == EmptyStorage())
+    {
+        // 第一次写入(或Shrink之后): 按观察到的读取大小分配, 小于一个chunk时就用一个chunk
+        Reallocate(kCheapPrepend + std::max(len, std::min(read_hint_, kExtraBufferSize)));
+    }
+    // 前部空闲空间加上尾部空闲空间仍然不够时才扩容, 否则把可读数据挪到前面
+    else if(WritableBytes() + PrependableBytes() < len + kCheapPrepend)
+    {
+        // 按至少翻倍扩容, 与vector的增长方式一致
+        Reallocate(std::max(kCheapPrepend + ReadableBytes() + len, capacity_ * 2));
+    }
+    else
+    {
+        size_t readable = ReadableBytes();
+        copy(begin() + reader_index_, begin() + writer_index_, begin() + kCheapPrepend);
+        reader_index_ = kCheapPrepend;
+        writer_index_ = reader_index_ + readable;
+    }
+}
+
+ssize_t Buffer::ReadFd(int fd, int* saved_errno)
+{
+    char extra_buf[kExtraBufferSize];
+    iovec vec[2];
+    const size_t writable = WritableBytes();
+    vec[0].iov_base = BeginWrite();
+    vec[0].iov_len = writable;
+    vec[1].iov_base = extra_buf;
+    vec[1].iov_len = sizeof extra_buf;
+    // Buffer本身的空闲空间已经足够大时就不再使用栈上的缓冲区
+    const int iovcnt = UseExtraBuffer() ? 2 : 1;
+    const ssize_t n = ::readv(fd, vec, iovcnt);
+    if(n < 0)
+    {
+        *saved_errno = errno;
+        return n;
+    }
+    ObserveRead(n);
+    if(static_cast<size_t>(n) <= writable)
+    {
+        writer_index_ += n;
+    }
+    else
+    {
+        writer_index_ = capacity_;
+        Append(extra_buf, n - writable);
+    }
+    return n;
+}
+
+ssize_t Buffer::ReadFd(int fd, int* saved_errno, define::SystemTimePoint* rx_time)
+{
+    char extra_buf[kExtraBufferSize];
+    iovec vec[2];
+    const size_t writable = WritableBytes();
+    vec[0].iov_base = BeginWrite();
+    vec[0].iov_len = writable;
+    vec[1].iov_base = extra_buf;
+    vec[1].iov_len = sizeof extra_buf;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(scm_timestamping))];
+    msghdr msg {};
+    msg.msg_iov = vec;
+    msg.msg_iovlen = UseExtraBuffer() ? 2 : 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+    const ssize_t n = ::recvmsg(fd, &msg, 0);
+    if(n < 0)
+    {
+        *saved_errno = errno;
+        return n;
+    }
+    for(cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING)
+        {
+            scm_timestamping stamps;
+            memcpy(&stamps, CMSG_DATA(cmsg), sizeof stamps);
+            // ts[0]是软件时间戳, ts[2]是硬件时间戳(未开启)
+            if(stamps.ts[0].tv_sec != 0 || stamps.ts[0].tv_nsec != 0)
+            {
+                *rx_time = define::SystemTimePoint(chrono::duration_cast<define::SystemTimePoint::duration>(
+                    chrono::seconds(stamps.ts[0].tv_sec) + chrono::nanoseconds(stamps.ts[0].tv_nsec)));
+            }
+        }
+    }
+    ObserveRead(n);
+    if(static_cast<size_t>(n) <= writable)
+    {
+        writer_index_ += n;
+    }
+    else
+    {
+        writer_index_ = capacity_;
+        Append(extra_buf, n - writable);
+    }
+    return n;
+}
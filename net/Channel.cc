@@ -1,6 +1,8 @@
 #include "include/Channel.h"
 #include "include/EventLoop.h"
+#include "include/LoopMemory.h"
 
+#include <cassert>
 #include <iostream>
 #include <memory>
 #include <poll.h>
@@ -16,32 +18,89 @@ const int Channel::kWriteEvent = POLLOUT;
 // private constructor, 因为Channel类继承了enable_shared_ptr_from_this模板类
 // 禁止用户通过构造函数创建栈上的对象
 // 必须使用工厂方法Create(2)来创建堆上的对象,并初始化一个shared_ptr指针
-Channel::Channel(const shared_ptr<EventLoop>& loop, int fd)
+Channel::Channel(EventLoop* loop, int fd)
     : owner_loop_(loop),
       fd_(fd),
       events_(0),
       revents_(0),
-      index_(-1)
+      index_(-1),
+      edge_triggered_(false),
+      tied_(false),
+      event_handling_(false)
     {
         //do nothing
     }
 
+Channel::~Channel()
+{
+    // 不允许在HandleEvent的过程中析构自己, 拥有者需要借助Tie()延长生命周期
+    assert(!event_handling_);
+}
+
 shared_ptr<Channel> Channel::Create(const shared_ptr<EventLoop> &loop, int fd)
 {
-    shared_ptr<Channel> channel = shared_ptr<Channel>(new Channel(loop, fd));
-    return channel;
+    return Create(loop.get(), fd);
 }
 
-void Channel::update()
+shared_ptr<Channel> Channel::Create(EventLoop* loop, int fd)
 {
-    if(auto loop = owner_loop_.lock())
+    // 在IO线程中创建时, Channel对象与shared_ptr的控制块都从EventLoop的LoopMemory中分配
+    LoopMemory* memory = loop ? loop->MemoryForThisThread() : nullptr;
+    if(!memory)
     {
-        loop->UpdateChannel(shared_from_this());
+        return shared_ptr<Channel>(new Channel(loop, fd));
     }
+    Channel* channel = new (memory->AllocateObject(sizeof(Channel))) Channel(loop, fd);
+    auto deleter = [memory](Channel* ptr)
+    {
+        ptr->~Channel();
+        memory->DeallocateObject(ptr, sizeof(Channel));
+    };
+    return shared_ptr<Channel>(channel, deleter, LoopAllocator<Channel>(memory));
+}
+
+void Channel::update()
+{
+    owner_loop_->UpdateChannel(this);
+}
+
+void Channel::Remove()
+{
+    assert(IsNoneEvent());
+    owner_loop_->RemoveChannel(this);
+}
+
+void Channel::Tie(const shared_ptr<void>& owner)
+{
+    tie_ = owner;
+    tied_ = true;
 }
 
 void Channel::HandleEvent()
 {
+    if(tied_)
+    {
+        // 拥有者已经析构, 这个事件不再有人处理
+        if(auto guard = tie_.lock())
+        {
+            HandleEventWithGuard();
+        }
+    }
+    else
+    {
+        HandleEventWithGuard();
+    }
+}
+
+void Channel::HandleEventWithGuard()
+{
+    event_handling_ = true;
+    // 对端关闭且没有数据可读
+    if((revents_ & POLLHUP) && !(revents_ & POLLIN))
+    {
+        if(closeCallBack_) closeCallBack_();
+    }
+
     if(revents_ & POLLNVAL)
     {
         cerr << "Channel::HandleEvent() POLLNVAL" << endl;
@@ -52,7 +111,7 @@ void Channel::HandleEvent()
         if(errorCallBack_) errorCallBack_();
     }
 
-    if(revents_ & (POLLIN | POLLPRI | POLLHUP))
+    if(revents_ & (POLLIN | POLLPRI | POLLRDHUP))
     {
         if(readCallBack_) readCallBack_();
     }
@@ -61,4 +120,5 @@ void Channel::HandleEvent()
     {
         if(writeCallBack_) writeCallBack_();
     }
+    event_handling_ = false;
 }
\ No newline at end of file
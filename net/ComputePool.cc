@@ -0,0 +1,232 @@
+#include "include/ComputePool.h"
+#include "include/EventLoop.h"
+
+#include <cassert>
+#include <exception>
+#include <iostream>
+#include <stdexcept>
+
+using namespace Cloo;
+using namespace std;
+
+namespace Cloo::detail 
+{
+
+// 每个worker线程记录自己在池中的下标, 用于判断Submit是否来自本池的worker
+thread_local const ComputePool* T_CURRENT_POOL = nullptr;
+thread_local size_t T_WORKER_INDEX = 0;
+
+}
+
+ComputePool::ComputePool(int num_threads, size_t max_pending, RejectPolicy policy)
+    : max_pending_(max_pending),
+      policy_(policy),
+      pending_(0),
+      next_worker_(0),
+      rejected_(0),
+      stolen_(0),
+      stopping_(false),
+      idle_workers_(0)
+{
+    assert(num_threads > 0);
+    for(int i = 0; i < num_threads; ++i)
+    {
+        workers_.push_back(make_unique<Worker>(max_pending));
+    }
+    for(size_t i = 0; i < workers_.size(); ++i)
+    {
+        workers_[i]->thread = thread(&ComputePool::WorkerFunc, this, i);
+    }
+}
+
+ComputePool::~ComputePool()
+{
+    Stop();
+}
+
+void ComputePool::Stop()
+{
+    if(stopping_.exchange(true))
+    {
+        return;
+    }
+    {
+        lock_guard<mutex> lg(idle_mutex_);
+        idle_cv_.notify_all();
+    }
+    for(auto& worker : workers_)
+    {
+        if(worker->thread.joinable())
+        {
+            worker->thread.join();
+        }
+    }
+}
+
+bool ComputePool::Submit(Task task)
+{
+    // 先占用一个名额, 超出上限或者已经停止时按策略拒绝
+    bool saturated = stopping_.load(memory_order_relaxed);
+    if(!saturated && pending_.fetch_add(1, memory_order_relaxed) >= max_pending_)
+    {
+        pending_.fetch_sub(1, memory_order_relaxed);
+        saturated = true;
+    }
+    if(saturated)
+    {
+        rejected_.fetch_add(1, memory_order_relaxed);
+        switch(policy_)
+        {
+            case RejectPolicy::kCallerRuns:
+                task();
+                return true;
+            case RejectPolicy::kAbort:
+                throw runtime_error("ComputePool is saturated");
+            case RejectPolicy::kReject:
+                return false;
+        }
+    }
+
+    auto* item = new Task(std::move(task));
+    // worker派生的子任务直接压入自己的队列, 不需要加锁
+    if(detail::T_CURRENT_POOL == this && workers_[detail::T_WORKER_INDEX]->deque.Push(item))
+    {
+        // do nothing
+    }
+    else
+    {
+        auto& worker = workers_[next_worker_.fetch_add(1, memory_order_relaxed) % workers_.size()];
+        lock_guard<mutex> lg(worker->inbox_mutex);
+        worker->inbox.push_back(item);
+    }
+    // 与WorkerFunc中"先登记空闲再检查队列"配对: 任务入队与读取idle_workers_之间需要全序,
+    // 否则worker可能没看到任务, 这里也没看到它登记空闲, 任务就会一直等到下一次Submit
+    atomic_thread_fence(memory_order_seq_cst);
+    if(idle_workers_.load(memory_order_relaxed) > 0)
+    {
+        lock_guard<mutex> lg(idle_mutex_);
+        idle_cv_.notify_one();
+    }
+    return true;
+}
+
+ComputePool::Task* ComputePool::FindTask(size_t index)
+{
+    Worker& self = *workers_[index];
+    if(auto task = self.deque.Pop())
+    {
+        return *task;
+    }
+    // 把收件箱中的任务批量转移到自己的队列中, 其他worker随后就可以窃取它们
+    {
+        lock_guard<mutex> lg(self.inbox_mutex);
+        while(!self.inbox.empty() && self.deque.Push(self.inbox.front()))
+        {
+            self.inbox.pop_front();
+        }
+    }
+    if(auto task = self.deque.Pop())
+    {
+        return *task;
+    }
+    // 从其他worker的队列顶部窃取
+    for(size_t i = 1; i < workers_.size(); ++i)
+    {
+        Worker& victim = *workers_[(index + i) % workers_.size()];
+        if(auto task = victim.deque.Steal())
+        {
+            stolen_.fetch_add(1, memory_order_relaxed);
+            return *task;
+        }
+    }
+    // 其他worker正忙于执行长任务时, 它收件箱中的任务也可以被取走
+    for(size_t i = 1; i < workers_.size(); ++i)
+    {
+        Worker& victim = *workers_[(index + i) % workers_.size()];
+        unique_lock<mutex> lock(victim.inbox_mutex, try_to_lock);
+        if(lock.owns_lock() && !victim.inbox.empty())
+        {
+            Task* task = victim.inbox.front();
+            victim.inbox.pop_front();
+            stolen_.fetch_add(1, memory_order_relaxed);
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+bool ComputePool::HasQueuedTask()
+{
+    for(auto& worker : workers_)
+    {
+        if(worker->deque.SizeApprox() > 0)
+        {
+            return true;
+        }
+        lock_guard<mutex> lg(worker->inbox_mutex);
+        if(!worker->inbox.empty())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ComputePool::Run(Task* task)
+{
+    unique_ptr<Task> owned(task);
+    // 任务抛出的异常不能让worker线程退出(std::terminate), 也不能漏掉pending_的计数
+    try
+    {
+        (*owned)();
+    }
+    catch(const exception& e)
+    {
+        cerr << "ComputePool: task threw " << e.what() << endl;
+    }
+    catch(...)
+    {
+        cerr << "ComputePool: task threw an unknown exception" << endl;
+    }
+    owned.reset();
+    if(pending_.fetch_sub(1, memory_order_acq_rel) == 1 && stopping_.load())
+    {
+        // 最后一个任务执行完, 唤醒等待退出的worker
+        lock_guard<mutex> lg(idle_mutex_);
+        idle_cv_.notify_all();
+    }
+}
+
+void ComputePool::WorkerFunc(size_t index)
+{
+    detail::T_CURRENT_POOL = this;
+    detail::T_WORKER_INDEX = index;
+    while(true)
+    {
+        if(Task* task = FindTask(index))
+        {
+            Run(task);
+            continue;
+        }
+        if(stopping_.load() && pending_.load() == 0)
+        {
+            break;
+        }
+        // 没有找到任务, 睡眠等待新任务
+        // 先在idle_mutex_下登记空闲, 再重新检查所有队列: Submit在任务入队之后读取idle_workers_,
+        // 要么这里看到了新任务, 要么Submit看到了登记并在idle_mutex_下notify(此时本线程已经在wait中)
+        unique_lock<mutex> lock(idle_mutex_);
+        idle_workers_.fetch_add(1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        if(!HasQueuedTask() && !(stopping_.load() && pending_.load() == 0))
+        {
+            idle_cv_.wait(lock);
+        }
+        idle_workers_.fetch_sub(1, memory_order_relaxed);
+    }
+}
+
+void ComputePool::QueueInLoop(EventLoop* loop, define::IOEventCallback cb)
+{
+    loop->QueueTaskInThisLoop(cb);
+}
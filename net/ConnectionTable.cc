@@ -0,0 +1,313 @@
+#include "include/ConnectionTable.h"
+#include "include/EventLoop.h"
+#include "include/TcpConnection.h"
+
+#include <cassert>
+#include <stdexcept>
+#include <utility>
+
+using namespace Cloo;
+using namespace std;
+
+struct ConnectionTable::Message
+{
+    Message* next;
+    uint32_t generation;
+    std::string data;
+};
+
+namespace
+{
+
+// 生产者线程缓存的空闲节点, 节点都是operator new分配的, 可以用于任意一张连接表, 线程退出时释放
+template <typename Node>
+struct NodeCache
+{
+    Node* head = nullptr;
+
+    ~NodeCache()
+    {
+        while(head != nullptr)
+        {
+            Node* next = head->next;
+            delete head;
+            head = next;
+        }
+    }
+};
+
+}
+
+void Cloo::Send(const ConnectionHandle& handle, string data)
+{
+    assert(handle.Valid());
+    handle.table->Post(handle, std::move(data));
+}
+
+ConnectionTable::ConnectionTable()
+    : num_slots_(0),
+      size_(0),
+      free_messages_(nullptr),
+      dropped_(0)
+{
+    for(auto& segment : segments_)
+    {
+        segment.store(nullptr, memory_order_relaxed);
+    }
+}
+
+ConnectionTable::~ConnectionTable()
+{
+    // 还没有被处理的消息直接丢弃
+    for(auto& segment : segments_)
+    {
+        Slot* slots = segment.load(memory_order_acquire);
+        if(slots == nullptr)
+        {
+            break;
+        }
+        for(size_t i = 0; i < kSegmentSlots; ++i)
+        {
+            Message* msg = slots[i].inbound.exchange(nullptr, memory_order_acquire);
+            while(msg != nullptr)
+            {
+                Message* next = msg->next;
+                delete msg;
+                msg = next;
+            }
+        }
+        delete[] slots;
+    }
+    Message* msg = free_messages_.exchange(nullptr, memory_order_acquire);
+    while(msg != nullptr)
+    {
+        Message* next = msg->next;
+        delete msg;
+        msg = next;
+    }
+}
+
+ConnectionTable::Slot* ConnectionTable::Locate(uint32_t slot) const
+{
+    const size_t segment = slot / kSegmentSlots;
+    if(segment >= kMaxSegments)
+    {
+        return nullptr;
+    }
+    Slot* slots = segments_[segment].load(memory_order_acquire);
+    return slots == nullptr ? nullptr : &slots[slot % kSegmentSlots];
+}
+
+ConnectionHandle ConnectionTable::Register(TcpConnection* conn)
+{
+    EventLoop* loop = conn->GetLoop();
+    loop->AssertInLoopTread();
+    uint32_t index;
+    {
+        lock_guard<mutex> lg(mutex_);
+        if(!free_slots_.empty())
+        {
+            index = free_slots_.back();
+            free_slots_.pop_back();
+        }
+        else
+        {
+            if(num_slots_ == kSegmentSlots * kMaxSegments)
+            {
+                throw runtime_error("ConnectionTable: too many connections");
+            }
+            index = static_cast<uint32_t>(num_slots_++);
+            if(index % kSegmentSlots == 0)
+            {
+                segments_[index / kSegmentSlots].store(new Slot[kSegmentSlots], memory_order_release);
+            }
+        }
+    }
+    Slot& slot = *Locate(index);
+    slot.conn = conn;
+    // 上一条连接注销之后才到达的数据
+    DropInbound(slot);
+    {
+        lock_guard<mutex> lg(WakeLock(index));
+        slot.loop = loop;
+    }
+    size_.fetch_add(1, memory_order_relaxed);
+    return ConnectionHandle{this, index, slot.generation.load(memory_order_relaxed)};
+}
+
+void ConnectionTable::Unregister(const ConnectionHandle& handle)
+{
+    if(Find(handle) == nullptr)
+    {
+        return;
+    }
+    Slot& slot = *Locate(handle.slot);
+    slot.conn->GetLoop()->AssertInLoopTread();
+    slot.conn = nullptr;
+    {
+        lock_guard<mutex> lg(WakeLock(handle.slot));
+        slot.loop = nullptr;
+    }
+    // 跳过0, 0留给空句柄
+    uint32_t generation = handle.generation + 1;
+    slot.generation.store(generation == 0 ? 1 : generation, memory_order_release);
+    DropInbound(slot);
+    size_.fetch_sub(1, memory_order_relaxed);
+    lock_guard<mutex> lg(mutex_);
+    free_slots_.push_back(handle.slot);
+}
+
+void ConnectionTable::Detach(const ConnectionHandle& handle)
+{
+    if(Find(handle) == nullptr)
+    {
+        return;
+    }
+    lock_guard<mutex> lg(WakeLock(handle.slot));
+    Locate(handle.slot)->loop = nullptr;
+}
+
+void ConnectionTable::Attach(const ConnectionHandle& handle, EventLoop* loop)
+{
+    if(Find(handle) == nullptr)
+    {
+        return;
+    }
+    {
+        lock_guard<mutex> lg(WakeLock(handle.slot));
+        Locate(handle.slot)->loop = loop;
+    }
+    DrainSlot(handle.slot);
+}
+
+TcpConnection* ConnectionTable::Find(const ConnectionHandle& handle) const
+{
+    if(handle.table != this)
+    {
+        return nullptr;
+    }
+    Slot* slot = Locate(handle.slot);
+    if(slot == nullptr || slot->generation.load(memory_order_acquire) != handle.generation)
+    {
+        return nullptr;
+    }
+    return slot->conn;
+}
+
+void ConnectionTable::Post(const ConnectionHandle& handle, string data)
+{
+    assert(handle.table == this);
+    Slot* slot = Locate(handle.slot);
+    if(slot == nullptr || slot->generation.load(memory_order_acquire) != handle.generation)
+    {
+        dropped_.fetch_add(1, memory_order_relaxed);
+        return;
+    }
+    Message* msg = AllocateMessage();
+    msg->generation = handle.generation;
+    msg->data = std::move(data);
+    Message* head = slot->inbound.load(memory_order_relaxed);
+    do
+    {
+        msg->next = head;
+    } while(!slot->inbound.compare_exchange_weak(head, msg, memory_order_release, memory_order_relaxed));
+    // 队列由空变为非空时投递取空任务, 之后的Post由同一次DrainSlot处理.
+    // 在锁内使用loop: 连接注销或离开loop都要先拿到这把锁, 因此loop在此期间不会被销毁;
+    // loop为nullptr时连接正在迁移(由Attach取空)或已经注销(数据由slot下一次Register时丢弃)
+    if(head == nullptr)
+    {
+        lock_guard<mutex> lg(WakeLock(handle.slot));
+        if(slot->loop != nullptr)
+        {
+            slot->loop->QueueTaskInThisLoop([table = shared_from_this(), index = handle.slot]
+            {
+                table->DrainSlot(index);
+            });
+        }
+    }
+}
+
+void ConnectionTable::DrainSlot(uint32_t index)
+{
+    Slot& slot = *Locate(index);
+    {
+        // 投递之后连接可能已经注销或离开了这个loop, 由新的所属线程负责
+        lock_guard<mutex> lg(WakeLock(index));
+        if(slot.loop == nullptr || !slot.loop->IsInLoopThread())
+        {
+            return;
+        }
+    }
+    Message* msg = slot.inbound.exchange(nullptr, memory_order_acquire);
+    if(msg == nullptr)
+    {
+        return;
+    }
+    // 链表是后进先出的, 反转后按Post的顺序发送
+    Message* ordered = nullptr;
+    Message* last = msg;
+    while(msg != nullptr)
+    {
+        Message* next = msg->next;
+        msg->next = ordered;
+        ordered = msg;
+        msg = next;
+    }
+    const uint32_t generation = slot.generation.load(memory_order_relaxed);
+    for(Message* m = ordered; m != nullptr; m = m->next)
+    {
+        if(m->generation == generation && slot.conn != nullptr && slot.conn->Connected())
+        {
+            slot.conn->Send(m->data);
+        }
+        else
+        {
+            dropped_.fetch_add(1, memory_order_relaxed);
+        }
+        string().swap(m->data);
+    }
+    RecycleMessages(ordered, last);
+}
+
+void ConnectionTable::DropInbound(Slot& slot)
+{
+    Message* msg = slot.inbound.exchange(nullptr, memory_order_acquire);
+    if(msg == nullptr)
+    {
+        return;
+    }
+    Message* last = msg;
+    for(Message* m = msg; m != nullptr; m = m->next)
+    {
+        dropped_.fetch_add(1, memory_order_relaxed);
+        string().swap(m->data);
+        last = m;
+    }
+    RecycleMessages(msg, last);
+}
+
+ConnectionTable::Message* ConnectionTable::AllocateMessage()
+{
+    thread_local NodeCache<Message> cache;
+    if(cache.head == nullptr)
+    {
+        // 一次取走整个空闲链表, 不存在单个节点出栈的ABA问题
+        cache.head = free_messages_.exchange(nullptr, memory_order_acquire);
+    }
+    if(cache.head == nullptr)
+    {
+        return new Message;
+    }
+    Message* msg = cache.head;
+    cache.head = msg->next;
+    return msg;
+}
+
+void ConnectionTable::RecycleMessages(Message* first, Message* last)
+{
+    Message* head = free_messages_.load(memory_order_relaxed);
+    do
+    {
+        last->next = head;
+    } while(!free_messages_.compare_exchange_weak(head, first, memory_order_release, memory_order_relaxed));
+}
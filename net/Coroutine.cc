@@ -0,0 +1,270 @@
+#include "include/Coroutine.h"
+#include "include/Channel.h"
+#include "include/EventLoop.h"
+#include "include/Socket.h"
+#include "include/SocketAddress.h"
+
+#include <array>
+#include <cassert>
+#include <cerrno>
+#include <new>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace Cloo::detail 
+{
+
+// 每个线程(即每个EventLoop)独占的协程帧空闲链表
+// 空闲的协程帧本身被用作链表节点, 不需要额外的内存
+struct FramePool
+{
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    static constexpr size_t kNumClasses = FrameAllocator::kMaxPooledFrameSize / FrameAllocator::kSizeClassBytes;
+
+    std::array<FreeBlock*, kNumClasses> free_lists {};
+    FrameAllocator::Stats stats;
+
+    ~FramePool()
+    {
+        for(size_t i = 0; i < kNumClasses; ++i)
+        {
+            while(FreeBlock* block = free_lists[i])
+            {
+                free_lists[i] = block->next;
+                ::operator delete(block);
+            }
+        }
+    }
+
+    // size对应的大小级别, 每一级覆盖kSizeClassBytes字节
+    static size_t ClassOf(size_t size)
+    {
+        return (size + FrameAllocator::kSizeClassBytes - 1) / FrameAllocator::kSizeClassBytes - 1;
+    }
+};
+
+thread_local FramePool T_FRAME_POOL;
+
+void* FrameAllocator::Allocate(size_t size)
+{
+    if(size == 0 || size > kMaxPooledFrameSize)
+    {
+        return ::operator new(size);
+    }
+    size_t cls = FramePool::ClassOf(size);
+    if(FramePool::FreeBlock* block = T_FRAME_POOL.free_lists[cls])
+    {
+        T_FRAME_POOL.free_lists[cls] = block->next;
+        T_FRAME_POOL.stats.pool_hits++;
+        T_FRAME_POOL.stats.bytes_cached -= (cls + 1) * kSizeClassBytes;
+        return block;
+    }
+    T_FRAME_POOL.stats.pool_misses++;
+    return ::operator new((cls + 1) * kSizeClassBytes);
+}
+
+void FrameAllocator::Deallocate(void* ptr, size_t size) noexcept
+{
+    if(size == 0 || size > kMaxPooledFrameSize)
+    {
+        ::operator delete(ptr);
+        return;
+    }
+    size_t cls = FramePool::ClassOf(size);
+    auto* block = static_cast<FramePool::FreeBlock*>(ptr);
+    block->next = T_FRAME_POOL.free_lists[cls];
+    T_FRAME_POOL.free_lists[cls] = block;
+    T_FRAME_POOL.stats.bytes_cached += (cls + 1) * kSizeClassBytes;
+}
+
+const FrameAllocator::Stats& FrameAllocator::ThreadStats()
+{
+    return T_FRAME_POOL.stats;
+}
+
+}
+
+using namespace Cloo;
+using namespace std;
+
+void SleepAwaiter::await_suspend(coroutine_handle<> handle)
+{
+    loop_->RunAfter(delay_ms_, [handle]{ handle.resume(); });
+}
+
+AsyncSocket::AsyncSocket(EventLoop* loop, SocketFd fd)
+    : AsyncSocket(loop, Socket::FromFd(fd))
+{
+
+}
+
+AsyncSocket::AsyncSocket(EventLoop* loop, unique_ptr<Socket> socket)
+    : loop_(loop),
+      socket_(std::move(socket)),
+      channel_(Channel::Create(loop, static_cast<int>(socket_->Fd()))),
+      reader_(nullptr),
+      writer_(nullptr)
+{
+    channel_->SetReadCallBack(bind(&AsyncSocket::HandleRead, this));
+    channel_->SetWriteCallBack(bind(&AsyncSocket::HandleWrite, this));
+    // 出错或对端关闭时, 让等待中的操作通过系统调用得到具体的结果
+    channel_->SetCloseCallBack(bind(&AsyncSocket::HandleRead, this));
+    channel_->SetErrorCallBack(bind(&AsyncSocket::HandleRead, this));
+}
+
+AsyncSocket::~AsyncSocket()
+{
+    loop_->AssertInLoopTread();
+    channel_->DisableAll();
+    channel_->Remove();
+    // 协程通常是在Channel的回调中被恢复并执行完毕的, 此时AsyncSocket随协程帧一起析构, 而Channel仍处于HandleEvent中:
+    // 清空revents让HandleEvent不再调用其余的回调, 并把Channel的析构推迟到本轮事件处理结束之后
+    if(channel_->EventHandling())
+    {
+        channel_->SetRevents(0);
+        loop_->QueueTaskInThisLoop([channel = std::move(channel_)]{});
+    }
+}
+
+unique_ptr<AsyncSocket> AsyncSocket::Listen(EventLoop* loop, const SocketAddress& listen_addr)
+{
+    auto socket = Socket::CreateNonblockSocket();
+    socket->SetReuseAddr(true);
+    socket->Bind(listen_addr);
+    socket->Listen();
+    return make_unique<AsyncSocket>(loop, std::move(socket));
+}
+
+void AsyncSocket::HandleRead()
+{
+    // 没有等待者时取消关注可读事件, 避免水平触发下反复被通知
+    if(!reader_)
+    {
+        channel_->DisableReading();
+        return;
+    }
+    if(reader_->TryComplete())
+    {
+        Operation* op = reader_;
+        reader_ = nullptr;
+        op->handle_.resume();
+    }
+}
+
+void AsyncSocket::HandleWrite()
+{
+    if(!writer_)
+    {
+        channel_->DisableWriting();
+        return;
+    }
+    if(writer_->TryComplete())
+    {
+        Operation* op = writer_;
+        writer_ = nullptr;
+        op->handle_.resume();
+    }
+}
+
+void AsyncSocket::Operation::await_suspend(coroutine_handle<> handle)
+{
+    socket_->loop_->AssertInLoopTread();
+    handle_ = handle;
+    if(kind_ == Kind::kWrite)
+    {
+        assert(socket_->writer_ == nullptr);
+        socket_->writer_ = this;
+        if(!socket_->channel_->IsWriting())
+        {
+            socket_->channel_->EnableWriting();
+        }
+    }
+    else
+    {
+        assert(socket_->reader_ == nullptr);
+        socket_->reader_ = this;
+        if(!socket_->channel_->IsReading())
+        {
+            socket_->channel_->EnableReading();
+        }
+    }
+}
+
+bool AsyncSocket::Operation::TryComplete() noexcept
+{
+    int fd = static_cast<int>(socket_->Fd());
+    while(true)
+    {
+        switch(kind_)
+        {
+            case Kind::kAccept:
+            {
+                socklen_t addr_len = sizeof(sockaddr_in);
+                int conn_fd = ::accept4(fd, reinterpret_cast<sockaddr*>(&accepted_.peer_addr), &addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if(conn_fd >= 0)
+                {
+                    accepted_.fd = static_cast<SocketFd>(conn_fd);
+                    return true;
+                }
+                // 连接在accept之前就被对端重置, 继续接受下一个
+                if(errno == EINTR || errno == ECONNABORTED)
+                {
+                    continue;
+                }
+                if(errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    return false;
+                }
+                result_ = -errno;
+                accepted_.fd = SocketFd::invalid;
+                return true;
+            }
+            case Kind::kRead:
+            {
+                ssize_t n = ::read(fd, buf_, len_);
+                if(n >= 0)
+                {
+                    result_ = n;
+                    return true;
+                }
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+                if(errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    return false;
+                }
+                result_ = -errno;
+                return true;
+            }
+            case Kind::kWrite:
+            {
+                while(done_ < len_)
+                {
+                    // MSG_NOSIGNAL: 对端已经关闭时返回EPIPE而不是产生SIGPIPE
+                    ssize_t n = ::send(fd, buf_ + done_, len_ - done_, MSG_NOSIGNAL);
+                    if(n >= 0)
+                    {
+                        done_ += n;
+                    }
+                    else if(errno == EAGAIN || errno == EWOULDBLOCK)
+                    {
+                        return false;
+                    }
+                    else if(errno != EINTR)
+                    {
+                        result_ = -errno;
+                        return true;
+                    }
+                }
+                result_ = static_cast<ssize_t>(len_);
+                return true;
+            }
+        }
+    }
+}
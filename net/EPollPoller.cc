@@ -0,0 +1,120 @@
+#include "include/EPollPoller.h"
+#include "include/Channel.h"
+
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+using namespace Cloo;
+using namespace std;
+
+namespace Cloo::detail 
+{
+
+// Channel::Index()在EPollPoller中表示channel在epoll中的状态
+const int K_NEW = -1;     // 从未加入epoll
+const int K_ADDED = 1;    // 已经加入epoll
+const int K_DELETED = 2;  // 不再关心任何事件, 已从epoll中删除, 但仍保留在channels_中
+
+}
+
+EPollPoller::EPollPoller(EventLoop* loop)
+    : Poller(loop, PollerKind::kEPoll),
+      epoll_fd_(::epoll_create1(EPOLL_CLOEXEC)),
+      events_(kInitEventListSize)
+{
+    if(epoll_fd_ < 0)
+    {
+        cerr << "Failed in epoll_create1: " << ::strerror(errno) << endl;
+        abort();
+    }
+}
+
+EPollPoller::~EPollPoller()
+{
+    ::close(epoll_fd_);
+}
+
+void EPollPoller::UpdateChannel(Channel* channel)
+{
+    AssertInLoopTread();
+    int index = channel->Index();
+    if(index == detail::K_NEW || index == detail::K_DELETED)
+    {
+        if(index == detail::K_NEW)
+        {
+            assert(channels_.count(channel->Fd()) == 0);
+            channels_[channel->Fd()] = channel;
+        }
+        else
+        {
+            assert(channels_.count(channel->Fd()) != 0);
+            assert(channels_[channel->Fd()] == channel);
+        }
+        // 不关心任何事件的channel不需要加入epoll
+        if(channel->IsNoneEvent())
+        {
+            channel->SetIndex(detail::K_DELETED);
+            return;
+        }
+        channel->SetIndex(detail::K_ADDED);
+        update(EPOLL_CTL_ADD, channel);
+    }
+    else
+    {
+        assert(channels_.count(channel->Fd()) != 0);
+        assert(channels_[channel->Fd()] == channel);
+        assert(index == detail::K_ADDED);
+        if(channel->IsNoneEvent())
+        {
+            update(EPOLL_CTL_DEL, channel);
+            channel->SetIndex(detail::K_DELETED);
+        }
+        else
+        {
+            update(EPOLL_CTL_MOD, channel);
+        }
+    }
+}
+
+void EPollPoller::RemoveChannel(Channel* channel)
+{
+    AssertInLoopTread();
+    assert(channels_.count(channel->Fd()) != 0);
+    assert(channels_[channel->Fd()] == channel);
+    assert(channel->IsNoneEvent());
+    int index = channel->Index();
+    assert(index == detail::K_ADDED || index == detail::K_DELETED);
+    channels_.erase(channel->Fd());
+    if(index == detail::K_ADDED)
+    {
+        update(EPOLL_CTL_DEL, channel);
+    }
+    channel->SetIndex(detail::K_NEW);
+}
+
+void EPollPoller::update(int operation, Channel* channel)
+{
+    epoll_event event;
+    ::memset(&event, 0, sizeof event);
+    // Channel的事件掩码使用POLLIN/POLLOUT等poll(2)的常量, 在Linux上它们与EPOLLIN/EPOLLOUT的取值相同
+    event.events = static_cast<uint32_t>(channel->Events());
+    if(channel->EdgeTriggered())
+    {
+        event.events |= EPOLLET;
+    }
+    event.data.ptr = channel;
+    if(::epoll_ctl(epoll_fd_, operation, channel->Fd(), &event) < 0)
+    {
+        cerr << "epoll_ctl op = " << operation << " fd = " << channel->Fd() << " failed: " << ::strerror(errno) << endl;
+        if(operation != EPOLL_CTL_DEL)
+        {
+            abort();
+        }
+    }
+}
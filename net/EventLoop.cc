@@ -1,9 +1,15 @@
 #include "include/EventLoop.h"
 #include "include/CallbackDefs.h"
 #include "include/Poller.h"
+#include "include/EPollPoller.h"
+#include "include/PollPoller.h"
+#include "include/SimPoller.h"
 #include "include/Channel.h"
+#include "include/ComputePool.h"
+#include "include/LoopMemory.h"
 #include "include/TimerId.h"
 #include "include/TimerQueue.h"
+#include "include/Tracer.h"
 
 #include <chrono>
 #include <cstdint>
@@ -12,6 +18,7 @@
 #include <cassert>
 #include <memory>
 #include <algorithm>
+#include <iterator>
 #include <mutex>
 #include <thread>
 #include <unistd.h>
@@ -41,19 +48,65 @@ using namespace Cloo;
 thread_local shared_ptr<EventLoop> T_LOOP_IN_THIS_THREAD = nullptr;
 // Poll超时时间(ms)EventLoopGetEventLoopOfThi
 const int K_POLL_TIMEOUT_MS = 10000;
+// 每个Channel单次事件处理默认最多读写64KiB
+const size_t K_DEFAULT_IO_BUDGET_PER_EVENT = 64 * 1024;
+// 每轮迭代默认最多花费1ms处理pending tasks, 不限制个数
+const auto K_DEFAULT_TASK_TIME_PER_ITERATION = chrono::microseconds(1000);
+// 每执行这么多个任务检查一次时间预算, 避免每个任务都读一次时钟
+const size_t K_TASK_TIME_CHECK_INTERVAL = 8;
 
 std::shared_ptr<EventLoop> EventLoop::Create()
+{
+    return CreateImpl(nullptr);
+}
+
+std::shared_ptr<EventLoop> EventLoop::CreateSimulated(const std::shared_ptr<VirtualClock>& clock)
+{
+    return CreateImpl(clock);
+}
+
+std::shared_ptr<EventLoop> EventLoop::CreateImpl(const std::shared_ptr<VirtualClock>& clock)
 {
     auto loop = shared_ptr<EventLoop>(new EventLoop());
     loop->looping_ = false;
     loop->quit_ = false;
     loop->handling_pending_tasks_ = false;
     loop->thread_id_ = this_thread::get_id();
-    loop->poller_ = make_unique<Poller>(loop);
-    loop->active_channels_ = make_shared<ChannelList>();
+    loop->memory_.reset(LoopMemory::Create().release());
+    loop->clock_ = clock;
+    // Poller必须先于所有Channel创建
+    if(clock)
+    {
+        loop->poller_ = make_unique<SimPoller>(loop.get(), clock.get());
+    }
+    else
+    {
+        loop->poller_ = Poller::NewDefaultPoller(loop.get());
+    }
+    loop->io_budget_per_event_ = K_DEFAULT_IO_BUDGET_PER_EVENT;
+    loop->next_hook_id_ = 0;
+    loop->running_hooks_ = false;
+    loop->write_coalescing_ = false;
+    loop->cork_on_flush_ = false;
+    loop->flushing_ = false;
+    loop->bulk_resume_scheduled_ = false;
+    std::fill(std::begin(loop->running_pos_), std::end(loop->running_pos_), 0);
+    loop->max_tasks_per_iteration_ = 0;
+    loop->max_task_time_per_iteration_ = K_DEFAULT_TASK_TIME_PER_ITERATION;
     loop->timer_queue_ = make_unique<TimerQueue>(loop);
+    loop->max_spin_ = chrono::microseconds::zero();
+    loop->min_spin_ = chrono::microseconds::zero();
+    loop->spin_budget_ = chrono::microseconds::zero();
     loop->wakeup_fd_ = (detail::CreateEventfd()),
     loop->wakeup_channel_ = Channel::Create(loop, loop->wakeup_fd_);
+    // 将eventfd注册到Poller中, 其他线程通过WakeUp()写eventfd即可唤醒阻塞在Poll中的IO线程
+    loop->wakeup_channel_->SetReadCallBack(std::bind(&EventLoop::HandleWakeUp, loop.get()));
+    loop->wakeup_channel_->EnableReading();
+    if(clock)
+    {
+        // timerfd使用真实时间, 仿真中改由Poll超时驱动定时器
+        loop->timer_queue_->SetTimerFdEnabled(false);
+    }
 
     cout<<"EventLoop created " << loop.get() << " in thread " << loop->thread_id_ <<endl;
     if(T_LOOP_IN_THIS_THREAD)
@@ -71,7 +124,28 @@ std::shared_ptr<EventLoop> EventLoop::Create()
 EventLoop::~EventLoop()
 {
     assert(!looping_);
-    T_LOOP_IN_THIS_THREAD = nullptr;
+    // Notice: 这里不再清空T_LOOP_IN_THIS_THREAD
+    // T_LOOP_IN_THIS_THREAD本身持有EventLoop的shared_ptr, 析构只可能发生在两种情况下:
+    // 1. IO线程退出, thread_local对象正在析构, 此时再对它赋值是未定义行为
+    // 2. 在其他线程中释放最后一个引用(例如EventLoopThread在join之后释放loop_), 
+    //    此时清空的是其他线程的T_LOOP_IN_THIS_THREAD, 会把该线程自己的EventLoop释放掉
+}
+
+template <typename Fn>
+void EventLoop::WithPoller(Fn&& fn)
+{
+    switch(poller_->Kind())
+    {
+        case PollerKind::kEPoll:
+            fn(static_cast<EPollPoller*>(poller_.get()));
+            break;
+        case PollerKind::kPoll:
+            fn(static_cast<PollPoller*>(poller_.get()));
+            break;
+        case PollerKind::kSim:
+            fn(static_cast<SimPoller*>(poller_.get()));
+            break;
+    }
 }
 
 void EventLoop::Loop()
@@ -80,26 +154,148 @@ void EventLoop::Loop()
     AssertInLoopTread();
     looping_ = true;
     quit_ = false;
+    loop_start_ns_.store(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count(), memory_order_relaxed);
+    WithPoller([this](auto* poller) { LoopWith(poller); });
+    cout << "EventLoop " << this << " stop looping" << endl;
+    looping_ = false;
+}
 
+template <typename PollerT>
+void EventLoop::LoopWith(PollerT* poller)
+{
     while(!quit_)
     {
-        active_channels_->clear();
-        // 通过poll(2)IO多路复用获取当前有活动事件的fd, 将活动事件通过channel转发过来
-        poller_->Poll(K_POLL_TIMEOUT_MS, active_channels_);
+        Tracer::BeginIteration();
+        active_channels_.clear();
+        // 上一轮迭代推迟下来的任务在这一轮执行, 这一轮中新推迟的任务留到下一轮
+        running_deferred_tasks_.swap(deferred_tasks_);
+        bool has_backlog = !running_deferred_tasks_.empty() || !pending_flushes_.empty() || HasPendingBacklog();
+        {
+            TraceSpan poll_span(TraceKind::kPoll);
+            // 开启忙轮询时先在自旋预算内以0超时Poll, 落空后再阻塞等待
+            bool spin_hit = !has_backlog && spin_budget_.count() > 0 && SpinPoll(poller);
+            if(has_backlog)
+            {
+                // 有未完成的工作, 只检查一下新的IO事件, 不睡眠
+                poll_return_time_ = poller->Poll(0, &active_channels_);
+            }
+            else if(!spin_hit)
+            {
+                // 不使用timerfd时, 最多睡到最早的定时器到期
+                int timeout_ms = timer_queue_->TimerFdEnabled() ? K_POLL_TIMEOUT_MS
+                                                                : timer_queue_->NextPollTimeoutMs(K_POLL_TIMEOUT_MS);
+                // 通过poll(2)IO多路复用获取当前有活动事件的fd, 将活动事件通过channel转发过来
+                auto block_start = chrono::steady_clock::now();
+                poll_return_time_ = poller->Poll(timeout_ms, &active_channels_);
+                auto blocked = chrono::steady_clock::now() - block_start;
+                idle_ns_.store(idle_ns_.load(memory_order_relaxed) + chrono::duration_cast<chrono::nanoseconds>(blocked).count(),
+                               memory_order_relaxed);
+                // 因定时器到期而超时返回并不说明IO事件来得快, 不据此调整自旋预算
+                bool timer_timeout = active_channels_.empty() && timeout_ms < K_POLL_TIMEOUT_MS;
+                if(max_spin_.count() > 0 && !timer_timeout)
+                {
+                    AdjustSpinBudget(false, blocked);
+                }
+            }
+            else
+            {
+                AdjustSpinBudget(true, chrono::steady_clock::duration::zero());
+            }
+        }
+        // 不使用timerfd时, Poll返回后直接处理到期的定时器
+        if(!timer_queue_->TimerFdEnabled())
+        {
+            timer_queue_->HandleExpiredTimers(Now());
+        }
         // 直接在IO线程中利用用户在channel中注册的callback function处理channel转发的IO事件
-        std::for_each(active_channels_->begin(), active_channels_->end(), [](const auto& channel){channel->HandleEvent();});
+        for(Channel* channel : active_channels_)
+        {
+            TraceSpan event_span(TraceKind::kChannelEvent, channel->Fd());
+            channel->HandleEvent();
+        }
+        // 继续处理上一轮迭代中因预算耗尽而推迟的工作
+        DoDeferredTasks();
         // 处理投放到pending_callbacks_中pending的事务
         DoPendingTasks();
+        // 每轮迭代末尾的钩子(例如取空InterLoopChannel的队列)
+        RunIterationHooks();
+        // 写合并: 刷新这一轮中有Send的连接
+        RunFlushes();
     }
-    cout << "EventLoop " << this << " stop looping" << endl;
-    looping_ = false;
 }
 
-void EventLoop::UpdateChannel(const std::shared_ptr<Channel>& channel)
+template <typename PollerT>
+bool EventLoop::SpinPoll(PollerT* poller)
+{
+    auto deadline = chrono::steady_clock::now() + spin_budget_;
+    do
+    {
+        poll_return_time_ = poller->Poll(0, &active_channels_);
+        if(!active_channels_.empty())
+        {
+            return true;
+        }
+    } while(!quit_ && chrono::steady_clock::now() < deadline);
+    return false;
+}
+
+void EventLoop::AdjustSpinBudget(bool spin_hit, chrono::steady_clock::duration blocked)
 {
-    assert(channel->OwnerLoop() == shared_from_this());
+    // 自旋等到了事件, 或者刚进入阻塞等待就被唤醒(说明再多自旋一会儿就能等到), 扩大预算
+    if(spin_hit || blocked < max_spin_)
+    {
+        spin_budget_ = std::clamp(spin_budget_ * 2, min_spin_, max_spin_);
+    }
+    // 自旋落空且之后又睡了很久, 说明EventLoop比较空闲, 缩小预算
+    else
+    {
+        spin_budget_ /= 2;
+        if(spin_budget_ < min_spin_)
+        {
+            spin_budget_ = chrono::microseconds::zero();
+        }
+    }
+}
+
+EventLoop::LoadSample EventLoop::Load() const
+{
+    LoadSample sample;
+    const int64_t start = loop_start_ns_.load(memory_order_relaxed);
+    if(start != 0)
+    {
+        sample.total = chrono::nanoseconds(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count() - start);
+        sample.idle = chrono::nanoseconds(idle_ns_.load(memory_order_relaxed));
+    }
+    return sample;
+}
+
+void EventLoop::SetBusyPoll(chrono::microseconds max_spin_us, chrono::microseconds min_spin_us)
+{
+    AssertInLoopTread();
+    max_spin_ = max_spin_us;
+    min_spin_ = std::min(min_spin_us, max_spin_us);
+    spin_budget_ = max_spin_us;
+}
+
+void EventLoop::UpdateChannel(Channel* channel)
+{
+    assert(channel->OwnerLoop() == this);
+    AssertInLoopTread();
+    WithPoller([channel](auto* poller) { poller->UpdateChannel(channel); });
+}
+
+void EventLoop::RemoveChannel(Channel* channel)
+{
+    assert(channel->OwnerLoop() == this);
     AssertInLoopTread();
-    poller_->UpdateChannel(channel);
+    WithPoller([channel](auto* poller) { poller->RemoveChannel(channel); });
+}
+
+bool EventLoop::HasChannel(Channel* channel)
+{
+    assert(channel->OwnerLoop() == this);
+    AssertInLoopTread();
+    return poller_->HasChannel(channel);
 }
 
 shared_ptr<EventLoop> EventLoop::GetEventLoopOfThisThread()
@@ -129,39 +325,263 @@ void EventLoop::RunTaskInThisLoop(const define::IOEventCallback &cb)
     }
 }
 
-void EventLoop::QueueTaskInThisLoop(const define::IOEventCallback &cb)
+void EventLoop::QueueTaskInThisLoop(const define::IOEventCallback &cb, TaskPriority priority)
 {
     // 缩小mutex的粒度
     if(1)
     {
         std::lock_guard<std::mutex> lg(mutex_);
-        pending_tasks_.push_back(cb);
+        pending_tasks_[static_cast<size_t>(priority)].push_back(cb);
     }
-    if(!IsInLoopThread() /*在其他线程*/ || handling_pending_tasks_ /*本线程中正在处理pendding callbacks*/)
+    if(!IsInLoopThread() /*在其他线程*/ || handling_pending_tasks_ /*本线程中正在处理pendding callbacks*/
+       || running_hooks_ /*迭代末尾的钩子中投递的任务(例如InterLoopChannel的handler)*/
+       || flushing_ /*迭代末尾的刷新中投递的任务(例如WriteCompleteCallback)*/)
     {
         WakeUp();        
     }
 }
 
+void EventLoop::SetPendingTaskBudget(size_t max_tasks, std::chrono::microseconds max_time)
+{
+    AssertInLoopTread();
+    max_tasks_per_iteration_ = max_tasks;
+    max_task_time_per_iteration_ = max_time;
+}
+
+bool EventLoop::HasPendingBacklog() const
+{
+    for(size_t lane = 0; lane < kTaskLanes; ++lane)
+    {
+        if(running_pos_[lane] < running_tasks_[lane].size())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 void EventLoop::DoPendingTasks()
 {
-    vector<define::IOEventCallback> callbacks;
     handling_pending_tasks_ = true;
-    // 控制mutex的粒度
+    // 控制mutex的粒度: 临界区内只交换vector, 拼接到结转下来的任务之后的工作放在锁外
     if(1)
     {
         lock_guard<mutex> lg(mutex_);
-        callbacks.swap(pending_tasks_);
+        for(size_t lane = 0; lane < kTaskLanes; ++lane)
+        {
+            incoming_tasks_[lane].swap(pending_tasks_[lane]);
+        }
     }
-    for(const auto& cb : callbacks)
+    for(size_t lane = 0; lane < kTaskLanes; ++lane)
     {
-        cb();
+        auto& incoming = incoming_tasks_[lane];
+        auto& running = running_tasks_[lane];
+        if(running.empty())
+        {
+            running.swap(incoming);
+        }
+        else
+        {
+            running.insert(running.end(), make_move_iterator(incoming.begin()), make_move_iterator(incoming.end()));
+            incoming.clear();
+        }
+    }
+
+    const bool time_limited = max_task_time_per_iteration_.count() > 0;
+    const auto deadline = time_limited ? chrono::steady_clock::now() + max_task_time_per_iteration_
+                                       : chrono::steady_clock::time_point::max();
+    size_t done = 0;
+    bool exhausted = false;
+    // 先执行kControl再执行kBulk, 预算耗尽时停在当前位置, 剩下的任务留到下一轮
+    for(size_t lane = 0; lane < kTaskLanes && !exhausted; ++lane)
+    {
+        auto& running = running_tasks_[lane];
+        size_t& pos = running_pos_[lane];
+        while(pos < running.size())
+        {
+            if((max_tasks_per_iteration_ > 0 && done >= max_tasks_per_iteration_) ||
+               (time_limited && done > 0 && done % K_TASK_TIME_CHECK_INTERVAL == 0 && chrono::steady_clock::now() >= deadline))
+            {
+                exhausted = true;
+                break;
+            }
+            // 先移出再执行, 任务执行期间不会持有队列中元素的引用
+            auto task = std::move(running[pos++]);
+            TraceSpan task_span(TraceKind::kTask);
+            task();
+            ++done;
+        }
+        if(pos == running.size())
+        {
+            running.clear();
+            pos = 0;
+        }
     }
     handling_pending_tasks_ = false;
 }
 
+int EventLoop::AddIterationHook(const define::IOEventCallback& hook)
+{
+    AssertInLoopTread();
+    iteration_hooks_.emplace_back(next_hook_id_, hook);
+    return next_hook_id_++;
+}
+
+void EventLoop::RemoveIterationHook(int hook_id)
+{
+    AssertInLoopTread();
+    iteration_hooks_.erase(std::remove_if(iteration_hooks_.begin(), iteration_hooks_.end(),
+        [hook_id](const auto& item){ return item.first == hook_id; }), iteration_hooks_.end());
+}
+
+void EventLoop::RunIterationHooks()
+{
+    // Notice: 钩子中不能增删钩子
+    running_hooks_ = true;
+    for(const auto& item : iteration_hooks_)
+    {
+        item.second();
+    }
+    running_hooks_ = false;
+}
+
+void EventLoop::SetWriteCoalescing(bool on, bool cork)
+{
+    AssertInLoopTread();
+    write_coalescing_ = on;
+    cork_on_flush_ = on && cork;
+}
+
+void EventLoop::FlushAtIterationEnd(const define::IOEventCallback& flush)
+{
+    AssertInLoopTread();
+    pending_flushes_.push_back(flush);
+}
+
+void EventLoop::RunFlushes()
+{
+    if(pending_flushes_.empty())
+    {
+        return;
+    }
+    flushing_ = true;
+    running_flushes_.swap(pending_flushes_);
+    for(const auto& flush : running_flushes_)
+    {
+        TraceSpan flush_span(TraceKind::kTask);
+        flush();
+    }
+    running_flushes_.clear();
+    flushing_ = false;
+}
+
+void EventLoop::SetBulkBandwidthLimit(uint64_t bytes_per_sec, size_t burst_bytes)
+{
+    AssertInLoopTread();
+    bulk_bucket_.Configure(bytes_per_sec, burst_bytes > 0 ? burst_bytes : bytes_per_sec / 50);
+    if(bytes_per_sec == 0)
+    {
+        // 取消限制, 排队的连接立即恢复
+        ResumeBulkWaiters();
+    }
+}
+
+size_t EventLoop::BulkAllowance(bool resumed)
+{
+    if(!bulk_bucket_.Enabled())
+    {
+        return SIZE_MAX;
+    }
+    // 有连接在排队时新来的连接也要排到后面, 保证轮转公平
+    if(!bulk_waiters_.empty() && !resumed)
+    {
+        return 0;
+    }
+    return std::min({bulk_bucket_.Available(), kBulkQuantum, bulk_bucket_.Burst()});
+}
+
+void EventLoop::WaitForBulkBandwidth(const define::IOEventCallback& resume)
+{
+    AssertInLoopTread();
+    bulk_waiters_.push_back(resume);
+    if(bulk_resume_scheduled_)
+    {
+        return;
+    }
+    bulk_resume_scheduled_ = true;
+    const size_t quantum = std::min(kBulkQuantum, bulk_bucket_.Burst());
+    if(!bulk_bucket_.Enabled() || bulk_bucket_.Available() >= quantum)
+    {
+        // 令牌足够(一个连接用完了自己的份额), 不必等定时器
+        QueueTaskInThisLoop([this] { ResumeBulkWaiters(); });
+    }
+    else
+    {
+        RunAfter(bulk_bucket_.TimeUntil(quantum).count(), [this] { ResumeBulkWaiters(); });
+    }
+}
+
+void EventLoop::ResumeBulkWaiters()
+{
+    bulk_resume_scheduled_ = false;
+    // 只恢复现在排队的连接, 恢复后仍有数据的连接重新排到队尾, 留给下一次
+    // 每个连接恢复时都要有一整份quantum, 否则排在后面的连接只能分到前一个连接剩下的零头
+    const size_t quantum = std::min(kBulkQuantum, bulk_bucket_.Burst());
+    for(size_t count = bulk_waiters_.size(); count > 0 && !bulk_waiters_.empty(); --count)
+    {
+        if(bulk_bucket_.Enabled() && bulk_bucket_.Available() < quantum)
+        {
+            break;
+        }
+        define::IOEventCallback resume = std::move(bulk_waiters_.front());
+        bulk_waiters_.pop_front();
+        resume();
+    }
+    if(!bulk_waiters_.empty() && !bulk_resume_scheduled_)
+    {
+        bulk_resume_scheduled_ = true;
+        RunAfter(bulk_bucket_.TimeUntil(quantum).count(), [this] { ResumeBulkWaiters(); });
+    }
+}
+
+bool EventLoop::RunInComputePool(ComputePool& pool, const define::IOEventCallback& work, const define::IOEventCallback& done)
+{
+    return pool.Submit([this, work, done]
+    {
+        work();
+        QueueTaskInThisLoop(done);
+    });
+}
+
+void EventLoop::DeferToNextIteration(const define::IOEventCallback& task)
+{
+    AssertInLoopTread();
+    deferred_tasks_.push_back(task);
+}
+
+void EventLoop::DoDeferredTasks()
+{
+    for(const auto& task : running_deferred_tasks_)
+    {
+        TraceSpan task_span(TraceKind::kTask);
+        task();
+    }
+    running_deferred_tasks_.clear();
+}
+
+SimPoller* EventLoop::Simulation() const
+{
+    return poller_->Kind() == PollerKind::kSim ? static_cast<SimPoller*>(poller_.get()) : nullptr;
+}
+
 void EventLoop::WakeUp()
 {
+    if(SimPoller* sim = Simulation())
+    {
+        // SimPoller不监听真实的fd
+        sim->WakeUp();
+        return;
+    }
     constexpr uint64_t one = 1;
     size_t n = ::write(wakeup_fd_, &one, sizeof one);
     if(n != sizeof one)
@@ -172,6 +592,7 @@ void EventLoop::WakeUp()
 
 void EventLoop::HandleWakeUp()
 {
+    TraceSpan wakeup_span(TraceKind::kWakeup);
     uint64_t one = 1;
     auto n = ::read(wakeup_fd_, &one, sizeof one);
     if(n != sizeof one)
@@ -188,19 +609,35 @@ void EventLoop::AbortNotInLoopThread()
        << ", current thread id = " <<  this_thread::get_id() << endl;
 }
 
-TimerId EventLoop::RunAt(const define::SystemTimePoint time, const define::TimerCallback& cb)
+TimerId EventLoop::RunAt(const define::SystemTimePoint time, const define::TimerCallback& cb, long slack_ms)
 {
-    return timer_queue_->AddTimer(cb, time, 0);
+    return timer_queue_->AddTimer(cb, time, 0, slack_ms);
 }
 
-TimerId EventLoop::RunAfter(long delay_ms, const define::TimerCallback& cb)
+TimerId EventLoop::RunAfter(long delay_ms, const define::TimerCallback& cb, long slack_ms)
 {
-    auto expiration = std::chrono::system_clock::now() + std::chrono::milliseconds(delay_ms);
-    return timer_queue_->AddTimer(cb, expiration, 0);
+    auto expiration = Now() + std::chrono::milliseconds(delay_ms);
+    return timer_queue_->AddTimer(cb, expiration, 0, slack_ms);
 }
 
-TimerId EventLoop::RunEvery(long interval_ms, const define::TimerCallback& cb)
+TimerId EventLoop::RunEvery(long interval_ms, const define::TimerCallback& cb, long slack_ms)
 {
-    auto expiration = std::chrono::system_clock::now() + std::chrono::milliseconds(interval_ms);
-    return timer_queue_->AddTimer(cb, expiration, interval_ms);
-}
\ No newline at end of file
+    auto expiration = Now() + std::chrono::milliseconds(interval_ms);
+    return timer_queue_->AddTimer(cb, expiration, interval_ms, slack_ms);
+}
+
+void LoopMemoryDeleter::operator()(LoopMemory* memory) const
+{
+    LoopMemory::Deleter()(memory);
+}
+
+void EventLoop::SetPollDrivenTimers(bool on)
+{
+    AssertInLoopTread();
+    timer_queue_->SetTimerFdEnabled(!on);
+}
+
+const TimerQueueStats& EventLoop::TimerStats() const
+{
+    return timer_queue_->Stats();
+}
@@ -8,10 +8,11 @@
 using namespace Cloo;
 using namespace std;
 
-EventLoopThread::EventLoopThread()
-    : loop_(EventLoop::Create()),
+EventLoopThread::EventLoopThread(const ThreadPlacement& placement)
+    : loop_(nullptr),
       exited_(false),
-      thread_started_(false)
+      thread_started_(false),
+      placement_(placement)
 {
 
 }
@@ -19,7 +20,10 @@ EventLoopThread::EventLoopThread()
 EventLoopThread::~EventLoopThread()
 {
     exited_ = true;
-    loop_->Quit();
+    if(loop_)
+    {
+        loop_->Quit();
+    }
     if(thread_ && thread_->joinable())
     {
         thread_->join();
@@ -37,6 +41,8 @@ shared_ptr<EventLoop> EventLoopThread::StartLoop()
 
 void EventLoopThread::ThreadFunc()
 {
+    // 先完成线程放置, 再创建EventLoop, 让EventLoop及其内部结构分配在本地NUMA节点上
+    placement_.ApplyToThisThread();
     loop_ = EventLoop::Create();
     {
         unique_lock<mutex> lock(mutex_);
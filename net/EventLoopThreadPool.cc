@@ -0,0 +1,141 @@
+#include "include/EventLoopThreadPool.h"
+#include "include/EventLoop.h"
+#include "include/EventLoopThread.h"
+#include "include/Socket.h"
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+
+using namespace Cloo;
+using namespace std;
+
+EventLoopThreadPool::EventLoopThreadPool(const shared_ptr<EventLoop>& base_loop)
+    : base_loop_(base_loop),
+      started_(false),
+      next_(0)
+{
+
+}
+
+EventLoopThreadPool::~EventLoopThreadPool()
+{
+    // EventLoopThread析构时会让各自的EventLoop退出并join线程
+}
+
+void EventLoopThreadPool::Start(int num_threads, const vector<ThreadPlacement>& placements)
+{
+    assert(!started_);
+    base_loop_->AssertInLoopTread();
+    started_ = true;
+    for(int i = 0; i < num_threads; ++i)
+    {
+        AddLoop(placements.empty() ? ThreadPlacement() : placements[i % placements.size()]);
+    }
+}
+
+shared_ptr<EventLoop> EventLoopThreadPool::AddLoop(const ThreadPlacement& placement)
+{
+    base_loop_->AssertInLoopTread();
+    auto thread = make_unique<EventLoopThread>(placement);
+    loops_.push_back(thread->StartLoop());
+    threads_.push_back(std::move(thread));
+    // 多个IO线程绑定同一个CPU(例如放置在同一个NUMA节点上)时, 该CPU上的连接在它们之间轮转
+    for(int cpu : placement.ResolveCpus())
+    {
+        cpu_to_loops_[cpu].loops.push_back(loops_.size() - 1);
+    }
+    return loops_.back();
+}
+
+unique_ptr<EventLoopThread> EventLoopThreadPool::DetachLoop(EventLoop* loop)
+{
+    base_loop_->AssertInLoopTread();
+    auto iter = find_if(loops_.begin(), loops_.end(), [loop](const shared_ptr<EventLoop>& item) { return item.get() == loop; });
+    if(iter == loops_.end())
+    {
+        return nullptr;
+    }
+    const size_t index = iter - loops_.begin();
+    unique_ptr<EventLoopThread> thread = std::move(threads_[index]);
+    threads_.erase(threads_.begin() + index);
+    loops_.erase(iter);
+    last_load_.erase(loop);
+    next_ = loops_.empty() ? 0 : next_ % loops_.size();
+    RebuildCpuMap();
+    return thread;
+}
+
+bool EventLoopThreadPool::Contains(EventLoop* loop) const
+{
+    return any_of(loops_.begin(), loops_.end(), [loop](const shared_ptr<EventLoop>& item) { return item.get() == loop; });
+}
+
+void EventLoopThreadPool::RebuildCpuMap()
+{
+    cpu_to_loops_.clear();
+    for(size_t i = 0; i < threads_.size(); ++i)
+    {
+        for(int cpu : threads_[i]->Placement().ResolveCpus())
+        {
+            cpu_to_loops_[cpu].loops.push_back(i);
+        }
+    }
+}
+
+vector<double> EventLoopThreadPool::SampleUtilization()
+{
+    base_loop_->AssertInLoopTread();
+    vector<double> utilization;
+    for(const auto& loop : loops_)
+    {
+        EventLoop::LoadSample sample = loop->Load();
+        auto& last = last_load_[loop.get()];
+        const int64_t total = sample.total.count() - last.first;
+        const int64_t idle = sample.idle.count() - last.second;
+        last = {sample.total.count(), sample.idle.count()};
+        utilization.push_back(total > 0 ? std::clamp(1.0 - static_cast<double>(idle) / static_cast<double>(total), 0.0, 1.0) : 0.0);
+    }
+    return utilization;
+}
+
+vector<ThreadPlacement> EventLoopThreadPool::PinEachToCpu(const vector<int>& cpus)
+{
+    vector<ThreadPlacement> placements;
+    for(int cpu : cpus)
+    {
+        placements.push_back(ThreadPlacement::OnCpu(cpu));
+    }
+    return placements;
+}
+
+shared_ptr<EventLoop> EventLoopThreadPool::GetNextLoop()
+{
+    base_loop_->AssertInLoopTread();
+    if(loops_.empty())
+    {
+        return base_loop_;
+    }
+    auto loop = loops_[next_];
+    next_ = (next_ + 1) % loops_.size();
+    return loop;
+}
+
+shared_ptr<EventLoop> EventLoopThreadPool::GetLoopForCpu(int cpu)
+{
+    auto iter = cpu_to_loops_.find(cpu);
+    if(iter == cpu_to_loops_.end())
+    {
+        return GetNextLoop();
+    }
+    CpuLoops& candidates = iter->second;
+    size_t index = candidates.loops[candidates.next % candidates.loops.size()];
+    candidates.next = (candidates.next + 1) % candidates.loops.size();
+    return loops_[index];
+}
+
+shared_ptr<EventLoop> EventLoopThreadPool::GetLoopForSocket(SocketFd fd)
+{
+    int cpu = Socket::GetIncomingCpu(fd);
+    return cpu < 0 ? GetNextLoop() : GetLoopForCpu(cpu);
+}
@@ -0,0 +1,289 @@
+#include "include/FdHandover.h"
+#include "include/Channel.h"
+#include "include/EventLoop.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace Cloo;
+using namespace std;
+
+namespace
+{
+
+// 每条消息携带的fd数, 小于内核的SCM_MAX_FD(253)
+constexpr size_t K_MAX_FDS_PER_MESSAGE = 64;
+// 旧进程发送时最多阻塞这么久, 避免新进程卡住时拖住旧进程的EventLoop
+constexpr long K_SEND_TIMEOUT_MS = 1000;
+
+// SEQPACKET保留消息边界, 每条消息的fds与描述它们用途的kinds一一对应
+struct HandoverHeader
+{
+    uint32_t count;
+    uint8_t kinds[K_MAX_FDS_PER_MESSAGE];
+};
+
+[[noreturn]] void ThrowErrno(const string& what)
+{
+    throw runtime_error("Failed to " + what + ": " + string(::strerror(errno)));
+}
+
+sockaddr_un MakeUnixAddress(const string& path)
+{
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    if(path.size() >= sizeof addr.sun_path)
+    {
+        throw runtime_error("Handover path too long: " + path);
+    }
+    ::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+}
+
+void SetTimeout(int fd, int option, long timeout_ms)
+{
+    timeval tv {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+    ::setsockopt(fd, SOL_SOCKET, option, &tv, sizeof tv);
+}
+
+void SendBatch(int unix_fd, const HandoverFd* fds, size_t count)
+{
+    HandoverHeader header {};
+    header.count = static_cast<uint32_t>(count);
+    iovec iov {&header, sizeof header};
+    msghdr msg {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * K_MAX_FDS_PER_MESSAGE)];
+    if(count > 0)
+    {
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+        int* out = reinterpret_cast<int*>(CMSG_DATA(cmsg));
+        for(size_t i = 0; i < count; ++i)
+        {
+            header.kinds[i] = static_cast<uint8_t>(fds[i].kind);
+            out[i] = static_cast<int>(fds[i].fd);
+        }
+    }
+    ssize_t n;
+    do
+    {
+        n = ::sendmsg(unix_fd, &msg, MSG_NOSIGNAL);
+    } while(n == -1 && errno == EINTR);
+    if(n != static_cast<ssize_t>(sizeof header))
+    {
+        ThrowErrno("send handover fds");
+    }
+}
+
+void CloseAll(const vector<HandoverFd>& fds)
+{
+    for(const auto& item : fds)
+    {
+        ::close(static_cast<int>(item.fd));
+    }
+}
+
+}
+
+void Cloo::SendHandoverFds(int unix_fd, const vector<HandoverFd>& fds)
+{
+    for(size_t pos = 0; pos < fds.size(); pos += K_MAX_FDS_PER_MESSAGE)
+    {
+        SendBatch(unix_fd, fds.data() + pos, std::min(K_MAX_FDS_PER_MESSAGE, fds.size() - pos));
+    }
+    // 不带fd的消息表示发送完毕
+    SendBatch(unix_fd, nullptr, 0);
+}
+
+vector<HandoverFd> Cloo::ReceiveHandoverFds(int unix_fd)
+{
+    vector<HandoverFd> result;
+    while(true)
+    {
+        HandoverHeader header {};
+        iovec iov {&header, sizeof header};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * K_MAX_FDS_PER_MESSAGE)];
+        msghdr msg {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof control;
+        ssize_t n;
+        do
+        {
+            n = ::recvmsg(unix_fd, &msg, MSG_CMSG_CLOEXEC);
+        } while(n == -1 && errno == EINTR);
+        if(n == -1)
+        {
+            CloseAll(result);
+            ThrowErrno("receive handover fds");
+        }
+
+        size_t received = 0;
+        for(cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+            {
+                const int* in = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+                const size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                for(size_t i = 0; i < count; ++i, ++received)
+                {
+                    HandoverFdKind kind = received < K_MAX_FDS_PER_MESSAGE ? static_cast<HandoverFdKind>(header.kinds[received])
+                                                                           : HandoverFdKind::kConnection;
+                    result.push_back(HandoverFd{kind, static_cast<SocketFd>(in[i])});
+                }
+            }
+        }
+        if(n != static_cast<ssize_t>(sizeof header) || (msg.msg_flags & MSG_CTRUNC) || received != header.count)
+        {
+            CloseAll(result);
+            throw runtime_error(n == 0 ? "Handover peer closed before sending all fds" : "Malformed handover message");
+        }
+        if(header.count == 0)
+        {
+            return result;
+        }
+    }
+}
+
+vector<HandoverFd> Cloo::FetchHandoverFds(const string& path, int timeout_ms)
+{
+    const sockaddr_un addr = MakeUnixAddress(path);
+    const auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+    while(true)
+    {
+        int fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if(fd == -1)
+        {
+            ThrowErrno("create handover socket");
+        }
+        if(::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof addr) == 0)
+        {
+            SetTimeout(fd, SO_RCVTIMEO, std::max(1, timeout_ms));
+            try
+            {
+                auto fds = ReceiveHandoverFds(fd);
+                ::close(fd);
+                return fds;
+            }
+            catch(...)
+            {
+                ::close(fd);
+                throw;
+            }
+        }
+        int saved_errno = errno;
+        ::close(fd);
+        // 旧进程还没有开始监听(ENOENT)或者正在处理另一个新进程(ECONNREFUSED)时重试
+        if((saved_errno != ENOENT && saved_errno != ECONNREFUSED) || chrono::steady_clock::now() >= deadline)
+        {
+            errno = saved_errno;
+            ThrowErrno("connect to handover path " + path);
+        }
+        this_thread::sleep_for(chrono::milliseconds(10));
+    }
+}
+
+HandoverServer::HandoverServer(const shared_ptr<EventLoop>& loop, const string& path)
+    : loop_(loop.get()),
+      path_(path),
+      handed_over_(false),
+      closed_(false)
+{
+    const sockaddr_un addr = MakeUnixAddress(path_);
+    int fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd == -1)
+    {
+        ThrowErrno("create handover socket");
+    }
+    listen_socket_ = Socket::FromFd(static_cast<SocketFd>(fd));
+    // 上一次重启留下的socket文件
+    ::unlink(path_.c_str());
+    if(::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof addr) == -1)
+    {
+        ThrowErrno("bind handover path " + path_);
+    }
+    channel_ = Channel::Create(loop, fd);
+    channel_->SetReadCallBack(std::bind(&HandoverServer::HandleRead, this));
+}
+
+HandoverServer::~HandoverServer()
+{
+    Close();
+}
+
+void HandoverServer::Listen()
+{
+    loop_->AssertInLoopTread();
+    if(::listen(static_cast<int>(listen_socket_->Fd()), 1) == -1)
+    {
+        ThrowErrno("listen on handover path " + path_);
+    }
+    channel_->EnableReading();
+}
+
+void HandoverServer::Close()
+{
+    // 可能在Channel自己的读回调中调用, 这里只注销Channel, 析构留给~HandoverServer
+    if(!closed_)
+    {
+        closed_ = true;
+        channel_->DisableAll();
+        channel_->Remove();
+        ::unlink(path_.c_str());
+    }
+}
+
+void HandoverServer::HandleRead()
+{
+    loop_->AssertInLoopTread();
+    int peer = ::accept4(static_cast<int>(listen_socket_->Fd()), nullptr, nullptr, SOCK_CLOEXEC);
+    if(peer == -1)
+    {
+        return;
+    }
+    SetTimeout(peer, SO_SNDTIMEO, K_SEND_TIMEOUT_MS);
+    vector<HandoverFd> fds = collect_cb_ ? collect_cb_() : vector<HandoverFd>();
+    bool ok = true;
+    try
+    {
+        SendHandoverFds(peer, fds);
+    }
+    catch(const exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        ok = false;
+    }
+    ::close(peer);
+    // 连接已经从旧进程的TcpServer中分离, 无论是否发送成功, 旧进程都不再使用它们
+    for(const auto& item : fds)
+    {
+        if(item.kind == HandoverFdKind::kConnection)
+        {
+            ::close(static_cast<int>(item.fd));
+        }
+    }
+    if(ok)
+    {
+        handed_over_ = true;
+        Close();
+    }
+    if(complete_cb_)
+    {
+        complete_cb_(ok);
+    }
+}
@@ -0,0 +1,97 @@
+#include "include/LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+using namespace Cloo;
+using namespace std;
+
+// 小于kSubBuckets的值每个值一个桶; 之后最高位为2^exp的值落在第(exp - kSubBucketBits + 1)组,
+// 组内按最高位之后的kSubBucketBits位线性分桶
+size_t LatencyHistogram::BucketOf(uint64_t ns)
+{
+    if(ns < kSubBuckets)
+    {
+        return static_cast<size_t>(ns);
+    }
+    const int exp = 63 - __builtin_clzll(ns);
+    const int shift = exp - kSubBucketBits;
+    const uint64_t sub = (ns >> shift) & (kSubBuckets - 1);
+    return static_cast<size_t>((shift + 1) * kSubBuckets + sub);
+}
+
+uint64_t LatencyHistogram::UpperBoundOf(size_t bucket)
+{
+    if(bucket < kSubBuckets)
+    {
+        return bucket;
+    }
+    const int shift = static_cast<int>(bucket / kSubBuckets) - 1;
+    const uint64_t sub = bucket % kSubBuckets;
+    const uint64_t lower = (kSubBuckets + sub) << shift;
+    return lower + ((uint64_t {1} << shift) - 1);
+}
+
+void LatencyHistogram::Record(int64_t ns)
+{
+    // 不同时钟之间的比较可能得到负值(例如系统时间被调整), 按0计
+    const uint64_t value = ns > 0 ? static_cast<uint64_t>(ns) : 0;
+    ++counts_[BucketOf(value)];
+    ++count_;
+    sum_ += value;
+    max_ = std::max<int64_t>(max_, static_cast<int64_t>(value));
+}
+
+void LatencyHistogram::Reset()
+{
+    counts_.fill(0);
+    count_ = 0;
+    sum_ = 0;
+    max_ = 0;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other)
+{
+    for(size_t i = 0; i < kBuckets; ++i)
+    {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    max_ = std::max(max_, other.max_);
+}
+
+int64_t LatencyHistogram::Percentile(double p) const
+{
+    if(count_ == 0)
+    {
+        return 0;
+    }
+    const double clamped = std::clamp(p, 0.0, 100.0);
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(clamped / 100 * static_cast<double>(count_))));
+    uint64_t seen = 0;
+    for(size_t i = 0; i < kBuckets; ++i)
+    {
+        seen += counts_[i];
+        if(seen >= rank)
+        {
+            // 桶的上界可能超过实际的最大值
+            return std::min<int64_t>(static_cast<int64_t>(UpperBoundOf(i)), max_);
+        }
+    }
+    return max_;
+}
+
+string LatencyHistogram::Summary() const
+{
+    ostringstream out;
+    out << fixed << setprecision(1) << "n=" << count_
+        << " mean=" << Mean() / 1000 << "us"
+        << " p50=" << Percentile(50) / 1000.0 << "us"
+        << " p99=" << Percentile(99) / 1000.0 << "us"
+        << " p999=" << Percentile(99.9) / 1000.0 << "us"
+        << " max=" << max_ / 1000.0 << "us";
+    return out.str();
+}
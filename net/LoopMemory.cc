@@ -0,0 +1,237 @@
+#include "include/LoopMemory.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <sys/mman.h>
+
+using namespace Cloo;
+using namespace std;
+
+namespace
+{
+
+// 每个FixedPool一次从region中切出约64KiB, 摊薄切分的开销
+constexpr size_t K_CARVE_BYTES = 64 * 1024;
+
+size_t SizeClassIndex(size_t size)
+{
+    return (std::max<size_t>(size, 1) + LoopMemory::kSizeClassBytes - 1) / LoopMemory::kSizeClassBytes - 1;
+}
+
+atomic<size_t> G_LIVE_INSTANCES {0};
+
+}
+
+unique_ptr<LoopMemory, LoopMemory::Deleter> LoopMemory::Create()
+{
+    return unique_ptr<LoopMemory, Deleter>(new LoopMemory());
+}
+
+void LoopMemory::Deleter::operator()(LoopMemory* memory) const
+{
+    // 还有比EventLoop活得久的对象时, 由最后一次归还释放LoopMemory
+    memory->Orphan();
+}
+
+size_t LoopMemory::LiveInstances()
+{
+    return G_LIVE_INSTANCES.load(memory_order_relaxed);
+}
+
+void LoopMemory::Orphan()
+{
+    orphaned_.store(true, memory_order_release);
+    // EventLoop已经析构, 所属线程不会再分配或在本地归还, 这些计数不再变化
+    size_t not_freed_locally = chunk_pool_.NotFreedLocally();
+    for(const auto& pool : object_pools_)
+    {
+        not_freed_locally += pool.NotFreedLocally();
+    }
+    const size_t delta = kOwnerRef - not_freed_locally;
+    if(remote_refs_.fetch_sub(delta, memory_order_acq_rel) == delta)
+    {
+        delete this;
+    }
+}
+
+void LoopMemory::ReleaseRemoteRef() noexcept
+{
+    if(remote_refs_.fetch_sub(1, memory_order_acq_rel) == 1)
+    {
+        delete this;
+    }
+}
+
+LoopMemory::LoopMemory()
+    : owner_(this_thread::get_id()),
+      huge_page_policy_(HugePagePolicy::kNone),
+      region_cursor_(nullptr),
+      region_end_(nullptr),
+      huge_regions_(0)
+{
+    for(size_t i = 0; i < kNumSizeClasses; ++i)
+    {
+        object_pools_[i].Init(this, (i + 1) * kSizeClassBytes);
+    }
+    chunk_pool_.Init(this, kBufferChunkSize);
+    G_LIVE_INSTANCES.fetch_add(1, memory_order_relaxed);
+}
+
+LoopMemory::~LoopMemory()
+{
+    G_LIVE_INSTANCES.fetch_sub(1, memory_order_relaxed);
+    for(const auto& region : regions_)
+    {
+        ::munmap(region.first, region.second);
+    }
+}
+
+void* LoopMemory::AllocateObject(size_t size)
+{
+    assert(size <= kMaxSlabObjectSize);
+    assert(IsOwnerThread());
+    return object_pools_[SizeClassIndex(size)].Allocate();
+}
+
+void LoopMemory::DeallocateObject(void* ptr, size_t size) noexcept
+{
+    const bool remote = IsRemoteFree();
+    object_pools_[SizeClassIndex(size)].Deallocate(ptr, remote);
+    if(remote)
+    {
+        ReleaseRemoteRef();
+    }
+}
+
+void* LoopMemory::AllocateChunk()
+{
+    assert(IsOwnerThread());
+    return chunk_pool_.Allocate();
+}
+
+void LoopMemory::DeallocateChunk(void* ptr) noexcept
+{
+    const bool remote = IsRemoteFree();
+    chunk_pool_.Deallocate(ptr, remote);
+    if(remote)
+    {
+        ReleaseRemoteRef();
+    }
+}
+
+LoopMemory::Stats LoopMemory::GetStats() const
+{
+    Stats stats;
+    for(const auto& pool : object_pools_)
+    {
+        pool.AddTo(stats.objects);
+    }
+    chunk_pool_.AddTo(stats.chunks);
+    for(const auto& region : regions_)
+    {
+        stats.bytes_mapped += region.second;
+    }
+    stats.huge_regions = huge_regions_;
+    return stats;
+}
+
+char* LoopMemory::CarveFromRegion(size_t len)
+{
+    if(region_cursor_ == nullptr || static_cast<size_t>(region_end_ - region_cursor_) < len)
+    {
+        // region剩下的尾部不足一次切分时直接丢弃, 最多浪费K_CARVE_BYTES
+        MapRegion();
+    }
+    char* result = region_cursor_;
+    region_cursor_ += len;
+    return result;
+}
+
+void LoopMemory::MapRegion()
+{
+    void* addr = MAP_FAILED;
+    if(huge_page_policy_ == HugePagePolicy::kExplicit)
+    {
+        addr = ::mmap(nullptr, kRegionSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(addr != MAP_FAILED)
+        {
+            ++huge_regions_;
+        }
+    }
+    if(addr == MAP_FAILED)
+    {
+        addr = ::mmap(nullptr, kRegionSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(addr == MAP_FAILED)
+        {
+            throw bad_alloc();
+        }
+        if(huge_page_policy_ != HugePagePolicy::kNone)
+        {
+            // THP只是建议, 失败(例如内核关闭了THP)时照常使用普通页
+            ::madvise(addr, kRegionSize, MADV_HUGEPAGE);
+        }
+    }
+    regions_.emplace_back(addr, kRegionSize);
+    region_cursor_ = static_cast<char*>(addr);
+    region_end_ = region_cursor_ + kRegionSize;
+}
+
+void* LoopMemory::FixedPool::Allocate()
+{
+    if(free_list_ == nullptr && remote_free_.load(memory_order_relaxed) != nullptr)
+    {
+        // 本线程的空闲链表耗尽时, 一次性取回其他线程归还的内存
+        free_list_ = remote_free_.exchange(nullptr, memory_order_acquire);
+    }
+    if(free_list_ != nullptr)
+    {
+        FreeNode* node = free_list_;
+        free_list_ = node->next;
+        ++hits_;
+        return node;
+    }
+    if(carve_ == carve_end_)
+    {
+        size_t blocks = std::max<size_t>(1, K_CARVE_BYTES / block_size_);
+        carve_ = memory_->CarveFromRegion(blocks * block_size_);
+        carve_end_ = carve_ + blocks * block_size_;
+    }
+    void* result = carve_;
+    carve_ += block_size_;
+    ++misses_;
+    return result;
+}
+
+void LoopMemory::FixedPool::Deallocate(void* ptr, bool remote) noexcept
+{
+    FreeNode* node = static_cast<FreeNode*>(ptr);
+    if(!remote)
+    {
+        node->next = free_list_;
+        free_list_ = node;
+        ++local_frees_;
+        return;
+    }
+    FreeNode* head = remote_free_.load(memory_order_relaxed);
+    do
+    {
+        node->next = head;
+    } while(!remote_free_.compare_exchange_weak(head, node, memory_order_release, memory_order_relaxed));
+    remote_frees_.fetch_add(1, memory_order_relaxed);
+}
+
+void LoopMemory::FixedPool::AddTo(PoolStats& stats) const
+{
+    const size_t remote_frees = remote_frees_.load(memory_order_relaxed);
+    const size_t in_use = hits_ + misses_ - local_frees_ - remote_frees;
+    stats.hits += hits_;
+    stats.misses += misses_;
+    stats.remote_frees += remote_frees;
+    stats.bytes_in_use += in_use * block_size_;
+    // 切分出来的内存要么在使用中, 要么在(本线程或其他线程归还的)空闲链表中
+    stats.bytes_cached += (misses_ - in_use) * block_size_;
+}
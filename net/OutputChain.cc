@@ -0,0 +1,145 @@
+#include "include/OutputChain.h"
+
+#include <algorithm>
+#include <cassert>
+#include <unistd.h>
+
+using namespace Cloo;
+using namespace std;
+
+namespace
+{
+
+// 独占段超过这个大小后不再继续追加, 避免一次复制导致整段重新分配
+constexpr size_t K_MAX_OWNED_SEGMENT = 64 * 1024;
+// 链头已经写出的段达到这个数目后考虑整体前移
+constexpr size_t K_COMPACT_THRESHOLD = 16;
+
+}
+
+SharedFile Cloo::MakeSharedFile(int fd)
+{
+    return SharedFile(new int(fd), [](const int* file_fd)
+    {
+        ::close(*file_fd);
+        delete file_fd;
+    });
+}
+
+void OutputChain::Append(SharedPayload payload, size_t offset)
+{
+    assert(payload && offset <= payload->size());
+    const size_t len = payload->size() - offset;
+    if(len == 0)
+    {
+        return;
+    }
+    total_ += len;
+    segments_.push_back(Segment{std::move(payload), offset, nullptr, nullptr, 0});
+}
+
+void OutputChain::Append(const char* data, size_t len)
+{
+    if(len == 0)
+    {
+        return;
+    }
+    total_ += len;
+    if(SegmentCount() > 0 && segments_.back().owned != nullptr && segments_.back().owned->size() < K_MAX_OWNED_SEGMENT)
+    {
+        segments_.back().owned->append(data, len);
+        return;
+    }
+    auto owned = make_shared<string>(data, len);
+    std::string* raw = owned.get();
+    segments_.push_back(Segment{std::move(owned), 0, raw, nullptr, 0});
+}
+
+void OutputChain::AppendFile(SharedFile file, off_t offset, size_t len)
+{
+    assert(file && offset >= 0);
+    if(len == 0)
+    {
+        return;
+    }
+    total_ += len;
+    const size_t begin = static_cast<size_t>(offset);
+    segments_.push_back(Segment{nullptr, begin, nullptr, std::move(file), begin + len});
+}
+
+bool OutputChain::FrontFile(int* fd, off_t* offset, size_t* len) const
+{
+    if(SegmentCount() == 0 || !segments_[head_].file)
+    {
+        return false;
+    }
+    const Segment& front = segments_[head_];
+    *fd = *front.file;
+    *offset = static_cast<off_t>(front.offset);
+    *len = front.Remaining();
+    return true;
+}
+
+bool OutputChain::HasFile() const
+{
+    for(auto iter = segments_.begin() + head_; iter != segments_.end(); ++iter)
+    {
+        if(iter->file)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+int OutputChain::FillIovec(iovec* iov, int max_iov) const
+{
+    int count = 0;
+    for(auto iter = segments_.begin() + head_; iter != segments_.end() && count < max_iov && !iter->file; ++iter, ++count)
+    {
+        iov[count].iov_base = const_cast<char*>(iter->payload->data() + iter->offset);
+        iov[count].iov_len = iter->payload->size() - iter->offset;
+    }
+    return count;
+}
+
+void OutputChain::Retrieve(size_t len)
+{
+    assert(len <= total_);
+    total_ -= len;
+    while(len > 0)
+    {
+        Segment& front = segments_[head_];
+        const size_t remaining = front.Remaining();
+        if(len < remaining)
+        {
+            front.offset += len;
+            break;
+        }
+        len -= remaining;
+        // 释放引用, 段表的位置留到下面一起回收
+        front = Segment{};
+        ++head_;
+    }
+    if(head_ == segments_.size())
+    {
+        segments_.clear();
+        head_ = 0;
+    }
+    else if(head_ >= K_COMPACT_THRESHOLD && head_ * 2 >= segments_.size())
+    {
+        // 链头已经写出的段占了一半以上时整体前移, 摊还后每段只移动常数次
+        segments_.erase(segments_.begin(), segments_.begin() + static_cast<ptrdiff_t>(head_));
+        head_ = 0;
+    }
+}
+
+void OutputChain::Shrink()
+{
+    if(Empty())
+    {
+        segments_.clear();
+        segments_.shrink_to_fit();
+        head_ = 0;
+    }
+}
@@ -0,0 +1,128 @@
+#include "include/PollPoller.h"
+#include "include/Channel.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <memory>
+#include <poll.h>
+#include <sys/poll.h>
+
+#include <iostream>
+
+using namespace Cloo;
+using namespace std;
+
+PollPoller::PollPoller(EventLoop* loop)
+    : Poller(loop, PollerKind::kPoll)
+{
+
+}
+
+PollPoller::~PollPoller()
+{
+
+}
+
+Poller::TimePoint PollPoller::Poll(int timeout_ms, ChannelList* active_channels)
+{
+    int num_events = ::poll(pollfds_.data(), pollfds_.size(), timeout_ms);
+    auto now = chrono::system_clock::now();
+    // Notice: Poll位于IO线程的热路径上(忙轮询时更是以0超时反复调用), 这里不再逐次打印日志
+    if(num_events > 0)
+    {
+        fillActiveChannels(num_events, active_channels);
+    }
+    else if(num_events < 0 && errno != EINTR)
+    {
+        cerr << "Poller::poll() error" <<endl;
+    }
+    return now;
+}
+
+
+void PollPoller::fillActiveChannels(int num_events, ChannelList* active_channels) const
+{
+    for(auto iter = pollfds_.begin(); iter != pollfds_.end() && num_events > 0; iter++)
+    {
+        if(iter->revents > 0)
+        {
+            // 在numEvents == 0时结束循环, 避免在已经处理完所有poll返回的pollfd后
+            // 对pollfds做无效地遍历
+            --num_events;
+            assert(channels_.count(iter->fd) != 0);
+            Channel* channel = channels_.find(iter->fd)->second;
+            assert(channel->Fd() == iter->fd);
+            channel->SetRevents(iter->revents);
+            active_channels->push_back(channel);
+        }
+    }
+}
+
+// 三处update:
+//  update PollPoller::pollfds : 将channel携带的fd和“关心的fd的IO事件”更新到Poller::pollfds中
+//  update Poller::channels : 将<channel->fd, channel>的KV更新到Poller::channels
+//  update channel: 将channel->fd插入到pollfds数组的最新index更新到channel->index 
+// 函数会严格要求Poller::channels[fd] - channel - Poller::pollfds[index]三者对应关系的正确性
+// 基本的关系为：
+//  Poller::channels[channel->fd] = channel
+//  Poller::pollfds[channel->index].fd = channel->fd 
+void PollPoller::UpdateChannel(Channel* channel)
+{
+    AssertInLoopTread();
+    // channel->Index < 0代表channel从未被注册到Poller中
+    // 需要将channel和对应的fd分别注册到Poller::channels_和Poller::pollfds_中
+    if(channel->Index() < 0)
+    {
+        assert(channels_.count(channel->Fd()) == 0);
+        pollfd pfd;
+        pfd.fd = channel->Fd();
+        pfd.events = static_cast<short>(channel->Events());
+        pfd.revents = 0;
+        pollfds_.push_back(pfd); // vector push_back()均摊分析的时间复杂度为O(1)
+        int idx = static_cast<int>(pollfds_.size()) - 1 ;
+        channel->SetIndex(idx);
+        channels_[pfd.fd] = channel;
+    }
+    // channel曾经已经注册到Poller中,这次只需要更新
+    else
+    {
+        assert(channels_.count(channel->Fd()) != 0);
+        assert(channels_[channel->Fd()] == channel);
+        int idx = channel->Index();
+        assert(0 <= idx && idx < static_cast<int>(pollfds_.size()));
+        pollfd& pfd = pollfds_[channel->Index()];
+        assert(pfd.fd == channel->Fd() || pfd.fd == -channel->Fd() - 1);
+        pfd.events = static_cast<short>(channel->Events());
+        pfd.revents = 0;
+        // Channel不关注任何IO事件, 将对应的fd置为负数, poll(2)会忽略此项
+        // 使用-fd-1而不是-1, 这样RemoveChannel仍然可以从pollfd反查出对应的Channel(fd为0时也能区分)
+        pfd.fd = channel->IsNoneEvent() ? -channel->Fd() - 1 : channel->Fd();
+    }
+}
+
+// 把待移除的pollfd与pollfds_末尾的元素交换后pop_back, 时间复杂度O(1)
+// 被交换到前面的Channel需要同步更新它的index
+void PollPoller::RemoveChannel(Channel* channel)
+{
+    AssertInLoopTread();
+    assert(channels_.count(channel->Fd()) != 0);
+    assert(channels_[channel->Fd()] == channel);
+    assert(channel->IsNoneEvent());
+    int idx = channel->Index();
+    assert(0 <= idx && idx < static_cast<int>(pollfds_.size()));
+    channels_.erase(channel->Fd());
+    if(idx != static_cast<int>(pollfds_.size()) - 1)
+    {
+        int back_fd = pollfds_.back().fd;
+        if(back_fd < 0)
+        {
+            back_fd = -back_fd - 1;
+        }
+        std::iter_swap(pollfds_.begin() + idx, pollfds_.end() - 1);
+        channels_[back_fd]->SetIndex(idx);
+    }
+    pollfds_.pop_back();
+    channel->SetIndex(-1);
+}
@@ -0,0 +1,266 @@
+#include "include/Resolver.h"
+#include "include/EventLoop.h"
+
+#include <arpa/inet.h>
+#include <cassert>
+#include <cstring>
+#include <netdb.h>
+#include <sys/socket.h>
+
+using namespace Cloo;
+using namespace std;
+
+namespace
+{
+
+// 析构时还在排队的请求的错误码, EAI_CANCELED是GNU扩展
+#ifdef EAI_CANCELED
+constexpr int K_CANCELED_ERROR = EAI_CANCELED;
+#else
+constexpr int K_CANCELED_ERROR = EAI_AGAIN;
+#endif
+
+}
+
+Resolver::Resolver() : Resolver(Options())
+{
+}
+
+Resolver::Resolver(const Options& options)
+    : options_(options),
+      stopping_(false),
+      lookups_(0),
+      cache_hits_(0),
+      coalesced_(0)
+{
+    assert(options_.num_threads > 0);
+    for(int i = 0; i < options_.num_threads; ++i)
+    {
+        threads_.emplace_back(&Resolver::WorkerFunc, this);
+    }
+}
+
+Resolver::~Resolver()
+{
+    {
+        lock_guard<mutex> lg(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    // 正在执行的getaddrinfo无法取消, 等它返回
+    for(auto& t : threads_)
+    {
+        t.join();
+    }
+    // 还没有开始的解析不再进行, 等待它们的请求以K_CANCELED_ERROR回调, 而不是永远等不到回调
+    for(auto& item : cache_)
+    {
+        for(auto& waiter : item.second.waiters)
+        {
+            ResolveResult result = MakeResult(K_CANCELED_ERROR, {}, waiter.port, false);
+            ResolveCallback cb = move(waiter.cb);
+            waiter.loop->QueueTaskInThisLoop([cb, result] { cb(result); });
+        }
+    }
+}
+
+void Resolver::Resolve(EventLoop* loop, const string& host, uint16_t port, const ResolveCallback& cb)
+{
+    ResolveResult result;
+    if(ParseNumeric(host, port, &result))
+    {
+        loop->QueueTaskInThisLoop([cb, result] { cb(result); });
+        return;
+    }
+    const auto now = chrono::steady_clock::now();
+    {
+        lock_guard<mutex> lg(mutex_);
+        Entry& entry = cache_[host];
+        if(entry.resolving)
+        {
+            coalesced_.fetch_add(1, memory_order_relaxed);
+            entry.waiters.push_back(Waiter{loop, port, cb});
+            return;
+        }
+        if(entry.expires > now)
+        {
+            cache_hits_.fetch_add(1, memory_order_relaxed);
+            result = MakeResult(entry.error, entry.addresses, port, true);
+        }
+        else
+        {
+            entry.resolving = true;
+            entry.waiters.push_back(Waiter{loop, port, cb});
+            queue_.push_back(host);
+        }
+    }
+    if(result.from_cache)
+    {
+        loop->QueueTaskInThisLoop([cb, result] { cb(result); });
+    }
+    else
+    {
+        cv_.notify_one();
+    }
+}
+
+bool Resolver::Lookup(const string& host, uint16_t port, ResolveResult* result)
+{
+    if(ParseNumeric(host, port, result))
+    {
+        return true;
+    }
+    lock_guard<mutex> lg(mutex_);
+    auto it = cache_.find(host);
+    if(it == cache_.end() || it->second.expires <= chrono::steady_clock::now())
+    {
+        return false;
+    }
+    cache_hits_.fetch_add(1, memory_order_relaxed);
+    *result = MakeResult(it->second.error, it->second.addresses, port, true);
+    return true;
+}
+
+void Resolver::ClearCache()
+{
+    lock_guard<mutex> lg(mutex_);
+    for(auto it = cache_.begin(); it != cache_.end();)
+    {
+        // 正在解析的项还挂着等待的请求, 保留
+        it = it->second.resolving ? next(it) : cache_.erase(it);
+    }
+}
+
+bool Resolver::IsPermanentError(int error)
+{
+#ifdef EAI_NODATA
+    return error == EAI_NONAME || error == EAI_NODATA;
+#else
+    return error == EAI_NONAME;
+#endif
+}
+
+void Resolver::WorkerFunc()
+{
+    while(true)
+    {
+        string host;
+        {
+            unique_lock<mutex> ul(mutex_);
+            cv_.wait(ul, [this] { return stopping_ || !queue_.empty(); });
+            if(stopping_)
+            {
+                return;
+            }
+            host = move(queue_.front());
+            queue_.pop_front();
+        }
+        DoResolve(host);
+    }
+}
+
+void Resolver::DoResolve(const string& host)
+{
+    lookups_.fetch_add(1, memory_order_relaxed);
+    addrinfo hints;
+    ::memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* list = nullptr;
+    int error = ::getaddrinfo(host.c_str(), nullptr, &hints, &list);
+    vector<in_addr> addresses;
+    if(error == 0)
+    {
+        for(addrinfo* ai = list; ai != nullptr; ai = ai->ai_next)
+        {
+            in_addr addr = reinterpret_cast<const sockaddr_in*>(ai->ai_addr)->sin_addr;
+            bool duplicate = false;
+            for(const in_addr& seen : addresses)
+            {
+                duplicate = duplicate || seen.s_addr == addr.s_addr;
+            }
+            if(!duplicate)
+            {
+                addresses.push_back(addr);
+            }
+        }
+        ::freeaddrinfo(list);
+        if(addresses.empty())
+        {
+            error = EAI_NONAME;
+        }
+    }
+
+    vector<Waiter> waiters;
+    {
+        lock_guard<mutex> lg(mutex_);
+        const auto now = chrono::steady_clock::now();
+        Entry& entry = cache_[host];
+        waiters.swap(entry.waiters);
+        if(error == 0 || IsPermanentError(error))
+        {
+            entry.error = error;
+            entry.addresses = addresses;
+            entry.expires = now + (error == 0 ? options_.positive_ttl : options_.negative_ttl);
+            entry.resolving = false;
+        }
+        else
+        {
+            // 暂时性的失败不缓存, 下一次请求重新解析
+            cache_.erase(host);
+        }
+        if(cache_.size() > options_.max_entries)
+        {
+            TrimCache(now);
+        }
+    }
+    for(auto& waiter : waiters)
+    {
+        ResolveResult result = MakeResult(error, addresses, waiter.port, false);
+        ResolveCallback cb = move(waiter.cb);
+        waiter.loop->QueueTaskInThisLoop([cb, result] { cb(result); });
+    }
+}
+
+void Resolver::TrimCache(chrono::steady_clock::time_point now)
+{
+    for(auto it = cache_.begin(); it != cache_.end();)
+    {
+        it = !it->second.resolving && it->second.expires <= now ? cache_.erase(it) : next(it);
+    }
+    if(cache_.size() > options_.max_entries)
+    {
+        for(auto it = cache_.begin(); it != cache_.end();)
+        {
+            it = it->second.resolving ? next(it) : cache_.erase(it);
+        }
+    }
+}
+
+bool Resolver::ParseNumeric(const string& host, uint16_t port, ResolveResult* result)
+{
+    in_addr addr;
+    if(::inet_pton(AF_INET, host.c_str(), &addr) != 1)
+    {
+        return false;
+    }
+    *result = MakeResult(0, {addr}, port, true);
+    return true;
+}
+
+ResolveResult Resolver::MakeResult(int error, const vector<in_addr>& addresses, uint16_t port, bool from_cache)
+{
+    ResolveResult result;
+    result.error = error;
+    result.from_cache = from_cache;
+    for(const in_addr& addr : addresses)
+    {
+        sockaddr_in sock_addr;
+        ::memset(&sock_addr, 0, sizeof sock_addr);
+        sock_addr.sin_family = AF_INET;
+        sock_addr.sin_port = htons(port);
+        sock_addr.sin_addr = addr;
+        result.addresses.push_back(sock_addr);
+    }
+    return result;
+}
@@ -0,0 +1,85 @@
+#include "include/SimPoller.h"
+#include "include/Channel.h"
+#include "include/Clock.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+using namespace Cloo;
+using namespace std;
+
+namespace Cloo::detail 
+{
+
+// Channel::Index()在SimPoller中只区分是否登记过
+const int K_SIM_NEW = -1;
+const int K_SIM_ADDED = 1;
+
+}
+
+SimPoller::SimPoller(EventLoop* loop, VirtualClock* clock)
+    : Poller(loop, PollerKind::kSim),
+      clock_(clock),
+      woken_(false),
+      polls_(0),
+      advances_(0)
+{
+
+}
+
+SimPoller::~SimPoller()
+{
+
+}
+
+Poller::TimePoint SimPoller::Poll(int timeout_ms, ChannelList* active_channels)
+{
+    ++polls_;
+    bool woken = woken_.exchange(false, memory_order_acquire);
+    if(!injected_.empty())
+    {
+        for(const auto& item : injected_)
+        {
+            item.first->SetRevents(item.second);
+            active_channels->push_back(item.first);
+        }
+        injected_.clear();
+    }
+    else if(!woken && timeout_ms > 0)
+    {
+        // 真实的Poll会在这里睡到超时, 仿真中直接跳过这段时间
+        clock_->Advance(chrono::milliseconds(timeout_ms));
+        ++advances_;
+    }
+    return clock_->Now();
+}
+
+void SimPoller::UpdateChannel(Channel* channel)
+{
+    AssertInLoopTread();
+    if(channel->Index() == detail::K_SIM_NEW)
+    {
+        assert(channels_.count(channel->Fd()) == 0);
+        channels_[channel->Fd()] = channel;
+        channel->SetIndex(detail::K_SIM_ADDED);
+    }
+}
+
+void SimPoller::RemoveChannel(Channel* channel)
+{
+    AssertInLoopTread();
+    assert(channels_.count(channel->Fd()) != 0);
+    assert(channel->IsNoneEvent());
+    channels_.erase(channel->Fd());
+    injected_.erase(remove_if(injected_.begin(), injected_.end(),
+        [channel](const pair<Channel*, int>& item) { return item.first == channel; }), injected_.end());
+    channel->SetIndex(detail::K_SIM_NEW);
+}
+
+void SimPoller::Inject(Channel* channel, int revents)
+{
+    AssertInLoopTread();
+    assert(HasChannel(channel));
+    injected_.emplace_back(channel, revents);
+}
@@ -1,14 +1,17 @@
 #include "include/Socket.h"
 #include "include/SocketAddress.h"
 
+#include <algorithm>
 #include <asm-generic/socket.h>
 #include <cerrno>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <linux/net_tstamp.h>
 #include <memory>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <system_error>
 #include <unistd.h>
 #include <fcntl.h>
@@ -50,6 +53,11 @@ std::unique_ptr<Socket> Socket::CreateNonblockSocket()
     return std::unique_ptr<Socket>(new Socket(static_cast<SocketFd>(sockfd)));
 }
 
+std::unique_ptr<Socket> Socket::FromFd(SocketFd fd)
+{
+    return std::unique_ptr<Socket>(new Socket(fd));
+}
+
 void Socket::Bind(const SocketAddress& addr)
 {
     auto ret = ::bind(static_cast<int>(sock_fd_), 
@@ -140,3 +148,58 @@ void Socket::SetReuseAddr(bool on)
         throw std::runtime_error(error_msg);
     }
 }
+
+void Socket::SetTcpNoDelay(bool on)
+{
+    int optval = on ? 1 : 0;
+    auto ret = ::setsockopt(static_cast<int>(sock_fd_), IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+    if(ret == -1)
+    {
+        std::string error_msg = "Failed to setsockopt: " + std::string(::strerror(errno));
+        throw std::runtime_error(error_msg);
+    }
+}
+
+bool Socket::SetTcpCork(bool on)
+{
+    int optval = on ? 1 : 0;
+    return ::setsockopt(static_cast<int>(sock_fd_), IPPROTO_TCP, TCP_CORK, &optval, sizeof(optval)) == 0;
+}
+
+bool Socket::SetMaxPacingRate(uint64_t bytes_per_sec)
+{
+    // 老内核只接受32位的值, ~0U表示不限制
+    unsigned int rate = bytes_per_sec == 0 ? ~0U : static_cast<unsigned int>(std::min<uint64_t>(bytes_per_sec, ~0U - 1));
+    return ::setsockopt(static_cast<int>(sock_fd_), SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate)) == 0;
+}
+
+void Socket::SetRxTimestamping(bool on)
+{
+    int flags = on ? (SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE) : 0;
+    auto ret = ::setsockopt(static_cast<int>(sock_fd_), SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+    if(ret == -1)
+    {
+        std::string error_msg = "Failed to setsockopt: " + std::string(::strerror(errno));
+        throw std::runtime_error(error_msg);
+    }
+}
+
+void Socket::ShutdownWrite()
+{
+    if(::shutdown(static_cast<int>(sock_fd_), SHUT_WR) == -1)
+    {
+        std::cerr << "Failed to shutdown socket: " << ::strerror(errno) << std::endl;
+    }
+}
+
+int Socket::GetIncomingCpu(SocketFd fd)
+{
+    int cpu = -1;
+    socklen_t len = sizeof(cpu);
+    auto ret = ::getsockopt(static_cast<int>(fd), SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len);
+    if(ret == -1)
+    {
+        return -1;
+    }
+    return cpu;
+}
@@ -0,0 +1,1172 @@
+#include "include/TcpConnection.h"
+#include "include/Channel.h"
+#include "include/EventLoop.h"
+#include "include/LoopMemory.h"
+#include "include/Socket.h"
+#include "include/TlsContext.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <climits>
+#include <string>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace Cloo;
+using namespace std;
+
+namespace
+{
+
+// TLS记录的最大明文长度
+constexpr size_t K_TLS_RECORD_SIZE = 16 * 1024;
+// 用户态限速的令牌桶默认容量的下限
+constexpr size_t K_MIN_PACING_BURST = 4096;
+constexpr size_t K_TASK_LOCKS = 64;
+
+}
+
+TcpConnection::TcpConnection(EventLoop* loop, const string& name, SocketFd fd, const SocketAddress& peer_addr)
+    : loop_(loop),
+      name_(name),
+      state_(State::kConnecting),
+      edge_triggered_(false),
+      read_deferred_(false),
+      write_deferred_(false),
+      rx_timestamping_(false),
+      flush_scheduled_(false),
+      release_check_scheduled_(false),
+      bulk_(false),
+      kernel_pacing_(false),
+      pacing_wait_(false),
+      bulk_turn_(false),
+      task_drain_scheduled_(false),
+      migrating_(false),
+      socket_(fd),
+      write_calls_(0),
+      cork_calls_(0),
+      buffer_release_idle_ms_(0),
+      channel_(Channel::Create(loop, static_cast<int>(fd))),
+      peer_addr_(peer_addr.ToSockAddrIn()),
+      input_buffer_(loop->MemoryForThisThread()),
+      output_buffer_(loop->MemoryForThisThread())
+{
+    SetChannelCallbacks();
+}
+
+void TcpConnection::SetChannelCallbacks()
+{
+    // 只捕获this的lambda可以放进std::function内部的存储, bind(成员函数指针, this)放不下, 每个回调要多一次堆分配
+    channel_->SetReadCallBack([this] { HandleRead(); });
+    channel_->SetWriteCallBack([this] { HandleWrite(); });
+    channel_->SetCloseCallBack([this] { HandleClose(); });
+    channel_->SetErrorCallBack([this] { HandleError(); });
+}
+
+TcpConnection::~TcpConnection()
+{
+    assert(state_ == State::kDisconnected);
+}
+
+void TcpConnection::SetTcpNoDelay(bool on)
+{
+    socket_.SetTcpNoDelay(on);
+}
+
+void TcpConnection::SetRxTimestamping(bool on)
+{
+    socket_.SetRxTimestamping(on);
+    rx_timestamping_ = on;
+    awaiting_reply_since_ = define::SystemTimePoint();
+}
+
+void TcpConnection::SetBufferReleaseIdle(long idle_ms)
+{
+    buffer_release_idle_ms_ = idle_ms;
+}
+
+void TcpConnection::MarkActive()
+{
+    if(buffer_release_idle_ms_ <= 0)
+    {
+        return;
+    }
+    last_active_ = GetLoop()->PollReturnTime();
+    if(!release_check_scheduled_)
+    {
+        release_check_scheduled_ = true;
+        ScheduleBufferRelease(buffer_release_idle_ms_);
+    }
+}
+
+void TcpConnection::ScheduleBufferRelease(long delay_ms)
+{
+    weak_ptr<TcpConnection> weak_conn = shared_from_this();
+    EventLoop* loop = GetLoop();
+    // 释放空闲内存对时间不敏感, 给足slack让到期时间相近的连接共用一次定时器唤醒
+    loop->RunAfter(delay_ms, [weak_conn, loop]
+    {
+        // 连接已经迁移到其他IO线程时由AttachToLoop重新安排
+        auto conn = weak_conn.lock();
+        if(conn && conn->GetLoop() == loop)
+        {
+            conn->ReleaseIdleBuffers();
+        }
+    }, delay_ms / 4);
+}
+
+void TcpConnection::ReleaseIdleBuffers()
+{
+    release_check_scheduled_ = false;
+    if(state_ == State::kDisconnected || buffer_release_idle_ms_ <= 0)
+    {
+        return;
+    }
+    const long idle_ms = chrono::duration_cast<chrono::milliseconds>(GetLoop()->Now() - last_active_).count();
+    if(idle_ms < buffer_release_idle_ms_)
+    {
+        // 期间有过读写, 从最后一次读写算起再等一个空闲周期
+        release_check_scheduled_ = true;
+        ScheduleBufferRelease(buffer_release_idle_ms_ - idle_ms);
+        return;
+    }
+    input_buffer_.Shrink();
+    if(PendingOutputBytes() == 0)
+    {
+        output_buffer_.Shrink();
+        output_chain_.Shrink();
+    }
+}
+
+size_t TcpConnection::MemoryUsage() const
+{
+    size_t bytes = LoopMemory::ObjectBlockSize(sizeof(TcpConnection)) + LoopMemory::ObjectBlockSize(sizeof(Channel));
+    // 超出SSO的连接名
+    if(name_.capacity() > string().capacity())
+    {
+        bytes += name_.capacity() + 1;
+    }
+    return bytes + input_buffer_.AllocatedBytes() + output_buffer_.AllocatedBytes() + output_chain_.AllocatedBytes();
+}
+
+void TcpConnection::RecordReplyLatency()
+{
+    if(awaiting_reply_since_ != define::SystemTimePoint())
+    {
+        auto elapsed = chrono::system_clock::now() - awaiting_reply_since_;
+        GetLoop()->RxLatency().dispatch_to_reply.Record(chrono::duration_cast<chrono::nanoseconds>(elapsed).count());
+        awaiting_reply_since_ = define::SystemTimePoint();
+    }
+}
+
+void TcpConnection::StartTls(const shared_ptr<TlsContext>& context)
+{
+    assert(!tls_);
+    tls_ = make_unique<TlsSession>(context, channel_->Fd());
+    // 连接已经建立(例如在ConnectionCallback中调用)时立即开始握手, 否则由ConnectEstablished开始
+    if(state_ == State::kConnected)
+    {
+        DriveHandshake();
+    }
+}
+
+bool TcpConnection::TlsHandshaking() const
+{
+    return tls_ && !tls_->HandshakeDone();
+}
+
+void TcpConnection::DriveHandshake()
+{
+    switch(tls_->Handshake())
+    {
+        case TlsSession::HandshakeResult::kDone:
+            if(PendingOutputBytes() > 0)
+            {
+                // 握手期间Send的数据
+                if(!channel_->IsWriting())
+                {
+                    channel_->EnableWriting();
+                }
+            }
+            else
+            {
+                if(channel_->IsWriting())
+                {
+                    channel_->DisableWriting();
+                }
+                if(state_ == State::kDisconnecting)
+                {
+                    ShutdownInLoop();
+                }
+            }
+            // 对端可能紧接着握手发来了应用数据, 边沿触发时不会再次通知
+            HandleRead();
+            break;
+        case TlsSession::HandshakeResult::kWantRead:
+            if(channel_->IsWriting())
+            {
+                channel_->DisableWriting();
+            }
+            break;
+        case TlsSession::HandshakeResult::kWantWrite:
+            if(!channel_->IsWriting())
+            {
+                channel_->EnableWriting();
+            }
+            break;
+        case TlsSession::HandshakeResult::kError:
+            cerr << "TcpConnection::DriveHandshake [" << name_ << "] TLS handshake failed: " << tls_->LastError() << endl;
+            HandleClose();
+            break;
+    }
+}
+
+void TcpConnection::ConnectEstablished()
+{
+    GetLoop()->AssertInLoopTread();
+    assert(state_ == State::kConnecting);
+    state_ = State::kConnected;
+    if(table_)
+    {
+        handle_ = table_->Register(this);
+    }
+    channel_->Tie(shared_from_this());
+    channel_->SetEdgeTriggered(edge_triggered_);
+    channel_->EnableReading();
+    if(connection_callback_)
+    {
+        connection_callback_(shared_from_this());
+    }
+    if(TlsHandshaking() && state_ == State::kConnected)
+    {
+        DriveHandshake();
+    }
+}
+
+void TcpConnection::ConnectDestroyed()
+{
+    GetLoop()->AssertInLoopTread();
+    if(state_ == State::kConnected)
+    {
+        state_ = State::kDisconnected;
+        channel_->DisableAll();
+        if(connection_callback_)
+        {
+            connection_callback_(shared_from_this());
+        }
+    }
+    channel_->Remove();
+    if(table_)
+    {
+        table_->Unregister(handle_);
+    }
+}
+
+void TcpConnection::HandleRead()
+{
+    GetLoop()->AssertInLoopTread();
+    read_deferred_ = false;
+    MarkActive();
+    if(TlsHandshaking())
+    {
+        DriveHandshake();
+        return;
+    }
+    const size_t budget = GetLoop()->IoBudgetPerEvent();
+    size_t total = 0;
+    bool peer_closed = false;
+    bool failed = false;
+    bool budget_exhausted = false;
+    int saved_errno = 0;
+    // 这一批数据中最早一次read得到的内核时间戳
+    define::SystemTimePoint rx_time;
+    // drain: 读到EAGAIN为止; 读到的数据少于本次能容纳的数据量时说明内核缓冲区已经读空, 省去最后一次返回EAGAIN的read
+    while(true)
+    {
+        const size_t capacity = input_buffer_.ReadFdCapacity();
+        ssize_t n = 0;
+        if(tls_)
+        {
+            n = tls_->Read(&input_buffer_, &saved_errno);
+        }
+        else if(rx_timestamping_ && rx_time == define::SystemTimePoint())
+        {
+            n = input_buffer_.ReadFd(channel_->Fd(), &saved_errno, &rx_time);
+        }
+        else
+        {
+            n = input_buffer_.ReadFd(channel_->Fd(), &saved_errno);
+        }
+        if(n > 0)
+        {
+            total += n;
+            if(budget > 0 && total >= budget)
+            {
+                budget_exhausted = true;
+                break;
+            }
+            // TLS每次最多读出一个记录, 一直读到EAGAIN
+            if(!tls_ && static_cast<size_t>(n) < capacity)
+            {
+                break;
+            }
+        }
+        else if(n == 0)
+        {
+            peer_closed = true;
+            break;
+        }
+        else if(saved_errno == EINTR)
+        {
+            continue;
+        }
+        else
+        {
+            failed = saved_errno != EAGAIN && saved_errno != EWOULDBLOCK;
+            break;
+        }
+    }
+
+    if(total > 0 && rx_timestamping_ && rx_time != define::SystemTimePoint())
+    {
+        // 内核时间戳是CLOCK_REALTIME, 与system_clock直接比较; 不使用GetLoop()->Now(), 它可能是虚拟时钟
+        const auto dispatch_time = chrono::system_clock::now();
+        GetLoop()->RxLatency().kernel_to_dispatch.Record(chrono::duration_cast<chrono::nanoseconds>(dispatch_time - rx_time).count());
+        last_rx_time_ = rx_time;
+        awaiting_reply_since_ = dispatch_time;
+        if(message_callback_)
+        {
+            message_callback_(shared_from_this(), &input_buffer_, rx_time);
+        }
+    }
+    else if(total > 0 && message_callback_)
+    {
+        message_callback_(shared_from_this(), &input_buffer_, GetLoop()->PollReturnTime());
+    }
+    if(peer_closed)
+    {
+        HandleClose();
+    }
+    else if(failed)
+    {
+        cerr << "TcpConnection::HandleRead [" << name_ << "] " << ::strerror(saved_errno) << endl;
+        HandleError();
+        HandleClose();
+    }
+    // 边沿触发时内核不会再次通知剩余的数据, 必须自己安排下一次读取
+    // 水平触发时下一轮Poll仍然会报告可读, 不需要额外处理; 但TLS已经从socket读出、尚未解密交付的数据Poll看不到
+    else if(budget_exhausted && (channel_->EdgeTriggered() || tls_) && state_ != State::kDisconnected)
+    {
+        read_deferred_ = true;
+        weak_ptr<TcpConnection> weak_conn = shared_from_this();
+        GetLoop()->DeferToNextIteration([weak_conn]
+        {
+            auto conn = weak_conn.lock();
+            if(conn && conn->read_deferred_)
+            {
+                conn->HandleRead();
+            }
+        });
+    }
+}
+
+void TcpConnection::HandleWrite()
+{
+    GetLoop()->AssertInLoopTread();
+    write_deferred_ = false;
+    if(!channel_->IsWriting())
+    {
+        return;
+    }
+    if(TlsHandshaking())
+    {
+        DriveHandshake();
+        return;
+    }
+    DrainOutput();
+}
+
+void TcpConnection::DrainOutput()
+{
+    const size_t budget = GetLoop()->IoBudgetPerEvent();
+    size_t total = 0;
+    bool budget_exhausted = false;
+    // 限速时这一次最多可以写出的字节数, 不限速时为SIZE_MAX
+    size_t allowance = PacingAllowance();
+    // drain: 写到输出缓冲区与输出链都为空、EAGAIN、预算或限速的额度耗尽为止
+    while(PendingOutputBytes() > 0 && allowance > 0)
+    {
+        size_t max_bytes = budget > 0 ? budget - total : 0;
+        if(allowance != SIZE_MAX)
+        {
+            max_bytes = max_bytes == 0 ? allowance : min(max_bytes, allowance);
+        }
+        ssize_t n = WriteOutput(max_bytes);
+        if(n > 0)
+        {
+            total += n;
+            if(allowance != SIZE_MAX)
+            {
+                allowance -= n;
+                ConsumePacing(n);
+            }
+            if(budget > 0 && total >= budget)
+            {
+                budget_exhausted = PendingOutputBytes() > 0;
+                break;
+            }
+        }
+        else if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else
+        {
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                cerr << "TcpConnection::HandleWrite [" << name_ << "] " << ::strerror(errno) << endl;
+            }
+            break;
+        }
+    }
+
+    if(PendingOutputBytes() == 0)
+    {
+        if(channel_->IsWriting())
+        {
+            channel_->DisableWriting();
+        }
+        if(write_complete_callback_)
+        {
+            GetLoop()->QueueTaskInThisLoop(bind(write_complete_callback_, shared_from_this()));
+        }
+        if(state_ == State::kDisconnecting)
+        {
+            ShutdownInLoop();
+        }
+    }
+    else if(allowance == 0)
+    {
+        // 限速的额度耗尽, 不再关注可写事件, 等令牌
+        WaitForPacing();
+    }
+    else if(!channel_->IsWriting())
+    {
+        // 写合并的刷新或限速连接的Send没有写完, 剩下的等可写事件
+        channel_->EnableWriting();
+    }
+    else if(budget_exhausted && channel_->EdgeTriggered())
+    {
+        write_deferred_ = true;
+        weak_ptr<TcpConnection> weak_conn = shared_from_this();
+        GetLoop()->DeferToNextIteration([weak_conn]
+        {
+            auto conn = weak_conn.lock();
+            if(conn && conn->write_deferred_)
+            {
+                conn->HandleWrite();
+            }
+        });
+    }
+}
+
+ssize_t TcpConnection::WriteOutput(size_t max_bytes)
+{
+    if(tls_ && max_bytes > 0)
+    {
+        // SSL_write返回WANT_WRITE后的重试不能比上一次短: 限速额度或预算不足时也按上一次的长度写, 多出的部分计入限速
+        max_bytes = max(max_bytes, tls_->PendingWriteBytes());
+    }
+    int file_fd = -1;
+    off_t file_offset = 0;
+    size_t file_len = 0;
+    if(output_buffer_.ReadableBytes() == 0 && output_chain_.FrontFile(&file_fd, &file_offset, &file_len))
+    {
+        ssize_t n = TransferFile(file_fd, file_offset, max_bytes > 0 ? min(file_len, max_bytes) : file_len);
+        if(n > 0)
+        {
+            output_chain_.Retrieve(n);
+        }
+        return n;
+    }
+    iovec iov[IOV_MAX];
+    int iovcnt = 0;
+    if(output_buffer_.ReadableBytes() > 0)
+    {
+        iov[0].iov_base = const_cast<char*>(output_buffer_.Peek());
+        iov[0].iov_len = output_buffer_.ReadableBytes();
+        iovcnt = 1;
+    }
+    iovcnt += output_chain_.FillIovec(iov + iovcnt, IOV_MAX - iovcnt);
+    if(max_bytes > 0)
+    {
+        // 按预算截断iovec
+        size_t sum = 0;
+        for(int i = 0; i < iovcnt; ++i)
+        {
+            if(sum + iov[i].iov_len >= max_bytes)
+            {
+                iov[i].iov_len = max_bytes - sum;
+                iovcnt = i + 1;
+                break;
+            }
+            sum += iov[i].iov_len;
+        }
+    }
+    ssize_t n = 0;
+    ++write_calls_;
+    if(!tls_)
+    {
+        n = ::writev(channel_->Fd(), iov, iovcnt);
+    }
+    else if(iovcnt == 1 || iov[0].iov_len >= K_TLS_RECORD_SIZE)
+    {
+        n = tls_->Write(iov[0].iov_base, iov[0].iov_len);
+    }
+    else
+    {
+        // TLS没有writev: 链头的小段先拼成一个记录再加密, 避免每段单独成为一个记录.
+        // EAGAIN之后重试时拼出的内容以上次的内容为前缀, 满足SSL_write的重试要求
+        char record[K_TLS_RECORD_SIZE];
+        size_t len = 0;
+        for(int i = 0; i < iovcnt && len < sizeof record; ++i)
+        {
+            size_t chunk = min(iov[i].iov_len, sizeof record - len);
+            memcpy(record + len, iov[i].iov_base, chunk);
+            len += chunk;
+        }
+        n = tls_->Write(record, len);
+    }
+    if(n > 0)
+    {
+        size_t from_buffer = min(static_cast<size_t>(n), output_buffer_.ReadableBytes());
+        output_buffer_.Retrieve(from_buffer);
+        output_chain_.Retrieve(n - from_buffer);
+    }
+    return n;
+}
+
+ssize_t TcpConnection::WriteDirect(const void* data, size_t len)
+{
+    ++write_calls_;
+    return tls_ ? tls_->Write(data, len) : ::write(channel_->Fd(), data, len);
+}
+
+ssize_t TcpConnection::TransferFile(int file_fd, off_t offset, size_t len)
+{
+    ++write_calls_;
+    ssize_t n = tls_ ? tls_->SendFile(file_fd, offset, len) : ::sendfile(channel_->Fd(), file_fd, &offset, len);
+    if(n == 0 && len > 0)
+    {
+        // 文件在发送过程中被截短
+        errno = EIO;
+        return -1;
+    }
+    return n;
+}
+
+bool TcpConnection::CanWriteDirectly() const
+{
+    return !channel_->IsWriting() && PendingOutputBytes() == 0 && !TlsHandshaking() && !GetLoop()->WriteCoalescing() && !Paced();
+}
+
+bool TcpConnection::Paced() const
+{
+    return pacing_bucket_.Enabled() || (bulk_ && GetLoop()->BulkBandwidthLimited());
+}
+
+void TcpConnection::ScheduleOutput()
+{
+    // 在等待可写事件, 或者在等待限速的令牌
+    if(channel_->IsWriting() || pacing_wait_)
+    {
+        return;
+    }
+    // 写合并: 不关注可写事件, 在本轮迭代的最后统一刷新; TLS握手期间的数据仍等握手完成后写出
+    if(GetLoop()->WriteCoalescing() && !TlsHandshaking())
+    {
+        if(!flush_scheduled_)
+        {
+            flush_scheduled_ = true;
+            weak_ptr<TcpConnection> weak_conn = shared_from_this();
+            GetLoop()->FlushAtIterationEnd([weak_conn]
+            {
+                if(auto conn = weak_conn.lock())
+                {
+                    conn->FlushOutput();
+                }
+            });
+        }
+        return;
+    }
+    // 限速的连接按额度立即写, 写不完的部分等可写事件或令牌
+    if(Paced() && !TlsHandshaking())
+    {
+        DrainOutput();
+        return;
+    }
+    channel_->EnableWriting();
+}
+
+void TcpConnection::SetPacing(const PacingOptions& options)
+{
+    bulk_ = options.bulk;
+    const bool was_kernel = kernel_pacing_;
+    kernel_pacing_ = options.rate_bytes_per_sec > 0 && options.kernel && socket_.SetMaxPacingRate(options.rate_bytes_per_sec);
+    if(was_kernel && !kernel_pacing_)
+    {
+        socket_.SetMaxPacingRate(0);
+    }
+    if(options.rate_bytes_per_sec > 0 && !kernel_pacing_)
+    {
+        size_t burst = options.burst_bytes > 0 ? options.burst_bytes
+                                               : max<size_t>(options.rate_bytes_per_sec / 50, K_MIN_PACING_BURST);
+        pacing_bucket_.Configure(options.rate_bytes_per_sec, burst);
+    }
+    else
+    {
+        pacing_bucket_.Configure(0, 0);
+    }
+}
+
+size_t TcpConnection::PacingAllowance()
+{
+    const bool bulk_turn = bulk_turn_;
+    bulk_turn_ = false;
+    size_t allowance = pacing_bucket_.Available();
+    if(bulk_)
+    {
+        allowance = min(allowance, GetLoop()->BulkAllowance(bulk_turn));
+    }
+    return allowance;
+}
+
+void TcpConnection::ConsumePacing(size_t bytes)
+{
+    pacing_bucket_.Consume(bytes);
+    if(bulk_)
+    {
+        GetLoop()->ConsumeBulkBandwidth(bytes);
+    }
+}
+
+void TcpConnection::WaitForPacing()
+{
+    if(channel_->IsWriting())
+    {
+        channel_->DisableWriting();
+    }
+    if(pacing_wait_)
+    {
+        return;
+    }
+    pacing_wait_ = true;
+    weak_ptr<TcpConnection> weak_conn = shared_from_this();
+    if(pacing_bucket_.Enabled() && pacing_bucket_.Available() == 0)
+    {
+        // 连接自己的速率: 等令牌攒到足够发出剩余的数据(最多一个burst)
+        GetLoop()->RunAfter(pacing_bucket_.TimeUntil(PendingOutputBytes()).count(), [weak_conn]
+        {
+            if(auto conn = weak_conn.lock())
+            {
+                conn->ResumeAfterPacing(false);
+            }
+        });
+    }
+    else
+    {
+        // EventLoop的bulk总带宽: 排队轮转
+        GetLoop()->WaitForBulkBandwidth([weak_conn]
+        {
+            if(auto conn = weak_conn.lock())
+            {
+                conn->ResumeAfterPacing(true);
+            }
+        });
+    }
+}
+
+void TcpConnection::ResumeAfterPacing(bool bulk_turn)
+{
+    pacing_wait_ = false;
+    if(state_ == State::kDisconnected || channel_->IsWriting() || PendingOutputBytes() == 0)
+    {
+        return;
+    }
+    bulk_turn_ = bulk_turn;
+    DrainOutput();
+}
+
+void TcpConnection::FlushOutput()
+{
+    flush_scheduled_ = false;
+    // 期间连接已经关闭, 或者已经改为等待可写事件
+    if(state_ == State::kDisconnected || channel_->IsWriting() || PendingOutputBytes() == 0)
+    {
+        return;
+    }
+    // 一次写就能写完时不cork, 省去两次setsockopt
+    bool cork = false;
+    if(GetLoop()->CorkOnFlush() && OutputNeedsMultipleWrites())
+    {
+        ++cork_calls_;
+        cork = socket_.SetTcpCork(true);
+    }
+    DrainOutput();
+    if(cork)
+    {
+        ++cork_calls_;
+        socket_.SetTcpCork(false);
+    }
+}
+
+bool TcpConnection::OutputNeedsMultipleWrites() const
+{
+    const size_t pieces = (output_buffer_.ReadableBytes() > 0 ? 1 : 0) + output_chain_.SegmentCount();
+    if(pieces <= 1)
+    {
+        return false;
+    }
+    if(output_chain_.HasFile() || pieces > IOV_MAX)
+    {
+        return true;
+    }
+    return tls_ != nullptr && PendingOutputBytes() > K_TLS_RECORD_SIZE;
+}
+
+void TcpConnection::HandleClose()
+{
+    GetLoop()->AssertInLoopTread();
+    if(state_ == State::kDisconnected)
+    {
+        return;
+    }
+    state_ = State::kDisconnected;
+    channel_->DisableAll();
+    // 回调过程中TcpServer会把自己持有的shared_ptr移除, 这里保证回调结束前TcpConnection不会被析构
+    define::TcpConnectionPtr guard(shared_from_this());
+    if(connection_callback_)
+    {
+        connection_callback_(guard);
+    }
+    if(close_callback_)
+    {
+        (*close_callback_)(guard);
+    }
+}
+
+void TcpConnection::HandleError()
+{
+    int optval = 0;
+    socklen_t optlen = sizeof optval;
+    if(::getsockopt(channel_->Fd(), SOL_SOCKET, SO_ERROR, &optval, &optlen) == 0 && optval != 0)
+    {
+        cerr << "TcpConnection::HandleError [" << name_ << "] SO_ERROR = " << optval << " " << ::strerror(optval) << endl;
+    }
+}
+
+void TcpConnection::Send(string_view data)
+{
+    if(state_ != State::kConnected)
+    {
+        return;
+    }
+    if(InOwnerThread())
+    {
+        SendInLoop(data.data(), data.size());
+    }
+    else
+    {
+        auto self = shared_from_this();
+        string copy(data);
+        QueueInOwnerLoop([self, copy]{ self->SendInLoop(copy.data(), copy.size()); });
+    }
+}
+
+void TcpConnection::Send(Buffer* buf)
+{
+    Send(string_view(buf->Peek(), buf->ReadableBytes()));
+    buf->RetrieveAll();
+}
+
+void TcpConnection::Send(const SharedPayload& payload)
+{
+    if(state_ != State::kConnected)
+    {
+        return;
+    }
+    if(InOwnerThread())
+    {
+        SendPayloadInLoop(payload);
+    }
+    else
+    {
+        // 跨线程时也只传递引用
+        auto self = shared_from_this();
+        QueueInOwnerLoop([self, payload]{ self->SendPayloadInLoop(payload); });
+    }
+}
+
+void TcpConnection::SendPayloadInLoop(const SharedPayload& payload)
+{
+    GetLoop()->AssertInLoopTread();
+    if(state_ == State::kDisconnected)
+    {
+        cerr << "TcpConnection::SendPayloadInLoop [" << name_ << "] disconnected, give up writing" << endl;
+        return;
+    }
+    RecordReplyLatency();
+    MarkActive();
+    size_t nwrote = 0;
+    // 没有待写的数据时先尝试直接写, 只有写不完的部分才进入输出链
+    if(CanWriteDirectly())
+    {
+        ssize_t n = WriteDirect(payload->data(), payload->size());
+        if(n >= 0)
+        {
+            nwrote = n;
+            if(nwrote == payload->size() && write_complete_callback_)
+            {
+                GetLoop()->QueueTaskInThisLoop(bind(write_complete_callback_, shared_from_this()));
+            }
+        }
+        else if(errno != EWOULDBLOCK && errno != EAGAIN)
+        {
+            cerr << "TcpConnection::SendPayloadInLoop [" << name_ << "] " << ::strerror(errno) << endl;
+            if(errno == EPIPE || errno == ECONNRESET)
+            {
+                return;
+            }
+        }
+    }
+    if(nwrote < payload->size())
+    {
+        output_chain_.Append(payload, nwrote);
+        ScheduleOutput();
+    }
+}
+
+void TcpConnection::SendInLoop(const char* data, size_t len)
+{
+    GetLoop()->AssertInLoopTread();
+    if(state_ == State::kDisconnected)
+    {
+        cerr << "TcpConnection::SendInLoop [" << name_ << "] disconnected, give up writing" << endl;
+        return;
+    }
+    RecordReplyLatency();
+    MarkActive();
+    ssize_t nwrote = 0;
+    size_t remaining = len;
+    bool fault = false;
+    // 输出缓冲区为空时先尝试直接写, 写不完的部分再放入输出缓冲区
+    if(CanWriteDirectly())
+    {
+        nwrote = WriteDirect(data, len);
+        if(nwrote >= 0)
+        {
+            remaining = len - nwrote;
+            if(remaining == 0 && write_complete_callback_)
+            {
+                GetLoop()->QueueTaskInThisLoop(bind(write_complete_callback_, shared_from_this()));
+            }
+        }
+        else
+        {
+            nwrote = 0;
+            if(errno != EWOULDBLOCK && errno != EAGAIN)
+            {
+                cerr << "TcpConnection::SendInLoop [" << name_ << "] " << ::strerror(errno) << endl;
+                fault = errno == EPIPE || errno == ECONNRESET;
+            }
+        }
+    }
+    if(!fault && remaining > 0)
+    {
+        // 输出链中还有数据时追加到输出链尾部, 保证发送顺序
+        if(output_chain_.Empty())
+        {
+            output_buffer_.Append(data + nwrote, remaining);
+        }
+        else
+        {
+            output_chain_.Append(data + nwrote, remaining);
+        }
+        ScheduleOutput();
+    }
+}
+
+void TcpConnection::SendFile(int file_fd, off_t offset, size_t count)
+{
+    if(state_ != State::kConnected)
+    {
+        return;
+    }
+    struct stat st;
+    if(::fstat(file_fd, &st) != 0 || offset < 0 || static_cast<size_t>(st.st_size) < offset + count)
+    {
+        cerr << "TcpConnection::SendFile [" << name_ << "] file is shorter than offset + count" << endl;
+        return;
+    }
+    int fd = ::fcntl(file_fd, F_DUPFD_CLOEXEC, 0);
+    if(fd == -1)
+    {
+        cerr << "TcpConnection::SendFile [" << name_ << "] " << ::strerror(errno) << endl;
+        return;
+    }
+    SharedFile file = MakeSharedFile(fd);
+    if(InOwnerThread())
+    {
+        SendFileInLoop(file, offset, count);
+    }
+    else
+    {
+        auto self = shared_from_this();
+        QueueInOwnerLoop([self, file, offset, count]{ self->SendFileInLoop(file, offset, count); });
+    }
+}
+
+void TcpConnection::SendFileInLoop(const SharedFile& file, off_t offset, size_t count)
+{
+    GetLoop()->AssertInLoopTread();
+    if(state_ == State::kDisconnected)
+    {
+        cerr << "TcpConnection::SendFileInLoop [" << name_ << "] disconnected, give up writing" << endl;
+        return;
+    }
+    RecordReplyLatency();
+    MarkActive();
+    size_t sent = 0;
+    if(CanWriteDirectly())
+    {
+        while(sent < count)
+        {
+            ssize_t n = TransferFile(*file, offset + static_cast<off_t>(sent), count - sent);
+            if(n > 0)
+            {
+                sent += n;
+            }
+            else if(errno == EINTR)
+            {
+                continue;
+            }
+            else
+            {
+                if(errno != EWOULDBLOCK && errno != EAGAIN)
+                {
+                    cerr << "TcpConnection::SendFileInLoop [" << name_ << "] " << ::strerror(errno) << endl;
+                    if(errno == EPIPE || errno == ECONNRESET)
+                    {
+                        return;
+                    }
+                }
+                break;
+            }
+        }
+        if(sent == count && write_complete_callback_)
+        {
+            GetLoop()->QueueTaskInThisLoop(bind(write_complete_callback_, shared_from_this()));
+        }
+    }
+    if(sent < count)
+    {
+        output_chain_.AppendFile(file, offset + static_cast<off_t>(sent), count - sent);
+        ScheduleOutput();
+    }
+}
+
+void TcpConnection::Shutdown()
+{
+    if(state_ == State::kConnected)
+    {
+        state_ = State::kDisconnecting;
+        RunInOwnerLoop(bind(&TcpConnection::ShutdownInLoop, shared_from_this()));
+    }
+}
+
+void TcpConnection::ShutdownInLoop()
+{
+    GetLoop()->AssertInLoopTread();
+    // 还有数据没有写完时等HandleWrite(或写合并的刷新)写完后再关闭, TLS握手还没有完成时等握手完成后再关闭
+    if(!channel_->IsWriting() && PendingOutputBytes() == 0 && !TlsHandshaking())
+    {
+        if(tls_)
+        {
+            tls_->Shutdown();
+        }
+        socket_.ShutdownWrite();
+    }
+}
+
+void TcpConnection::ForceClose()
+{
+    if(state_ == State::kConnected || state_ == State::kDisconnecting)
+    {
+        state_ = State::kDisconnecting;
+        QueueInOwnerLoop(bind(&TcpConnection::ForceCloseInLoop, shared_from_this()));
+    }
+}
+
+SocketFd TcpConnection::DetachForHandover()
+{
+    GetLoop()->AssertInLoopTread();
+    // TLS连接的会话状态无法交给新进程
+    if(state_ != State::kConnected || PendingOutputBytes() > 0 || tls_)
+    {
+        return SocketFd::invalid;
+    }
+    int fd = ::fcntl(static_cast<int>(socket_.Fd()), F_DUPFD_CLOEXEC, 0);
+    if(fd == -1)
+    {
+        return SocketFd::invalid;
+    }
+    // 副本仍然引用同一个socket, 之后socket_析构时的close不会断开连接
+    HandleClose();
+    return static_cast<SocketFd>(fd);
+}
+
+void TcpConnection::ForceCloseInLoop()
+{
+    GetLoop()->AssertInLoopTread();
+    if(state_ == State::kConnected || state_ == State::kDisconnecting)
+    {
+        HandleClose();
+    }
+}
+
+bool TcpConnection::InOwnerThread() const
+{
+    return GetLoop()->IsInLoopThread() && !migrating_;
+}
+
+void TcpConnection::RunInOwnerLoop(function<void()> task)
+{
+    if(InOwnerThread())
+    {
+        task();
+    }
+    else
+    {
+        QueueInOwnerLoop(std::move(task));
+    }
+}
+
+void TcpConnection::QueueInOwnerLoop(function<void()> task)
+{
+    EventLoop* loop = nullptr;
+    {
+        lock_guard<mutex> lg(TaskMutex());
+        queued_tasks_.push_back(std::move(task));
+        // 迁移途中由AttachToLoop执行
+        if(task_drain_scheduled_ || migrating_)
+        {
+            return;
+        }
+        task_drain_scheduled_ = true;
+        loop = GetLoop();
+    }
+    loop->QueueTaskInThisLoop(bind(&TcpConnection::RunQueuedTasks, shared_from_this()));
+}
+
+mutex& TcpConnection::TaskMutex() const
+{
+    static mutex locks[K_TASK_LOCKS];
+    // 连接对象按LoopMemory的size class对齐, 低位没有区分度
+    return locks[(reinterpret_cast<uintptr_t>(this) / LoopMemory::kSizeClassBytes) % K_TASK_LOCKS];
+}
+
+void TcpConnection::RunQueuedTasks()
+{
+    vector<function<void()>> tasks;
+    {
+        lock_guard<mutex> lg(TaskMutex());
+        if(!InOwnerThread())
+        {
+            // 任务排队期间连接迁移走了: 已经Attach时转交给新的IO线程, 还在迁移途中时由AttachToLoop执行
+            if(!migrating_ && !queued_tasks_.empty())
+            {
+                GetLoop()->QueueTaskInThisLoop(bind(&TcpConnection::RunQueuedTasks, shared_from_this()));
+            }
+            else
+            {
+                task_drain_scheduled_ = false;
+            }
+            return;
+        }
+        tasks.swap(queued_tasks_);
+        task_drain_scheduled_ = false;
+    }
+    for(auto& task : tasks)
+    {
+        task();
+    }
+}
+
+bool TcpConnection::DetachFromLoop(EventLoop* target)
+{
+    GetLoop()->AssertInLoopTread();
+    if(state_ != State::kConnected || TlsHandshaking() || read_deferred_ || write_deferred_ || flush_scheduled_ || pacing_wait_)
+    {
+        return false;
+    }
+    channel_->DisableAll();
+    channel_->Remove();
+    if(table_)
+    {
+        table_->Detach(handle_);
+    }
+    lock_guard<mutex> lg(TaskMutex());
+    migrating_ = true;
+    loop_.store(target, memory_order_release);
+    return true;
+}
+
+void TcpConnection::AttachToLoop()
+{
+    EventLoop* loop = GetLoop();
+    loop->AssertInLoopTread();
+    assert(migrating_);
+    // 原来的Channel已经从原IO线程的Poller中注销, 新的Channel从target的LoopMemory中分配
+    const int fd = channel_->Fd();
+    channel_ = Channel::Create(loop, fd);
+    SetChannelCallbacks();
+    channel_->Tie(shared_from_this());
+    channel_->SetEdgeTriggered(edge_triggered_);
+    input_buffer_.Rebind(loop->MemoryForThisThread());
+    output_buffer_.Rebind(loop->MemoryForThisThread());
+    // 注册时内核报告当前的就绪状态, 迁移途中到达的数据不会丢失通知
+    channel_->EnableReading();
+    if(PendingOutputBytes() > 0)
+    {
+        channel_->EnableWriting();
+    }
+    if(table_)
+    {
+        table_->Attach(handle_, loop);
+    }
+    if(buffer_release_idle_ms_ > 0)
+    {
+        release_check_scheduled_ = false;
+        MarkActive();
+    }
+    vector<function<void()>> tasks;
+    {
+        lock_guard<mutex> lg(TaskMutex());
+        migrating_ = false;
+        tasks.swap(queued_tasks_);
+        task_drain_scheduled_ = false;
+    }
+    for(auto& task : tasks)
+    {
+        task();
+    }
+}
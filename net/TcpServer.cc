@@ -0,0 +1,460 @@
+#include "include/TcpServer.h"
+#include "include/Acceptor.h"
+#include "include/ConnectionTable.h"
+#include "include/EventLoop.h"
+#include "include/EventLoopThread.h"
+#include "include/EventLoopThreadPool.h"
+#include "include/LoopMemory.h"
+#include "include/TcpConnection.h"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace Cloo;
+using namespace std;
+using namespace std::placeholders;
+
+namespace
+{
+
+// 检查正在退役的IO线程的间隔
+constexpr long K_RETIRE_CHECK_MS = 10;
+
+}
+
+TcpServer::TcpServer(const shared_ptr<EventLoop>& loop, const SocketAddress& listen_addr, const string& name)
+    : TcpServer(loop, make_unique<Acceptor>(loop, listen_addr), name)
+{
+}
+
+TcpServer::TcpServer(const shared_ptr<EventLoop>& loop, SocketFd listen_fd, const string& name)
+    : TcpServer(loop, make_unique<Acceptor>(loop, listen_fd), name)
+{
+}
+
+TcpServer::TcpServer(const shared_ptr<EventLoop>& loop, unique_ptr<Acceptor> acceptor, const string& name)
+    : loop_(loop),
+      name_(name),
+      acceptor_(std::move(acceptor)),
+      thread_pool_(make_unique<EventLoopThreadPool>(loop)),
+      num_threads_(0),
+      route_by_incoming_cpu_(false),
+      edge_triggered_(false),
+      buffer_release_idle_ms_(0),
+      started_(false),
+      next_conn_id_(1),
+      connection_table_(make_shared<ConnectionTable>()),
+      max_connections_per_loop_(0),
+      retire_check_scheduled_(false),
+      auto_scale_enabled_(false),
+      above_intervals_(0),
+      below_intervals_(0),
+      alive_(make_shared<bool>(true))
+{
+    acceptor_->SetNewConnectionCallback(bind(&TcpServer::NewConnection, this, _1, _2));
+    acceptor_->SetCapacityCallback(bind(&TcpServer::HasLoopCapacity, this));
+    // 在连接所属的IO线程中执行, 不访问this
+    weak_ptr<bool> alive = alive_;
+    close_callback_ = make_shared<const define::CloseCallback>([this, alive, base = loop_](const define::TcpConnectionPtr& conn)
+    {
+        // TcpServer已经析构时, 它的析构函数(已登记的连接)或EstablishConnection的登记任务(未登记的连接)负责ConnectDestroyed
+        base->RunTaskInThisLoop([this, alive, conn]
+        {
+            if(alive.lock())
+            {
+                RemoveConnectionInLoop(conn);
+            }
+        });
+    });
+}
+
+void TcpServer::SetAdmission(const AdmissionOptions& options)
+{
+    acceptor_->SetAdmissionOptions(options);
+}
+
+bool TcpServer::HasLoopCapacity()
+{
+    if(max_connections_per_loop_ == 0)
+    {
+        return true;
+    }
+    const auto& loops = thread_pool_->Loops();
+    if(loops.empty())
+    {
+        return loop_connections_[loop_.get()] < max_connections_per_loop_;
+    }
+    return any_of(loops.begin(), loops.end(), [this](const shared_ptr<EventLoop>& loop)
+    {
+        return loop_connections_[loop.get()] < max_connections_per_loop_;
+    });
+}
+
+EventLoop* TcpServer::PickLoopWithCapacity(EventLoop* preferred)
+{
+    if(max_connections_per_loop_ == 0 || loop_connections_[preferred] < max_connections_per_loop_)
+    {
+        return preferred;
+    }
+    EventLoop* least = nullptr;
+    for(const auto& loop : thread_pool_->Loops())
+    {
+        if(least == nullptr || loop_connections_[loop.get()] < loop_connections_[least])
+        {
+            least = loop.get();
+        }
+    }
+    return (least != nullptr && loop_connections_[least] < max_connections_per_loop_) ? least : nullptr;
+}
+
+TcpServer::~TcpServer()
+{
+    loop_->AssertInLoopTread();
+    for(auto& item : connections_)
+    {
+        define::TcpConnectionPtr conn(item.second);
+        item.second.reset();
+        conn->GetLoop()->RunTaskInThisLoop(bind(&TcpConnection::ConnectDestroyed, conn));
+    }
+}
+
+void TcpServer::SetThreadNum(int num_threads, const vector<ThreadPlacement>& placements)
+{
+    assert(num_threads >= 0);
+    num_threads_ = num_threads;
+    placements_ = placements;
+}
+
+void TcpServer::Start()
+{
+    loop_->AssertInLoopTread();
+    if(started_)
+    {
+        return;
+    }
+    started_ = true;
+    thread_pool_->Start(num_threads_, placements_);
+    acceptor_->Listen();
+}
+
+void TcpServer::NewConnection(SocketFd fd, const SocketAddress& peer_addr)
+{
+    loop_->AssertInLoopTread();
+    auto preferred = route_by_incoming_cpu_ ? thread_pool_->GetLoopForSocket(fd) : thread_pool_->GetNextLoop();
+    EventLoop* io_loop = PickLoopWithCapacity(preferred.get());
+    if(io_loop == nullptr)
+    {
+        // Acceptor在accept之前已经检查过HasLoopCapacity, 只有回调之间容量发生变化时才会走到这里
+        ::close(static_cast<int>(fd));
+        acceptor_->ConnectionClosed();
+        return;
+    }
+    EstablishConnection(io_loop, fd, peer_addr);
+}
+
+void TcpServer::AdoptConnection(SocketFd fd)
+{
+    loop_->AssertInLoopTread();
+    sockaddr_in peer {};
+    socklen_t len = sizeof peer;
+    ::getpeername(static_cast<int>(fd), reinterpret_cast<sockaddr*>(&peer), &len);
+    // 交接过来的fd可能没有O_NONBLOCK(取决于旧进程), 与accept4得到的连接保持一致
+    ::fcntl(static_cast<int>(fd), F_SETFL, ::fcntl(static_cast<int>(fd), F_GETFL, 0) | O_NONBLOCK);
+    acceptor_->ConnectionAdopted();
+    EstablishConnection(thread_pool_->GetNextLoop().get(), fd, SocketAddress(peer));
+}
+
+void TcpServer::EstablishConnection(EventLoop* io_loop, SocketFd fd, const SocketAddress& peer_addr)
+{
+    ++loop_connections_[io_loop];
+    string conn_name = name_ + "#" + to_string(next_conn_id_++);
+    sockaddr_in peer = peer_addr.ToSockAddrIn();
+    // 连接在它所属的IO线程中构造, 这样连接对象、它的Channel与缓冲区都从该EventLoop的LoopMemory中分配,
+    // 不再由acceptor线程分配、IO线程释放. 构造完成后再回到本线程把连接登记到connections_中:
+    // 这个任务先于连接关闭时的RemoveConnectionInLoop投递到同一个队列, 因此登记总是早于移除
+    // IO线程中的任务不访问this: 连接的选项按值复制进来, 回到本线程后再检查TcpServer是否还存在
+    weak_ptr<bool> alive = alive_;
+    io_loop->RunTaskInThisLoop([this, alive, base = loop_, io_loop, conn_name, fd, peer,
+                                edge_triggered = edge_triggered_, buffer_release_idle_ms = buffer_release_idle_ms_,
+                                tls_context = tls_context_, connection_callback = connection_callback_,
+                                message_callback = message_callback_, write_complete_callback = write_complete_callback_,
+                                connection_table = connection_table_, close_callback = close_callback_]
+    {
+        if(alive.expired())
+        {
+            ::close(static_cast<int>(fd));
+            return;
+        }
+        auto conn = allocate_shared<TcpConnection>(LoopAllocator<TcpConnection>(io_loop->MemoryForThisThread()),
+                                                   io_loop, conn_name, fd, SocketAddress(peer));
+        conn->SetEdgeTriggered(edge_triggered);
+        conn->SetBufferReleaseIdle(buffer_release_idle_ms);
+        if(tls_context)
+        {
+            conn->StartTls(tls_context);
+        }
+        conn->SetConnectionCallback(connection_callback);
+        conn->SetMessageCallback(message_callback);
+        conn->SetWriteCompleteCallback(write_complete_callback);
+        conn->SetCloseCallback(close_callback);
+        conn->SetConnectionTable(connection_table);
+        base->RunTaskInThisLoop([this, alive, conn]
+        {
+            if(alive.lock())
+            {
+                connections_[conn.get()] = conn;
+            }
+            else
+            {
+                conn->GetLoop()->QueueTaskInThisLoop(bind(&TcpConnection::ConnectDestroyed, conn));
+            }
+        });
+        conn->ConnectEstablished();
+    });
+}
+
+void TcpServer::RemoveConnectionInLoop(const define::TcpConnectionPtr& conn)
+{
+    loop_->AssertInLoopTread();
+    connections_.erase(conn.get());
+    --loop_connections_[conn->GetLoop()];
+    acceptor_->ConnectionClosed();
+    // ConnectDestroyed需要在连接所属的IO线程中执行, 并且要晚于当前正在处理的事件,
+    // 因此使用QueueTaskInThisLoop而不是RunTaskInThisLoop
+    conn->GetLoop()->QueueTaskInThisLoop(bind(&TcpConnection::ConnectDestroyed, conn));
+}
+
+shared_ptr<EventLoop> TcpServer::AddIoLoop()
+{
+    loop_->AssertInLoopTread();
+    assert(started_);
+    const size_t index = thread_pool_->Loops().size();
+    auto loop = thread_pool_->AddLoop(placements_.empty() ? ThreadPlacement() : placements_[index % placements_.size()]);
+    ++resize_stats_.loops_added;
+    return loop;
+}
+
+bool TcpServer::RetireIoLoop(EventLoop* loop, bool migrate)
+{
+    loop_->AssertInLoopTread();
+    if(thread_pool_->Loops().size() <= 1 || !thread_pool_->Contains(loop))
+    {
+        return false;
+    }
+    retiring_[loop] = RetiringLoop{thread_pool_->DetachLoop(loop), migrate, false};
+    CheckRetiringLoops();
+    return true;
+}
+
+void TcpServer::CheckRetiringLoops()
+{
+    loop_->AssertInLoopTread();
+    for(auto& [loop, retiring] : retiring_)
+    {
+        if(retiring.draining)
+        {
+            continue;
+        }
+        if(loop_connections_[loop] == 0)
+        {
+            // 连接的ConnectDestroyed已经投递到loop的任务队列中, 绕loop一圈再让线程退出, 保证它们先执行.
+            // 线程对象在本线程中析构(Quit并join), 不能在IO线程自己中析构
+            retiring.draining = true;
+            loop_connections_.erase(loop);
+            weak_ptr<bool> alive = alive_;
+            loop->QueueTaskInThisLoop([this, alive, base = loop_, loop = loop]
+            {
+                base->QueueTaskInThisLoop([this, alive, loop]
+                {
+                    if(alive.lock())
+                    {
+                        retiring_.erase(loop);
+                        ++resize_stats_.loops_retired;
+                    }
+                });
+            });
+        }
+        else if(retiring.migrate)
+        {
+            for(const auto& item : connections_)
+            {
+                if(item.second->GetLoop() != loop)
+                {
+                    continue;
+                }
+                EventLoop* target = PickLoopWithCapacity(thread_pool_->GetNextLoop().get());
+                if(target != nullptr)
+                {
+                    MigrateConnection(item.second, target);
+                }
+            }
+        }
+    }
+    // 有推迟的工作或者在等待限速令牌的连接暂时不能迁移, 不迁移时则要等连接关闭
+    const bool pending = any_of(retiring_.begin(), retiring_.end(), [](const auto& item) { return !item.second.draining; });
+    if(pending && !retire_check_scheduled_)
+    {
+        retire_check_scheduled_ = true;
+        weak_ptr<bool> alive = alive_;
+        loop_->RunAfter(K_RETIRE_CHECK_MS, [this, alive]
+        {
+            if(alive.lock())
+            {
+                retire_check_scheduled_ = false;
+                CheckRetiringLoops();
+            }
+        });
+    }
+}
+
+void TcpServer::MigrateConnection(const define::TcpConnectionPtr& conn, EventLoop* target)
+{
+    loop_->AssertInLoopTread();
+    EventLoop* source = conn->GetLoop();
+    if(source == target || !thread_pool_->Contains(target))
+    {
+        return;
+    }
+    // 迁移途中连接已经计入target, target在连接到达之前不会因为没有连接而退役
+    ++loop_connections_[target];
+    weak_ptr<bool> alive = alive_;
+    source->RunTaskInThisLoop([this, alive, base = loop_, conn, source, target]
+    {
+        // 同一条连接的上一次迁移已经把它带走时不再处理
+        const bool detached = conn->GetLoop() == source && conn->DetachFromLoop(target);
+        if(detached)
+        {
+            target->QueueTaskInThisLoop(bind(&TcpConnection::AttachToLoop, conn));
+        }
+        base->QueueTaskInThisLoop([this, alive, source, target, detached]
+        {
+            if(alive.lock())
+            {
+                --loop_connections_[detached ? source : target];
+                if(detached)
+                {
+                    ++resize_stats_.migrations;
+                }
+            }
+        });
+    });
+}
+
+size_t TcpServer::RebalanceConnections()
+{
+    loop_->AssertInLoopTread();
+    const auto& loops = thread_pool_->Loops();
+    if(loops.size() < 2)
+    {
+        return 0;
+    }
+    map<EventLoop*, vector<define::TcpConnectionPtr>> by_loop;
+    for(const auto& loop : loops)
+    {
+        by_loop[loop.get()];
+    }
+    for(const auto& item : connections_)
+    {
+        auto iter = by_loop.find(item.second->GetLoop());
+        if(iter != by_loop.end())
+        {
+            iter->second.push_back(item.second);
+        }
+    }
+    size_t migrated = 0;
+    while(true)
+    {
+        auto [least, most] = minmax_element(by_loop.begin(), by_loop.end(), [](const auto& lhs, const auto& rhs)
+        {
+            return lhs.second.size() < rhs.second.size();
+        });
+        if(most->second.size() <= least->second.size() + 1)
+        {
+            break;
+        }
+        define::TcpConnectionPtr conn = std::move(most->second.back());
+        most->second.pop_back();
+        MigrateConnection(conn, least->first);
+        least->second.push_back(std::move(conn));
+        ++migrated;
+    }
+    return migrated;
+}
+
+void TcpServer::SetAutoScale(const AutoScaleOptions& options)
+{
+    loop_->AssertInLoopTread();
+    assert(started_);
+    auto_scale_ = options;
+    above_intervals_ = 0;
+    below_intervals_ = 0;
+    if(!auto_scale_enabled_)
+    {
+        auto_scale_enabled_ = true;
+        // 以现在为第一次采样的起点
+        thread_pool_->SampleUtilization();
+        ScheduleAutoScaleTick();
+    }
+}
+
+void TcpServer::ScheduleAutoScaleTick()
+{
+    // 每次采样后重新安排下一次, TcpServer析构后不再继续
+    weak_ptr<bool> alive = alive_;
+    loop_->RunAfter(auto_scale_.interval_ms, [this, alive]
+    {
+        if(alive.lock())
+        {
+            AutoScaleTick();
+            ScheduleAutoScaleTick();
+        }
+    });
+}
+
+void TcpServer::AutoScaleTick()
+{
+    vector<double> utilization = thread_pool_->SampleUtilization();
+    if(utilization.empty())
+    {
+        return;
+    }
+    const double mean = accumulate(utilization.begin(), utilization.end(), 0.0) / static_cast<double>(utilization.size());
+    const size_t loops = utilization.size();
+    if(mean > auto_scale_.scale_up_utilization && loops < auto_scale_.max_loops)
+    {
+        below_intervals_ = 0;
+        if(++above_intervals_ >= auto_scale_.sustain_intervals)
+        {
+            above_intervals_ = 0;
+            AddIoLoop();
+        }
+    }
+    else if(mean < auto_scale_.scale_down_utilization && loops > auto_scale_.min_loops)
+    {
+        above_intervals_ = 0;
+        if(++below_intervals_ >= auto_scale_.sustain_intervals)
+        {
+            below_intervals_ = 0;
+            const auto& pool_loops = thread_pool_->Loops();
+            auto idlest = min_element(pool_loops.begin(), pool_loops.end(), [this](const auto& lhs, const auto& rhs)
+            {
+                return loop_connections_[lhs.get()] < loop_connections_[rhs.get()];
+            });
+            RetireIoLoop(idlest->get());
+        }
+    }
+    else
+    {
+        above_intervals_ = 0;
+        below_intervals_ = 0;
+    }
+}
@@ -0,0 +1,150 @@
+#include "include/ThreadPlacement.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <string>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+
+namespace Cloo::detail 
+{
+
+// 解析形如"0-3,8-11,16"的cpulist格式
+std::vector<int> ParseCpuList(const std::string& list)
+{
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while(std::getline(ss, range, ','))
+    {
+        if(range.empty() || range == "\n")
+        {
+            continue;
+        }
+        auto dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for(int cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+}
+
+using namespace Cloo;
+using namespace std;
+
+namespace
+{
+
+// 内核支持的NUMA节点数的上限(CONFIG_NODES_SHIFT最大为10)
+constexpr int K_MAX_NUMA_NODES = 1024;
+
+}
+
+ThreadPlacement ThreadPlacement::OnCpu(int cpu)
+{
+    return OnCpus({cpu});
+}
+
+ThreadPlacement ThreadPlacement::OnCpus(const vector<int>& cpus)
+{
+    ThreadPlacement placement;
+    placement.cpus_ = cpus;
+    return placement;
+}
+
+ThreadPlacement ThreadPlacement::OnNumaNode(int node)
+{
+    ThreadPlacement placement;
+    placement.numa_node_ = node;
+    return placement;
+}
+
+vector<int> ThreadPlacement::CpusOfNumaNode(int node)
+{
+    ifstream in("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+    string list;
+    if(!in || !getline(in, list))
+    {
+        cerr << "ThreadPlacement: NUMA node " << node << " does not exist" << endl;
+        return {};
+    }
+    return detail::ParseCpuList(list);
+}
+
+vector<int> ThreadPlacement::ResolveCpus() const
+{
+    vector<int> cpus = cpus_;
+    if(numa_node_ >= 0)
+    {
+        auto node_cpus = CpusOfNumaNode(numa_node_);
+        cpus.insert(cpus.end(), node_cpus.begin(), node_cpus.end());
+    }
+    sort(cpus.begin(), cpus.end());
+    cpus.erase(unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+bool ThreadPlacement::ApplyToThisThread() const
+{
+    if(Empty())
+    {
+        return true;
+    }
+    bool ok = true;
+    auto cpus = ResolveCpus();
+    if(!cpus.empty())
+    {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        int valid = 0;
+        for(int cpu : cpus)
+        {
+            // CPU_SET对超出cpu_set_t范围的CPU是未定义行为
+            if(cpu < 0 || cpu >= CPU_SETSIZE)
+            {
+                cerr << "ThreadPlacement: CPU " << cpu << " is out of range [0, " << CPU_SETSIZE << ")" << endl;
+                ok = false;
+                continue;
+            }
+            CPU_SET(cpu, &cpu_set);
+            ++valid;
+        }
+        int ret = valid > 0 ? ::pthread_setaffinity_np(::pthread_self(), sizeof cpu_set, &cpu_set) : 0;
+        if(ret != 0)
+        {
+            cerr << "ThreadPlacement: pthread_setaffinity_np failed: " << ::strerror(ret) << endl;
+            ok = false;
+        }
+    }
+    // 优先从本地NUMA节点分配内存, 本地内存不足时内核仍然可以回退到其他节点
+    if(numa_node_ >= K_MAX_NUMA_NODES)
+    {
+        cerr << "ThreadPlacement: NUMA node " << numa_node_ << " is out of range [0, " << K_MAX_NUMA_NODES << ")" << endl;
+        ok = false;
+    }
+    else if(numa_node_ >= 0)
+    {
+        // 节点号可能超过一个unsigned long的位数, 按需要的长度构造位图
+        constexpr int K_BITS = sizeof(unsigned long) * 8;
+        vector<unsigned long> node_mask(numa_node_ / K_BITS + 1, 0);
+        node_mask[numa_node_ / K_BITS] = 1UL << (numa_node_ % K_BITS);
+        if(::syscall(SYS_set_mempolicy, MPOL_PREFERRED, node_mask.data(), node_mask.size() * K_BITS) != 0)
+        {
+            cerr << "ThreadPlacement: set_mempolicy failed: " << ::strerror(errno) << endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
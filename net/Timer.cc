@@ -1,20 +1,59 @@
 #include "include/Timer.h"
 #include "include/TimeDefs.h"
+#include <chrono>
 #include <iostream>
 
 using namespace Cloo;
 using namespace Cloo::define;
 using namespace std;
 
-Timer::Timer(const TimerCallback& cb, SystemTimePoint when, long interval_ms)
+namespace
+{
+
+// 不超过slack_ms的最大的2的幂
+long SlotOf(long slack_ms)
+{
+    if(slack_ms <= 0)
+    {
+        return 0;
+    }
+    long slot = 1;
+    while(slot * 2 <= slack_ms)
+    {
+        slot *= 2;
+    }
+    return slot;
+}
+
+}
+
+Timer::Timer(const TimerCallback& cb, SystemTimePoint when, long interval_ms, long slack_ms)
     : callback_(cb),
       expiration_(when),
       interval_ms_(interval_ms),
+      slot_ms_(SlotOf(slack_ms)),
       repeat_(interval_ms_ > 0)
 {
 
 }
 
+SystemTimePoint Timer::FireTime() const
+{
+    if(slot_ms_ == 0)
+    {
+        return expiration_;
+    }
+    // 向上对齐到slot_ms_的整数倍, 结果落在[expiration_, expiration_ + slot_ms_)内
+    const auto slot = chrono::duration_cast<SystemTimePoint::duration>(chrono::milliseconds(slot_ms_));
+    auto since_epoch = expiration_.time_since_epoch();
+    auto remainder = since_epoch % slot;
+    if(remainder == SystemTimePoint::duration::zero())
+    {
+        return expiration_;
+    }
+    return expiration_ + (slot - remainder);
+}
+
 Timer::~Timer()
 {
 
@@ -4,6 +4,7 @@
 #include "include/TimerId.h"
 #include "include/Timer.h"
 #include "include/Channel.h"
+#include "include/Tracer.h"
 
 #include <algorithm>
 #include <cstdlib>
@@ -50,17 +51,21 @@ int CreateTimerFd()
 timespec HowMuchTimeFromNow(Cloo::define::SystemTimePoint when)
 {
     auto duration = when - std::chrono::system_clock::now();
+    // it_value全为0会关闭timerfd, 已经到期的时间点至少推迟100us, 保证timerfd一定会触发
+    if(duration < std::chrono::microseconds(100))
+    {
+        duration = std::chrono::microseconds(100);
+    }
     timespec ts {0} ;
     ts.tv_sec = std::chrono::duration_cast<std::chrono::seconds>(duration).count();
     ts.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()%1000000000;
     return ts;
 }
 
-void ReadTimerFd(int timerfd, Cloo::define::SystemTimePoint now)
+void ReadTimerFd(int timerfd)
 {
     uint64_t howmany;
     ssize_t n = ::read(timerfd, &howmany, sizeof howmany);
-    std::cout << "TimerQueue read " << howmany << " at " << SytemTimePointToStr(now) << std::endl;
     if(n != sizeof howmany)
     {
         std::cerr << "TimerQueue reads " << n <<" bytes instead of " << sizeof howmany << std::endl;
@@ -70,7 +75,6 @@ void ReadTimerFd(int timerfd, Cloo::define::SystemTimePoint now)
 void ResetTimerFd(int timerfd, std::chrono::time_point<std::chrono::system_clock> expiration)
 {
     itimerspec new_value{0}, old_value{0};
-    auto time_from_now = expiration - std::chrono::system_clock::now();
     new_value.it_value = HowMuchTimeFromNow(expiration);
     int ret = ::timerfd_settime(timerfd, 0, &new_value, &old_value);
     if(ret != 0)
@@ -86,10 +90,12 @@ using namespace Cloo::detail;
 using namespace std;
 
 TimerQueue::TimerQueue(const shared_ptr<EventLoop>& loop)
-    : owner_loop_(loop),
+    : owner_loop_(loop.get()),
       timer_fd_(CreateTimerFd()),
       timer_fd_channel_(Channel::Create(loop, timer_fd_)),
-      timers_(EntryComp) /*自定义的比较函数*/
+      timers_(EntryComp), /*自定义的比较函数*/
+      armed_expiration_(define::SystemTimePoint::max()),
+      timer_fd_enabled_(true)
 {
     // 注册timerfd到期事件的回调
     timer_fd_channel_->SetReadCallBack(bind(&TimerQueue::HandleRead, this));
@@ -99,29 +105,35 @@ TimerQueue::TimerQueue(const shared_ptr<EventLoop>& loop)
 
 TimerQueue::~TimerQueue()
 {
+    // TimerQueue只会随EventLoop一起析构(可能发生在IO线程已经退出之后),
+    // 此时Poller也即将被销毁, 因此不再把timer_fd_channel_从Poller中注销
     ::close(timer_fd_);
 }
 
-TimerId TimerQueue::AddTimer(const define::TimerCallback &cb, define::SystemTimePoint when, long interval_ms)
+TimerId TimerQueue::AddTimer(const define::TimerCallback &cb, define::SystemTimePoint when, long interval_ms, long slack_ms)
 {
-    auto timer = make_shared<Timer>(cb, when, interval_ms);
-    if(auto loop = owner_loop_.lock())
-    {
-        loop->RunTaskInThisLoop(bind(&TimerQueue::AddTimerInLoop,this,timer));
-    }
+    auto timer = make_shared<Timer>(cb, when, interval_ms, slack_ms);
+    owner_loop_->RunTaskInThisLoop(bind(&TimerQueue::AddTimerInLoop,this,timer));
     return TimerId(timer);
 }
 
 void TimerQueue::AddTimerInLoop(const shared_ptr<Timer>& timer)
 {
-    if(auto loop = owner_loop_.lock())
-    {
-        loop->AssertInLoopTread();
-    }
+    owner_loop_->AssertInLoopTread();
     bool is_earlist = Insert(timer);
     if(is_earlist)
     {
-        ResetTimerFd(timer_fd_, timer->Expiration());
+        ArmTimerFd(timer->FireTime());
+    }
+}
+
+void TimerQueue::ArmTimerFd(define::SystemTimePoint when)
+{
+    if(timer_fd_enabled_ && when < armed_expiration_)
+    {
+        ResetTimerFd(timer_fd_, when);
+        armed_expiration_ = when;
+        ++stats_.rearms;
     }
 }
 
@@ -132,21 +144,79 @@ void TimerQueue::Cancel(const TimerId& timer_id)
 
 void TimerQueue::HandleRead()
 {   
-    auto loop = owner_loop_.lock(); 
-    if(!loop)
+    owner_loop_->AssertInLoopTread();
+    // 将timerfd的内容读出, 避免 "level-trigger" IO多路复用组件持续触发“可读”条件
+    define::SystemTimePoint now = owner_loop_->Now();
+    ReadTimerFd(timer_fd_);
+    // timerfd到期后不再处于设置状态
+    armed_expiration_ = define::SystemTimePoint::max();
+    ++stats_.wakeups;
+    RunExpiredTimers(now);
+}
+
+void TimerQueue::SetTimerFdEnabled(bool on)
+{
+    owner_loop_->AssertInLoopTread();
+    if(on == timer_fd_enabled_)
     {
-        cerr << "TimerQueue owner_loop does not exisit" << endl;
-        abort();
+        return;
     }
-    loop->AssertInLoopTread();
-    // 将timerfd的内容读出, 避免 "level-trigger" IO多路复用组件持续触发“可读”条件
-    define::SystemTimePoint now = std::chrono::system_clock::now();
-    ReadTimerFd(timer_fd_, now);
+    timer_fd_enabled_ = on;
+    if(on)
+    {
+        if(!timers_.empty())
+        {
+            ArmTimerFd(timers_.begin()->first);
+        }
+    }
+    else if(armed_expiration_ != define::SystemTimePoint::max())
+    {
+        // 关闭已经设置的timerfd
+        itimerspec disarm{};
+        ::timerfd_settime(timer_fd_, 0, &disarm, nullptr);
+        armed_expiration_ = define::SystemTimePoint::max();
+    }
+}
+
+int TimerQueue::NextPollTimeoutMs(int max_timeout_ms) const
+{
+    if(timers_.empty())
+    {
+        return max_timeout_ms;
+    }
+    auto remaining = timers_.begin()->first - owner_loop_->Now();
+    if(remaining <= define::SystemTimePoint::duration::zero())
+    {
+        return 0;
+    }
+    // 向上取整, 避免在到期前提前醒来后再空转一轮
+    auto ms = std::chrono::ceil<std::chrono::milliseconds>(remaining).count();
+    return static_cast<int>(std::min<long long>(ms, max_timeout_ms));
+}
+
+void TimerQueue::HandleExpiredTimers(define::SystemTimePoint now)
+{
+    owner_loop_->AssertInLoopTread();
+    if(timers_.empty() || timers_.begin()->first > now)
+    {
+        return;
+    }
+    ++stats_.wakeups;
+    RunExpiredTimers(now);
+}
+
+void TimerQueue::RunExpiredTimers(define::SystemTimePoint now)
+{
     // 从TimerList中找到目前为止所有的到期timer, 过期的timer的所有权从timers_转移到vector<Entry>中
     vector<Entry> expired_vec = GetExpiration(now);
 
     // 触发所有定时回调
-    for_each(expired_vec.begin(), expired_vec.end(), [](const Entry& item){ item.second->Run(); });
+    for_each(expired_vec.begin(), expired_vec.end(), [](const Entry& item)
+    {
+        TraceSpan timer_span(TraceKind::kTimer);
+        item.second->Run();
+    });
+    stats_.fired += expired_vec.size();
     
     Reset(expired_vec, now);
     
@@ -159,7 +229,8 @@ vector<TimerQueue::Entry> TimerQueue::GetExpiration(define::SystemTimePoint now)
     // shared_ptr会去释放UINTPTR_MAX指向的地址, 导致非法访问
     // Entry sentry = make_pair(now, shared_ptr<Timer>(reinterpret_cast<Timer*>(UINTPTR_MAX)));
     // auto last_iter = timers_.lower_bound(sentry);
-    decltype(timers_.begin()) last_iter;
+    // 所有timer都已到期时last_iter应当指向end()
+    auto last_iter = timers_.end();
     for(auto iter = timers_.begin(); iter != timers_.end(); iter++)
     {
         if(iter->first > now)
@@ -191,18 +262,16 @@ void TimerQueue::Reset(vector<Entry>& expired_vec, define::SystemTimePoint now)
         });
     if(!timers_.empty())
     {
-        auto next_expire = timers_.begin()->second->Expiration();
-        if(next_expire > std::chrono::system_clock::now())
-        {
-            ResetTimerFd(timer_fd_, next_expire);
-        }
+        // 回调中新加入的定时器可能已经设置过timerfd, ArmTimerFd只会把它提前
+        ArmTimerFd(timers_.begin()->first);
     }
 }
 
 bool TimerQueue::Insert( const shared_ptr<Timer>& timer)
 {
     bool earliest_expired = false;
-    define::SystemTimePoint when = timer->Expiration();
+    // 按对齐后的触发时间排序, 相同时间槽中的定时器由同一次唤醒触发
+    define::SystemTimePoint when = timer->FireTime();
     
     if(auto iter = timers_.begin(); iter == timers_.end() || when < iter->first)
     {
@@ -0,0 +1,329 @@
+#include "include/TlsContext.h"
+#include "include/Buffer.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#ifdef CLOO_WITH_OPENSSL
+
+#include <algorithm>
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <unistd.h>
+
+using namespace Cloo;
+using namespace std;
+
+namespace
+{
+
+// 单个TLS记录的最大明文长度
+constexpr size_t K_MAX_RECORD = 16 * 1024;
+
+string TakeOpenSslError()
+{
+    char message[256] = "unknown error";
+    unsigned long code = ::ERR_get_error();
+    if(code != 0)
+    {
+        ::ERR_error_string_n(code, message, sizeof message);
+    }
+    ::ERR_clear_error();
+    return message;
+}
+
+SSL_CTX* NewContext(const SSL_METHOD* method)
+{
+    SSL_CTX* ctx = ::SSL_CTX_new(method);
+    if(ctx == nullptr)
+    {
+        throw runtime_error("SSL_CTX_new failed: " + TakeOpenSslError());
+    }
+    ::SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    // 对端不发送close_notify直接关闭时按正常的EOF处理
+    ::SSL_CTX_set_options(ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+    // 与write的语义一致: 允许部分写入; 重试时数据所在的地址可以变化(输出缓冲区可能被挪动或扩容)
+    // 空闲连接不保留读写记录的缓冲区
+    ::SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+    return ctx;
+}
+
+}
+
+TlsContext::TlsContext(SSL_CTX* ctx, bool server)
+    : ctx_(ctx),
+      server_(server),
+      kernel_tls_(true)
+{
+}
+
+TlsContext::~TlsContext()
+{
+    ::SSL_CTX_free(ctx_);
+}
+
+shared_ptr<TlsContext> TlsContext::CreateServer(const string& cert_file, const string& key_file)
+{
+    SSL_CTX* ctx = NewContext(::TLS_server_method());
+    if(::SSL_CTX_use_certificate_chain_file(ctx, cert_file.c_str()) != 1
+       || ::SSL_CTX_use_PrivateKey_file(ctx, key_file.c_str(), SSL_FILETYPE_PEM) != 1
+       || ::SSL_CTX_check_private_key(ctx) != 1)
+    {
+        ::SSL_CTX_free(ctx);
+        throw runtime_error("Failed to load " + cert_file + " / " + key_file + ": " + TakeOpenSslError());
+    }
+    return shared_ptr<TlsContext>(new TlsContext(ctx, true));
+}
+
+shared_ptr<TlsContext> TlsContext::CreateClient(const string& ca_file)
+{
+    SSL_CTX* ctx = NewContext(::TLS_client_method());
+    if(!ca_file.empty())
+    {
+        if(::SSL_CTX_load_verify_locations(ctx, ca_file.c_str(), nullptr) != 1)
+        {
+            ::SSL_CTX_free(ctx);
+            throw runtime_error("Failed to load " + ca_file + ": " + TakeOpenSslError());
+        }
+        ::SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+    }
+    return shared_ptr<TlsContext>(new TlsContext(ctx, false));
+}
+
+void TlsContext::SetKernelTlsEnabled(bool on)
+{
+    kernel_tls_ = on;
+}
+
+TlsSession::TlsSession(const shared_ptr<TlsContext>& context, int fd)
+    : context_(context),
+      ssl_(::SSL_new(context->Native())),
+      handshake_done_(false),
+      pending_write_(0)
+{
+    if(ssl_ == nullptr)
+    {
+        throw runtime_error("SSL_new failed: " + TakeOpenSslError());
+    }
+    ::SSL_set_fd(ssl_, fd);
+    if(context->KernelTlsEnabled())
+    {
+        // 握手完成、密钥确定后OpenSSL对socket执行setsockopt(TCP_ULP, "tls")并设置TLS_TX/TLS_RX
+        ::SSL_set_options(ssl_, SSL_OP_ENABLE_KTLS);
+    }
+    if(context->IsServer())
+    {
+        ::SSL_set_accept_state(ssl_);
+    }
+    else
+    {
+        ::SSL_set_connect_state(ssl_);
+    }
+}
+
+TlsSession::~TlsSession()
+{
+    ::SSL_free(ssl_);
+}
+
+TlsSession::HandshakeResult TlsSession::Handshake()
+{
+    ::ERR_clear_error();
+    int ret = ::SSL_do_handshake(ssl_);
+    if(ret == 1)
+    {
+        handshake_done_ = true;
+        return HandshakeResult::kDone;
+    }
+    switch(::SSL_get_error(ssl_, ret))
+    {
+        case SSL_ERROR_WANT_READ:
+            return HandshakeResult::kWantRead;
+        case SSL_ERROR_WANT_WRITE:
+            return HandshakeResult::kWantWrite;
+        case SSL_ERROR_SYSCALL:
+            last_error_ = errno != 0 ? ::strerror(errno) : "connection closed during handshake";
+            ::ERR_clear_error();
+            return HandshakeResult::kError;
+        default:
+            last_error_ = TakeOpenSslError();
+            return HandshakeResult::kError;
+    }
+}
+
+bool TlsSession::KernelSend() const
+{
+#ifndef OPENSSL_NO_KTLS
+    return BIO_get_ktls_send(::SSL_get_wbio(ssl_));
+#else
+    return false;
+#endif
+}
+
+bool TlsSession::KernelRecv() const
+{
+#ifndef OPENSSL_NO_KTLS
+    return BIO_get_ktls_recv(::SSL_get_rbio(ssl_));
+#else
+    return false;
+#endif
+}
+
+string TlsSession::Version() const
+{
+    return handshake_done_ ? ::SSL_get_version(ssl_) : "";
+}
+
+string TlsSession::Cipher() const
+{
+    return handshake_done_ ? ::SSL_get_cipher_name(ssl_) : "";
+}
+
+ssize_t TlsSession::MapError(int ret)
+{
+    switch(::SSL_get_error(ssl_, ret))
+    {
+        case SSL_ERROR_WANT_READ:
+        case SSL_ERROR_WANT_WRITE:
+            // 写的时候也可能需要先读(例如TLS 1.3的KeyUpdate), 都交给下一次读写事件重试
+            errno = EAGAIN;
+            return -1;
+        case SSL_ERROR_ZERO_RETURN:
+            return 0;
+        case SSL_ERROR_SYSCALL:
+            ::ERR_clear_error();
+            if(errno == 0)
+            {
+                return 0;
+            }
+            return -1;
+        default:
+            last_error_ = TakeOpenSslError();
+            errno = EPROTO;
+            return -1;
+    }
+}
+
+ssize_t TlsSession::Read(Buffer* buf, int* saved_errno)
+{
+    buf->EnsureWritableBytes(K_MAX_RECORD);
+    ::ERR_clear_error();
+    errno = 0;
+    int ret = ::SSL_read(ssl_, buf->BeginWrite(), static_cast<int>(std::min<size_t>(buf->WritableBytes(), INT_MAX)));
+    if(ret > 0)
+    {
+        buf->HasWritten(ret);
+        return ret;
+    }
+    ssize_t n = MapError(ret);
+    if(n < 0)
+    {
+        *saved_errno = errno;
+    }
+    return n;
+}
+
+ssize_t TlsSession::Write(const void* data, size_t len)
+{
+    ::ERR_clear_error();
+    errno = 0;
+    const int requested = static_cast<int>(std::min<size_t>(len, INT_MAX));
+    int ret = ::SSL_write(ssl_, data, requested);
+    if(ret > 0)
+    {
+        pending_write_ = 0;
+        return ret;
+    }
+    ssize_t n = MapError(ret);
+    if(n < 0 && errno == EAGAIN)
+    {
+        pending_write_ = static_cast<size_t>(requested);
+    }
+    // 写方向上对端关闭按EPIPE报告
+    if(n == 0)
+    {
+        errno = EPIPE;
+        return -1;
+    }
+    return n;
+}
+
+ssize_t TlsSession::SendFile(int file_fd, off_t offset, size_t len)
+{
+    if(KernelSend())
+    {
+        ::ERR_clear_error();
+        errno = 0;
+        ossl_ssize_t ret = ::SSL_sendfile(ssl_, file_fd, offset, len, 0);
+        if(ret >= 0)
+        {
+            return ret;
+        }
+        ssize_t n = MapError(-1);
+        return n == 0 ? (errno = EPIPE, -1) : n;
+    }
+    // 用户空间加密: 每次最多一个记录. Write返回EAGAIN后会以相同的offset重试, 再次读出的是相同的内容
+    char chunk[K_MAX_RECORD];
+    ssize_t nread = ::pread(file_fd, chunk, std::min(len, sizeof chunk), offset);
+    if(nread <= 0)
+    {
+        if(nread == 0)
+        {
+            // 文件比声明的短
+            errno = EIO;
+        }
+        return -1;
+    }
+    return Write(chunk, static_cast<size_t>(nread));
+}
+
+void TlsSession::Shutdown()
+{
+    if(handshake_done_)
+    {
+        ::ERR_clear_error();
+        ::SSL_shutdown(ssl_);
+        ::ERR_clear_error();
+    }
+}
+
+#else // CLOO_WITH_OPENSSL
+
+// 没有OpenSSL时只能创建失败, TlsSession不会被构造
+using namespace Cloo;
+using namespace std;
+
+namespace
+{
+
+[[noreturn]] void NoOpenSsl()
+{
+    throw runtime_error("Cloo was built without OpenSSL, TLS is not available");
+}
+
+}
+
+TlsContext::TlsContext(ssl_ctx_st* ctx, bool server) : ctx_(ctx), server_(server), kernel_tls_(false) {}
+TlsContext::~TlsContext() = default;
+shared_ptr<TlsContext> TlsContext::CreateServer(const string&, const string&) { NoOpenSsl(); }
+shared_ptr<TlsContext> TlsContext::CreateClient(const string&) { NoOpenSsl(); }
+void TlsContext::SetKernelTlsEnabled(bool on) { kernel_tls_ = on; }
+
+TlsSession::TlsSession(const shared_ptr<TlsContext>&, int) : ssl_(nullptr), handshake_done_(false), pending_write_(0) { NoOpenSsl(); }
+TlsSession::~TlsSession() = default;
+TlsSession::HandshakeResult TlsSession::Handshake() { return HandshakeResult::kError; }
+bool TlsSession::KernelSend() const { return false; }
+bool TlsSession::KernelRecv() const { return false; }
+string TlsSession::Version() const { return ""; }
+string TlsSession::Cipher() const { return ""; }
+ssize_t TlsSession::MapError(int) { errno = ENOTSUP; return -1; }
+ssize_t TlsSession::Read(Buffer*, int* saved_errno) { *saved_errno = ENOTSUP; return -1; }
+ssize_t TlsSession::Write(const void*, size_t) { errno = ENOTSUP; return -1; }
+ssize_t TlsSession::SendFile(int, off_t, size_t) { errno = ENOTSUP; return -1; }
+void TlsSession::Shutdown() {}
+
+#endif // CLOO_WITH_OPENSSL
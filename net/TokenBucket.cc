@@ -0,0 +1,53 @@
+#include "include/TokenBucket.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace Cloo;
+using namespace std;
+
+void TokenBucket::Configure(double rate, size_t burst)
+{
+    rate_ = rate;
+    burst_ = max<size_t>(burst, 1);
+    tokens_ = static_cast<double>(burst_);
+    last_refill_ = chrono::steady_clock::now();
+}
+
+void TokenBucket::Refill()
+{
+    auto now = chrono::steady_clock::now();
+    double elapsed = chrono::duration<double>(now - last_refill_).count();
+    last_refill_ = now;
+    tokens_ = min(static_cast<double>(burst_), tokens_ + elapsed * rate_);
+}
+
+size_t TokenBucket::Available()
+{
+    if(rate_ == 0)
+    {
+        return SIZE_MAX;
+    }
+    Refill();
+    return tokens_ < 1 ? 0 : static_cast<size_t>(tokens_);
+}
+
+void TokenBucket::Consume(size_t n)
+{
+    if(rate_ > 0)
+    {
+        tokens_ -= static_cast<double>(n);
+    }
+}
+
+chrono::milliseconds TokenBucket::TimeUntil(size_t n)
+{
+    if(rate_ == 0)
+    {
+        return chrono::milliseconds(0);
+    }
+    Refill();
+    double missing = static_cast<double>(min(n, burst_)) - tokens_;
+    double wait_ms = ceil(missing * 1000 / rate_);
+    return chrono::milliseconds(max(1L, static_cast<long>(wait_ms)));
+}
@@ -0,0 +1,284 @@
+#include "include/Tracer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace Cloo;
+using namespace std;
+
+namespace
+{
+
+// 单写者的环形缓冲区. 写者在写槽位前后各更新一次seq(写入中为奇数, 写完为偶数),
+// 读者读取前后的seq相同且等于期望值时这个span才是完整的
+class TraceRing
+{
+public:
+    TraceRing(size_t capacity, pid_t tid)
+        : slots_(capacity),
+          mask_(capacity - 1),
+          head_(0),
+          tid_(tid)
+    {
+    }
+
+    void Push(TraceKind kind, uint64_t start_ns, uint64_t end_ns, int32_t arg)
+    {
+        const uint64_t pos = head_.load(memory_order_relaxed);
+        Slot& slot = slots_[pos & mask_];
+        slot.seq.store(2 * pos + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        const uint64_t duration = std::min<uint64_t>(end_ns - start_ns, UINT32_MAX);
+        slot.start_ns.store(start_ns, memory_order_relaxed);
+        slot.packed.store(duration | (static_cast<uint64_t>(kind) << 32), memory_order_relaxed);
+        slot.arg.store(arg, memory_order_relaxed);
+        slot.seq.store(2 * pos + 2, memory_order_release);
+        head_.store(pos + 1, memory_order_release);
+    }
+
+    template <typename Fn>
+    size_t ForEach(Fn&& fn) const
+    {
+        const uint64_t head = head_.load(memory_order_acquire);
+        const uint64_t begin = head > slots_.size() ? head - slots_.size() : 0;
+        size_t count = 0;
+        for(uint64_t pos = begin; pos < head; ++pos)
+        {
+            const Slot& slot = slots_[pos & mask_];
+            const uint64_t seq = slot.seq.load(memory_order_acquire);
+            const uint64_t start_ns = slot.start_ns.load(memory_order_relaxed);
+            const uint64_t packed = slot.packed.load(memory_order_relaxed);
+            const int32_t arg = slot.arg.load(memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            if(seq != 2 * pos + 2 || slot.seq.load(memory_order_relaxed) != seq)
+            {
+                // 已经被写者覆盖
+                continue;
+            }
+            fn(static_cast<TraceKind>(packed >> 32), start_ns, static_cast<uint32_t>(packed), arg);
+            ++count;
+        }
+        return count;
+    }
+
+    pid_t Tid() const { return tid_; }
+
+private:
+    struct Slot
+    {
+        atomic<uint64_t> seq {0};
+        atomic<uint64_t> start_ns {0};
+        atomic<uint64_t> packed {0};  // 低32位为持续时间(ns), 之上为TraceKind
+        atomic<int32_t> arg {0};
+    };
+
+    vector<Slot> slots_;
+    const uint64_t mask_;
+    atomic<uint64_t> head_;
+    const pid_t tid_;
+};
+
+struct Registry
+{
+    mutex mutex_;
+    // 线程退出后它的环形缓冲区仍然保留, 以便导出
+    vector<shared_ptr<TraceRing>> rings;
+    string dump_path;
+    int dump_pipe[2] = {-1, -1};
+};
+
+Registry& GetRegistry()
+{
+    static Registry* registry = new Registry();
+    return *registry;
+}
+
+atomic<uint32_t> G_SAMPLE_EVERY {1};
+atomic<size_t> G_RING_CAPACITY {16384};
+thread_local TraceRing* T_RING = nullptr;
+thread_local uint32_t T_ITERATION = 0;
+
+TraceRing* RingOfThisThread()
+{
+    if(T_RING == nullptr)
+    {
+        size_t capacity = 1;
+        while(capacity < std::max<size_t>(G_RING_CAPACITY.load(memory_order_relaxed), 2))
+        {
+            capacity <<= 1;
+        }
+        auto ring = make_shared<TraceRing>(capacity, ::gettid());
+        Registry& registry = GetRegistry();
+        lock_guard<mutex> lock(registry.mutex_);
+        registry.rings.push_back(ring);
+        T_RING = ring.get();
+    }
+    return T_RING;
+}
+
+const char* KindName(TraceKind kind)
+{
+    switch(kind)
+    {
+        case TraceKind::kPoll: return "poll";
+        case TraceKind::kChannelEvent: return "event";
+        case TraceKind::kTask: return "task";
+        case TraceKind::kTimer: return "timer";
+        case TraceKind::kWakeup: return "wakeup";
+    }
+    return "unknown";
+}
+
+void OnDumpSignal(int)
+{
+    int saved_errno = errno;
+    char byte = 1;
+    // 写端是非阻塞的, 导出线程来不及处理时多余的信号被合并
+    [[maybe_unused]] auto n = ::write(GetRegistry().dump_pipe[1], &byte, 1);
+    errno = saved_errno;
+}
+
+void InstallHandler(int signo)
+{
+    struct sigaction action {};
+    action.sa_handler = OnDumpSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    ::sigaction(signo, &action, nullptr);
+}
+
+void DumpLoop(Registry* registry)
+{
+    char byte;
+    while(true)
+    {
+        ssize_t n = ::read(registry->dump_pipe[0], &byte, 1);
+        if(n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if(n <= 0)
+        {
+            return;
+        }
+        string path;
+        {
+            lock_guard<mutex> lock(registry->mutex_);
+            path = registry->dump_path;
+        }
+        if(!Tracer::DumpChromeJson(path))
+        {
+            cerr << "Tracer failed to write " << path << endl;
+        }
+    }
+}
+
+}
+
+atomic<bool> Tracer::enabled_ {false};
+
+void Tracer::Start(const TraceOptions& options)
+{
+    G_SAMPLE_EVERY.store(std::max<uint32_t>(options.sample_every, 1), memory_order_relaxed);
+    // 只影响之后创建的环形缓冲区
+    G_RING_CAPACITY.store(options.ring_capacity, memory_order_relaxed);
+    enabled_.store(true, memory_order_relaxed);
+}
+
+void Tracer::Stop()
+{
+    enabled_.store(false, memory_order_relaxed);
+}
+
+void Tracer::BeginIteration()
+{
+    sampled_ = Enabled() && ++T_ITERATION % G_SAMPLE_EVERY.load(memory_order_relaxed) == 0;
+}
+
+void Tracer::Record(TraceKind kind, uint64_t start_ns, uint64_t end_ns, int32_t arg)
+{
+    RingOfThisThread()->Push(kind, start_ns, end_ns, arg);
+}
+
+uint64_t Tracer::NowNs()
+{
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+size_t Tracer::DumpChromeJson(ostream& out)
+{
+    vector<shared_ptr<TraceRing>> rings;
+    {
+        Registry& registry = GetRegistry();
+        lock_guard<mutex> lock(registry.mutex_);
+        rings = registry.rings;
+    }
+    const pid_t pid = ::getpid();
+    size_t total = 0;
+    bool first = true;
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    out << std::fixed << std::setprecision(3);
+    for(const auto& ring : rings)
+    {
+        out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << ring->Tid()
+            << ",\"args\":{\"name\":\"loop-" << ring->Tid() << "\"}}";
+        first = false;
+        total += ring->ForEach([&](TraceKind kind, uint64_t start_ns, uint32_t duration_ns, int32_t arg)
+        {
+            // trace-event的时间单位是微秒
+            out << ",\n{\"name\":\"" << KindName(kind) << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << ring->Tid()
+                << ",\"ts\":" << start_ns / 1000.0 << ",\"dur\":" << duration_ns / 1000.0;
+            if(kind == TraceKind::kChannelEvent)
+            {
+                out << ",\"args\":{\"fd\":" << arg << "}";
+            }
+            out << "}";
+        });
+    }
+    out << "\n]}\n";
+    return total;
+}
+
+bool Tracer::DumpChromeJson(const string& path)
+{
+    ofstream out(path, ios::trunc);
+    if(!out)
+    {
+        return false;
+    }
+    DumpChromeJson(out);
+    return static_cast<bool>(out);
+}
+
+void Tracer::InstallDumpSignal(int signo, const string& path)
+{
+    Registry& registry = GetRegistry();
+    lock_guard<mutex> lock(registry.mutex_);
+    registry.dump_path = path;
+    if(registry.dump_pipe[0] == -1)
+    {
+        if(::pipe2(registry.dump_pipe, O_CLOEXEC) != 0)
+        {
+            cerr << "Tracer::InstallDumpSignal() failed to create pipe: " << ::strerror(errno) << endl;
+            return;
+        }
+        ::fcntl(registry.dump_pipe[1], F_SETFL, O_NONBLOCK);
+        thread(DumpLoop, &registry).detach();
+    }
+    InstallHandler(signo);
+}
@@ -3,6 +3,9 @@
 
 #include "Socket.h"
 #include "SocketAddress.h"
+#include "TokenBucket.h"
+#include <chrono>
+#include <cstddef>
 #include <functional>
 #include <memory>
 namespace Cloo 
@@ -12,12 +15,40 @@ class EventLoop;
 class Channel;
 enum class SocketFd;
 
+// 超出准入限制时如何处理新连接
+// kPauseAccept: 暂时取消监听Channel的读事件, 让新连接留在内核的backlog中, 由定时器稍后重新开启
+// kAcceptAndClose: 接受后立即以RST关闭, 让客户端尽快失败重试, 不占用backlog
+enum class AdmissionOverflow
+{
+    kPauseAccept,
+    kAcceptAndClose,
+};
+
+// 准入控制: 令牌桶限制accept速率, max_connections限制同时存在的连接数, 0表示不限制
+struct AdmissionOptions
+{
+    double accepts_per_second = 0;
+    // 令牌桶容量, 即允许的突发accept数
+    size_t burst = 1;
+    size_t max_connections = 0;
+    AdmissionOverflow overflow = AdmissionOverflow::kPauseAccept;
+    // 因连接数达到上限而暂停时, 每隔retry_ms重新检查一次
+    long retry_ms = 10;
+};
+
+// Acceptor在listen socket可读时accept新连接, 交给NewConnectionCallback
+// 设置了AdmissionOptions时, accept之前先检查令牌桶、连接数上限以及CapacityCallback(例如每个IO线程的连接数上限),
+// 不允许接受时按AdmissionOverflow处理; 暂停的监听由TimerQueue的定时器恢复
 class Acceptor
 {
 using NewConnectionCallback = std::function<void (SocketFd, const SocketAddress&)> ;
+using CapacityCallback = std::function<bool ()>;
 
 public:
     Acceptor(std::shared_ptr<EventLoop> owner_loop, const SocketAddress& listen_addr);
+    // 接管一个已经bind(通常也已经listen)的监听fd, 例如零停机重启时从旧进程交接过来的fd(见FdHandover.h)
+    Acceptor(std::shared_ptr<EventLoop> owner_loop, SocketFd listen_fd);
+    ~Acceptor();
 
     Acceptor(const Acceptor&) = delete;
     Acceptor& operator=(const Acceptor&) = delete;
@@ -26,13 +57,53 @@ public:
     void Listen();
     void HandleRead();
     bool Listenning() const { return listenning_; }
+    // 停止accept但不关闭监听fd: 新连接留在监听队列中, 交由共享同一个fd的其他进程接受
+    void StopListening();
+    SocketFd ListenFd() const { return accept_socket_->Fd(); }
+
+    // 以下只能在owner_loop_所在线程中调用
+    void SetAdmissionOptions(const AdmissionOptions& options);
+    // 返回false表示暂时没有容量接受新连接
+    void SetCapacityCallback(const CapacityCallback& cb) { capacity_cb_ = cb; }
+    // 通过NewConnectionCallback交出的连接关闭后调用, 用于统计同时存在的连接数
+    void ConnectionClosed();
+    // 不经过accept得到的连接(例如交接过来的连接)也计入同时存在的连接数
+    void ConnectionAdopted() { ++active_connections_; }
+    size_t ActiveConnections() const { return active_connections_; }
+
+    struct Stats
+    {
+        size_t accepted = 0;
+        size_t rejected = 0;  // kAcceptAndClose下被立即关闭的连接数
+        size_t pauses = 0;    // kPauseAccept下暂停监听的次数
+    };
+    const Stats& GetStats() const { return stats_; }
 
 private:
-    std::weak_ptr<EventLoop> owner_loop_;
+    Acceptor(std::shared_ptr<EventLoop> owner_loop, std::unique_ptr<Socket> accept_socket);
+
+    // 检查是否允许接受一个新连接, 不允许时通过retry_after给出建议的重试间隔
+    bool Admit(std::chrono::milliseconds* retry_after);
+    void PauseAccepting(std::chrono::milliseconds retry_after);
+    void ResumeAccepting();
+    void RejectOne();
+
+    // Acceptor必须在owner_loop_析构之前析构
+    EventLoop* owner_loop_;
     std::unique_ptr<Socket> accept_socket_;
     std::shared_ptr<Channel> channel_;
     NewConnectionCallback cb_;
     bool listenning_;
+
+    AdmissionOptions admission_;
+    CapacityCallback capacity_cb_;
+    // accept速率的令牌桶, 一个令牌对应一个连接
+    TokenBucket accept_bucket_;
+    size_t active_connections_;
+    bool paused_;
+    // 恢复监听的定时器持有它的weak_ptr, Acceptor析构后定时器不再访问this
+    std::shared_ptr<bool> alive_;
+    Stats stats_;
 };
 
 } // end namespace Cloo
\ No newline at end of file
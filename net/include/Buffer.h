@@ -0,0 +1,108 @@
+#pragma once
+
+#include "TimeDefs.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+
+namespace Cloo 
+{
+
+class LoopMemory;
+
+// Buffer是连接的应用层输入/输出缓冲区, 底层是一段连续的内存
+// 使用LoopMemory构造的Buffer(连接的输入/输出缓冲区)一开始没有存储, 第一次写入时才分配:
+// 需要的空间不超过一个chunk时使用LoopMemory中一个kBufferChunkSize字节的chunk, 析构或Shrink后归还给chunk池复用,
+// 否则使用全局的operator new. 分配的大小参考最近观察到的单次读取大小, 大消息不必从一个chunk开始反复扩容
+// +-------------------+------------------+------------------+
+// | prependable bytes |  readable bytes  |  writable bytes  |
+// |                   |     (CONTENT)    |                  |
+// +-------------------+------------------+------------------+
+// 0      <=      reader_index_   <=   writer_index_    <=     size
+class Buffer
+{
+public:
+    static const size_t kCheapPrepend = 8;
+    static const size_t kInitialSize = 1024;
+    // ReadFd使用的栈上缓冲区大小
+    static const size_t kExtraBufferSize = 65536;
+
+    explicit Buffer(size_t initial_size = kInitialSize);
+    // 按需分配存储, memory为nullptr时使用全局的operator new
+    explicit Buffer(LoopMemory* memory);
+    ~Buffer();
+
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+
+    size_t ReadableBytes() const { return writer_index_ - reader_index_; }
+    size_t WritableBytes() const { return capacity_ - writer_index_; }
+    size_t PrependableBytes() const { return reader_index_; }
+
+    // 可读数据的起始地址
+    const char* Peek() const { return begin() + reader_index_; }
+
+    // 取走len字节的可读数据
+    void Retrieve(size_t len);
+    void RetrieveAll();
+    std::string RetrieveAsString(size_t len);
+    std::string RetrieveAllAsString();
+
+    void Append(const char* data, size_t len);
+    void Append(std::string_view data) { Append(data.data(), data.size()); }
+
+    char* BeginWrite() { return begin() + writer_index_; }
+    void HasWritten(size_t len) { writer_index_ += len; }
+    void EnsureWritableBytes(size_t len);
+
+    // 当前占用的存储字节数, 没有存储时为0
+    size_t AllocatedBytes() const { return data_ == EmptyStorage() ? 0 : capacity_; }
+    // 没有可读数据时释放存储(chunk归还给LoopMemory), 否则把可读数据挪到一块刚好够用的存储中;
+    // 用于空闲的连接归还内存, 观察到的读取大小减半, 下一次按它重新分配
+    void Shrink();
+    // 之后改用memory分配chunk(连接迁移到其他EventLoop时), 在memory所属的线程中调用;
+    // 当前存储是原来LoopMemory的chunk时把可读数据搬到新的存储中, chunk归还给原来的LoopMemory
+    void Rebind(LoopMemory* memory);
+
+    // 从fd中读取数据, 返回read的结果, 出错时errno保存在saved_errno中
+    // 借助栈上的64KiB缓冲区和readv, 一次系统调用最多可以读出 ReadFdCapacity() 字节,
+    // 既不需要预先为每个连接分配很大的缓冲区, 也减少了反复read的次数
+    ssize_t ReadFd(int fd, int* saved_errno);
+    // 同ReadFd, 但使用recvmsg, 并取出随数据返回的内核接收时间戳(需要先开启Socket::SetRxTimestamping)
+    // 控制消息中带有时间戳时写入rx_time, 否则不修改rx_time. TCP返回的是这次读到的最后一个报文段的时间戳
+    ssize_t ReadFd(int fd, int* saved_errno, define::SystemTimePoint* rx_time);
+    // 下一次ReadFd最多能读出的字节数: 空闲空间不足64KiB时才会额外使用栈上的缓冲区
+    // ReadFd读到的数据少于它时说明内核缓冲区已经读空
+    size_t ReadFdCapacity() const { return UseExtraBuffer() ? WritableBytes() + kExtraBufferSize : WritableBytes(); }
+
+private:
+    // ReadFd是否需要栈上的缓冲区
+    bool UseExtraBuffer() const { return WritableBytes() < kExtraBufferSize; }
+    // 没有存储时data_指向的共享的空区域, 只有kCheapPrepend字节, 从不被写入
+    static char* EmptyStorage();
+
+    char* begin() { return data_; }
+    const char* begin() const { return data_; }
+    void MakeSpace(size_t len);
+    // 换成一块至少capacity字节的新存储, 保留可读数据
+    void Reallocate(size_t capacity);
+    void ReleaseStorage();
+    // 记录一次读取的大小
+    void ObserveRead(size_t n) { read_hint_ = std::max(read_hint_, n); }
+
+    char* data_;
+    size_t capacity_;
+    // 分配chunk使用的LoopMemory, 为nullptr时总是使用operator new
+    LoopMemory* memory_;
+    // data_是从memory_中分配的chunk
+    bool chunk_;
+    size_t reader_index_;
+    size_t writer_index_;
+    // 最近观察到的最大单次读取字节数
+    size_t read_hint_;
+};
+
+} // end namespace Cloo
@@ -1,10 +1,31 @@
 #pragma once
 
+#include "TimeDefs.h"
+
 #include <functional>
+#include <memory>
+
+namespace Cloo
+{
+// forward declaration
+class Buffer;
+class TcpConnection;
+}
+
 namespace Cloo::define 
 {
 
 using IOEventCallback = std::function<void()>;
 using TimerCallback = std::function<void()>;
 
-} // end namespace Cloo::define
\ No newline at end of file
+// 连接相关的回调
+using TcpConnectionPtr = std::shared_ptr<TcpConnection>;
+// 连接建立和断开时都会回调, 通过TcpConnection::Connected()区分
+using ConnectionCallback = std::function<void(const TcpConnectionPtr&)>;
+// 收到数据时回调, receive_time为本轮Poll返回的时间; 连接开启了内核接收时间戳时为内核收到这批数据的时间
+using MessageCallback = std::function<void(const TcpConnectionPtr&, Buffer*, SystemTimePoint)>;
+// 输出缓冲区中的数据全部写入内核时回调
+using WriteCompleteCallback = std::function<void(const TcpConnectionPtr&)>;
+using CloseCallback = std::function<void(const TcpConnectionPtr&)>;
+
+} // end namespace Cloo::define
@@ -2,11 +2,16 @@
 #include <functional>
 #include <memory>
 
-namespace Cloo 
+namespace Cloo
 {
 // forward declaration 简化头文件关系
 class EventLoop;
 
+// 所有权约定:
+// Channel由拥有fd的对象(Acceptor、TimerQueue、连接等)通过shared_ptr持有, Poller与EventLoop只保存裸指针,
+// 因此Channel的拥有者必须在Channel析构之前调用Remove()把它从Poller中注销.
+// EventLoop的生命周期长于注册在它上面的所有Channel, 所以Channel同样以裸指针引用所属的EventLoop.
+// 这样IO线程在分发事件的热路径上不会产生任何shared_ptr引用计数的原子操作
 class Channel : public std::enable_shared_from_this<Channel>
 {
 // 在C++11后应该尽量使用using alias而非typedef
@@ -15,12 +20,16 @@ using EventCallBack = std::function<void()>;
 public:
 
 static std::shared_ptr<Channel> Create(const std::shared_ptr<EventLoop>& loop, int fd);
+static std::shared_ptr<Channel> Create(EventLoop* loop, int fd);
+
+~Channel();
 
 void HandleEvent();
 // 设置IO事件回调函数
 void SetReadCallBack(const EventCallBack& cb) { readCallBack_ = cb; }
 void SetWriteCallBack(const EventCallBack& cb) { writeCallBack_ = cb; }
 void SetErrorCallBack(const EventCallBack& cb) { errorCallBack_ = cb; }
+void SetCloseCallBack(const EventCallBack& cb) { closeCallBack_ = cb; }
 // 返回channel关联的文件描述符
 int Fd() const { return fd_; }
 
@@ -28,41 +37,91 @@ int Events() const { return events_; }
 void SetRevents(int revt) { revents_ = revt; }
 bool IsNoneEvent() const { return events_ == kNoneEvent; }
 
-void EnableReading() 
-{ 
-    events_ |= kReadEvent; 
-    update(); 
+void EnableReading()
+{
+    events_ |= kReadEvent;
+    update();
 }
+void DisableReading()
+{
+    events_ &= ~kReadEvent;
+    update();
+}
+void EnableWriting()
+{
+    events_ |= kWriteEvent;
+    update();
+}
+void DisableWriting()
+{
+    events_ &= ~kWriteEvent;
+    update();
+}
+void DisableAll()
+{
+    events_ = kNoneEvent;
+    update();
+}
+// 边沿触发(EPOLLET): 只有fd的状态发生变化时才会通知一次, 使用者必须读/写直到EAGAIN,
+// 否则剩余的数据不会再被通知. 只有EPollPoller支持, PollPoller会按水平触发处理
+void SetEdgeTriggered(bool on)
+{
+    edge_triggered_ = on;
+    if(!IsNoneEvent())
+    {
+        update();
+    }
+}
+bool EdgeTriggered() const { return edge_triggered_; }
+bool IsReading() const { return events_ & kReadEvent; }
+bool IsWriting() const { return events_ & kWriteEvent; }
+
+// 将Channel与它的拥有者(通常是一个连接)绑定
+// HandleEvent期间会临时提升weak_ptr, 保证拥有者不会在回调执行到一半时被析构;
+// 只有绑定过的Channel才会产生这一次引用计数操作, 且只持续HandleEvent这一段时间
+void Tie(const std::shared_ptr<void>& owner);
 
+// 从Poller中注销, 调用前必须先DisableAll()
+void Remove();
+
+// 是否正在HandleEvent中
+bool EventHandling() const { return event_handling_; }
 
 int Index() const { return index_; }
 void SetIndex(int index) { index_ = index; }
 
 // channel所属的EventLoop
-std::shared_ptr<EventLoop> OwnerLoop() const 
-{ 
-    return owner_loop_.lock(); 
+EventLoop* OwnerLoop() const
+{
+    return owner_loop_;
 };
 
 private:
-    
-    Channel(const std::shared_ptr<EventLoop>& loop, int fd);
+
+    Channel(EventLoop* loop, int fd);
 
     void update();
+    void HandleEventWithGuard();
 
     static const int kNoneEvent;
     static const int kReadEvent;
     static const int kWriteEvent;
 
-    std::weak_ptr<EventLoop> owner_loop_;
+    EventLoop* owner_loop_;
     const int fd_;
     int events_;
     int revents_;
     int index_;
+    bool edge_triggered_;
+    bool tied_;
+    bool event_handling_;
+
+    std::weak_ptr<void> tie_;
 
     EventCallBack readCallBack_;
     EventCallBack writeCallBack_;
     EventCallBack errorCallBack_;
+    EventCallBack closeCallBack_;
 };
 
 } // end namespace Cloo
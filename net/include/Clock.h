@@ -0,0 +1,58 @@
+#pragma once
+
+#include "TimeDefs.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace Cloo
+{
+
+// EventLoop与TimerQueue的时间源. 默认(没有注入Clock时)使用system_clock;
+// 仿真时注入VirtualClock, 由SimPoller在Poll中直接推进, 不会真正睡眠
+class Clock
+{
+public:
+    virtual ~Clock() = default;
+    virtual define::SystemTimePoint Now() const = 0;
+};
+
+// 只由仿真推进的时钟. 其他线程可能通过RunAfter等读取当前时间, 因此用原子变量保存
+class VirtualClock final : public Clock
+{
+public:
+    explicit VirtualClock(define::SystemTimePoint start = define::SystemTimePoint())
+        : now_ns_(ToNs(start))
+    {
+    }
+
+    define::SystemTimePoint Now() const override
+    {
+        return define::SystemTimePoint(std::chrono::duration_cast<define::SystemTimePoint::duration>(
+            std::chrono::nanoseconds(now_ns_.load(std::memory_order_relaxed))));
+    }
+
+    void Advance(std::chrono::nanoseconds duration)
+    {
+        now_ns_.fetch_add(duration.count(), std::memory_order_relaxed);
+    }
+
+    // 时钟不会后退, when早于当前时间时不变
+    void AdvanceTo(define::SystemTimePoint when)
+    {
+        int64_t target = ToNs(when);
+        int64_t current = now_ns_.load(std::memory_order_relaxed);
+        while(current < target && !now_ns_.compare_exchange_weak(current, target, std::memory_order_relaxed)) {}
+    }
+
+private:
+    static int64_t ToNs(define::SystemTimePoint when)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(when.time_since_epoch()).count();
+    }
+
+    std::atomic<int64_t> now_ns_;
+};
+
+} // end namespace Cloo
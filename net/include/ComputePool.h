@@ -0,0 +1,105 @@
+#pragma once
+
+#include "CallbackDefs.h"
+#include "WorkStealingDeque.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Cloo 
+{
+
+class EventLoop;
+
+// ComputePool是一个工作窃取(work-stealing)的线程池, 用于执行解析、压缩、加解密等计算密集型任务,
+// 避免它们阻塞IO线程上的其他fd
+// 每个worker拥有一个有界的Chase-Lev双端队列:
+//  worker执行任务时派生出的子任务直接压入自己的队列底部(无锁)
+//  其他线程(例如IO线程)提交的任务先进入worker的收件箱, 由worker批量转移到自己的队列中
+//  空闲的worker从其他worker队列的顶部窃取任务
+// 池中积压的任务总数是有界的, 超出上限时按照RejectPolicy处理
+class ComputePool
+{
+public:
+    using Task = std::function<void()>;
+
+    enum class RejectPolicy
+    {
+        kReject,       // Submit返回false, 由调用者决定如何处理
+        kCallerRuns,   // 在调用者线程中直接执行(会阻塞调用者, IO线程慎用)
+        kAbort         // 抛出std::runtime_error
+    };
+
+    // num_threads: worker数量; max_pending: 积压任务总数的上限(同时也是每个worker队列的容量)
+    ComputePool(int num_threads, size_t max_pending, RejectPolicy policy = RejectPolicy::kReject);
+    ~ComputePool();
+
+    ComputePool(const ComputePool&) = delete;
+    ComputePool& operator=(const ComputePool&) = delete;
+
+    // 提交一个任务, 线程安全
+    // 被拒绝时返回false(仅kReject策略); 任务抛出的异常被捕获并输出到cerr, 不影响worker继续执行其他任务
+    bool Submit(Task task);
+
+    // 在compute pool中执行work, work的返回值通过origin->QueueTaskInThisLoop交回origin所在的IO线程, 并在那里调用done
+    // work的返回值不能是void, work与done都需要是可拷贝的
+    template<typename Work, typename Done>
+    bool Offload(EventLoop* origin, Work work, Done done);
+
+    // 停止接受新任务, 执行完已经提交的任务后退出所有worker, 析构时会自动调用
+    void Stop();
+
+    size_t PendingApprox() const { return pending_.load(std::memory_order_relaxed); }
+    size_t RejectedCount() const { return rejected_.load(std::memory_order_relaxed); }
+    size_t StolenCount() const { return stolen_.load(std::memory_order_relaxed); }
+
+private:
+    struct Worker
+    {
+        explicit Worker(size_t capacity) : deque(capacity) {}
+
+        WorkStealingDeque<Task*> deque;
+        std::mutex inbox_mutex;
+        std::deque<Task*> inbox;
+        std::thread thread;
+    };
+
+    void WorkerFunc(size_t index);
+    Task* FindTask(size_t index);
+    // 任意一个worker的队列或收件箱中还有任务
+    bool HasQueuedTask();
+    void Run(Task* task);
+    static void QueueInLoop(EventLoop* loop, define::IOEventCallback cb);
+
+    const size_t max_pending_;
+    const RejectPolicy policy_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<size_t> pending_;
+    std::atomic<size_t> next_worker_;
+    std::atomic<size_t> rejected_;
+    std::atomic<size_t> stolen_;
+    std::atomic<bool> stopping_;
+    // 空闲worker在这里睡眠
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cv_;
+    std::atomic<int> idle_workers_;
+};
+
+template<typename Work, typename Done>
+bool ComputePool::Offload(EventLoop* origin, Work work, Done done)
+{
+    return Submit([origin, work, done]() mutable
+    {
+        auto result = std::make_shared<decltype(work())>(work());
+        QueueInLoop(origin, [done, result]() mutable { done(std::move(*result)); });
+    });
+}
+
+} // end namespace Cloo
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Cloo
+{
+
+class EventLoop;
+class ConnectionTable;
+class TcpConnection;
+
+// 连接的句柄: 连接表 + 表中的(slot, generation)
+// 可以随意拷贝、跨线程传递, 不持有连接, 不影响连接的生命周期. 连接销毁后slot被复用时generation递增,
+// 旧句柄随之失效, 通过它发送的数据被丢弃. 连接表属于TcpServer而不是某个EventLoop, 连接迁移到其他IO线程后句柄不变,
+// IO线程退役后句柄仍然可以安全使用, 它上面已经关闭的连接的句柄按失效处理. 句柄只能在TcpServer存在期间使用
+struct ConnectionHandle
+{
+    ConnectionTable* table = nullptr;
+    uint32_t slot = 0;
+    // generation从1开始, 0表示空句柄
+    uint32_t generation = 0;
+
+    bool Valid() const { return generation != 0; }
+};
+
+// TcpServer所有连接的连接表, 由TcpServer与它的连接共同持有
+// slot按段分配, 段一旦分配就不再移动或释放, 任意线程都可以凭句柄找到slot并检查generation.
+// slot中的连接指针只在连接所属的IO线程中访问; 其他线程通过Post向连接发送数据:
+// 数据进入slot自己的入站队列(无锁的多生产者单消费者链表), 队列由空变为非空时向连接当前所属的EventLoop投递一次取空任务,
+// 连续的多次Post共用一次任务. 连接迁移到其他IO线程时队列随slot留在原处, 句柄不变, 发送顺序也不受迁移影响
+// 与捕获shared_ptr<TcpConnection>再QueueTaskInThisLoop相比: 发送方不需要持有连接(没有引用计数的原子操作),
+// 不需要为每次发送构造std::function闭包, 也不会因为持有连接而推迟连接的析构
+class ConnectionTable : public std::enable_shared_from_this<ConnectionTable>
+{
+public:
+    ConnectionTable();
+    ~ConnectionTable();
+
+    ConnectionTable(const ConnectionTable&) = delete;
+    ConnectionTable& operator=(const ConnectionTable&) = delete;
+
+    // 以下五个只能在连接所属的IO线程中调用
+    // 为连接分配一个slot(优先复用空闲的slot), 由TcpConnection::ConnectEstablished调用
+    ConnectionHandle Register(TcpConnection* conn);
+    // 释放slot, generation递增使已发出的句柄失效, 由TcpConnection::ConnectDestroyed调用
+    void Unregister(const ConnectionHandle& handle);
+    // 连接迁移: 在原IO线程中Detach, 之后的Post只入队、不投递; 在新的IO线程中Attach, 发送迁移途中积累的数据
+    void Detach(const ConnectionHandle& handle);
+    void Attach(const ConnectionHandle& handle, EventLoop* loop);
+    // 句柄仍然有效时返回连接, 否则返回nullptr
+    TcpConnection* Find(const ConnectionHandle& handle) const;
+
+    // 以下可以在任意线程中调用
+    size_t Size() const { return size_.load(std::memory_order_relaxed); }
+    // 向handle指向的连接发送data
+    void Post(const ConnectionHandle& handle, std::string data);
+    // 因为句柄失效或者连接已经断开而被丢弃的Post的数量
+    size_t DroppedSends() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    struct Message;
+
+    struct Slot
+    {
+        std::atomic<uint32_t> generation {1};
+        // 连接所属的EventLoop, 迁移途中与注销后为nullptr; 在wake_locks_下修改与读取
+        EventLoop* loop = nullptr;
+        // 只在连接所属的IO线程中访问
+        TcpConnection* conn = nullptr;
+        // 入站队列: 生产者以CAS压入栈顶, IO线程一次取走整个链表后反转为投递顺序
+        std::atomic<Message*> inbound {nullptr};
+    };
+
+    static constexpr size_t kSegmentSlots = 1024;
+    static constexpr size_t kMaxSegments = 4096;
+    static constexpr size_t kWakeLocks = 64;
+
+    Slot* Locate(uint32_t slot) const;
+    std::mutex& WakeLock(uint32_t slot) { return wake_locks_[slot % kWakeLocks]; }
+    // 取空slot的入站队列, 在连接所属的IO线程中执行
+    void DrainSlot(uint32_t slot);
+    // 丢弃slot入站队列中的数据
+    void DropInbound(Slot& slot);
+    // 入站队列的节点池: 取空后的节点压回free_messages_, 生产者线程一次取走整个链表放入线程局部的缓存
+    Message* AllocateMessage();
+    void RecycleMessages(Message* first, Message* last);
+
+    // 段目录, 只追加
+    std::atomic<Slot*> segments_[kMaxSegments];
+    // 保护free_slots_、num_slots_与段的分配
+    std::mutex mutex_;
+    std::vector<uint32_t> free_slots_;
+    size_t num_slots_;
+    std::mutex wake_locks_[kWakeLocks];
+    std::atomic<size_t> size_;
+    std::atomic<Message*> free_messages_;
+    std::atomic<size_t> dropped_;
+};
+
+// 向handle指向的连接发送data, 可以在任意线程中调用: 数据进入连接的入站队列, 由连接所属的IO线程发送;
+// 句柄已经失效(连接已经销毁, slot可能已被其他连接复用)时丢弃, 不会发给其他连接
+void Send(const ConnectionHandle& handle, std::string data);
+
+} // end namespace Cloo
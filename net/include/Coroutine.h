@@ -0,0 +1,167 @@
+#pragma once
+
+#include "Socket.h"
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <netinet/in.h>
+#include <sys/types.h>
+
+namespace Cloo
+{
+
+class Channel;
+class EventLoop;
+class SocketAddress;
+
+namespace detail
+{
+
+// 协程帧分配器
+// one loop per thread, 协程总是在IO线程中创建、恢复和销毁, 因此以thread_local的形式为每个EventLoop维护一组
+// 按64字节分级的空闲链表, 协程帧释放后留在空闲链表中供下一个协程复用, 稳态下不会再进入全局的operator new
+// 超过kMaxPooledFrameSize的协程帧直接使用operator new
+class FrameAllocator
+{
+public:
+    static constexpr size_t kSizeClassBytes = 64;
+    static constexpr size_t kMaxPooledFrameSize = 4096;
+
+    static void* Allocate(size_t size);
+    static void Deallocate(void* ptr, size_t size) noexcept;
+
+    // 当前线程的统计信息
+    struct Stats
+    {
+        size_t pool_hits = 0;     // 从空闲链表中复用的次数
+        size_t pool_misses = 0;   // 需要向operator new申请的次数
+        size_t bytes_cached = 0;  // 空闲链表中缓存的字节数
+    };
+    static const Stats& ThreadStats();
+};
+
+}
+
+// Task是一个“发射后不管”(fire-and-forget)的协程类型
+// 协程被调用后立即开始执行, 直到第一次co_await挂起才返回调用者; 执行完毕后协程帧自动销毁
+// 协程由AsyncSocket或者定时器在IO线程中直接(inline)恢复, 不会经过任务队列
+class Task
+{
+public:
+    struct promise_type
+    {
+        Task get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+
+        static void* operator new(size_t size) { return detail::FrameAllocator::Allocate(size); }
+        static void operator delete(void* ptr, size_t size) noexcept { detail::FrameAllocator::Deallocate(ptr, size); }
+    };
+};
+
+// co_await Sleep(loop, ms): 借助TimerQueue在ms毫秒后于IO线程中恢复协程
+class SleepAwaiter
+{
+public:
+    SleepAwaiter(EventLoop* loop, long delay_ms) : loop_(loop), delay_ms_(delay_ms) {}
+
+    bool await_ready() const noexcept { return delay_ms_ <= 0; }
+    void await_suspend(std::coroutine_handle<> handle);
+    void await_resume() const noexcept {}
+
+private:
+    EventLoop* loop_;
+    long delay_ms_;
+};
+
+inline SleepAwaiter Sleep(EventLoop* loop, long delay_ms) { return SleepAwaiter(loop, delay_ms); }
+
+struct AcceptResult
+{
+    SocketFd fd;
+    sockaddr_in peer_addr;
+};
+
+// AsyncSocket把一个非阻塞socket绑定到EventLoop上, 提供可以co_await的Accept/Read/Write
+// 每种操作都先直接尝试系统调用, 只有遇到EAGAIN时才挂起协程并关注相应的IO事件,
+// 事件到来时由Channel的回调在IO线程中完成系统调用, 再inline地恢复协程
+// 为了减少epoll_ctl, 关注的事件在协程恢复后不会立即取消, 直到没有等待者的事件到来时才取消
+// Notice:
+//  1. 所有操作都必须在IO线程中进行, 同一种操作同一时刻只能有一个协程在等待
+//  2. AsyncSocket析构时仍在等待它的协程不会再被恢复, 使用者需要保证AsyncSocket比等待它的协程活得久
+class AsyncSocket
+{
+public:
+    // 接管fd/socket的所有权
+    AsyncSocket(EventLoop* loop, SocketFd fd);
+    AsyncSocket(EventLoop* loop, std::unique_ptr<Socket> socket);
+    ~AsyncSocket();
+
+    AsyncSocket(const AsyncSocket&) = delete;
+    AsyncSocket& operator=(const AsyncSocket&) = delete;
+
+    // 创建一个监听listen_addr的AsyncSocket
+    static std::unique_ptr<AsyncSocket> Listen(EventLoop* loop, const SocketAddress& listen_addr);
+
+    SocketFd Fd() const { return socket_->Fd(); }
+    EventLoop* GetLoop() const { return loop_; }
+
+    // 挂起中的操作, 同时也是co_await的awaiter
+    class Operation
+    {
+    public:
+        bool await_ready() noexcept { return TryComplete(); }
+        void await_suspend(std::coroutine_handle<> handle);
+        ssize_t await_resume() const noexcept { return result_; }
+
+    protected:
+        enum class Kind { kAccept, kRead, kWrite };
+        Operation(AsyncSocket* socket, Kind kind, char* buf, size_t len)
+            : socket_(socket), kind_(kind), buf_(buf), len_(len) {}
+
+        // 尝试完成操作, 完成(成功或失败)时返回true, 遇到EAGAIN时返回false
+        bool TryComplete() noexcept;
+
+        AsyncSocket* socket_;
+        Kind kind_;
+        char* buf_;
+        size_t len_;
+        size_t done_ = 0;
+        ssize_t result_ = 0;
+        std::coroutine_handle<> handle_;
+        AcceptResult accepted_ {SocketFd::invalid, {}};
+
+        friend class AsyncSocket;
+    };
+
+    class AcceptOperation : public Operation
+    {
+    public:
+        explicit AcceptOperation(AsyncSocket* socket) : Operation(socket, Kind::kAccept, nullptr, 0) {}
+        AcceptResult await_resume() const noexcept { return accepted_; }
+    };
+
+    // co_await Accept(): 返回接受的连接, 失败时fd为SocketFd::invalid
+    AcceptOperation Accept() { return AcceptOperation(this); }
+    // co_await Read(buf, len): 读到至少1字节后返回读到的字节数, 对端关闭时返回0, 出错时返回-errno
+    Operation Read(char* buf, size_t len) { return Operation(this, Operation::Kind::kRead, buf, len); }
+    // co_await Write(data, len): 全部写完后返回len, 出错时返回-errno
+    Operation Write(const char* data, size_t len) { return Operation(this, Operation::Kind::kWrite, const_cast<char*>(data), len); }
+
+private:
+    void HandleRead();
+    void HandleWrite();
+
+    EventLoop* loop_;
+    std::unique_ptr<Socket> socket_;
+    std::shared_ptr<Channel> channel_;
+    // 正在等待可读(Accept/Read)与可写(Write)的操作
+    Operation* reader_;
+    Operation* writer_;
+};
+
+} // end namespace Cloo
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Channel.h"
+#include "Poller.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sys/epoll.h>
+#include <vector>
+
+namespace Cloo 
+{
+
+// 基于epoll(7)的Poller实现
+// 与PollPoller不同, epoll_wait的开销只与活跃fd的数量有关, 并且支持Channel选择边沿触发(EPOLLET)
+// Poll与fillActiveChannels位于每轮迭代的热路径上, 定义在头文件中, 以便内联进EventLoop以EPollPoller特化的循环
+class EPollPoller final : public Poller
+{
+
+public:
+    explicit EPollPoller(EventLoop* loop);
+    ~EPollPoller() override;
+
+    TimePoint Poll(int timeout_ms, ChannelList* active_channels) override;
+    void UpdateChannel(Channel* channel) override;
+    void RemoveChannel(Channel* channel) override;
+
+private:
+    // epoll_event::data.ptr中直接保存Channel指针, 不需要再查询channels_
+    void fillActiveChannels(int num_events, ChannelList* active_channels) const;
+    // 对epoll_ctl的简单封装
+    void update(int operation, Channel* channel);
+
+    using EventList = std::vector<epoll_event>;
+    // 初始时events_的大小, 一次epoll_wait返回的事件填满events_时会自动扩容
+    static const int kInitEventListSize = 16;
+
+    int epoll_fd_;
+    EventList events_;
+};
+
+inline Poller::TimePoint EPollPoller::Poll(int timeout_ms, ChannelList* active_channels)
+{
+    int num_events = ::epoll_wait(epoll_fd_, events_.data(), static_cast<int>(events_.size()), timeout_ms);
+    auto now = std::chrono::system_clock::now();
+    if(num_events > 0)
+    {
+        fillActiveChannels(num_events, active_channels);
+        if(static_cast<size_t>(num_events) == events_.size())
+        {
+            events_.resize(events_.size() * 2);
+        }
+    }
+    else if(num_events < 0 && errno != EINTR)
+    {
+        std::cerr << "EPollPoller::Poll() error: " << ::strerror(errno) << std::endl;
+    }
+    return now;
+}
+
+inline void EPollPoller::fillActiveChannels(int num_events, ChannelList* active_channels) const
+{
+    for(int i = 0; i < num_events; ++i)
+    {
+        Channel* channel = static_cast<Channel*>(events_[i].data.ptr);
+        channel->SetRevents(static_cast<int>(events_[i].events));
+        active_channels->push_back(channel);
+    }
+}
+
+}//end namespace Cloo
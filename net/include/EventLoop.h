@@ -1,21 +1,44 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <deque>
 #include <memory>
 #include <thread>
 #include <vector>
 #include <mutex>
 
 #include "CallbackDefs.h"
+#include "Clock.h"
+#include "LatencyHistogram.h"
 #include "TimeDefs.h"
 #include "TimerId.h"
+#include "TokenBucket.h"
 
 namespace Cloo 
 {
 // 前向声明简化头文件关系
 class Poller;
+class SimPoller;
 class Channel;
 class TimerQueue;
+class ComputePool;
+struct TimerQueueStats;
+class LoopMemory;
+// EventLoop.h中不包含LoopMemory.h, 以函数对象转发LoopMemory::Deleter
+struct LoopMemoryDeleter
+{
+    void operator()(LoopMemory* memory) const;
+};
+
+// 投递到EventLoop中的任务的优先级
+// kControl: 控制类/延迟敏感的任务(连接的建立与销毁、定时器的增删、Quit等), 总是先于kBulk执行
+// kBulk: 批量的后台任务, 可以被推迟到后续的迭代中, 不应该阻塞IO事件与控制类任务
+enum class TaskPriority
+{
+    kControl,
+    kBulk,
+};
 
 class EventLoop final : public std::enable_shared_from_this<EventLoop>
 {
@@ -29,6 +52,9 @@ public:
     
     // 利用工厂函数实现两段式构造, 避免在构造函数中使用shared_from_this
     static std::shared_ptr<EventLoop> Create();
+    // 仿真用的EventLoop: 时间取自clock, Poller是不做系统调用的SimPoller, 定时器由Poll超时驱动(不使用timerfd).
+    // 没有就绪事件时Loop直接把clock推进到最早的定时器到期, 可以在几毫秒内回放数小时的定时器活动
+    static std::shared_ptr<EventLoop> CreateSimulated(const std::shared_ptr<VirtualClock>& clock);
 
     // Loop是EventLoop的核心函数, 它几乎是一个不会停止的循环(除非主动调用Quit()使其退出)
     // Loop在每次迭代中都从IO多路复用组件中获取活动事件(由active_channels转发)
@@ -37,7 +63,10 @@ public:
     
     // 通过channel将 “某个fd” 和 “fd上的关心的IO事件” 注册到IO复用组件中
     // 之后IO多路复用组件中关于这个fd的活动事件都会通过channel转发给这个EventLoop
-    void UpdateChannel(const std::shared_ptr<Channel>& channel);
+    void UpdateChannel(Channel* channel);
+    // 将channel从IO复用组件中注销, channel的拥有者在析构channel之前必须调用
+    void RemoveChannel(Channel* channel);
+    bool HasChannel(Channel* channel);
 
     // assert(EventLoop处在thread_id_指向的线程中)
     inline void AssertInLoopTread()
@@ -62,25 +91,141 @@ public:
     void Quit();
 
     define::SystemTimePoint PollReturnTime() const { return poll_return_time_; }
+    // EventLoop的当前时间, 定时器都以它为准; 没有注入Clock时即system_clock::now()
+    define::SystemTimePoint Now() const { return clock_ ? clock_->Now() : std::chrono::system_clock::now(); }
+    // 仿真用的EventLoop返回它的SimPoller(用于注入就绪事件), 否则返回nullptr
+    SimPoller* Simulation() const;
+
+    // 负载采样, 可以在任意线程中读取: total为Loop开始以来的时间, idle为其中阻塞在Poll中等待的时间(忙轮询的自旋不算空闲)
+    // 两次采样之差的 1 - idle / total 即这段时间的利用率, 见EventLoopThreadPool::Utilization
+    struct LoadSample
+    {
+        std::chrono::nanoseconds total {0};
+        std::chrono::nanoseconds idle {0};
+    };
+    LoadSample Load() const;
+
+    // 忙轮询(busy-poll)策略, 只能在IO线程中设置
+    // max_spin_us > 0 时, 每轮迭代先以0超时反复调用Poll, 最多自旋max_spin_us微秒, 
+    // 仍然没有IO事件时才退回到阻塞的Poll, 以此省去线程睡眠/唤醒的调度延迟
+    // 自旋预算是自适应的: 自旋期间等到了事件或者阻塞等待很快就被唤醒时预算翻倍(不超过max_spin_us),
+    // 自旋落空时预算减半, 低于min_spin_us时直接降为0, 这样空闲的EventLoop不会白白占满一个核
+    // max_spin_us == 0 表示关闭忙轮询(默认)
+    void SetBusyPoll(std::chrono::microseconds max_spin_us, 
+                     std::chrono::microseconds min_spin_us = std::chrono::microseconds(5));
+    // 当前自适应调整后的自旋预算
+    std::chrono::microseconds BusyPollBudget() const { return spin_budget_; }
 
     void RunTaskInThisLoop(const define::IOEventCallback& task);
 
-    void QueueTaskInThisLoop(const define::IOEventCallback& task);
+    // 把task投递到本EventLoop的任务队列中, 由IO线程在处理完IO事件后执行, 可以在任意线程中调用
+    // 同一优先级内的任务按投递顺序执行, kControl的任务总是先于kBulk的任务执行
+    void QueueTaskInThisLoop(const define::IOEventCallback& task, TaskPriority priority = TaskPriority::kControl);
+
+    // 每轮迭代最多执行max_tasks个任务、最多花费max_time处理任务, 0表示不限制
+    // 预算耗尽时剩下的任务留到下一轮迭代继续执行, 期间Poll使用0超时,
+    // 这样大量堆积的任务不会让IO事件一直等待, 也不会因为睡眠而被推迟
+    // Notice: 只能在IO线程中设置
+    void SetPendingTaskBudget(size_t max_tasks, std::chrono::microseconds max_time);
 
     void WakeUp();
 
+    // 把task推迟到下一轮Loop迭代中, 在下一轮Poll返回、分发完IO事件之后执行
+    // 用于读写预算耗尽的连接把剩余的工作让给同一个EventLoop上的其他连接
+    // 存在被推迟的任务时, 下一轮Poll使用0超时, 不会因为等待IO事件而把它们饿死
+    // Notice: 只能在IO线程中调用
+    void DeferToNextIteration(const define::IOEventCallback& task);
+
+    // 注册一个在每轮Loop迭代末尾(处理完IO事件与pending tasks之后)执行的钩子, 返回钩子的id
+    // 用于InterLoopChannel等需要每轮迭代批量处理一次的组件, 钩子本身应当足够廉价
+    // Notice: 只能在IO线程中调用
+    int AddIterationHook(const define::IOEventCallback& hook);
+    void RemoveIterationHook(int hook_id);
+
+    // 写合并(write coalescing), 只能在IO线程中设置, 默认关闭
+    // 开启后IO线程中的Send(处理IO事件、pending tasks与迭代钩子期间)不直接写socket, 只把数据追加到连接的输出缓冲区,
+    // 每轮迭代的最后每条有待写数据的连接刷新一次, 用一次writev写出这一轮中积攒的所有数据:
+    // 一个回复分几次Send(头部、正文、尾部)时只需要一次系统调用, 报文也更少
+    // cork为true时, 需要多次系统调用才能写完的刷新(例如数据之后是sendfile的文件段)期间设置TCP_CORK, 不会发出未填满的报文,
+    // 代价是这样的刷新多两次setsockopt; 一次writev就能写完的刷新不cork
+    void SetWriteCoalescing(bool on, bool cork = false);
+    bool WriteCoalescing() const { return write_coalescing_; }
+    bool CorkOnFlush() const { return cork_on_flush_; }
+    // 登记一个在本轮迭代最后(迭代钩子之后)执行的刷新, 由开启了写合并的TcpConnection调用
+    // Notice: 只能在IO线程中调用
+    void FlushAtIterationEnd(const define::IOEventCallback& flush);
+
+    // bulk连接(TcpConnection::SetPacing中bulk为true)在本EventLoop上的总发送速率上限(字节/秒), 0表示不限制(默认)
+    // burst_bytes为允许的突发, 0表示取20ms的量. 只能在IO线程中设置
+    // 交互式(非bulk)连接不受这个上限约束, 不会排在大流量之后; bulk连接之间轮转分享带宽:
+    // 每次最多取得kBulkQuantum字节, 还有数据要发时排到等待队列的末尾, 令牌足够时按排队顺序恢复
+    static constexpr size_t kBulkQuantum = 16 * 1024;
+    void SetBulkBandwidthLimit(uint64_t bytes_per_sec, size_t burst_bytes = 0);
+    bool BulkBandwidthLimited() const { return bulk_bucket_.Enabled(); }
+    // 以下三个供TcpConnection使用
+    // bulk连接这一次最多可以发送的字节数, 0表示需要排队等待(WaitForBulkBandwidth); 不限制时返回SIZE_MAX
+    // resumed表示调用者刚被WaitForBulkBandwidth恢复, 可以越过队列中的其他连接
+    size_t BulkAllowance(bool resumed);
+    void ConsumeBulkBandwidth(size_t bytes) { bulk_bucket_.Consume(bytes); }
+    void WaitForBulkBandwidth(const define::IOEventCallback& resume);
+
+    // 把计算密集型的work交给pool执行, 避免阻塞本EventLoop上的其他fd
+    // work执行完后done通过QueueTaskInThisLoop回到本EventLoop所在的IO线程中执行
+    // pool已满且拒绝了任务时返回false; 需要传递计算结果时可以使用ComputePool::Offload
+    bool RunInComputePool(ComputePool& pool, const define::IOEventCallback& work, const define::IOEventCallback& done);
+
+    // 每个Channel在一轮迭代中单次事件处理最多读写的字节数, 0表示不限制
+    void SetIoBudgetPerEvent(size_t bytes) { io_budget_per_event_ = bytes; }
+    size_t IoBudgetPerEvent() const { return io_budget_per_event_; }
+
+    // 本EventLoop独享的内存资源, 连接、Channel与IO缓冲区从这里分配
+    LoopMemory& Memory() const { return *memory_; }
+    // 在IO线程中调用时返回memory_, 否则返回nullptr(此时应当使用全局的operator new)
+    LoopMemory* MemoryForThisThread() const { return IsInLoopThread() ? memory_.get() : nullptr; }
+
     // 定时器相关
-    TimerId RunAt(const define::SystemTimePoint time, const define::TimerCallback& cb);
-    TimerId RunAfter(long delay_ms, const define::TimerCallback& cb);
-    TimerId RunEvery(long interval_ms, const define::TimerCallback& cb);
+    // slack_ms是定时器可以容忍的延迟, 定时器会在[到期时间, 到期时间 + slack_ms]内触发,
+    // 到期时间相近的定时器会被合并到同一次timerfd唤醒中; 0表示精确触发(默认)
+    // 空闲超时这类对精度不敏感的定时器应当给出尽可能大的slack
+    TimerId RunAt(const define::SystemTimePoint time, const define::TimerCallback& cb, long slack_ms = 0);
+    TimerId RunAfter(long delay_ms, const define::TimerCallback& cb, long slack_ms = 0);
+    TimerId RunEvery(long interval_ms, const define::TimerCallback& cb, long slack_ms = 0);
+    // 定时器的运行统计(timerfd唤醒次数等), 只能在IO线程中读取
+    const TimerQueueStats& TimerStats() const;
+    // 本EventLoop上开启了内核接收时间戳的连接的延迟直方图, 只能在IO线程中读取或Reset
+    RxLatencyStats& RxLatency() { return rx_latency_; }
+    // poll超时驱动的定时器(不使用timerfd), 只能在IO线程中设置, 默认关闭
+    // 开启后Poll的超时时间取最早到期的定时器的剩余时间(毫秒, 向上取整), Poll返回后直接处理到期的定时器,
+    // 每个定时周期省去timerfd_settime与read两次系统调用, 代价是定时精度只能到毫秒级
+    void SetPollDrivenTimers(bool on);
 
 private:
     EventLoop() = default;
+    static std::shared_ptr<EventLoop> CreateImpl(const std::shared_ptr<VirtualClock>& clock);
     void AbortNotInLoopThread();
     void HandleWakeUp();
     void DoPendingTasks();
+    // 是否还有因预算耗尽而未执行完的任务
+    bool HasPendingBacklog() const;
+    void DoDeferredTasks();
+    void RunIterationHooks();
+    void RunFlushes();
+    void ResumeBulkWaiters();
+    // 事件循环的主体, 以具体的Poller类型(EPollPoller/PollPoller, 都是final)作为编译期策略:
+    // 循环中对Poll的调用是非虚的, EPollPoller::Poll定义在头文件中, 会内联进循环. Loop()在入口按Poller::Kind()选择一次
+    template <typename PollerT>
+    void LoopWith(PollerT* poller);
+    // 以poller_的具体类型调用fn, 用于UpdateChannel/RemoveChannel等不经过虚函数的分发
+    template <typename Fn>
+    void WithPoller(Fn&& fn);
+    // 在自旋预算内以0超时反复Poll, 得到IO事件时返回true
+    template <typename PollerT>
+    bool SpinPoll(PollerT* poller);
+    // 根据本轮自旋/阻塞等待的结果调整自旋预算
+    void AdjustSpinBudget(bool spin_hit, std::chrono::steady_clock::duration blocked);
 
-    using ChannelList = std::vector<std::shared_ptr<Channel>>;
+    // 只保存裸指针, 分发IO事件的热路径上不产生引用计数的原子操作
+    using ChannelList = std::vector<Channel*>;
     bool looping_;
     bool quit_;
     bool handling_pending_tasks_;
@@ -88,18 +233,55 @@ private:
     // IO多路复用的组件
     // EventLoop拥有Poller的唯一所有权, 因此通过unique_ptr来管理
     std::unique_ptr<Poller> poller_;
+    // 注入的时间源, 为空时使用system_clock
+    std::shared_ptr<Clock> clock_;
     define::SystemTimePoint poll_return_time_;
+    RxLatencyStats rx_latency_;
     // 存放正在“转发”活跃IO事件的channel
-    // 由poller_负责更新
-    // Fixme: EventLoop应该拥有active_channels的唯一所有权, 但是这里似乎使用shared_ptr更加合适 
-    std::shared_ptr<ChannelList> active_channels_;
+    // 由poller_负责更新, EventLoop拥有它的唯一所有权
+    ChannelList active_channels_;
 
+    // 必须先于所有从它分配的Channel构造, 晚于它们析构
+    std::unique_ptr<LoopMemory, LoopMemoryDeleter> memory_;
     std::unique_ptr<TimerQueue> timer_queue_;
     // 负责任务调度工作
     int wakeup_fd_;
     std::shared_ptr<Channel> wakeup_channel_;
     std::mutex mutex_;
-    std::vector<define::IOEventCallback> pending_tasks_;
+    // 按TaskPriority分道的任务队列, pending_tasks_由mutex_保护;
+    // running_tasks_只在IO线程中访问, running_pos_之前的任务已经执行过, 之后的是结转下来的任务
+    static constexpr size_t kTaskLanes = 2;
+    std::vector<define::IOEventCallback> pending_tasks_[kTaskLanes];
+    std::vector<define::IOEventCallback> incoming_tasks_[kTaskLanes];
+    std::vector<define::IOEventCallback> running_tasks_[kTaskLanes];
+    size_t running_pos_[kTaskLanes];
+    size_t max_tasks_per_iteration_;
+    std::chrono::microseconds max_task_time_per_iteration_;
+    // 被推迟到下一轮迭代的任务, 只在IO线程中访问, 不需要加锁
+    std::vector<define::IOEventCallback> deferred_tasks_;
+    std::vector<define::IOEventCallback> running_deferred_tasks_;
+    size_t io_budget_per_event_;
+    // 每轮迭代末尾执行的钩子, 只在IO线程中访问
+    std::vector<std::pair<int, define::IOEventCallback>> iteration_hooks_;
+    int next_hook_id_;
+    bool running_hooks_;
+    // 写合并相关, 只在IO线程中访问
+    bool write_coalescing_;
+    bool cork_on_flush_;
+    bool flushing_;
+    std::vector<define::IOEventCallback> pending_flushes_;
+    std::vector<define::IOEventCallback> running_flushes_;
+    // bulk连接的总带宽, 只在IO线程中访问
+    TokenBucket bulk_bucket_;
+    std::deque<define::IOEventCallback> bulk_waiters_;
+    bool bulk_resume_scheduled_;
+    // 忙轮询相关
+    std::chrono::microseconds max_spin_;
+    std::chrono::microseconds min_spin_;
+    std::chrono::microseconds spin_budget_;
+    // 负载统计, 只由IO线程写入; steady_clock的纳秒数
+    std::atomic<int64_t> loop_start_ns_ {0};
+    std::atomic<int64_t> idle_ns_ {0};
 };
 
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "ThreadPlacement.h"
+
 #include <condition_variable>
 #include <memory>
 #include <mutex>
@@ -14,7 +16,8 @@ class EventLoopThread
 {
 
 public:
-    EventLoopThread();
+    // placement: IO线程的CPU/NUMA放置策略, 在EventLoop创建之前应用
+    explicit EventLoopThread(const ThreadPlacement& placement = ThreadPlacement());
     ~EventLoopThread();
     EventLoopThread(const EventLoopThread&) = delete;
     EventLoopThread& operator=(const EventLoopThread&) = delete;
@@ -23,15 +26,19 @@ public:
 
     std::shared_ptr<EventLoop> StartLoop();
 
+    const ThreadPlacement& Placement() const { return placement_; }
+
 private:
     void ThreadFunc();
 
+    // EventLoop只能在IO线程中创建, StartLoop返回之前为nullptr
     std::shared_ptr<EventLoop> loop_;
     bool exited_;
     std::unique_ptr<std::thread> thread_;
     std::mutex mutex_;
     std::condition_variable cv_;
     bool thread_started_;
+    const ThreadPlacement placement_;
 };
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "ThreadPlacement.h"
+
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace Cloo 
+{
+
+class EventLoop;
+class EventLoopThread;
+enum class SocketFd;
+
+// EventLoopThreadPool管理一组EventLoopThread, 为新连接挑选处理它的IO线程
+// 每个IO线程都可以指定ThreadPlacement, 池会记录“CPU -> EventLoop”的映射,
+// 配合SO_INCOMING_CPU可以把连接交给绑定在“网卡软中断所在CPU”上的EventLoop处理,
+// 使得收包、协议栈处理和用户回调都发生在同一个CPU(同一个NUMA节点)上
+// Start之后还可以用AddLoop/DetachLoop增减IO线程, 增减与连接的迁移由TcpServer根据SampleUtilization()的结果决定
+class EventLoopThreadPool
+{
+public:
+    // base_loop: 通常是Acceptor所在的EventLoop, 池中没有IO线程时所有连接都交给它
+    explicit EventLoopThreadPool(const std::shared_ptr<EventLoop>& base_loop);
+    ~EventLoopThreadPool();
+
+    EventLoopThreadPool(const EventLoopThreadPool&) = delete;
+    EventLoopThreadPool& operator=(const EventLoopThreadPool&) = delete;
+
+    // 启动num_threads个IO线程, 第i个线程使用placements[i % placements.size()]放置
+    // placements为空表示不做放置
+    // 必须在base_loop所在线程中调用
+    void Start(int num_threads, const std::vector<ThreadPlacement>& placements = {});
+
+    // 一个线程绑定一个CPU, 依次使用cpus中的CPU
+    static std::vector<ThreadPlacement> PinEachToCpu(const std::vector<int>& cpus);
+
+    // round-robin地选取下一个EventLoop
+    std::shared_ptr<EventLoop> GetNextLoop();
+    // 选取绑定在cpu上的EventLoop, 有多个时在它们之间round-robin; 没有绑定在该CPU上的IO线程时退化为GetNextLoop()
+    std::shared_ptr<EventLoop> GetLoopForCpu(int cpu);
+    // 通过SO_INCOMING_CPU得到处理该连接收包的CPU, 再由GetLoopForCpu选取EventLoop
+    std::shared_ptr<EventLoop> GetLoopForSocket(SocketFd fd);
+
+    // 运行时增加一个IO线程, 返回它的EventLoop, 必须在base_loop所在线程中调用
+    std::shared_ptr<EventLoop> AddLoop(const ThreadPlacement& placement = ThreadPlacement());
+    // 把loop移出池, 之后不会再被选中; 返回它的线程, 线程对象析构时EventLoop退出并join.
+    // 调用者负责在析构之前让loop上的连接离开. loop不在池中时返回nullptr. 必须在base_loop所在线程中调用
+    std::unique_ptr<EventLoopThread> DetachLoop(EventLoop* loop);
+    bool Contains(EventLoop* loop) const;
+    // 各IO线程(与Loops()的顺序相同)自上一次调用以来的利用率(0~1), 第一次调用时为Loop开始以来的利用率
+    // 必须在base_loop所在线程中调用
+    std::vector<double> SampleUtilization();
+
+    const std::vector<std::shared_ptr<EventLoop>>& Loops() const { return loops_; }
+    bool Started() const { return started_; }
+
+private:
+    void RebuildCpuMap();
+
+    std::shared_ptr<EventLoop> base_loop_;
+    bool started_;
+    size_t next_;
+    std::vector<std::unique_ptr<EventLoopThread>> threads_;
+    std::vector<std::shared_ptr<EventLoop>> loops_;
+    // 绑定在同一个CPU上的IO线程(loops_的下标)与轮转的位置
+    struct CpuLoops
+    {
+        std::vector<size_t> loops;
+        size_t next = 0;
+    };
+    // CPU到IO线程的映射, 只记录放置策略中出现过的CPU
+    std::map<int, CpuLoops> cpu_to_loops_;
+    // SampleUtilization上一次的采样
+    std::map<EventLoop*, std::pair<int64_t, int64_t>> last_load_;
+};
+
+} // end namespace Cloo
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Socket.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Cloo
+{
+
+class EventLoop;
+class Channel;
+
+// 交接的fd的用途
+enum class HandoverFdKind : uint8_t
+{
+    kListener,    // 监听socket, 新进程用它构造TcpServer/Acceptor
+    kConnection,  // 已经建立的连接, 新进程通过TcpServer::AdoptConnection接管
+};
+
+struct HandoverFd
+{
+    HandoverFdKind kind;
+    SocketFd fd;
+};
+
+// 通过已连接的AF_UNIX SOCK_SEQPACKET socket用SCM_RIGHTS发送fds, 以一个不带fd的消息结尾. 失败时抛出runtime_error
+void SendHandoverFds(int unix_fd, const std::vector<HandoverFd>& fds);
+// 接收SendHandoverFds发送的全部fds, 收到的fd都带有FD_CLOEXEC. 失败时关闭已经收到的fd并抛出runtime_error
+std::vector<HandoverFd> ReceiveHandoverFds(int unix_fd);
+
+// 新进程: 连接旧进程在path上的HandoverServer并取回fds, path尚不存在时在timeout_ms内反复重试
+// 阻塞调用, 一般在创建EventLoop之前调用
+std::vector<HandoverFd> FetchHandoverFds(const std::string& path, int timeout_ms);
+
+// 零停机重启中旧进程的一端: 在Unix socket path上等待新进程连接,
+// 新进程连接后在loop中调用CollectCallback收集要交出的fds并发送过去, 之后调用CompleteCallback.
+// 一般在CompleteCallback中调用TcpServer::StopAccepting, 之后旧进程只处理已有的连接直到它们关闭(drain).
+// 监听fd仍由旧进程的Acceptor持有, 两个进程共享同一个监听队列, 交接期间到达的连接不会被拒绝;
+// kConnection的fd由TcpConnection::DetachForHandover得到, 发送之后由HandoverServer关闭.
+// 交接失败时CompleteCallback的参数为false, HandoverServer继续等待下一次连接
+class HandoverServer
+{
+using CollectCallback = std::function<std::vector<HandoverFd> ()>;
+using CompleteCallback = std::function<void (bool)>;
+
+public:
+    HandoverServer(const std::shared_ptr<EventLoop>& loop, const std::string& path);
+    ~HandoverServer();
+
+    HandoverServer(const HandoverServer&) = delete;
+    HandoverServer& operator=(const HandoverServer&) = delete;
+
+    void SetCollectCallback(const CollectCallback& cb) { collect_cb_ = cb; }
+    void SetCompleteCallback(const CompleteCallback& cb) { complete_cb_ = cb; }
+    // 开始监听path, 必须在loop所在线程中调用
+    void Listen();
+    bool HandedOver() const { return handed_over_; }
+
+private:
+    void HandleRead();
+    void Close();
+
+    EventLoop* loop_;
+    const std::string path_;
+    std::unique_ptr<Socket> listen_socket_;
+    std::shared_ptr<Channel> channel_;
+    CollectCallback collect_cb_;
+    CompleteCallback complete_cb_;
+    bool handed_over_;
+    bool closed_;
+};
+
+} // end namespace Cloo
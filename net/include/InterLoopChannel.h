@@ -0,0 +1,147 @@
+#pragma once
+
+#include "EventLoop.h"
+#include "SpscRing.h"
+
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+namespace Cloo 
+{
+
+// InterLoopChannel是IO线程之间传递类型化消息的通道, 一个通道只有一个接收方EventLoop
+// 与QueueTaskInThisLoop相比:
+//  1. 每个发送方(通常是另一个EventLoop)拥有一条专属的SPSC环形队列, 发送方之间、发送方与接收方之间都不争用同一把锁
+//  2. 消息是普通的结构体(例如 fd + 对端地址), 不需要把数据包装成std::function闭包
+//  3. 接收方在每轮Loop迭代结束时一次性取空所有队列; 多条消息共用一次WakeUp(eventfd)唤醒
+// 队列已满时Send返回false, 由发送方决定重试还是丢弃(背压)
+template<typename T>
+class InterLoopChannel
+{
+    static_assert(std::is_trivially_copyable_v<T>, "InterLoopChannel only carries plain structs");
+
+public:
+    using Handler = std::function<void(const T&)>;
+
+    // 每个发送方持有一个Producer, Producer只能在同一个线程中使用
+    class Producer
+    {
+    public:
+        bool Send(const T& msg) { return SendBatch(&msg, 1) == 1; }
+
+        // 批量发送, 返回实际放入队列的消息数
+        size_t SendBatch(const T* msgs, size_t count)
+        {
+            size_t n = ring_.TryPushBatch(msgs, count);
+            if(n > 0)
+            {
+                channel_->Notify();
+            }
+            return n;
+        }
+
+    private:
+        friend class InterLoopChannel;
+        Producer(InterLoopChannel* channel, size_t capacity) : channel_(channel), ring_(capacity) {}
+
+        InterLoopChannel* channel_;
+        SpscRing<T> ring_;
+    };
+
+    // ring_capacity: 每个发送方队列的容量; handler: 在接收方IO线程中处理每条消息
+    // 必须在receiver所在的IO线程中构造和析构
+    InterLoopChannel(EventLoop* receiver, size_t ring_capacity, const Handler& handler)
+        : receiver_(receiver),
+          ring_capacity_(ring_capacity),
+          handler_(handler),
+          notified_(false),
+          producers_changed_(false)
+    {
+        receiver_->AssertInLoopTread();
+        hook_id_ = receiver_->AddIterationHook([this]{ Drain(); });
+    }
+
+    ~InterLoopChannel()
+    {
+        receiver_->AssertInLoopTread();
+        receiver_->RemoveIterationHook(hook_id_);
+    }
+
+    InterLoopChannel(const InterLoopChannel&) = delete;
+    InterLoopChannel& operator=(const InterLoopChannel&) = delete;
+
+    // 为一个发送方创建专属的队列, 线程安全
+    // 返回的Producer由通道持有, 生命周期与通道相同
+    Producer* MakeProducer()
+    {
+        std::lock_guard<std::mutex> lg(mutex_);
+        producers_.push_back(std::unique_ptr<Producer>(new Producer(this, ring_capacity_)));
+        producers_changed_.store(true, std::memory_order_release);
+        return producers_.back().get();
+    }
+
+private:
+    // 只有第一个把notified_从false置为true的发送方需要唤醒接收方
+    void Notify()
+    {
+        // 与Drain中的fence配对: 要么接收方在清除标记之后能看到新消息, 要么发送方能看到被清除的标记并唤醒接收方
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(!notified_.exchange(true, std::memory_order_acq_rel))
+        {
+            receiver_->WakeUp();
+        }
+    }
+
+    // 接收方每轮迭代调用一次
+    void Drain()
+    {
+        if(!notified_.load(std::memory_order_acquire))
+        {
+            return;
+        }
+        // 先清除标记再取数据, 取数据期间新到达的消息会重新触发唤醒
+        notified_.store(false, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(producers_changed_.exchange(false, std::memory_order_acquire))
+        {
+            std::lock_guard<std::mutex> lg(mutex_);
+            snapshot_.clear();
+            for(auto& producer : producers_)
+            {
+                snapshot_.push_back(producer.get());
+            }
+        }
+        T batch[kDrainBatch];
+        for(Producer* producer : snapshot_)
+        {
+            size_t n;
+            while((n = producer->ring_.PopBatch(batch, kDrainBatch)) > 0)
+            {
+                for(size_t i = 0; i < n; ++i)
+                {
+                    handler_(batch[i]);
+                }
+            }
+        }
+    }
+
+    static constexpr size_t kDrainBatch = 64;
+
+    EventLoop* receiver_;
+    const size_t ring_capacity_;
+    Handler handler_;
+    int hook_id_;
+    alignas(64) std::atomic<bool> notified_;
+    std::atomic<bool> producers_changed_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Producer>> producers_;
+    // 接收方使用的producers_副本, 只在接收方IO线程中访问
+    std::vector<Producer*> snapshot_;
+};
+
+} // end namespace Cloo
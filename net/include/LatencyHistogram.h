@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Cloo
+{
+
+// 对数分桶的延迟直方图, 单位为纳秒
+// 每个2的幂区间再线性地分为kSubBuckets个桶, 百分位数的相对误差不超过1/kSubBuckets;
+// Record只是一次计数, 没有内存分配也不加锁, 只能在一个线程中更新(一般是IO线程)
+class LatencyHistogram
+{
+public:
+    static constexpr int kSubBucketBits = 3;
+    static constexpr uint64_t kSubBuckets = 1 << kSubBucketBits;
+
+    LatencyHistogram() { Reset(); }
+
+    void Record(int64_t ns);
+    void Reset();
+    // 把other的计数累加进来, 用于汇总多个EventLoop的直方图
+    void Merge(const LatencyHistogram& other);
+
+    uint64_t Count() const { return count_; }
+    int64_t Max() const { return max_; }
+    double Mean() const { return count_ == 0 ? 0 : static_cast<double>(sum_) / static_cast<double>(count_); }
+    // 第p(0~100)百分位数所在桶的上界, 没有样本时返回0
+    int64_t Percentile(double p) const;
+    // 形如 "n=1000 mean=12.3us p50=10.2us p99=40.9us p999=81.9us max=95.1us"
+    std::string Summary() const;
+
+private:
+    static constexpr size_t kBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+    static size_t BucketOf(uint64_t ns);
+    static uint64_t UpperBoundOf(size_t bucket);
+
+    std::array<uint64_t, kBuckets> counts_;
+    uint64_t count_;
+    uint64_t sum_;
+    int64_t max_;
+};
+
+// 开启了内核接收时间戳(TcpConnection::SetRxTimestamping)的连接在一个EventLoop上的延迟分布
+// 两段相加就是从内核收到请求到回复交给IO线程的时间, 分开统计可以看出p99是花在等待分发上还是花在处理上
+struct RxLatencyStats
+{
+    // 内核收到报文 -> MessageCallback被调用: 内核socket缓冲区中的排队 + 等待Poll返回 + 同一轮中排在前面的事件
+    LatencyHistogram kernel_to_dispatch;
+    // MessageCallback被调用 -> 这条连接的下一次Send进入IO线程: 处理请求并产生回复的时间
+    LatencyHistogram dispatch_to_reply;
+};
+
+} // end namespace Cloo
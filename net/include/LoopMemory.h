@@ -0,0 +1,201 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+namespace Cloo
+{
+
+// region的大页策略
+// kNone: 普通页
+// kTransparent: 普通mmap后madvise(MADV_HUGEPAGE), 由THP在后台合并为大页
+// kExplicit: mmap(MAP_HUGETLB)直接使用预留的大页, 系统没有预留大页时退回到kTransparent
+enum class HugePagePolicy
+{
+    kNone,
+    kTransparent,
+    kExplicit,
+};
+
+// LoopMemory是每个EventLoop独享的内存资源
+// 连接、Channel这类小对象按64字节分级使用slab, IO缓冲区使用固定大小(kBufferChunkSize)的chunk池,
+// 二者都从按kRegionSize向系统mmap的region中切分, 释放后留在空闲链表中供下一次复用, 不再归还给系统.
+// one loop per thread, 分配只在EventLoop所属的线程中进行, 不需要任何同步;
+// 释放可以发生在任意线程: 其他线程归还的内存先压入一个无锁的栈中, 由所属线程在空闲链表耗尽时一次性取回.
+// Notice:
+//  1. Allocate*只能在所属线程中调用, 其他线程应当通过EventLoop::MemoryForThisThread()得到nullptr并退回到全局的operator new
+//  2. 与Channel引用EventLoop一样, 从LoopMemory分配的对象只以裸指针引用它, 所属线程中的分配与释放不产生引用计数的原子操作;
+//     EventLoop析构时如果仍有内存没有归还(例如连接迁移到其他EventLoop后比原来的EventLoop活得久), LoopMemory转为"孤儿",
+//     由最后一次归还内存的线程释放它
+class LoopMemory
+{
+public:
+    // EventLoop析构时通过Deleter释放LoopMemory, 仍有内存未归还时推迟到最后一次归还时释放
+    struct Deleter
+    {
+        void operator()(LoopMemory* memory) const;
+    };
+
+    static constexpr size_t kSizeClassBytes = 64;
+    static constexpr size_t kMaxSlabObjectSize = 1024;
+    static constexpr size_t kBufferChunkSize = 2048;
+    static constexpr size_t kRegionSize = 2 * 1024 * 1024;
+
+    // 所属线程为调用线程
+    static std::unique_ptr<LoopMemory, Deleter> Create();
+    ~LoopMemory();
+
+    LoopMemory(const LoopMemory&) = delete;
+    LoopMemory& operator=(const LoopMemory&) = delete;
+
+    bool IsOwnerThread() const { return owner_ == std::this_thread::get_id(); }
+
+    // 只影响之后新映射的region, 只能在所属线程中设置
+    void SetHugePagePolicy(HugePagePolicy policy) { huge_page_policy_ = policy; }
+    HugePagePolicy GetHugePagePolicy() const { return huge_page_policy_; }
+
+    // size字节的对象实际占用的slab块大小(按kSizeClassBytes取整)
+    static constexpr size_t ObjectBlockSize(size_t size)
+    {
+        return ((size == 0 ? 1 : size) + kSizeClassBytes - 1) / kSizeClassBytes * kSizeClassBytes;
+    }
+
+    // size <= kMaxSlabObjectSize的对象, 只能在所属线程中分配, 可以在任意线程中释放
+    void* AllocateObject(size_t size);
+    void DeallocateObject(void* ptr, size_t size) noexcept;
+    // kBufferChunkSize字节的IO缓冲区
+    void* AllocateChunk();
+    void DeallocateChunk(void* ptr) noexcept;
+
+    struct PoolStats
+    {
+        size_t hits = 0;          // 从空闲链表中复用的次数
+        size_t misses = 0;        // 需要从region中新切分的次数
+        size_t remote_frees = 0;  // 由其他线程归还的次数
+        size_t bytes_in_use = 0;  // 分配出去尚未归还的字节数
+        size_t bytes_cached = 0;  // 切分出来、当前空闲的字节数
+    };
+    struct Stats
+    {
+        PoolStats objects;         // 所有slab size class的合计
+        PoolStats chunks;
+        size_t bytes_mapped = 0;   // 向系统mmap的字节数
+        size_t huge_regions = 0;   // 使用MAP_HUGETLB映射的region数
+    };
+    // 在所属线程中调用时是精确值, 其他线程中调用只能作为参考
+    Stats GetStats() const;
+
+    // 进程中尚未释放的LoopMemory个数(包括等待最后一次归还的孤儿)
+    static size_t LiveInstances();
+
+private:
+    LoopMemory();
+
+    // 单一大小的内存池
+    class FixedPool
+    {
+    public:
+        FixedPool() = default;
+        void Init(LoopMemory* memory, size_t block_size) { memory_ = memory; block_size_ = block_size; }
+        void* Allocate();
+        void Deallocate(void* ptr, bool remote) noexcept;
+        void AddTo(PoolStats& stats) const;
+        // 分配出去、没有在所属线程中归还的块数
+        size_t NotFreedLocally() const { return hits_ + misses_ - local_frees_; }
+
+    private:
+        struct FreeNode
+        {
+            FreeNode* next;
+        };
+
+        LoopMemory* memory_ = nullptr;
+        size_t block_size_ = 0;
+        // 以下只在所属线程中访问
+        FreeNode* free_list_ = nullptr;
+        char* carve_ = nullptr;
+        char* carve_end_ = nullptr;
+        size_t hits_ = 0;
+        size_t misses_ = 0;
+        size_t local_frees_ = 0;
+        // 其他线程归还的内存
+        std::atomic<FreeNode*> remote_free_ {nullptr};
+        std::atomic<size_t> remote_frees_ {0};
+    };
+
+    // 从region中切出len字节(kSizeClassBytes对齐), 只在所属线程中调用
+    char* CarveFromRegion(size_t len);
+    void MapRegion();
+    // EventLoop析构之后的所有归还都按跨线程归还处理: 所属线程已经退出时它的线程id可能被新线程复用
+    bool IsRemoteFree() const { return !IsOwnerThread() || orphaned_.load(std::memory_order_acquire); }
+    // 跨线程归还一个块之后调用, 最后一次归还孤儿的内存时释放LoopMemory
+    void ReleaseRemoteRef() noexcept;
+    // EventLoop析构时调用, 把所属线程中的计数并入remote_refs_
+    void Orphan();
+
+    static constexpr size_t kNumSizeClasses = kMaxSlabObjectSize / kSizeClassBytes;
+
+    const std::thread::id owner_;
+    HugePagePolicy huge_page_policy_;
+    FixedPool object_pools_[kNumSizeClasses];
+    FixedPool chunk_pool_;
+    std::vector<std::pair<void*, size_t>> regions_;
+    char* region_cursor_;
+    char* region_end_;
+    size_t huge_regions_;
+    // EventLoop析构后置位
+    std::atomic<bool> orphaned_ {false};
+    // 引用计数: 所属线程的引用为kOwnerRef, 每次跨线程归还减1; Orphan时减去kOwnerRef并加上所属线程中分配出去、
+    // 没有在所属线程中归还的块数, 此后的值就是仍未归还的块数, 减到0时释放. kOwnerRef足够大, Orphan之前不会减到0
+    static constexpr size_t kOwnerRef = size_t(1) << 62;
+    std::atomic<size_t> remote_refs_ {kOwnerRef};
+};
+
+// 从LoopMemory中分配的标准分配器, 可以用于std::allocate_shared与标准容器
+// memory为nullptr或者单次分配超过kMaxSlabObjectSize时退回到全局的operator new,
+// 分配与释放走哪条路径只取决于memory与大小, 因此二者总是一致的
+template<typename T>
+class LoopAllocator
+{
+public:
+    using value_type = T;
+
+    explicit LoopAllocator(LoopMemory* memory) noexcept : memory_(memory) {}
+    template<typename U>
+    LoopAllocator(const LoopAllocator<U>& other) noexcept : memory_(other.Memory()) {}
+
+    T* allocate(size_t n)
+    {
+        const size_t bytes = n * sizeof(T);
+        if(memory_ && bytes <= LoopMemory::kMaxSlabObjectSize && alignof(T) <= LoopMemory::kSizeClassBytes)
+        {
+            return static_cast<T*>(memory_->AllocateObject(bytes));
+        }
+        return static_cast<T*>(::operator new(bytes));
+    }
+
+    void deallocate(T* ptr, size_t n) noexcept
+    {
+        const size_t bytes = n * sizeof(T);
+        if(memory_ && bytes <= LoopMemory::kMaxSlabObjectSize && alignof(T) <= LoopMemory::kSizeClassBytes)
+        {
+            memory_->DeallocateObject(ptr, bytes);
+            return;
+        }
+        ::operator delete(ptr);
+    }
+
+    LoopMemory* Memory() const noexcept { return memory_; }
+
+    template<typename U>
+    bool operator==(const LoopAllocator<U>& other) const noexcept { return memory_ == other.Memory(); }
+
+private:
+    LoopMemory* memory_;
+};
+
+} // end namespace Cloo
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
+
+namespace Cloo
+{
+
+// 不可变的、引用计数的消息体. 同一份编码好的消息可以被Send给任意多条连接(包括其他IO线程中的连接),
+// 每条连接的输出链中只保存一个引用, 不会复制消息本身
+using SharedPayload = std::shared_ptr<const std::string>;
+
+inline SharedPayload MakeSharedPayload(std::string data)
+{
+    return std::make_shared<const std::string>(std::move(data));
+}
+
+// 一个打开的文件, 最后一个引用释放时关闭fd. 输出链中的文件段引用它, 写出时用sendfile直接从page cache发送
+using SharedFile = std::shared_ptr<const int>;
+// 接管fd
+SharedFile MakeSharedFile(int fd);
+
+// OutputChain是由若干段(slice)组成的输出链, 每一段引用一个SharedPayload的[offset, size())部分
+// 通过Append(SharedPayload)追加的段是零拷贝的; Append(data, len)会把数据复制到链尾一个由输出链独占的段中,
+// 连续的小块复制会合并到同一段里. 写出时用FillIovec把链头的若干段交给writev, 再用Retrieve丢弃已经写出的字节
+// 通过AppendFile追加的是文件段, 内容不进入内存: FillIovec在文件段之前停下, 链头是文件段时由FrontFile取出交给sendfile
+// Notice: 只能在连接所属的IO线程中使用
+class OutputChain
+{
+public:
+    OutputChain() : head_(0), total_(0) {}
+
+    OutputChain(const OutputChain&) = delete;
+    OutputChain& operator=(const OutputChain&) = delete;
+
+    bool Empty() const { return total_ == 0; }
+    size_t ReadableBytes() const { return total_; }
+    size_t SegmentCount() const { return segments_.size() - head_; }
+
+    void Append(SharedPayload payload, size_t offset = 0);
+    void Append(const char* data, size_t len);
+    // 追加文件中[offset, offset + len)的内容
+    void AppendFile(SharedFile file, off_t offset, size_t len);
+
+    // 链头是否是文件段, 是时通过fd/offset/len返回它剩余的部分
+    bool FrontFile(int* fd, off_t* offset, size_t* len) const;
+    // 链中是否有文件段
+    bool HasFile() const;
+
+    // 把链头最多max_iov段填入iov, 遇到文件段时停止, 返回填入的段数
+    int FillIovec(iovec* iov, int max_iov) const;
+    // 丢弃链头len字节
+    void Retrieve(size_t len);
+
+    // 段表占用的字节数(不含段引用的数据)
+    size_t AllocatedBytes() const { return segments_.capacity() * sizeof(Segment); }
+    // 为空时释放段表的存储
+    void Shrink();
+
+private:
+    struct Segment
+    {
+        SharedPayload payload;
+        // 内存段为payload中的偏移, 文件段为文件中的偏移
+        size_t offset;
+        // 由输出链自己创建、可以继续追加数据的段, 指向payload所指的同一个string
+        std::string* owned;
+        // 文件段的文件与结束偏移, 内存段的file为空
+        SharedFile file;
+        size_t end;
+
+        size_t Remaining() const { return (file ? end : payload->size()) - offset; }
+    };
+
+    // 段表, [head_, size())是链中的段. 空的vector不占用内存(std::deque即使为空也要分配), 空闲的连接可以不为输出链付出内存
+    std::vector<Segment> segments_;
+    size_t head_;
+    size_t total_;
+};
+
+} // end namespace Cloo
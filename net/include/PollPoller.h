@@ -0,0 +1,39 @@
+#pragma once
+
+#include "Poller.h"
+#include <vector>
+
+// forward-declaration
+struct pollfd;
+
+namespace Cloo 
+{
+
+// 基于poll(2)的Poller实现
+// poll(2)只有水平触发语义, Channel设置的边沿触发会被忽略(以水平触发的方式工作, 读写直到EAGAIN的语义仍然正确)
+class PollPoller final : public Poller
+{
+
+public:
+    explicit PollPoller(EventLoop* loop);
+    ~PollPoller() override;
+
+    // 调用poll(2)IO多路复用函数来管理到来的IO事件
+    // Question: 如果不在EventLoop所在的IO线程中被调用会发生什么?
+    TimePoint Poll(int timeout_ms, ChannelList* active_channels) override;
+    
+    // 通过Channel来更新和维护pollfds_列表, 过程中涉及多处修改, 详细内容见实现
+    void UpdateChannel(Channel* channel) override;
+    // 将Channel从pollfds_和channels_中移除
+    void RemoveChannel(Channel* channel) override;
+
+private:  
+    // 遍历pollfds_列表, 找出具有活动事件的fd, 把fd的活动事件填入关联的Channel, 然后把Channel填入到activeChannels中
+    void fillActiveChannels(int numEvents, ChannelList* active_channels) const;
+
+    using PollFdList = std::vector<pollfd>;
+    // poll(2)所使用的文件描述符集合,所有需要有IO操作的文件描述符都会被注册到pollfds中
+    PollFdList pollfds_; 
+};
+
+}//end namespace Cloo
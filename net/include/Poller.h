@@ -6,61 +6,70 @@
 #include <chrono>
 #include <map>
 
-// forward-declaration
-struct pollfd;
-
 namespace Cloo 
 {
 
 class Channel;
 
+// Poller的具体类型. EventLoop据此在Loop()入口选择以具体类型特化的事件循环, 循环中对Poller的调用都是非虚的
+enum class PollerKind
+{
+    kEPoll,
+    kPoll,
+    kSim,  // 仿真用的SimPoller, 见SimPoller.h
+};
+
+// Poller是IO多路复用组件的抽象接口, 目前有两种实现:
+//  PollPoller : 基于poll(2), 只支持水平触发
+//  EPollPoller: 基于epoll(7), 支持Channel选择边沿触发(EPOLLET)
+// 默认使用EPollPoller, 设置环境变量CLOO_USE_POLL后使用PollPoller
 class Poller
 {
 
 public:
     // Prefer "using-alias" to "typedef" in modern C++
-    using ChannelList = std::vector<std::shared_ptr<Channel>>;
+    // Poller只保存Channel的裸指针, Channel的生命周期由它的拥有者负责, 见Channel.h
+    using ChannelList = std::vector<Channel*>;
     using TimePoint = std::chrono::time_point<std::chrono::system_clock>;
 
-    Poller(const std::shared_ptr<EventLoop>& loop);
-    ~Poller();
+    Poller(EventLoop* loop, PollerKind kind);
+    virtual ~Poller();
 
     // 不可拷贝
     Poller(const Poller&) = delete;
     Poller(Poller&&) = delete;
     Poller& operator=(const Poller&) = delete;
     Poller& operator=(Poller&&) = delete;
+
+    // 根据环境变量创建默认的Poller
+    static std::unique_ptr<Poller> NewDefaultPoller(EventLoop* loop);
     
-    // 调用poll(2)IO多路复用函数来管理到来的IO事件
-    // 有需要处理的IO事件的fd所关联的Channel会被加入到activeChannels中
+    // 等待IO事件, 有需要处理的IO事件的fd所关联的Channel会被加入到activeChannels中
     // Notice: Poll必须在EventLoop所在的IO线程中被调用
-    // Question: 如果不在EventLoop所在的IO线程中被调用会发生什么?
-    TimePoint Poll(int timeout_ms, const std::shared_ptr<ChannelList>& active_channels);
+    virtual TimePoint Poll(int timeout_ms, ChannelList* active_channels) = 0;
     
-    // 通过Channel来更新和维护pollfds_列表, 过程中涉及多处修改, 详细内容见实现
-    void UpdateChannel(const std::shared_ptr<Channel>& channel);
+    // 注册或更新Channel关心的IO事件
+    virtual void UpdateChannel(Channel* channel) = 0;
+    // 将Channel从Poller中移除
+    virtual void RemoveChannel(Channel* channel) = 0;
+
+    bool HasChannel(Channel* channel) const;
+    PollerKind Kind() const { return kind_; }
 
     void AssertInLoopTread()
     {
-        if(auto loop = owner_loop_.lock())
-        {
-            loop->AssertInLoopTread();
-        }
-
+        owner_loop_->AssertInLoopTread();
     }
 
-private:  
-    // 遍历pollfds_列表, 找出具有活动事件的fd, 把fd的活动事件填入关联的Channel, 然后把Channel填入到activeChannels中
-    void fillActiveChannels(int numEvents, const std::shared_ptr<ChannelList>& active_channels) const;
-
-    using PollFdList = std::vector<pollfd>;
-    using ChannelMap = std::map<int, std::shared_ptr<Channel>>; 
-    // Poller所属的EventLoop
-    std::weak_ptr<EventLoop> owner_loop_;  
-    // poll(2)所使用的文件描述符集合,所有需要有IO操作的文件描述符都会被注册到pollfds中
-    PollFdList pollfds_; 
-    // pollfds中fd所关联的channel的map, poll(2)返回的fd的IO事件会被注册到channel中,由channel“转发”给用户注册的回调函数
+protected:
+    using ChannelMap = std::map<int, Channel*>; 
+    // 已注册的fd与关联的channel的map, IO事件会被注册到channel中,由channel“转发”给用户注册的回调函数
     ChannelMap channels_; 
+
+private:
+    // Poller所属的EventLoop, EventLoop拥有Poller, 因此使用裸指针即可
+    EventLoop* owner_loop_;  
+    const PollerKind kind_;
 };
 
-}//end namespace Cloo
\ No newline at end of file
+}//end namespace Cloo
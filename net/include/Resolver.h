@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <netinet/in.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Cloo
+{
+
+class EventLoop;
+
+// 一次解析的结果
+struct ResolveResult
+{
+    // 0表示成功, 否则为getaddrinfo的错误码(EAI_*), 可以用gai_strerror转换
+    int error = 0;
+    // 解析出的IPv4地址, 端口为Resolve时指定的端口, 可以直接构造SocketAddress
+    std::vector<sockaddr_in> addresses;
+    // 结果来自缓存(包括数字地址), 没有等待getaddrinfo
+    bool from_cache = false;
+};
+
+// 异步的主机名解析
+// getaddrinfo是阻塞的(可能要等DNS服务器几秒), 在IO线程中调用会卡住整个EventLoop, 所以交给Resolver自己的helper线程执行,
+// 完成后通过QueueTaskInThisLoop回到发起请求的EventLoop中回调
+//  缓存: 成功的结果保存positive_ttl, 名字不存在(EAI_NONAME/EAI_NODATA)的结果保存negative_ttl(负缓存, 避免不存在的名字反复打到DNS服务器);
+//       EAI_AGAIN、EAI_SYSTEM、EAI_MEMORY这类暂时性的失败不缓存, 下一次请求重新解析.
+//       getaddrinfo不返回DNS记录的TTL, 缓存时间由Options指定
+//  合并: 同一个名字正在解析时, 后来的请求不再调用getaddrinfo, 等第一个请求的结果一起回调
+// 数字地址(inet_pton能解析的)不经过helper线程与缓存
+// 所有公开函数都是线程安全的, 一个Resolver可以被多个EventLoop共享; 析构前需要保证不会再有请求.
+// 析构时正在进行的getaddrinfo照常完成并回调, 还在排队的请求以EAI_CANCELED回调, 回调所在的EventLoop需要仍然存在
+class Resolver
+{
+public:
+    using ResolveCallback = std::function<void(const ResolveResult&)>;
+
+    struct Options
+    {
+        // helper线程的数量, 即同时进行的getaddrinfo的最大数量
+        int num_threads = 2;
+        std::chrono::milliseconds positive_ttl = std::chrono::seconds(60);
+        std::chrono::milliseconds negative_ttl = std::chrono::seconds(5);
+        // 缓存的名字数量的上限, 超出时先清理过期的项, 仍然超出时清空
+        size_t max_entries = 4096;
+    };
+
+    Resolver();
+    explicit Resolver(const Options& options);
+    ~Resolver();
+
+    Resolver(const Resolver&) = delete;
+    Resolver& operator=(const Resolver&) = delete;
+
+    // 解析host, 完成后在loop所在的IO线程中调用cb. 缓存命中时也通过QueueTaskInThisLoop回调, 不会在Resolve中直接调用
+    void Resolve(EventLoop* loop, const std::string& host, uint16_t port, const ResolveCallback& cb);
+    // 只查缓存(包括数字地址), 命中时填写result并返回true
+    bool Lookup(const std::string& host, uint16_t port, ResolveResult* result);
+    // 清空缓存, 不影响正在进行的解析
+    void ClearCache();
+    // error是否表示名字确实不存在(会被负缓存), 否则是暂时性的失败, 可以重试
+    static bool IsPermanentError(int error);
+
+    // getaddrinfo的调用次数、缓存命中次数、合并到正在进行的解析上的请求数
+    size_t Lookups() const { return lookups_.load(std::memory_order_relaxed); }
+    size_t CacheHits() const { return cache_hits_.load(std::memory_order_relaxed); }
+    size_t Coalesced() const { return coalesced_.load(std::memory_order_relaxed); }
+
+private:
+    struct Waiter
+    {
+        EventLoop* loop;
+        uint16_t port;
+        ResolveCallback cb;
+    };
+
+    struct Entry
+    {
+        int error = 0;
+        std::vector<in_addr> addresses;
+        std::chrono::steady_clock::time_point expires;
+        // 正在解析, 等待结果的请求
+        bool resolving = false;
+        std::vector<Waiter> waiters;
+    };
+
+    void WorkerFunc();
+    // 在helper线程中调用getaddrinfo, 结果写入缓存并回调所有等待的请求
+    void DoResolve(const std::string& host);
+    void TrimCache(std::chrono::steady_clock::time_point now);
+    static bool ParseNumeric(const std::string& host, uint16_t port, ResolveResult* result);
+    static ResolveResult MakeResult(int error, const std::vector<in_addr>& addresses, uint16_t port, bool from_cache);
+
+    const Options options_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::unordered_map<std::string, Entry> cache_;
+    // 等待helper线程处理的名字
+    std::deque<std::string> queue_;
+    bool stopping_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> lookups_;
+    std::atomic<size_t> cache_hits_;
+    std::atomic<size_t> coalesced_;
+};
+
+} // end namespace Cloo
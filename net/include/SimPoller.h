@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Poller.h"
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace Cloo 
+{
+
+class VirtualClock;
+
+// 仿真用的Poller, 不做任何系统调用, 由EventLoop::CreateSimulated创建
+// Poll时返回通过Inject注入的"就绪"Channel; 没有就绪的Channel也没有被WakeUp时,
+// 把VirtualClock直接推进timeout_ms(即推进到最早的定时器到期)后立即返回.
+// 这样定时器与任务调度的逻辑可以在不睡眠、不依赖真实fd的情况下以远快于真实时间的速度回放
+class SimPoller final : public Poller
+{
+
+public:
+    SimPoller(EventLoop* loop, VirtualClock* clock);
+    ~SimPoller() override;
+
+    TimePoint Poll(int timeout_ms, ChannelList* active_channels) override;
+    void UpdateChannel(Channel* channel) override;
+    void RemoveChannel(Channel* channel) override;
+
+    // 让channel在下一次Poll中以revents就绪, 只能在EventLoop所在线程中调用
+    void Inject(Channel* channel, int revents);
+    // 代替写eventfd唤醒IO线程, 可以在任意线程中调用
+    void WakeUp() { woken_.store(true, std::memory_order_release); }
+
+    // Poll的次数, 以及其中推进了虚拟时间的次数
+    uint64_t Polls() const { return polls_; }
+    uint64_t Advances() const { return advances_; }
+
+private:
+    VirtualClock* clock_;
+    std::vector<std::pair<Channel*, int>> injected_;
+    std::atomic<bool> woken_;
+    uint64_t polls_;
+    uint64_t advances_;
+};
+
+}//end namespace Cloo
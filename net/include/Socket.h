@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 
 namespace Cloo 
@@ -17,17 +18,38 @@ class Socket
 {
 public:
     static std::unique_ptr<Socket> CreateNonblockSocket();
+    // 接管一个已经存在的fd(例如accept得到的连接), Socket析构时会关闭它
+    static std::unique_ptr<Socket> FromFd(SocketFd fd);
+    // 同FromFd, 用于把Socket直接嵌入拥有者(例如TcpConnection), 省去一次堆分配
+    explicit Socket(SocketFd sock_fd) noexcept;
+
+    Socket(const Socket&) = delete;
+    Socket& operator=(const Socket&) = delete;
     
     void Bind(const SocketAddress& sock_addr);
     void Listen();
     SocketFd Accept(std::unique_ptr<SocketAddress>& peer_addr);
     void SetNonblockAndCloseOnExec();
     void SetReuseAddr(bool on);
+    void SetTcpNoDelay(bool on);
+    // TCP_CORK: 设置期间内核只发送填满MSS的报文, 清除时立即发出剩余的数据
+    // 失败时返回false
+    bool SetTcpCork(bool on);
+    // SO_MAX_PACING_RATE: 内核按不超过bytes_per_sec(字节/秒)的速率把报文分散发出(TCP内部pacing或fq qdisc), 0表示取消限制
+    // 内核不支持时返回false
+    bool SetMaxPacingRate(uint64_t bytes_per_sec);
+    // 开启SO_TIMESTAMPING的软件接收时间戳: 内核在协议栈收到报文时记下时间(CLOCK_REALTIME),
+    // 之后通过recvmsg的控制消息(SCM_TIMESTAMPING)随数据一起返回, 见Buffer::ReadFd
+    void SetRxTimestamping(bool on);
+    // 关闭写端, 对端会读到EOF
+    void ShutdownWrite();
+
+    // 通过SO_INCOMING_CPU查询处理这个连接收包(软中断/RPS)的CPU, 不支持或尚未收包时返回-1
+    static int GetIncomingCpu(SocketFd fd);
 
     SocketFd Fd() const {return sock_fd_;}
     ~Socket() noexcept;
 private:
-    explicit Socket(SocketFd sock_fd) noexcept;
     SocketFd sock_fd_;
 };
 
@@ -11,6 +11,7 @@ class SocketAddress
 {
 public:
     SocketAddress(uint16_t port);
+    // host必须是数字形式的IPv4地址, 失败时抛出runtime_error; 主机名用Resolver异步解析
     SocketAddress(std::string_view host, uint16_t port);
     SocketAddress(const sockaddr_in& addr);
 
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+namespace Cloo 
+{
+
+// 有界的单生产者单消费者(SPSC)环形队列
+// 生产者只写tail_, 消费者只写head_, 两者位于不同的cache line上;
+// 双方各自缓存对方的下标, 只有在缓存的下标显示队列已满/已空时才去读取对方的原子变量, 减少cache line的来回传递
+template<typename T>
+class SpscRing
+{
+public:
+    // capacity会被向上取整为2的幂
+    explicit SpscRing(size_t capacity)
+        : capacity_(RoundUpPowerOfTwo(capacity)),
+          mask_(capacity_ - 1),
+          slots_(std::make_unique<T[]>(capacity_))
+    {
+
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // 生产者调用, 队列已满时返回false
+    bool TryPush(const T& item)
+    {
+        return TryPushBatch(&item, 1) == 1;
+    }
+
+    // 生产者调用, 尽可能多地压入items中的元素, 返回实际压入的个数
+    size_t TryPushBatch(const T* items, size_t count)
+    {
+        size_t tail = producer_.tail.load(std::memory_order_relaxed);
+        size_t free_slots = capacity_ - (tail - producer_.cached_head);
+        if(free_slots < count)
+        {
+            producer_.cached_head = consumer_.head.load(std::memory_order_acquire);
+            free_slots = capacity_ - (tail - producer_.cached_head);
+        }
+        size_t n = count < free_slots ? count : free_slots;
+        for(size_t i = 0; i < n; ++i)
+        {
+            slots_[(tail + i) & mask_] = items[i];
+        }
+        producer_.tail.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    // 消费者调用, 最多取出max_count个元素放入out, 返回实际取出的个数
+    size_t PopBatch(T* out, size_t max_count)
+    {
+        size_t head = consumer_.head.load(std::memory_order_relaxed);
+        size_t available = consumer_.cached_tail - head;
+        if(available < max_count)
+        {
+            consumer_.cached_tail = producer_.tail.load(std::memory_order_acquire);
+            available = consumer_.cached_tail - head;
+        }
+        size_t n = max_count < available ? max_count : available;
+        for(size_t i = 0; i < n; ++i)
+        {
+            out[i] = slots_[(head + i) & mask_];
+        }
+        consumer_.head.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    bool EmptyApprox() const
+    {
+        return consumer_.head.load(std::memory_order_relaxed) == producer_.tail.load(std::memory_order_relaxed);
+    }
+
+    size_t Capacity() const { return capacity_; }
+
+private:
+    static size_t RoundUpPowerOfTwo(size_t n)
+    {
+        size_t capacity = 1;
+        while(capacity < n)
+        {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+    struct alignas(64) ProducerSide
+    {
+        std::atomic<size_t> tail {0};
+        size_t cached_head = 0;
+    };
+    struct alignas(64) ConsumerSide
+    {
+        std::atomic<size_t> head {0};
+        size_t cached_tail = 0;
+    };
+
+    const size_t capacity_;
+    const size_t mask_;
+    std::unique_ptr<T[]> slots_;
+    ProducerSide producer_;
+    ConsumerSide consumer_;
+};
+
+} // end namespace Cloo
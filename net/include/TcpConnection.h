@@ -0,0 +1,258 @@
+#pragma once
+
+#include "Buffer.h"
+#include "CallbackDefs.h"
+#include "ConnectionTable.h"
+#include "OutputChain.h"
+#include "Socket.h"
+#include "SocketAddress.h"
+#include "TokenBucket.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+
+namespace Cloo 
+{
+
+class Channel;
+class EventLoop;
+class TlsContext;
+class TlsSession;
+
+// 连接的发送限速(pacing), 见TcpConnection::SetPacing
+struct PacingOptions
+{
+    // 这条连接每秒最多发送的字节数, 0表示不限制
+    uint64_t rate_bytes_per_sec = 0;
+    // 用户态令牌桶的容量(允许的突发), 0表示取20ms的量(至少4KiB)
+    size_t burst_bytes = 0;
+    // 优先使用内核的SO_MAX_PACING_RATE(报文在时间上均匀发出), 内核不支持或为false时使用用户态令牌桶
+    bool kernel = true;
+    // 大流量连接: 同时受EventLoop::SetBulkBandwidthLimit的总带宽约束, 与同一EventLoop上的其他bulk连接轮转分享
+    bool bulk = false;
+};
+enum class SocketFd;
+
+// TcpConnection表示一条已经建立的TCP连接, 由库负责它的读写:
+// 可读时把数据读入input_buffer_再回调MessageCallback, Send的数据写不完时暂存在output_buffer_中, 等可写时继续写
+// TcpConnection的生命周期由shared_ptr管理(TcpServer与用户共享), 它的Channel通过Tie()与它绑定
+// 在IO线程中构造时, 连接对象、Channel与输入/输出缓冲区都从所属EventLoop的LoopMemory中分配
+//
+// 读写都是“drain”语义: 一次事件中反复读/写直到EAGAIN, 这也是边沿触发模式所要求的.
+// 为了避免一条高流量的连接独占EventLoop, 单次事件处理最多读写EventLoop::IoBudgetPerEvent()字节,
+// 预算耗尽时剩余的工作通过EventLoop::DeferToNextIteration推迟到下一轮迭代, 让同一EventLoop上的其他连接先得到处理
+//
+// 连接可以在IO线程之间迁移(TcpServer::MigrateConnection), 迁移不改变连接对象、名字、回调、选项与句柄.
+// 其他线程中的Send/SendFile/Shutdown/ForceClose进入连接自己的任务队列, 由连接当前所属的IO线程按顺序执行,
+// 因此迁移途中发出的数据也保持发送顺序
+class TcpConnection : public std::enable_shared_from_this<TcpConnection>
+{
+public:
+    TcpConnection(EventLoop* loop, const std::string& name, SocketFd fd, const SocketAddress& peer_addr);
+    ~TcpConnection();
+
+    TcpConnection(const TcpConnection&) = delete;
+    TcpConnection& operator=(const TcpConnection&) = delete;
+
+    // 连接当前所属的EventLoop, 迁移后改变
+    EventLoop* GetLoop() const { return loop_.load(std::memory_order_acquire); }
+    const std::string& Name() const { return name_; }
+    const SocketAddress& PeerAddress() const { return peer_addr_; }
+    bool Connected() const { return state_ == State::kConnected; }
+    // 连接在TcpServer的连接表中的句柄, ConnectEstablished之后(包括ConnectionCallback中)有效
+    // 其他线程只需要保存句柄, 通过Cloo::Send(handle, data)发送, 不必持有TcpConnectionPtr
+    const ConnectionHandle& Handle() const { return handle_; }
+    bool Disconnected() const { return state_ == State::kDisconnected; }
+
+    // 以下函数线程安全, 可以在任意线程中调用
+    void Send(std::string_view data);
+    void Send(Buffer* buf);
+    // 零拷贝发送: 输出路径中只保存payload的引用, 同一个payload可以发送给任意多条连接(广播)
+    void Send(const SharedPayload& payload);
+    // 发送文件file_fd中[offset, offset + count)的内容, 文件至少要有offset + count字节, 连接使用fd的一个副本, 调用者可以随即关闭file_fd
+    // 没有待写的数据时直接sendfile, 写不完的部分作为文件段进入输出链, 文件内容不经过用户空间;
+    // 使用TLS时, 发送方向由kTLS处理的连接同样使用sendfile(由内核加密), 否则分块读出后在用户空间加密
+    void SendFile(int file_fd, off_t offset, size_t count);
+    // 输出缓冲区中的数据发送完之后关闭写端
+    void Shutdown();
+    void ForceClose();
+
+    // 零停机重启时把连接交给新进程: 返回连接fd的一个副本, 然后像对端关闭一样在本进程中关闭连接(不发送FIN).
+    // 必须在连接所属的IO线程中调用, 一般在处理完一个完整的请求之后调用;
+    // 输入缓冲区中尚未处理的数据会被丢弃, 还有数据没有写出、连接不处于kConnected或使用了TLS时返回SocketFd::invalid
+    SocketFd DetachForHandover();
+
+    // 使用边沿触发, 必须在ConnectEstablished之前设置
+    void SetEdgeTriggered(bool on) { edge_triggered_ = on; }
+    void SetTcpNoDelay(bool on);
+    // 开启内核接收时间戳(SO_TIMESTAMPING, 软件时间戳), 必须在ConnectEstablished之前或在IO线程中设置
+    // 开启后读取改用recvmsg, MessageCallback的receive_time参数是内核收到这批数据的时间(而不是PollReturnTime),
+    // 并且每次分发与随后的回复都记录到EventLoop::RxLatency()的直方图中
+    void SetRxTimestamping(bool on);
+    // 在这条连接上使用TLS, 必须在ConnectEstablished之前或在IO线程中、收发任何数据之前调用(TcpServer::SetTlsContext在连接建立前调用)
+    // 握手由读写事件驱动, 在用户空间完成; 握手期间Send的数据暂存在输出路径中, 握手完成后加密发出,
+    // MessageCallback收到的总是解密后的数据. 握手失败时连接被关闭
+    void StartTls(const std::shared_ptr<TlsContext>& context);
+    // 没有使用TLS时为nullptr
+    const TlsSession* Tls() const { return tls_.get(); }
+    // 最近一次读到的数据的内核接收时间, 没有开启或内核没有给出时间戳时为默认值
+    define::SystemTimePoint LastKernelReceiveTime() const { return last_rx_time_; }
+
+    void SetConnectionCallback(const define::ConnectionCallback& cb) { connection_callback_ = cb; }
+    void SetMessageCallback(const define::MessageCallback& cb) { message_callback_ = cb; }
+    void SetWriteCompleteCallback(const define::WriteCompleteCallback& cb) { write_complete_callback_ = cb; }
+    // 仅供TcpServer使用, 同一个TcpServer的所有连接共用一个回调对象
+    void SetCloseCallback(const std::shared_ptr<const define::CloseCallback>& cb) { close_callback_ = cb; }
+    void SetConnectionTable(const std::shared_ptr<ConnectionTable>& table) { table_ = table; }
+
+    Buffer* InputBuffer() { return &input_buffer_; }
+    Buffer* OutputBuffer() { return &output_buffer_; }
+    // 尚未写出的字节数(输出缓冲区与输出链之和)
+    size_t PendingOutputBytes() const { return output_buffer_.ReadableBytes() + output_chain_.ReadableBytes(); }
+    // 写socket的系统调用(write/writev/sendfile/TLS写)次数, 用于观察写合并(EventLoop::SetWriteCoalescing)的效果
+    uint64_t WriteCalls() const { return write_calls_; }
+    // 刷新时设置/清除TCP_CORK的setsockopt次数
+    uint64_t CorkCalls() const { return cork_calls_; }
+    // 连接空闲(没有读写)idle_ms毫秒后释放输入/输出缓冲区的存储: chunk归还给EventLoop的LoopMemory供其他连接复用,
+    // 下一次读写时按观察到的读取大小重新分配. 空闲检测使用带slack的定时器, 只有空闲周期内有过读写的连接才持有定时器.
+    // 0表示关闭(默认), 必须在ConnectEstablished之前或在IO线程中设置
+    void SetBufferReleaseIdle(long idle_ms);
+    // 连接自身占用的用户态内存的估计值: TcpConnection与Channel对象(按LoopMemory的slab块取整), 连接名,
+    // 输入/输出缓冲区与输出链的存储. 不含shared_ptr的控制块, 以及TcpServer、Poller与连接表中为连接登记的节点;
+    // 每条连接的全部开销要按分配器的增量统计, 见IdleMemory_test. 只能在IO线程中调用
+    size_t MemoryUsage() const;
+    // 发送限速, 必须在ConnectEstablished之前或在IO线程中设置
+    // 内核pacing: 数据照常写入socket, 由内核按速率发出. 用户态令牌桶: 额度耗尽时停止写socket(也不关注可写事件),
+    // 数据留在输出缓冲区中, 由TimerQueue的定时器在令牌足够时恢复. 限速的连接Send时不再直接写socket, 而是按额度写出
+    void SetPacing(const PacingOptions& options);
+    // 连接自己的速率由内核的SO_MAX_PACING_RATE执行
+    bool KernelPacing() const { return kernel_pacing_; }
+
+    // 连接被TcpServer接受后在IO线程中调用, 只调用一次
+    void ConnectEstablished();
+    // 连接从TcpServer中移除后在IO线程中调用, 只调用一次
+    void ConnectDestroyed();
+    // 迁移到target的两步, 仅供TcpServer使用:
+    // DetachFromLoop在原IO线程中把Channel从Poller中注销, 之后连接属于target, 但在AttachToLoop之前不处理任何事件与任务;
+    // 连接不处于kConnected、TLS握手还没有完成, 或者有推迟到下一轮迭代、迭代末尾刷新或等待限速令牌的工作时返回false, 连接不受影响
+    bool DetachFromLoop(EventLoop* target);
+    // 在target中调用: 重新注册Channel(输入/输出缓冲区改用target的LoopMemory), 恢复连接表的投递与空闲释放的定时器,
+    // 再执行迁移途中其他线程排入的任务. 缓冲区中的数据、限速与TLS状态都保持不变, 不回调ConnectionCallback
+    void AttachToLoop();
+
+private:
+    enum class State { kConnecting, kConnected, kDisconnecting, kDisconnected };
+
+    void HandleRead();
+    void HandleWrite();
+    // 写出待写的数据直到写完、EAGAIN或预算耗尽, 写完时停止关注可写事件, 没写完时等待可写事件
+    void DrainOutput();
+    // 写出全部待写数据是否需要多次系统调用: 有文件段(sendfile与writev交替), 段数超过IOV_MAX,
+    // 或者TLS下小段拼成的记录装不下全部数据
+    bool OutputNeedsMultipleWrites() const;
+    void HandleClose();
+    void HandleError();
+    void SendInLoop(const char* data, size_t len);
+    void SendPayloadInLoop(const SharedPayload& payload);
+    // 开启接收时间戳时, 记录上一次分发到这次回复的时间
+    void RecordReplyLatency();
+    void SendFileInLoop(const SharedFile& file, off_t offset, size_t count);
+    // 用一次writev写出output_buffer_与output_chain_链头的数据, 最多max_bytes字节(0表示不限制)
+    // 链头是文件段时改为一次sendfile; 使用TLS时改为一次TLS写
+    ssize_t WriteOutput(size_t max_bytes);
+    // 不经过输出路径直接写socket(使用TLS时加密), 返回值与write相同
+    ssize_t WriteDirect(const void* data, size_t len);
+    ssize_t TransferFile(int file_fd, off_t offset, size_t len);
+    // 没有待写的数据、也不在TLS握手中, Send可以直接写socket
+    bool CanWriteDirectly() const;
+    // Send留下了待写的数据: 关注可写事件, 开启写合并时改为登记到本轮迭代最后的刷新
+    void ScheduleOutput();
+    // 写合并的刷新, 在迭代的最后由EventLoop调用
+    void FlushOutput();
+    // 记录一次读写, 开启了空闲释放时安排检查
+    void MarkActive();
+    void ScheduleBufferRelease(long delay_ms);
+    void ReleaseIdleBuffers();
+    // 连接受限速约束(用户态令牌桶或EventLoop的bulk总带宽)
+    bool Paced() const;
+    // 这一次最多可以写出的字节数, 不限速时为SIZE_MAX
+    size_t PacingAllowance();
+    void ConsumePacing(size_t bytes);
+    // 额度耗尽: 停止关注可写事件, 等令牌后恢复写出
+    void WaitForPacing();
+    void ResumeAfterPacing(bool bulk_turn);
+    bool TlsHandshaking() const;
+    // 推进TLS握手, 并按握手需要的方向调整关注的事件
+    void DriveHandshake();
+    void ShutdownInLoop();
+    void ForceCloseInLoop();
+    void SetChannelCallbacks();
+    // 当前线程是连接所属的IO线程, 并且连接不在迁移途中
+    bool InOwnerThread() const;
+    // 在连接所属的IO线程中执行task: 当前就是所属线程时立即执行, 否则排入连接的任务队列
+    void RunInOwnerLoop(std::function<void()> task);
+    void QueueInOwnerLoop(std::function<void()> task);
+    void RunQueuedTasks();
+    // 任务队列的锁: 按连接地址分散到一组共享的mutex中, 不为每条连接付出一个std::mutex
+    std::mutex& TaskMutex() const;
+
+    // 迁移时在原IO线程中修改, 其他线程可以随时读取
+    // 成员的顺序按大小排列, 小的标志放在一起, 减少对齐填充: 空闲连接的内存主要就是这个对象本身
+    std::atomic<EventLoop*> loop_;
+    const std::string name_;
+    State state_;
+    bool edge_triggered_;
+    // 读/写预算耗尽, 已经推迟到下一轮迭代
+    bool read_deferred_;
+    bool write_deferred_;
+    bool rx_timestamping_;
+    // 已经登记了本轮迭代最后的刷新
+    bool flush_scheduled_;
+    bool release_check_scheduled_;
+    // 发送限速相关, 只在IO线程中访问
+    bool bulk_;
+    bool kernel_pacing_;
+    // 正在等待令牌
+    bool pacing_wait_;
+    // 轮到这条连接使用bulk总带宽
+    bool bulk_turn_;
+    // 任务队列与迁移状态; 与loop_的修改一样在TaskMutex()下进行
+    bool task_drain_scheduled_;
+    // DetachFromLoop之后、AttachToLoop之前
+    bool migrating_;
+    Socket socket_;
+    // 在ConnectEstablished中登记到连接表, ConnectDestroyed中注销; 没有连接表时句柄为空
+    std::shared_ptr<ConnectionTable> table_;
+    ConnectionHandle handle_;
+    uint64_t write_calls_;
+    uint64_t cork_calls_;
+    long buffer_release_idle_ms_;
+    define::SystemTimePoint last_active_;
+    TokenBucket pacing_bucket_;
+    define::SystemTimePoint last_rx_time_;
+    // 上一次MessageCallback被调用的时间, 之后还没有回复时不为默认值
+    define::SystemTimePoint awaiting_reply_since_;
+    std::shared_ptr<Channel> channel_;
+    const SocketAddress peer_addr_;
+    define::ConnectionCallback connection_callback_;
+    define::MessageCallback message_callback_;
+    define::WriteCompleteCallback write_complete_callback_;
+    std::shared_ptr<const define::CloseCallback> close_callback_;
+    Buffer input_buffer_;
+    Buffer output_buffer_;
+    // 零拷贝发送的数据. output_buffer_中的数据总是先于output_chain_写出:
+    // output_chain_不为空时, 之后复制发送的数据也追加到output_chain_中, 以保持发送顺序
+    OutputChain output_chain_;
+    std::unique_ptr<TlsSession> tls_;
+    // 其他线程排入的任务, 在TaskMutex()下访问
+    std::vector<std::function<void()>> queued_tasks_;
+};
+
+} // end namespace Cloo
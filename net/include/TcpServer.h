@@ -0,0 +1,178 @@
+#pragma once
+
+#include "Acceptor.h"
+#include "CallbackDefs.h"
+#include "ThreadPlacement.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Cloo 
+{
+
+class ConnectionTable;
+class EventLoop;
+class EventLoopThread;
+class EventLoopThreadPool;
+class SocketAddress;
+class TlsContext;
+enum class SocketFd;
+
+// 按IO线程的利用率自动增减IO线程(见TcpServer::SetAutoScale)
+struct AutoScaleOptions
+{
+    size_t min_loops = 1;
+    size_t max_loops = 4;
+    // 所有IO线程的平均利用率连续sustain_intervals个采样周期高于scale_up_utilization时增加一个IO线程,
+    // 连续低于scale_down_utilization时退役连接数最少的IO线程
+    double scale_up_utilization = 0.75;
+    double scale_down_utilization = 0.25;
+    long interval_ms = 1000;
+    int sustain_intervals = 3;
+};
+
+// TcpServer在loop上监听listen_addr, 把接受的连接分配给IO线程池中的EventLoop,
+// 并持有所有连接的shared_ptr, 连接关闭后再将其移除
+class TcpServer
+{
+public:
+    TcpServer(const std::shared_ptr<EventLoop>& loop, const SocketAddress& listen_addr, const std::string& name);
+    // 使用一个已经存在的监听fd, 例如零停机重启时通过FetchHandoverFds从旧进程取得的fd
+    TcpServer(const std::shared_ptr<EventLoop>& loop, SocketFd listen_fd, const std::string& name);
+    ~TcpServer();
+
+    TcpServer(const TcpServer&) = delete;
+    TcpServer& operator=(const TcpServer&) = delete;
+
+    // IO线程的数量与放置策略, 0表示所有连接都在loop中处理, 必须在Start之前调用
+    void SetThreadNum(int num_threads, const std::vector<ThreadPlacement>& placements = {});
+    // 根据SO_INCOMING_CPU把连接分配给绑定在收包CPU上的IO线程
+    void SetRouteByIncomingCpu(bool on) { route_by_incoming_cpu_ = on; }
+    // 新连接使用边沿触发
+    void SetEdgeTriggered(bool on) { edge_triggered_ = on; }
+    // 新连接空闲idle_ms毫秒后释放缓冲区的内存, 见TcpConnection::SetBufferReleaseIdle
+    void SetBufferReleaseIdle(long idle_ms) { buffer_release_idle_ms_ = idle_ms; }
+    // 所有新连接都使用TLS(context必须是服务端的TlsContext), 必须在Start之前调用
+    void SetTlsContext(const std::shared_ptr<TlsContext>& context) { tls_context_ = context; }
+    // 准入控制(accept速率、全局连接数上限与超限时的处理方式), 必须在loop所在线程中调用
+    void SetAdmission(const AdmissionOptions& options);
+    // 每个IO线程同时处理的连接数上限, 0表示不限制; 选中的IO线程已满时改用连接数最少的IO线程,
+    // 所有IO线程都满时按AdmissionOptions::overflow处理
+    void SetMaxConnectionsPerLoop(size_t max_connections) { max_connections_per_loop_ = max_connections; }
+    const Acceptor::Stats& AdmissionStats() const { return acceptor_->GetStats(); }
+
+    void SetConnectionCallback(const define::ConnectionCallback& cb) { connection_callback_ = cb; }
+    void SetMessageCallback(const define::MessageCallback& cb) { message_callback_ = cb; }
+    void SetWriteCompleteCallback(const define::WriteCompleteCallback& cb) { write_complete_callback_ = cb; }
+
+    // 启动IO线程池并开始监听, 必须在loop所在线程中调用
+    void Start();
+
+    // 以下用于零停机重启(见FdHandover.h), 必须在loop所在线程中调用
+    // 监听fd, 交给新进程后两个进程共享同一个监听队列
+    SocketFd ListenFd() const { return acceptor_->ListenFd(); }
+    // 不再accept新连接(监听fd保持打开), 已有的连接照常处理, 旧进程借此在交接之后drain
+    void StopAccepting() { acceptor_->StopListening(); }
+    // 接管一个已经建立的连接(例如旧进程通过TcpConnection::DetachForHandover交出的连接),
+    // 与accept得到的连接一样分配给IO线程并回调ConnectionCallback, 不受每个IO线程连接数上限的限制, 必须在Start之后调用
+    void AdoptConnection(SocketFd fd);
+
+    // 以下用于运行时调整IO线程, 必须在loop所在线程中、Start之后调用
+    // 增加一个IO线程, 放置策略沿用SetThreadNum的placements; 之后新连接会分配给它, 已有的连接可以用RebalanceConnections迁移过去
+    std::shared_ptr<EventLoop> AddIoLoop();
+    // 退役一个IO线程: 立即不再给它分配新连接. migrate为true时把它上面的连接迁移到其他IO线程(暂时不能迁移的连接稍后重试),
+    // 为false时等连接自然关闭. 所有连接离开后线程退出. loop不在池中或者是池中最后一个IO线程时返回false
+    bool RetireIoLoop(EventLoop* loop, bool migrate = true);
+    // 把连接迁移到target(池中的IO线程): 在原IO线程中注销它的Channel, 再在target中重新注册(TcpConnection::DetachFromLoop/AttachToLoop).
+    // 迁移的是同一个TcpConnection对象: 连接名、回调、选项、句柄以及缓冲区中的数据都保持不变, 不回调ConnectionCallback.
+    // 已经断开、TLS握手还没有完成或者暂时有推迟的工作(见DetachFromLoop)的连接不会被迁移
+    void MigrateConnection(const define::TcpConnectionPtr& conn, EventLoop* target);
+    // 按连接数把连接从最多的IO线程迁移到最少的, 直到各IO线程的连接数之差不超过1, 返回发起迁移的连接数
+    size_t RebalanceConnections();
+    // 开启按利用率自动增减IO线程, 必须在Start之后调用. 增加的IO线程只接收之后的新连接, 已有的连接不会被自动迁移,
+    // 需要时由调用者RebalanceConnections; 退役IO线程时它上面的连接被迁移到其他IO线程
+    void SetAutoScale(const AutoScaleOptions& options);
+
+    struct ResizeStats
+    {
+        size_t loops_added = 0;
+        size_t loops_retired = 0;     // 已经退出的IO线程
+        size_t migrations = 0;        // 完成迁移的连接
+    };
+    const ResizeStats& GetResizeStats() const { return resize_stats_; }
+    // 每个IO线程当前的连接数(包括正在退役的IO线程)
+    const std::map<EventLoop*, size_t>& LoopConnections() const { return loop_connections_; }
+
+    // 所有连接的连接表, 其他线程通过Cloo::Send(conn->Handle(), data)发送时使用它
+    ConnectionTable& GetConnectionTable() const { return *connection_table_; }
+
+    const std::string& Name() const { return name_; }
+    EventLoopThreadPool* ThreadPool() const { return thread_pool_.get(); }
+
+private:
+    TcpServer(const std::shared_ptr<EventLoop>& loop, std::unique_ptr<Acceptor> acceptor, const std::string& name);
+
+    // Acceptor的回调, 在loop_中执行
+    void NewConnection(SocketFd fd, const SocketAddress& peer_addr);
+    // 在io_loop中构造连接并登记到connections_
+    void EstablishConnection(EventLoop* io_loop, SocketFd fd, const SocketAddress& peer_addr);
+    // 连接关闭后在loop_中移除连接
+    void RemoveConnectionInLoop(const define::TcpConnectionPtr& conn);
+    // 在没有超过每个IO线程连接数上限的前提下选取IO线程, 所有IO线程都满时返回nullptr
+    EventLoop* PickLoopWithCapacity(EventLoop* preferred);
+    bool HasLoopCapacity();
+    // 检查正在退役的IO线程: 迁移剩余的连接, 连接都离开后让线程退出; 还有没退役完的IO线程时稍后再检查
+    void CheckRetiringLoops();
+    void ScheduleAutoScaleTick();
+    void AutoScaleTick();
+
+    // 以连接对象的地址为键: 节点比以连接名为键的std::map小, 也不需要再复制一份连接名
+    using ConnectionMap = std::unordered_map<TcpConnection*, define::TcpConnectionPtr>;
+
+    std::shared_ptr<EventLoop> loop_;
+    const std::string name_;
+    std::unique_ptr<Acceptor> acceptor_;
+    std::unique_ptr<EventLoopThreadPool> thread_pool_;
+    define::ConnectionCallback connection_callback_;
+    define::MessageCallback message_callback_;
+    define::WriteCompleteCallback write_complete_callback_;
+    int num_threads_;
+    std::vector<ThreadPlacement> placements_;
+    bool route_by_incoming_cpu_;
+    bool edge_triggered_;
+    long buffer_release_idle_ms_;
+    std::shared_ptr<TlsContext> tls_context_;
+    bool started_;
+    int next_conn_id_;
+    ConnectionMap connections_;
+    // 由TcpServer与它的连接共同持有, 连接晚于TcpServer析构时仍然可以注销
+    std::shared_ptr<ConnectionTable> connection_table_;
+    size_t max_connections_per_loop_;
+    // 每个IO线程当前的连接数, 只在loop_中访问
+    std::map<EventLoop*, size_t> loop_connections_;
+    // 正在退役的IO线程, 只在loop_中访问
+    struct RetiringLoop
+    {
+        std::unique_ptr<EventLoopThread> thread;
+        bool migrate;
+        // 连接都已离开, 等待loop执行完队列中的任务
+        bool draining;
+    };
+    std::map<EventLoop*, RetiringLoop> retiring_;
+    bool retire_check_scheduled_;
+    AutoScaleOptions auto_scale_;
+    bool auto_scale_enabled_;
+    int above_intervals_;
+    int below_intervals_;
+    ResizeStats resize_stats_;
+    // 定时器与投递到其他线程的任务持有它的weak_ptr, TcpServer析构后它们不再访问this
+    std::shared_ptr<bool> alive_;
+    // 所有连接共用的CloseCallback, 回到loop_中检查alive_后再移除连接;
+    // 它按值持有alive_的weak_ptr, 放不进std::function的内部存储, 共用一份就不必为每条连接在堆上分配
+    std::shared_ptr<const define::CloseCallback> close_callback_;
+};
+
+} // end namespace Cloo
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+
+namespace Cloo 
+{
+
+// ThreadPlacement描述了一个IO线程应该被放置在哪些CPU/哪个NUMA节点上
+// EventLoopThread会在线程启动后、EventLoop创建和Loop()开始之前应用这个策略,
+// 这样EventLoop以及它在IO线程中首次分配(first-touch)的内存都会落在目标CPU所在的NUMA节点上
+class ThreadPlacement
+{
+public:
+    // 默认不做任何限制, 线程可以在所有CPU之间迁移
+    ThreadPlacement() = default;
+
+    // 绑定到单个CPU
+    static ThreadPlacement OnCpu(int cpu);
+    // 绑定到一组CPU
+    static ThreadPlacement OnCpus(const std::vector<int>& cpus);
+    // 绑定到某个NUMA节点的全部CPU上, 并优先从该节点分配内存
+    static ThreadPlacement OnNumaNode(int node);
+
+    bool Empty() const { return cpus_.empty() && numa_node_ < 0; }
+    int NumaNode() const { return numa_node_; }
+
+    // 展开后的CPU集合: 显式指定的CPU与NUMA节点上的CPU的并集, 已排序去重
+    std::vector<int> ResolveCpus() const;
+
+    // 把策略应用到调用线程上, 必须在目标线程中调用
+    // 设置失败时输出错误信息并返回false, 线程仍然可以继续以不绑定的方式运行
+    bool ApplyToThisThread() const;
+
+    // 读取/sys/devices/system/node/node<N>/cpulist, 返回NUMA节点上的CPU列表
+    static std::vector<int> CpusOfNumaNode(int node);
+
+private:
+    std::vector<int> cpus_;
+    int numa_node_ = -1;
+};
+
+} // end namespace Cloo
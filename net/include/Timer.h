@@ -14,7 +14,8 @@ public:
     // cb : 定时器到期时的回调函数
     // when : 定时器到期的时间点
     // interval_ms : 定时器循环间隔, 当interval_ms > 0 时, 定时器会循环触发, 触发节点为 when + n*interval_ms
-    Timer(const define::TimerCallback& cb, define::SystemTimePoint when, long interval_ms);
+    // slack_ms : 定时器可以容忍的延迟, 定时器会在[when, when + slack_ms]内的某个时间点触发, 0表示精确触发
+    Timer(const define::TimerCallback& cb, define::SystemTimePoint when, long interval_ms, long slack_ms = 0);
     
     ~Timer();
 
@@ -27,6 +28,12 @@ public:
     void Run() const { callback_(); };
 
     define::SystemTimePoint Expiration() const { return expiration_; }
+
+    // 考虑slack之后实际安排的触发时间点
+    // slack_ms > 0 时把到期时间向上对齐到一个不超过slack_ms的2的幂(毫秒)的整数倍上,
+    // 这样到期时间相近的定时器会落到同一个对齐的时间槽中, 由同一次timerfd唤醒批量触发;
+    // 粒度更粗的时间槽同时也是更细粒度的时间槽, 不同slack的定时器之间同样可以合并
+    define::SystemTimePoint FireTime() const;
     
     bool Repeat() const { return repeat_; }
     
@@ -38,6 +45,8 @@ private:
     const define::TimerCallback callback_;
     define::SystemTimePoint expiration_;
     const long interval_ms_;
+    // 对齐粒度(ms), 0表示精确触发
+    const long slot_ms_;
     const bool repeat_;
 };
 
@@ -32,9 +32,21 @@ class EventLoop;
 
 // TimerQueue拥有四个成员变量, 分别是一个timerfd, 一个与timerfd绑定的Channel, 一个存放Timer的Set
 // 和一个指向TimerQueue所属的EventLoop的指针。
+// 定时器合并(coalescing): 带有slack的定时器按Timer::FireTime()对齐到时间槽上排序,
+// 到期时间相近的定时器共享同一个触发时间点, 只需要一次timerfd唤醒; 只有新的触发时间点早于
+// 当前timerfd已经设置的时间点时才重新设置timerfd. slack为0的定时器不受影响, 仍然精确触发
+
 // 在这四个成员变量中, TimerQueue不对任何一个变量拥有唯一所有权, 理由是: timerfd需要与IO多路复用组件共享, Channel需要
 // 与EventLoop共享, Timer需要与用户共享, 执行EventLoop的指针更不必说。
 
+// TimerQueue的运行统计, 只在IO线程中更新
+struct TimerQueueStats
+{
+    size_t wakeups = 0;  // timerfd到期唤醒IO线程的次数(poll超时驱动模式下为处理到期定时器的次数)
+    size_t rearms = 0;   // 调用timerfd_settime重新设置timerfd的次数
+    size_t fired = 0;    // 触发的定时回调次数
+};
+
 class TimerQueue
 {
 
@@ -52,10 +64,24 @@ public:
     // 添加一个定时器, 定时器会在when时间点回调用户设置的cb函数
     // 当interval_ms > 0 时表示这个定时器是循环触发的, 每次触发间隔为interval_ms
     // 即cb会在when,when+interval_ms,when+interval_ms*2...等时间点被调用
+    // slack_ms > 0 时允许定时器在[when, when + slack_ms]内的任意时刻触发, 以便与其他定时器合并唤醒
     // 这个函数可能被其他线程(非TimerQueue所属的IO线程)中被调用,因此必须做到线程安全
-    TimerId AddTimer(const define::TimerCallback& cb, define::SystemTimePoint when, long interval_ms);
+    TimerId AddTimer(const define::TimerCallback& cb, define::SystemTimePoint when, long interval_ms, long slack_ms = 0);
     void Cancel(const TimerId& timer_id);
 
+    const TimerQueueStats& Stats() const { return stats_; }
+
+    // poll超时驱动模式(不使用timerfd), 只能在IO线程中设置
+    // 开启后timerfd不再被设置, 由EventLoop根据NextPollTimeoutMs()决定Poll的超时时间,
+    // 并在Poll返回后调用HandleExpiredTimers()直接处理到期的定时器,
+    // 每个定时周期省去一次timerfd_settime和一次read
+    void SetTimerFdEnabled(bool on);
+    bool TimerFdEnabled() const { return timer_fd_enabled_; }
+    // 距离最早的触发时间点的毫秒数(向上取整), 不超过max_timeout_ms; 已经到期时返回0
+    int NextPollTimeoutMs(int max_timeout_ms) const;
+    // 处理now时刻之前到期的所有定时器
+    void HandleExpiredTimers(define::SystemTimePoint now);
+
 private:
 
     void AddTimerInLoop(const std::shared_ptr<Timer>& timer);
@@ -73,15 +99,23 @@ private:
     
     // 处理timerfd可读事件
     void HandleRead();
+    void RunExpiredTimers(define::SystemTimePoint now);
     std::vector<Entry> GetExpiration(define::SystemTimePoint now);
     // 将expired列表中已经到期的、循环触发的定时器重新放入timers_中
     void Reset(std::vector<Entry>& expired, define::SystemTimePoint now);
     bool Insert(const std::shared_ptr<Timer>& timer);
+    // 只有when早于timerfd当前设置的到期时间时才重新设置timerfd
+    void ArmTimerFd(define::SystemTimePoint when);
 
-    std::weak_ptr<EventLoop> owner_loop_;
+    // TimerQueue由EventLoop拥有, EventLoop一定比它活得久, 使用裸指针即可
+    EventLoop* owner_loop_;
     const int timer_fd_;
     std::shared_ptr<Channel> timer_fd_channel_;
     TimerList timers_;
+    // timerfd当前设置的到期时间, 未设置时为time_point::max()
+    define::SystemTimePoint armed_expiration_;
+    TimerQueueStats stats_;
+    bool timer_fd_enabled_;
 
 };
 
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+
+// OpenSSL的类型, 头文件中不包含OpenSSL
+struct ssl_st;
+struct ssl_ctx_st;
+
+namespace Cloo
+{
+
+class Buffer;
+
+// TLS配置(证书、私钥、是否使用kTLS), 对应一个SSL_CTX, 可以被任意多条连接共享
+// 需要OpenSSL: CMake找到OpenSSL时定义CLOO_WITH_OPENSSL并链接libssl, 否则Create*抛出runtime_error
+class TlsContext
+{
+public:
+    // 服务端, cert_file为PEM格式的证书链, key_file为PEM格式的私钥, 加载失败时抛出runtime_error
+    static std::shared_ptr<TlsContext> CreateServer(const std::string& cert_file, const std::string& key_file);
+    // 客户端, ca_file不为空时校验服务端证书
+    static std::shared_ptr<TlsContext> CreateClient(const std::string& ca_file = "");
+    ~TlsContext();
+
+    TlsContext(const TlsContext&) = delete;
+    TlsContext& operator=(const TlsContext&) = delete;
+
+    bool IsServer() const { return server_; }
+    // 握手完成后把记录的加解密交给内核(kTLS, setsockopt(TCP_ULP, "tls")), 默认开启, 只影响之后开始握手的连接
+    // 内核不支持(没有tls模块)或协商出的密码套件内核不支持时, 连接自动退回用户空间加密
+    void SetKernelTlsEnabled(bool on);
+    bool KernelTlsEnabled() const { return kernel_tls_; }
+    ssl_ctx_st* Native() const { return ctx_; }
+
+private:
+    TlsContext(ssl_ctx_st* ctx, bool server);
+
+    ssl_ctx_st* ctx_;
+    bool server_;
+    bool kernel_tls_;
+};
+
+// 一条连接上的TLS状态, 由TcpConnection持有, 只在连接所属的IO线程中使用
+// 握手在用户空间用OpenSSL完成, 读写都在非阻塞的socket上进行, 需要等待时返回EAGAIN, 由Channel的读写事件驱动重试.
+// 握手完成后OpenSSL在内核支持时把发送/接收方向交给kTLS: 之后Read/Write不再在用户空间加解密,
+// SendFile可以直接sendfile(由内核加密); 不支持的方向仍在用户空间加密, 对调用者透明
+class TlsSession
+{
+public:
+    enum class HandshakeResult { kDone, kWantRead, kWantWrite, kError };
+
+    TlsSession(const std::shared_ptr<TlsContext>& context, int fd);
+    ~TlsSession();
+
+    TlsSession(const TlsSession&) = delete;
+    TlsSession& operator=(const TlsSession&) = delete;
+
+    // 推进握手, 非阻塞
+    HandshakeResult Handshake();
+    bool HandshakeDone() const { return handshake_done_; }
+    // 发送/接收方向是否已经由kTLS处理
+    bool KernelSend() const;
+    bool KernelRecv() const;
+    // 协商出的协议版本与密码套件, 握手完成前为空
+    std::string Version() const;
+    std::string Cipher() const;
+    // 握手失败等错误的描述
+    const std::string& LastError() const { return last_error_; }
+
+    // 以下三个函数的返回值与read/write相同: 需要等待时返回-1且errno为EAGAIN, 出错时返回-1, 对端发送close_notify或关闭时Read返回0
+    // 解密后读入buf, 一次最多读一个TLS记录
+    ssize_t Read(Buffer* buf, int* saved_errno);
+    // Write返回EAGAIN后必须用相同的数据(前缀)重试, 长度不能小于上一次, 见SSL_write
+    ssize_t Write(const void* data, size_t len);
+    // 上一次返回EAGAIN的Write的长度, 重试时至少要写这么多; 没有待重试的Write时为0
+    size_t PendingWriteBytes() const { return pending_write_; }
+    // 发送文件fd中从offset开始的最多len字节: 发送方向由kTLS处理时使用SSL_sendfile, 否则分块pread后Write
+    ssize_t SendFile(int file_fd, off_t offset, size_t len);
+    // 发送close_notify, 不等待对端的close_notify
+    void Shutdown();
+
+private:
+    // 把SSL_get_error的结果转换为errno, 返回-1或0
+    ssize_t MapError(int ret);
+
+    std::shared_ptr<TlsContext> context_;
+    ssl_st* ssl_;
+    bool handshake_done_;
+    size_t pending_write_;
+    std::string last_error_;
+};
+
+} // end namespace Cloo
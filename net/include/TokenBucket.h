@@ -0,0 +1,39 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace Cloo
+{
+
+// 令牌桶: 以每秒rate个的速度产生令牌, 最多积攒burst个
+// 用于限制发送速率(一个令牌对应一个字节)与Acceptor的accept速率(一个令牌对应一个连接, rate可以小于1)
+// 不加锁, 只能在一个线程中使用(一般是IO线程)
+class TokenBucket
+{
+public:
+    TokenBucket() : rate_(0), burst_(0), tokens_(0) {}
+
+    // rate为0表示不限制
+    void Configure(double rate, size_t burst);
+    bool Enabled() const { return rate_ > 0; }
+    double Rate() const { return rate_; }
+    size_t Burst() const { return burst_; }
+
+    // 当前可用的令牌数
+    size_t Available();
+    void Consume(size_t n);
+    // 积攒到n个令牌(不超过burst)还需要等待的时间, 向上取整到毫秒, 至少1ms
+    std::chrono::milliseconds TimeUntil(size_t n);
+
+private:
+    void Refill();
+
+    double rate_;
+    size_t burst_;
+    double tokens_;
+    std::chrono::steady_clock::time_point last_refill_;
+};
+
+} // end namespace Cloo
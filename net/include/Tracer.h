@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+namespace Cloo
+{
+
+// 记录的span种类
+enum class TraceKind : uint8_t
+{
+    kPoll,          // 等待IO事件(包括忙轮询)
+    kChannelEvent,  // 一次Channel::HandleEvent, arg为fd
+    kTask,          // 一个pending task或被推迟的任务
+    kTimer,         // 一个定时器回调
+    kWakeup,        // 处理一次WakeUp(读eventfd)
+};
+
+struct TraceOptions
+{
+    // 每个线程的环形缓冲区能保存的span数, 向上取整为2的幂, 写满后覆盖最旧的span
+    size_t ring_capacity = 16384;
+    // 每sample_every轮迭代记录一轮, 1表示每轮都记录
+    uint32_t sample_every = 1;
+};
+
+// Tracer把EventLoop每轮迭代中的poll等待、事件分发、任务、定时器与唤醒记录为span,
+// 导出为Chrome trace-event JSON(可以直接在chrome://tracing或Perfetto UI中打开).
+// 每个IO线程第一次记录时创建自己的环形缓冲区, 记录时只有本线程写入, 不加锁;
+// 导出时按序号校验每个槽位, 跳过正在被覆盖的span, 因此可以在IO线程运行时随时导出.
+// 关闭时每个span只多一次relaxed原子读; 开启后按轮采样, 未被采样的迭代同样只多一次线程局部变量的读取
+class Tracer
+{
+public:
+    static void Start(const TraceOptions& options = TraceOptions());
+    static void Stop();
+    static bool Enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    // EventLoop在每轮迭代开始时调用, 按采样率决定本线程这一轮是否记录
+    static void BeginIteration();
+    // 本线程当前这一轮是否记录
+    static bool Recording() { return sampled_ && Enabled(); }
+    static void Record(TraceKind kind, uint64_t start_ns, uint64_t end_ns, int32_t arg);
+    static uint64_t NowNs();
+
+    // 导出所有线程环形缓冲区中的span, 返回导出的span数
+    static size_t DumpChromeJson(std::ostream& out);
+    // 写入path, 失败时返回false
+    static bool DumpChromeJson(const std::string& path);
+    // 收到signo时由一个后台线程把trace写入path. 信号处理函数只向pipe写一个字节, 导出不在信号上下文中进行
+    static void InstallDumpSignal(int signo, const std::string& path);
+
+private:
+    static std::atomic<bool> enabled_;
+    inline static thread_local bool sampled_ = false;
+};
+
+// RAII: 构造时记下开始时间, 析构时记录span; 本线程这一轮不记录时什么也不做
+class TraceSpan
+{
+public:
+    explicit TraceSpan(TraceKind kind, int32_t arg = -1)
+        : kind_(kind),
+          arg_(arg),
+          start_ns_(Tracer::Recording() ? Tracer::NowNs() : 0)
+    {
+    }
+    ~TraceSpan()
+    {
+        if(start_ns_ != 0)
+        {
+            Tracer::Record(kind_, start_ns_, Tracer::NowNs(), arg_);
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    TraceKind kind_;
+    int32_t arg_;
+    uint64_t start_ns_;
+};
+
+} // end namespace Cloo
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace Cloo 
+{
+
+// 有界的Chase-Lev工作窃取双端队列
+// 只有拥有者线程可以在底部Push/Pop(LIFO, 缓存友好), 其他线程只能从顶部Steal(FIFO)
+// 内存序参考 Lê et al. "Correct and Efficient Work-Stealing for Weak Memory Models"(PPoPP'13)
+// T必须是可以放入std::atomic的平凡类型, 通常是指针
+template<typename T>
+class WorkStealingDeque
+{
+public:
+    // capacity会被向上取整为2的幂
+    explicit WorkStealingDeque(size_t capacity)
+        : top_(0),
+          bottom_(0),
+          buffer_(RoundUpPowerOfTwo(capacity)),
+          mask_(static_cast<int64_t>(buffer_.size()) - 1)
+    {
+
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // 只能由拥有者调用, 队列已满时返回false
+    bool Push(T item)
+    {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        if(b - t > mask_)
+        {
+            return false;
+        }
+        buffer_[b & mask_].store(item, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // 只能由拥有者调用
+    std::optional<T> Pop()
+    {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        if(t > b)
+        {
+            // 队列为空
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return std::nullopt;
+        }
+        T item = buffer_[b & mask_].load(std::memory_order_relaxed);
+        if(t == b)
+        {
+            // 只剩最后一个元素, 与窃取者竞争
+            bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            if(!won)
+            {
+                return std::nullopt;
+            }
+        }
+        return item;
+    }
+
+    // 可以由任意线程调用, 队列为空或者竞争失败时返回nullopt
+    std::optional<T> Steal()
+    {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        if(t >= b)
+        {
+            return std::nullopt;
+        }
+        T item = buffer_[t & mask_].load(std::memory_order_relaxed);
+        if(!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return std::nullopt;
+        }
+        return item;
+    }
+
+    // 近似的元素个数, 只用于统计
+    size_t SizeApprox() const
+    {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        return b > t ? static_cast<size_t>(b - t) : 0;
+    }
+
+    size_t Capacity() const { return buffer_.size(); }
+
+private:
+    static size_t RoundUpPowerOfTwo(size_t n)
+    {
+        size_t capacity = 1;
+        while(capacity < n)
+        {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+    // top_与bottom_分别被窃取者和拥有者频繁修改, 放在不同的cache line上避免伪共享
+    alignas(64) std::atomic<int64_t> top_;
+    alignas(64) std::atomic<int64_t> bottom_;
+    alignas(64) std::vector<std::atomic<T>> buffer_;
+    const int64_t mask_;
+};
+
+} // end namespace Cloo
@@ -0,0 +1,186 @@
+// Acceptor准入控制
+// 1. 令牌桶: 每秒100个连接、突发10个, 100个几乎同时到达的连接被平滑地在约0.9秒内接受
+// 2. 全局上限20、超限时accept后立即关闭: 50个连接中20个被接受, 30个被拒绝
+// 3. 每个IO线程上限5、超限时暂停accept: 2个IO线程接受10个连接, 客户端关闭3个后暂停的连接被定时器恢复接受
+
+#include "../net/include/Acceptor.h"
+#include "../net/include/EventLoop.h"
+#include "../net/include/SocketAddress.h"
+#include "../net/include/TcpConnection.h"
+#include "../net/include/TcpServer.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+int ConnectTo(uint16_t port)
+{
+    Cloo::SocketAddress addr("127.0.0.1", port);
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    ::connect(fd, reinterpret_cast<const sockaddr*>(&addr.ToSockAddrIn()), sizeof(sockaddr_in));
+    return fd;
+}
+
+// 在独立的线程中运行一个TcpServer, setup中配置服务器并安排客户端, done返回true时退出
+void RunServer(uint16_t port, int io_threads,
+               const std::function<void(Cloo::TcpServer&, Cloo::EventLoop*)>& setup,
+               const std::function<bool(Cloo::TcpServer&, int)>& done)
+{
+    std::thread server_thread([&]
+    {
+        auto loop = Cloo::EventLoop::Create();
+        Cloo::TcpServer server(loop, Cloo::SocketAddress(port), "admission");
+        server.SetThreadNum(io_threads);
+        auto connected = std::make_shared<std::atomic<int>>(0);
+        server.SetConnectionCallback([connected](const Cloo::define::TcpConnectionPtr& conn)
+        {
+            if(conn->Connected())
+            {
+                ++*connected;
+            }
+        });
+        // 先开始监听再安排客户端连接
+        server.Start();
+        setup(server, loop.get());
+        loop->RunEvery(5, [&, connected]
+        {
+            if(done(server, connected->load()))
+            {
+                loop->Quit();
+            }
+        });
+        loop->Loop();
+    });
+    server_thread.join();
+}
+
+void TokenBucket()
+{
+    constexpr uint16_t kPort = 7782;
+    constexpr int kClients = 100;
+    std::vector<int> clients;
+    std::thread client_thread;
+    auto start = std::chrono::steady_clock::now();
+    RunServer(kPort, 0, [&](Cloo::TcpServer& server, Cloo::EventLoop*)
+    {
+        Cloo::AdmissionOptions options;
+        options.accepts_per_second = 100;
+        options.burst = 10;
+        server.SetAdmission(options);
+        client_thread = std::thread([&]
+        {
+            start = std::chrono::steady_clock::now();
+            for(int i = 0; i < kClients; ++i)
+            {
+                clients.push_back(ConnectTo(kPort));
+            }
+        });
+    }, [&](Cloo::TcpServer&, int connected) { return connected == kClients; });
+    auto end = std::chrono::steady_clock::now();
+    client_thread.join();
+    double seconds = std::chrono::duration<double>(end - start).count();
+    for(int fd : clients)
+    {
+        ::close(fd);
+    }
+    std::cout << "token bucket: accepted " << kClients << " connections in " << seconds << "s" << std::endl;
+    assert(seconds > 0.8);
+}
+
+void GlobalCapWithReject()
+{
+    constexpr uint16_t kPort = 7783;
+    constexpr int kClients = 50;
+    std::vector<int> clients;
+    std::thread client_thread;
+    Cloo::Acceptor::Stats stats;
+    RunServer(kPort, 0, [&](Cloo::TcpServer& server, Cloo::EventLoop*)
+    {
+        Cloo::AdmissionOptions options;
+        options.max_connections = 20;
+        options.overflow = Cloo::AdmissionOverflow::kAcceptAndClose;
+        server.SetAdmission(options);
+        client_thread = std::thread([&]
+        {
+            for(int i = 0; i < kClients; ++i)
+            {
+                clients.push_back(ConnectTo(kPort));
+            }
+        });
+    }, [&](Cloo::TcpServer& server, int)
+    {
+        stats = server.AdmissionStats();
+        return stats.accepted + stats.rejected == kClients;
+    });
+    client_thread.join();
+    for(int fd : clients)
+    {
+        ::close(fd);
+    }
+    std::cout << "global cap: accepted " << stats.accepted << ", rejected " << stats.rejected << std::endl;
+    assert(stats.accepted == 20 && stats.rejected == 30);
+}
+
+void PerLoopCapWithPause()
+{
+    constexpr uint16_t kPort = 7784;
+    constexpr int kClients = 15;
+    std::vector<int> clients;
+    std::thread client_thread;
+    bool closed_some = false;
+    Cloo::Acceptor::Stats stats;
+    RunServer(kPort, 2, [&](Cloo::TcpServer& server, Cloo::EventLoop*)
+    {
+        server.SetMaxConnectionsPerLoop(5);
+        Cloo::AdmissionOptions options;
+        options.retry_ms = 20;
+        server.SetAdmission(options);
+        client_thread = std::thread([&]
+        {
+            for(int i = 0; i < kClients; ++i)
+            {
+                clients.push_back(ConnectTo(kPort));
+            }
+        });
+    }, [&](Cloo::TcpServer& server, int connected)
+    {
+        stats = server.AdmissionStats();
+        if(connected == 10 && !closed_some)
+        {
+            // 两个IO线程都满了, 剩下的5个连接留在backlog中; 关闭3个已接受的连接腾出容量
+            closed_some = true;
+            client_thread.join();
+            for(int i = 0; i < 3; ++i)
+            {
+                ::close(clients[i]);
+            }
+        }
+        return connected == 13;
+    });
+    for(size_t i = 3; i < clients.size(); ++i)
+    {
+        ::close(clients[i]);
+    }
+    std::cout << "per-loop cap: accepted " << stats.accepted << " after pausing " << stats.pauses << " times" << std::endl;
+    assert(stats.accepted == 13 && stats.pauses > 0);
+}
+
+}
+
+int main()
+{
+    TokenBucket();
+    GlobalCapWithReject();
+    PerLoopCapWithPause();
+}
@@ -0,0 +1,162 @@
+// 广播扇出: 同一条消息发送给K_SUBSCRIBERS条连接, 对端不读取, 消息大部分滞留在输出路径中
+// 分别用零拷贝的Send(SharedPayload)与复制的Send(string_view)发送, 对比滞留的字节数与进程RSS的增长,
+// 零拷贝时负载只有一份, RSS的增长远小于 K_SUBSCRIBERS * K_PAYLOAD_SIZE;
+// 另外用一条连接交替发送复制与零拷贝的数据, 检查对端收到的字节流顺序正确
+
+#include "../net/include/Channel.h"
+#include "../net/include/EventLoop.h"
+#include "../net/include/OutputChain.h"
+#include "../net/include/Socket.h"
+#include "../net/include/SocketAddress.h"
+#include "../net/include/TcpConnection.h"
+
+#include <cassert>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+constexpr int K_SUBSCRIBERS = 2000;
+constexpr size_t K_PAYLOAD_SIZE = 64 * 1024;
+
+long ResidentKiB()
+{
+    std::ifstream statm("/proc/self/statm");
+    long size = 0;
+    long resident = 0;
+    statm >> size >> resident;
+    return resident * (::sysconf(_SC_PAGESIZE) / 1024);
+}
+
+struct Subscriber
+{
+    Cloo::define::TcpConnectionPtr conn;
+    int peer_fd;
+};
+
+Subscriber MakeSubscriber(Cloo::EventLoop* loop, int id)
+{
+    int fds[2];
+    if(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) != 0)
+    {
+        std::cerr << "socketpair failed" << std::endl;
+        std::abort();
+    }
+    int small = 4096;
+    ::setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &small, sizeof small);
+    ::setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &small, sizeof small);
+    auto conn = std::make_shared<Cloo::TcpConnection>(loop, "sub#" + std::to_string(id),
+                                                      static_cast<Cloo::SocketFd>(fds[0]), Cloo::SocketAddress(uint16_t(0)));
+    conn->ConnectEstablished();
+    return Subscriber{conn, fds[1]};
+}
+
+void Teardown(std::vector<Subscriber>& subscribers)
+{
+    for(auto& sub : subscribers)
+    {
+        sub.conn->ConnectDestroyed();
+        ::close(sub.peer_fd);
+    }
+    subscribers.clear();
+}
+
+void RunFanOut(Cloo::EventLoop* loop, bool zero_copy)
+{
+    std::vector<Subscriber> subscribers;
+    for(int i = 0; i < K_SUBSCRIBERS; ++i)
+    {
+        subscribers.push_back(MakeSubscriber(loop, i));
+    }
+    long rss_before = ResidentKiB();
+    auto payload = Cloo::MakeSharedPayload(std::string(K_PAYLOAD_SIZE, 'x'));
+    for(auto& sub : subscribers)
+    {
+        if(zero_copy)
+        {
+            sub.conn->Send(payload);
+        }
+        else
+        {
+            sub.conn->Send(*payload);
+        }
+    }
+    size_t pending = 0;
+    for(auto& sub : subscribers)
+    {
+        pending += sub.conn->PendingOutputBytes();
+    }
+    long rss_after = ResidentKiB();
+    std::cout << (zero_copy ? "zero-copy" : "copy     ")
+              << "  subscribers=" << K_SUBSCRIBERS << "  payload=" << K_PAYLOAD_SIZE / 1024 << "KiB"
+              << "  pending=" << pending / (1024 * 1024) << "MiB"
+              << "  payload refs=" << payload.use_count()
+              << "  rss growth=" << (rss_after - rss_before) / 1024 << "MiB" << std::endl;
+    if(zero_copy)
+    {
+        // 每条连接的输出链各持有一个引用, 负载本身只有一份, RSS只增长链节点等少量开销
+        assert(payload.use_count() == K_SUBSCRIBERS + 1);
+        assert(static_cast<size_t>(rss_after - rss_before) * 1024 < K_SUBSCRIBERS * K_PAYLOAD_SIZE / 8);
+    }
+    Teardown(subscribers);
+}
+
+void CheckOrdering(const std::shared_ptr<Cloo::EventLoop>& loop)
+{
+    Subscriber sub = MakeSubscriber(loop.get(), -1);
+    std::string expected;
+    auto big = Cloo::MakeSharedPayload(std::string(100000, 'a'));
+    auto small = Cloo::MakeSharedPayload(std::string("<shared>"));
+    // 交替发送, 第一条大消息写不完后之后的数据都会排在输出链/输出缓冲区中
+    for(int i = 0; i < 50; ++i)
+    {
+        sub.conn->Send(big);
+        expected += *big;
+        std::string copied = "<copy " + std::to_string(i) + ">";
+        sub.conn->Send(copied);
+        expected += copied;
+        sub.conn->Send(small);
+        expected += *small;
+    }
+
+    std::string received;
+    auto reader = Cloo::Channel::Create(loop, sub.peer_fd);
+    reader->SetReadCallBack([&]
+    {
+        char buf[65536];
+        ssize_t n;
+        while((n = ::read(sub.peer_fd, buf, sizeof buf)) > 0)
+        {
+            received.append(buf, n);
+        }
+        if(received.size() >= expected.size())
+        {
+            loop->Quit();
+        }
+    });
+    reader->EnableReading();
+    loop->Loop();
+    reader->DisableAll();
+    reader->Remove();
+    assert(received == expected);
+    std::cout << "ordering check passed, " << received.size() << " bytes" << std::endl;
+    std::vector<Subscriber> subscribers {sub};
+    Teardown(subscribers);
+}
+
+}
+
+int main()
+{
+    auto loop = Cloo::EventLoop::Create();
+    CheckOrdering(loop);
+    // 先运行零拷贝, 复制模式释放的内存不一定会归还给系统
+    RunFanOut(loop.get(), true);
+    RunFanOut(loop.get(), false);
+}
@@ -0,0 +1,112 @@
+// 忙轮询(busy-poll)延迟基准测试
+// 发送线程每隔一段时间向pipe写入一个发送时刻(steady_clock), IO线程在read回调中计算唤醒延迟,
+// 分别统计阻塞Poll与不同自旋预算下的p50/p99延迟以及IO线程的CPU占用
+
+#include "../net/include/EventLoop.h"
+#include "../net/include/Channel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <fcntl.h>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+constexpr int K_MESSAGES = 2000;
+constexpr auto K_SEND_GAP = std::chrono::microseconds(200);
+
+int64_t SteadyNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double ThreadCpuSeconds()
+{
+    timespec ts {};
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void RunCase(std::chrono::microseconds max_spin)
+{
+    int fds[2];
+    if(::pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0)
+    {
+        std::cerr << "pipe2 failed" << std::endl;
+        return;
+    }
+
+    std::vector<int64_t> latencies;
+    latencies.reserve(K_MESSAGES);
+    double cpu_seconds = 0;
+    double wall_seconds = 0;
+    std::promise<std::shared_ptr<Cloo::EventLoop>> ready;
+
+    std::thread io_thread([&]
+    {
+        auto loop = Cloo::EventLoop::Create();
+        loop->SetBusyPoll(max_spin);
+        auto channel = Cloo::Channel::Create(loop, fds[0]);
+        auto* raw_loop = loop.get();
+        channel->SetReadCallBack([&, raw_loop]
+        {
+            int64_t sent_ns;
+            while(::read(fds[0], &sent_ns, sizeof sent_ns) == sizeof sent_ns)
+            {
+                latencies.push_back(SteadyNowNs() - sent_ns);
+            }
+            if(static_cast<int>(latencies.size()) >= K_MESSAGES)
+            {
+                raw_loop->Quit();
+            }
+        });
+        channel->EnableReading();
+        ready.set_value(loop);
+
+        auto wall_start = std::chrono::steady_clock::now();
+        double cpu_start = ThreadCpuSeconds();
+        loop->Loop();
+        cpu_seconds = ThreadCpuSeconds() - cpu_start;
+        wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    });
+
+    auto loop = ready.get_future().get();
+    for(int i = 0; i < K_MESSAGES; ++i)
+    {
+        std::this_thread::sleep_for(K_SEND_GAP);
+        int64_t now_ns = SteadyNowNs();
+        ::write(fds[1], &now_ns, sizeof now_ns);
+    }
+    io_thread.join();
+    ::close(fds[0]);
+    ::close(fds[1]);
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) { return latencies[static_cast<size_t>(p * (latencies.size() - 1))] / 1000.0; };
+    std::cout << std::fixed << std::setprecision(1)
+              << "max_spin=" << std::setw(5) << max_spin.count() << "us"
+              << "  p50=" << std::setw(7) << percentile(0.50) << "us"
+              << "  p99=" << std::setw(7) << percentile(0.99) << "us"
+              << "  cpu=" << std::setw(5) << 100.0 * cpu_seconds / wall_seconds << "%"
+              << "  final_budget=" << loop->BusyPollBudget().count() << "us" << std::endl;
+}
+
+}
+
+int main()
+{
+    for(long spin_us : {0L, 50L, 200L, 1000L})
+    {
+        RunCase(std::chrono::microseconds(spin_us));
+    }
+}
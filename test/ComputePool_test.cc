@@ -0,0 +1,257 @@
+// ComputePool与WorkStealingDeque
+// 1. IO线程把计算密集型任务交给ComputePool, 结果回到IO线程中处理; 同时用一个20ms的定时器检查IO线程在计算期间仍然及时响应
+// 2. worker派生的子任务进入自己的Chase-Lev队列(Push), 空闲的worker从中窃取, 子任务分布在多个worker上执行
+// 3. 积压已满时的三种RejectPolicy: kReject返回false, kCallerRuns在调用者线程中执行, kAbort抛出异常
+// 4. 任务抛出异常后pending计数仍然归零, 池继续工作
+// 5. 空闲的worker阻塞在条件变量上, 不会周期性地醒来
+// 6. WorkStealingDeque: 拥有者Push/Pop与多个窃取者Steal并发, 每个元素恰好被取走一次
+
+#include "../net/include/ComputePool.h"
+#include "../net/include/EventLoop.h"
+#include "../net/include/WorkStealingDeque.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <sys/resource.h>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+constexpr int K_WORKERS = 4;
+constexpr int K_SUBTASKS = 64;
+// 定时器的最大延迟: 计算任务在worker线程中执行, IO线程不应该被拖住一个以上的定时周期
+constexpr double K_MAX_TICK_DELAY_MS = 20;
+
+uint64_t Fibonacci(int n)
+{
+    return n < 2 ? n : Fibonacci(n - 1) + Fibonacci(n - 2);
+}
+
+void BusyWait(std::chrono::microseconds duration)
+{
+    auto until = std::chrono::steady_clock::now() + duration;
+    while(std::chrono::steady_clock::now() < until) {}
+}
+
+void WaitUntilIdle(const Cloo::ComputePool& pool)
+{
+    while(pool.PendingApprox() > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+long VoluntarySwitches()
+{
+    rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw;
+}
+
+void OffloadFromLoop()
+{
+    auto loop = Cloo::EventLoop::Create();
+    Cloo::ComputePool pool {K_WORKERS, 64};
+
+    constexpr int K_TASKS = 200;
+    int completed = 0;
+    int rejected = 0;
+    double max_tick_delay_ms = 0;
+    auto last_tick = std::chrono::steady_clock::now();
+    loop->RunEvery(20, [&]
+    {
+        auto now = std::chrono::steady_clock::now();
+        max_tick_delay_ms = std::max(max_tick_delay_ms, std::chrono::duration<double, std::milli>(now - last_tick).count() - 20);
+        last_tick = now;
+    });
+
+    for(int i = 0; i < K_TASKS; ++i)
+    {
+        bool accepted = pool.Offload(loop.get(), []{ return Fibonacci(27); }, [&](uint64_t result)
+        {
+            assert(loop->IsInLoopThread());
+            assert(result == 196418);
+            if(++completed + rejected == K_TASKS)
+            {
+                loop->Quit();
+            }
+        });
+        if(!accepted && ++rejected == K_TASKS)
+        {
+            loop->Quit();
+        }
+    }
+    loop->Loop();
+    std::cout << "offload: completed = " << completed << ", rejected = " << rejected
+              << ", max timer delay while computing = " << max_tick_delay_ms << "ms" << std::endl;
+    assert(completed > 0 && completed + rejected == K_TASKS);
+    assert(max_tick_delay_ms < K_MAX_TICK_DELAY_MS);
+}
+
+void SpawnAndSteal()
+{
+    Cloo::ComputePool pool {K_WORKERS, 256};
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    std::atomic<int> done {0};
+    // 根任务在一个worker中派生全部子任务, 子任务进入该worker自己的队列, 其他worker只能通过窃取得到它们
+    pool.Submit([&]
+    {
+        for(int i = 0; i < K_SUBTASKS; ++i)
+        {
+            [[maybe_unused]] bool accepted = pool.Submit([&]
+            {
+                BusyWait(std::chrono::microseconds(500));
+                {
+                    std::lock_guard<std::mutex> lg(mutex);
+                    threads.insert(std::this_thread::get_id());
+                }
+                ++done;
+            });
+            assert(accepted);
+        }
+    });
+    WaitUntilIdle(pool);
+    std::cout << "spawn: " << done.load() << " subtasks on " << threads.size() << " workers, stolen = " << pool.StolenCount()
+              << std::endl;
+    assert(done.load() == K_SUBTASKS);
+    assert(pool.StolenCount() > 0 && threads.size() > 1);
+
+    // 5. 全部任务完成后worker阻塞等待, 这段时间内本进程几乎没有主动的上下文切换
+    long before = VoluntarySwitches();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    long switches = VoluntarySwitches() - before;
+    std::cout << "idle: " << switches << " voluntary context switches in 200ms" << std::endl;
+    assert(switches < 20);
+}
+
+void RejectPolicies()
+{
+    using Policy = Cloo::ComputePool::RejectPolicy;
+    for(Policy policy : {Policy::kReject, Policy::kCallerRuns, Policy::kAbort})
+    {
+        // 一个worker, 积压上限为1: 占住worker的任务就用完了名额
+        Cloo::ComputePool pool {1, 1, policy};
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        pool.Submit([released] { released.wait(); });
+
+        std::thread::id ran_on;
+        bool accepted = false;
+        bool threw = false;
+        try
+        {
+            accepted = pool.Submit([&ran_on] { ran_on = std::this_thread::get_id(); });
+        }
+        catch(const std::runtime_error&)
+        {
+            threw = true;
+        }
+        release.set_value();
+        WaitUntilIdle(pool);
+        assert(pool.RejectedCount() == 1);
+        switch(policy)
+        {
+            case Policy::kReject:
+                assert(!accepted && !threw && ran_on == std::thread::id());
+                break;
+            case Policy::kCallerRuns:
+                assert(accepted && !threw && ran_on == std::this_thread::get_id());
+                break;
+            case Policy::kAbort:
+                assert(!accepted && threw);
+                break;
+        }
+    }
+    std::cout << "reject policies: ok" << std::endl;
+}
+
+void ThrowingTask()
+{
+    Cloo::ComputePool pool {2, 16};
+    pool.Submit([] { throw std::runtime_error("expected by the test"); });
+    WaitUntilIdle(pool);
+    std::promise<int> after;
+    pool.Submit([&after] { after.set_value(42); });
+    [[maybe_unused]] int value = after.get_future().get();
+    assert(value == 42);
+    WaitUntilIdle(pool);
+    std::cout << "throwing task: pool still running" << std::endl;
+}
+
+void DequeContention()
+{
+    constexpr int K_ITEMS = 200000;
+    constexpr int K_THIEVES = 3;
+    Cloo::WorkStealingDeque<intptr_t> deque {256};
+    std::vector<std::atomic<int>> taken(K_ITEMS + 1);
+    std::atomic<bool> producing {true};
+    std::atomic<long> stolen {0};
+    std::vector<std::thread> thieves;
+    for(int i = 0; i < K_THIEVES; ++i)
+    {
+        thieves.emplace_back([&]
+        {
+            while(producing.load() || deque.SizeApprox() > 0)
+            {
+                if(auto item = deque.Steal())
+                {
+                    ++taken[*item];
+                    ++stolen;
+                }
+            }
+        });
+    }
+    // 拥有者: 每压入3个弹出1个, 队列满时自己弹出
+    intptr_t next = 1;
+    while(next <= K_ITEMS)
+    {
+        if(deque.Push(next))
+        {
+            ++next;
+        }
+        if(next % 3 == 0 || deque.SizeApprox() == deque.Capacity())
+        {
+            if(auto item = deque.Pop())
+            {
+                ++taken[*item];
+            }
+        }
+    }
+    while(auto item = deque.Pop())
+    {
+        ++taken[*item];
+    }
+    producing.store(false);
+    for(auto& t : thieves)
+    {
+        t.join();
+    }
+    for(int i = 1; i <= K_ITEMS; ++i)
+    {
+        assert(taken[i].load() == 1);
+    }
+    std::cout << "deque: " << K_ITEMS << " items, " << stolen.load() << " stolen by " << K_THIEVES << " thieves" << std::endl;
+    assert(stolen.load() > 0);
+}
+
+}
+
+int main()
+{
+    OffloadFromLoop();
+    SpawnAndSteal();
+    RejectPolicies();
+    ThrowingTask();
+    DequeContention();
+}
@@ -0,0 +1,209 @@
+// 连接句柄(ConnectionHandle)与跨线程的Cloo::Send
+// 服务端使用K_IO_THREADS个IO线程, 在ConnectionCallback中记录每条连接的句柄, K_WORKERS个worker线程只持有句柄, 不持有TcpConnectionPtr:
+//  1. 每个worker向每条连接发送K_MESSAGES条定长消息, 客户端收齐全部消息, 同一个worker的消息保持发送顺序
+//  2. 关闭一个客户端后新连接复用它的slot(generation加1), 发往旧句柄的数据被丢弃(DroppedSends), 不会发给新连接
+//  3. 退役一个IO线程(不迁移连接), 它上面的连接关闭、线程退出后, 发往这些连接的句柄的数据被丢弃, 不会访问已经销毁的EventLoop
+
+#include "../net/include/ConnectionTable.h"
+#include "../net/include/EventLoop.h"
+#include "../net/include/SocketAddress.h"
+#include "../net/include/TcpConnection.h"
+#include "../net/include/TcpServer.h"
+#include "TestUtil.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+constexpr uint16_t K_PORT = 7793;
+constexpr int K_CLIENTS = 4;
+constexpr int K_IO_THREADS = 2;
+constexpr int K_WORKERS = 4;
+constexpr int K_MESSAGES = 1000;
+// "w" + worker + 序号(6位) + "\n"
+constexpr size_t K_MESSAGE_SIZE = 9;
+
+// 等待timeout_ms, fd上没有数据可读时返回true
+bool NothingToRead(int fd, int timeout_ms)
+{
+    pollfd pfd{fd, POLLIN, 0};
+    return ::poll(&pfd, 1, timeout_ms) == 0;
+}
+
+std::string Message(int worker, int seq)
+{
+    char buf[K_MESSAGE_SIZE + 1];
+    std::snprintf(buf, sizeof buf, "w%d%06d\n", worker, seq);
+    return std::string(buf, K_MESSAGE_SIZE);
+}
+
+
+struct Server
+{
+    std::shared_ptr<Cloo::EventLoop> loop;
+    Cloo::TcpServer* server;
+};
+
+}
+
+int main()
+{
+    std::mutex mutex;
+    std::vector<Cloo::ConnectionHandle> handles;
+    std::vector<Cloo::EventLoop*> handle_loops;
+    int disconnected = 0;
+    std::promise<Server> server_promise;
+    auto server_future = server_promise.get_future();
+    std::thread server_thread([&]
+    {
+        auto loop = Cloo::EventLoop::Create();
+        Cloo::TcpServer server(loop, Cloo::SocketAddress(K_PORT), "handle");
+        server.SetThreadNum(K_IO_THREADS);
+        server.SetConnectionCallback([&](const Cloo::define::TcpConnectionPtr& conn)
+        {
+            std::lock_guard<std::mutex> lg(mutex);
+            if(conn->Connected())
+            {
+                handles.push_back(conn->Handle());
+                handle_loops.push_back(conn->GetLoop());
+            }
+            else
+            {
+                ++disconnected;
+            }
+        });
+        server.Start();
+        server_promise.set_value(Server{loop, &server});
+        loop->Loop();
+    });
+    Server refs = server_future.get();
+    auto loop = refs.loop;
+    Cloo::TcpServer* server = refs.server;
+    Cloo::ConnectionTable* table = &server->GetConnectionTable();
+    auto handle_count = [&] { std::lock_guard<std::mutex> lg(mutex); return handles.size(); };
+
+    // 逐个连接, 使handles与clients一一对应
+    std::vector<int> clients;
+    for(int i = 0; i < K_CLIENTS; ++i)
+    {
+        clients.push_back(TestUtil::Connect(K_PORT));
+        TestUtil::WaitFor([&] { return handle_count() == clients.size(); });
+    }
+    std::vector<Cloo::ConnectionHandle> targets = [&] { std::lock_guard<std::mutex> lg(mutex); return handles; }();
+    for(const auto& handle : targets)
+    {
+        assert(handle.Valid() && handle.table == table);
+    }
+
+    // 1. worker线程只凭句柄发送
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for(int w = 0; w < K_WORKERS; ++w)
+    {
+        workers.emplace_back([w, &targets]
+        {
+            for(int seq = 0; seq < K_MESSAGES; ++seq)
+            {
+                for(const auto& handle : targets)
+                {
+                    Cloo::Send(handle, Message(w, seq));
+                }
+            }
+        });
+    }
+    for(int fd : clients)
+    {
+        std::string data = TestUtil::ReadExactly(fd, K_WORKERS * K_MESSAGES * K_MESSAGE_SIZE);
+        int next_seq[K_WORKERS] = {0};
+        for(size_t pos = 0; pos < data.size(); pos += K_MESSAGE_SIZE)
+        {
+            int worker = data[pos + 1] - '0';
+            assert(worker >= 0 && worker < K_WORKERS);
+            [[maybe_unused]] bool in_order = data.compare(pos, K_MESSAGE_SIZE, Message(worker, next_seq[worker])) == 0;
+            assert(in_order);
+            ++next_seq[worker];
+        }
+    }
+    for(auto& t : workers)
+    {
+        t.join();
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << K_WORKERS << " workers x " << K_CLIENTS << " connections x " << K_MESSAGES << " messages in " << ms << "ms"
+              << std::endl;
+    assert(table->DroppedSends() == 0);
+
+    // 2. 旧句柄失效, slot被新连接复用
+    const Cloo::ConnectionHandle stale = targets[0];
+    ::close(clients[0]);
+    TestUtil::WaitFor([&] { std::lock_guard<std::mutex> lg(mutex); return disconnected == 1; });
+    TestUtil::WaitFor([&] { return table->Size() == K_CLIENTS - 1; });
+    clients[0] = TestUtil::Connect(K_PORT);
+    TestUtil::WaitFor([&] { return handle_count() == K_CLIENTS + 1; });
+    const Cloo::ConnectionHandle fresh = [&] { std::lock_guard<std::mutex> lg(mutex); return handles.back(); }();
+    std::cout << "stale handle slot=" << stale.slot << " gen=" << stale.generation << ", new connection slot=" << fresh.slot
+              << " gen=" << fresh.generation << std::endl;
+    assert(fresh.slot == stale.slot && fresh.generation == stale.generation + 1);
+
+    std::thread([&] { Cloo::Send(stale, "stale\n"); }).join();
+    TestUtil::WaitFor([&] { return table->DroppedSends() == 1; });
+    assert(NothingToRead(clients[0], 50));
+    std::thread([&] { Cloo::Send(fresh, "fresh\n"); }).join();
+    [[maybe_unused]] std::string reply = TestUtil::ReadExactly(clients[0], 6);
+    assert(reply == "fresh\n");
+
+    // 3. 退役clients[1]所在的IO线程, 不迁移连接; 关闭它上面的连接后线程退出
+    std::vector<Cloo::ConnectionHandle> live_handles;
+    std::vector<Cloo::EventLoop*> live_loops;
+    {
+        std::lock_guard<std::mutex> lg(mutex);
+        live_handles.assign(handles.begin() + 1, handles.end() - 1);
+        live_handles.insert(live_handles.begin(), handles.back());
+        live_loops.assign(handle_loops.begin() + 1, handle_loops.end() - 1);
+        live_loops.insert(live_loops.begin(), handle_loops.back());
+    }
+    Cloo::EventLoop* retired = live_loops[1];
+    [[maybe_unused]] bool retiring = TestUtil::InLoop(loop.get(), [&] { return server->RetireIoLoop(retired, false); });
+    assert(retiring);
+    std::vector<Cloo::ConnectionHandle> retired_handles;
+    for(size_t i = clients.size(); i-- > 0;)
+    {
+        if(live_loops[i] == retired)
+        {
+            ::close(clients[i]);
+            clients.erase(clients.begin() + i);
+            retired_handles.push_back(live_handles[i]);
+        }
+    }
+    TestUtil::WaitFor([&] { return TestUtil::InLoop(loop.get(), [&] { return server->GetResizeStats().loops_retired; }) == 1; });
+    const size_t dropped_before = table->DroppedSends();
+    std::thread([&]
+    {
+        for(const auto& handle : retired_handles)
+        {
+            Cloo::Send(handle, "retired\n");
+        }
+    }).join();
+    std::cout << "sends to " << retired_handles.size() << " connections of a retired loop: dropped = "
+              << table->DroppedSends() - dropped_before << std::endl;
+    assert(table->DroppedSends() == dropped_before + retired_handles.size());
+
+    for(int fd : clients)
+    {
+        ::close(fd);
+    }
+    loop->QueueTaskInThisLoop([&loop] { loop->Quit(); });
+    server_thread.join();
+}
@@ -0,0 +1,161 @@
+// 协程echo服务器与回调echo服务器的对比基准测试
+// 多个客户端线程各自做固定轮数的64字节ping-pong, 统计两种服务器的吞吐量,
+// 以及IO线程中平均每个请求触发的全局operator new次数
+
+#include "../net/include/Buffer.h"
+#include "../net/include/Coroutine.h"
+#include "../net/include/EventLoop.h"
+#include "../net/include/SocketAddress.h"
+#include "../net/include/TcpConnection.h"
+#include "../net/include/TcpServer.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <new>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+// 只统计IO线程(主线程)中的内存分配
+thread_local bool t_count_allocations = false;
+size_t g_allocations = 0;
+
+}
+
+void* operator new(size_t size)
+{
+    if(t_count_allocations)
+    {
+        ++g_allocations;
+    }
+    if(void* ptr = std::malloc(size == 0 ? 1 : size))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+namespace
+{
+
+constexpr int K_CLIENTS = 8;
+constexpr int K_ROUNDS = 5000;
+constexpr size_t K_MESSAGE_SIZE = 64;
+
+Cloo::Task EchoSession(Cloo::EventLoop* loop, Cloo::SocketFd fd)
+{
+    Cloo::AsyncSocket socket(loop, fd);
+    char buf[2048];
+    while(true)
+    {
+        ssize_t n = co_await socket.Read(buf, sizeof buf);
+        if(n <= 0)
+        {
+            break;
+        }
+        if(co_await socket.Write(buf, n) < 0)
+        {
+            break;
+        }
+    }
+}
+
+Cloo::Task AcceptLoop(Cloo::AsyncSocket* listener)
+{
+    while(true)
+    {
+        auto accepted = co_await listener->Accept();
+        if(accepted.fd != Cloo::SocketFd::invalid)
+        {
+            EchoSession(listener->GetLoop(), accepted.fd);
+        }
+    }
+}
+
+void RunClients(const Cloo::SocketAddress& addr)
+{
+    std::vector<std::thread> clients;
+    for(int i = 0; i < K_CLIENTS; ++i)
+    {
+        clients.emplace_back([&addr]
+        {
+            int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            ::connect(fd, reinterpret_cast<const sockaddr*>(&addr.ToSockAddrIn()), sizeof(sockaddr_in));
+            char message[K_MESSAGE_SIZE] = {'x'};
+            char reply[K_MESSAGE_SIZE];
+            for(int round = 0; round < K_ROUNDS; ++round)
+            {
+                ::write(fd, message, sizeof message);
+                size_t got = 0;
+                while(got < sizeof reply)
+                {
+                    ssize_t n = ::read(fd, reply + got, sizeof reply - got);
+                    if(n <= 0) return;
+                    got += n;
+                }
+            }
+            ::close(fd);
+        });
+    }
+    for(auto& client : clients)
+    {
+        client.join();
+    }
+}
+
+// 在loop中运行服务器, 客户端线程结束后退出loop
+void Measure(const char* name, const std::shared_ptr<Cloo::EventLoop>& loop, const Cloo::SocketAddress& addr)
+{
+    std::thread driver([&]
+    {
+        RunClients(addr);
+        loop->QueueTaskInThisLoop([&]{ loop->Quit(); });
+    });
+    g_allocations = 0;
+    t_count_allocations = true;
+    auto start = std::chrono::steady_clock::now();
+    loop->Loop();
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    t_count_allocations = false;
+    driver.join();
+
+    double requests = static_cast<double>(K_CLIENTS) * K_ROUNDS;
+    std::cout << std::fixed << std::setprecision(2) << std::setw(10) << name
+              << "  throughput = " << std::setw(10) << requests / seconds << " req/s"
+              << "  allocations/request = " << g_allocations / requests << std::endl;
+}
+
+}
+
+int main()
+{
+    auto loop = Cloo::EventLoop::Create();
+
+    Cloo::SocketAddress callback_addr {"127.0.0.1", 7780};
+    Cloo::TcpServer server {loop, callback_addr, "CallbackEcho"};
+    server.SetMessageCallback([](const Cloo::define::TcpConnectionPtr& conn, Cloo::Buffer* buf, Cloo::define::SystemTimePoint)
+    {
+        conn->Send(buf);
+    });
+    server.Start();
+    Measure("callback", loop, callback_addr);
+
+    Cloo::SocketAddress coroutine_addr {"127.0.0.1", 7781};
+    auto listener = Cloo::AsyncSocket::Listen(loop.get(), coroutine_addr);
+    AcceptLoop(listener.get());
+    Measure("coroutine", loop, coroutine_addr);
+
+    const auto& stats = Cloo::detail::FrameAllocator::ThreadStats();
+    std::cout << "coroutine frames: pool hits = " << stats.pool_hits << ", pool misses = " << stats.pool_misses << std::endl;
+}
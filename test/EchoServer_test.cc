@@ -0,0 +1,109 @@
+// 边沿触发echo服务器
+// 一个客户端持续发送大量数据(firehose), 另一个客户端做小请求的ping-pong,
+// 观察在每次事件64KiB的读写预算下, firehose连接不会让同一个EventLoop上的ping-pong连接饿死
+
+#include "../net/include/Buffer.h"
+#include "../net/include/EventLoop.h"
+#include "../net/include/SocketAddress.h"
+#include "../net/include/TcpConnection.h"
+#include "../net/include/TcpServer.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+int ConnectTo(const Cloo::SocketAddress& addr)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    ::connect(fd, reinterpret_cast<const sockaddr*>(&addr.ToSockAddrIn()), sizeof(sockaddr_in));
+    return fd;
+}
+
+void Firehose(const Cloo::SocketAddress& addr, size_t total_bytes)
+{
+    int fd = ConnectTo(addr);
+    std::thread reader([fd, total_bytes]
+    {
+        std::vector<char> buf(65536);
+        size_t received = 0;
+        while(received < total_bytes)
+        {
+            ssize_t n = ::read(fd, buf.data(), buf.size());
+            if(n <= 0) break;
+            received += n;
+        }
+        std::cout << "firehose echoed " << received << " / " << total_bytes << " bytes" << std::endl;
+    });
+    std::vector<char> chunk(65536, 'x');
+    size_t sent = 0;
+    while(sent < total_bytes)
+    {
+        ssize_t n = ::write(fd, chunk.data(), std::min(chunk.size(), total_bytes - sent));
+        if(n <= 0) break;
+        sent += n;
+    }
+    reader.join();
+    ::close(fd);
+}
+
+void PingPong(const Cloo::SocketAddress& addr, int rounds)
+{
+    int fd = ConnectTo(addr);
+    std::vector<double> rtts;
+    char buf[64];
+    for(int i = 0; i < rounds; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        ::write(fd, "ping", 4);
+        size_t got = 0;
+        while(got < 4)
+        {
+            ssize_t n = ::read(fd, buf, sizeof buf);
+            if(n <= 0) break;
+            got += n;
+        }
+        rtts.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(rtts.begin(), rtts.end());
+    std::cout << "ping-pong rounds = " << rtts.size() << ", p50 = " << rtts[rtts.size() / 2]
+              << "us, max = " << rtts.back() << "us" << std::endl;
+    ::close(fd);
+}
+
+}
+
+int main()
+{
+    auto loop = Cloo::EventLoop::Create();
+    Cloo::SocketAddress listen_addr {"127.0.0.1", 7779};
+    Cloo::TcpServer server {loop, listen_addr, "EchoServer"};
+    server.SetThreadNum(1);
+    server.SetEdgeTriggered(true);
+    server.SetMessageCallback([](const Cloo::define::TcpConnectionPtr& conn, Cloo::Buffer* buf, Cloo::define::SystemTimePoint)
+    {
+        conn->Send(buf);
+    });
+    server.Start();
+
+    std::thread clients([&]
+    {
+        std::thread firehose(Firehose, std::cref(listen_addr), 64 * 1024 * 1024);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        PingPong(listen_addr, 200);
+        firehose.join();
+        loop->QueueTaskInThisLoop([&]{ loop->Quit(); });
+    });
+    loop->Loop();
+    clients.join();
+}
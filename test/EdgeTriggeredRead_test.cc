@@ -0,0 +1,94 @@
+// 边沿触发下的读取
+// 客户端在EventLoop被阻塞时把内核缓冲区写满, 然后停止写入; MessageCallback不取走数据, 直到收齐才回复一个字节,
+// 输入缓冲区中一直留有超过64KiB的未读数据.
+// 此时Buffer的空闲空间常常不小于64KiB, ReadFd不再使用栈上的缓冲区, 一次最多只能读出WritableBytes()字节;
+// 若把这样一次"读满"误判为短读而停止读取, 内核缓冲区中剩下的数据不会再触发新的边沿, 连接停住, 客户端等不到回复
+
+#include "../net/include/Buffer.h"
+#include "../net/include/EventLoop.h"
+#include "../net/include/SocketAddress.h"
+#include "../net/include/TcpConnection.h"
+#include "../net/include/TcpServer.h"
+#include "TestUtil.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <fcntl.h>
+#include <future>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+
+constexpr uint16_t K_PORT = 7794;
+
+}
+
+int main()
+{
+    auto loop = Cloo::EventLoop::Create();
+    // 不限制单次事件的读取量, 每次可读事件都必须读到内核缓冲区为空
+    loop->SetIoBudgetPerEvent(0);
+    Cloo::TcpServer server {loop, Cloo::SocketAddress("127.0.0.1", K_PORT), "EdgeTriggeredRead"};
+    server.SetEdgeTriggered(true);
+    std::atomic<bool> connected {false};
+    std::atomic<size_t> expected {0};
+    size_t max_unconsumed = 0;
+    server.SetConnectionCallback([&](const Cloo::define::TcpConnectionPtr& conn)
+    {
+        connected = conn->Connected();
+    });
+    server.SetMessageCallback([&](const Cloo::define::TcpConnectionPtr& conn, Cloo::Buffer* buf, Cloo::define::SystemTimePoint)
+    {
+        max_unconsumed = std::max(max_unconsumed, buf->ReadableBytes());
+        if(expected > 0 && buf->ReadableBytes() >= expected)
+        {
+            buf->RetrieveAll();
+            conn->Send(std::string_view("k"));
+        }
+    });
+    server.Start();
+
+    bool replied = false;
+    std::thread client([&]
+    {
+        int fd = TestUtil::Connect(K_PORT);
+        TestUtil::WaitFor([&]{ return connected.load(); });
+        // 阻塞EventLoop, 客户端把内核缓冲区写满后停止写入, 之后不会再有新的数据触发边沿
+        std::promise<void> filled;
+        loop->QueueTaskInThisLoop([&]{ filled.get_future().wait(); });
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        std::string chunk(65536, 'x');
+        size_t sent = 0;
+        while(true)
+        {
+            ssize_t n = ::write(fd, chunk.data(), chunk.size());
+            if(n <= 0) break;
+            sent += n;
+        }
+        std::cout << "client queued " << sent << " bytes" << std::endl;
+        expected = sent;
+        filled.set_value();
+
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        timeval timeout {5, 0};
+        ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+        char reply = 0;
+        replied = ::read(fd, &reply, 1) == 1 && reply == 'k';
+        ::close(fd);
+        loop->QueueTaskInThisLoop([&]{ loop->Quit(); });
+    });
+    loop->Loop();
+    client.join();
+
+    std::cout << "max unconsumed input = " << max_unconsumed << " bytes, replied = " << replied << std::endl;
+    assert(max_unconsumed > Cloo::Buffer::kExtraBufferSize);
+    assert(replied);
+}
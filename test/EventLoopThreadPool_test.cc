@@ -0,0 +1,109 @@
+#include "../net/include/Acceptor.h"
+#include "../net/include/EventLoop.h"
+#include "../net/include/EventLoopThreadPool.h"
+#include "../net/include/Socket.h"
+#include "../net/include/SocketAddress.h"
+
+#include <arpa/inet.h>
+#include <cassert>
+#include <set>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// 每个IO线程绑定一个CPU, Acceptor根据SO_INCOMING_CPU把连接交给绑定在收包CPU上的EventLoop
+int main()
+{
+    auto loop = Cloo::EventLoop::Create();
+    Cloo::EventLoopThreadPool pool {loop};
+
+    std::vector<int> cpus;
+    for(unsigned i = 0; i < std::thread::hardware_concurrency(); ++i)
+    {
+        cpus.push_back(static_cast<int>(i));
+    }
+    pool.Start(static_cast<int>(cpus.size()), Cloo::EventLoopThreadPool::PinEachToCpu(cpus));
+    for(const auto& io_loop : pool.Loops())
+    {
+        io_loop->RunTaskInThisLoop([]{ std::cout << "io thread " << std::this_thread::get_id() << " runs on cpu " << ::sched_getcpu() << std::endl; });
+    }
+
+    constexpr int K_CONNECTIONS = 4;
+    int accepted = 0;
+    int routed = 0;
+    Cloo::SocketAddress listen_addr {"127.0.0.1", 7778};
+    Cloo::Acceptor acceptor {loop, listen_addr};
+    acceptor.SetNewConnectionCallback([&](Cloo::SocketFd fd, const Cloo::SocketAddress& peer)
+    {
+        int incoming_cpu = Cloo::Socket::GetIncomingCpu(fd);
+        auto io_loop = pool.GetLoopForSocket(fd);
+        // 收包CPU已知时, 连接必须交给绑定在该CPU上的IO线程(PinEachToCpu下第i个线程绑定cpus[i])
+        for(size_t i = 0; incoming_cpu >= 0 && i < cpus.size(); ++i)
+        {
+            if(cpus[i] == incoming_cpu)
+            {
+                assert(io_loop == pool.Loops()[i]);
+                ++routed;
+            }
+        }
+        std::string peer_str = peer.ToHostPort();
+        io_loop->RunTaskInThisLoop([fd, incoming_cpu, peer_str]
+        {
+            std::cout << "connection from " << peer_str << " received on cpu " << incoming_cpu
+                      << ", handled on cpu " << ::sched_getcpu() << std::endl;
+            ::close(static_cast<int>(fd));
+        });
+        if(++accepted == K_CONNECTIONS)
+        {
+            loop->RunAfter(100, [&]{ loop->Quit(); });
+        }
+    });
+    acceptor.Listen();
+
+    std::thread client([&]
+    {
+        for(int i = 0; i < K_CONNECTIONS; ++i)
+        {
+            int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            ::connect(fd, reinterpret_cast<const sockaddr*>(&listen_addr.ToSockAddrIn()), sizeof(sockaddr_in));
+            ::write(fd, "ping", 4);
+            ::close(fd);
+        }
+    });
+    loop->Loop();
+    client.join();
+    std::cout << routed << " of " << K_CONNECTIONS << " connections routed by incoming cpu" << std::endl;
+
+    // 不依赖网卡实际的收包CPU: 每个CPU都映射到绑定在它上面的唯一IO线程
+    for(size_t i = 0; i < cpus.size(); ++i)
+    {
+        assert(pool.GetLoopForCpu(cpus[i]) == pool.Loops()[i]);
+    }
+
+    // 多个IO线程绑定同一组CPU(例如同一个NUMA节点)时, 同一个CPU上的连接在它们之间轮转
+    {
+        constexpr int K_SHARED = 3;
+        Cloo::EventLoopThreadPool shared_pool {loop};
+        shared_pool.Start(K_SHARED, {Cloo::ThreadPlacement::OnCpus(cpus)});
+        std::set<Cloo::EventLoop*> chosen;
+        for(int i = 0; i < K_SHARED; ++i)
+        {
+            chosen.insert(shared_pool.GetLoopForCpu(cpus.front()).get());
+        }
+        std::cout << K_SHARED << " loops sharing cpu " << cpus.front() << ": " << chosen.size() << " chosen" << std::endl;
+        assert(chosen.size() == K_SHARED);
+    }
+
+    // 超出cpu_set_t/NUMA节点位图范围的放置被拒绝, 而不是写越界
+    std::thread([]
+    {
+        [[maybe_unused]] bool cpu_ok = Cloo::ThreadPlacement::OnCpu(CPU_SETSIZE + 1).ApplyToThisThread();
+        [[maybe_unused]] bool node_ok = Cloo::ThreadPlacement::OnNumaNode(4096).ApplyToThisThread();
+        assert(!cpu_ok && !node_ok);
+    }).join();
+}
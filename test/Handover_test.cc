@@ -0,0 +1,181 @@
+// 零停机重启: 旧进程在回环地址上提供服务, 新进程通过Unix socket(SCM_RIGHTS)取得旧进程的监听fd与一条空闲的连接,
+// 旧进程随后停止accept并drain. 客户端在整个交接过程中不断建立短连接, 检查没有连接被拒绝或丢失,
+// 短连接先由旧进程、后由新进程应答, 交接过去的长连接之后由新进程应答
+
+#include "../net/include/Buffer.h"
+#include "../net/include/EventLoop.h"
+#include "../net/include/FdHandover.h"
+#include "../net/include/SocketAddress.h"
+#include "../net/include/TcpConnection.h"
+#include "../net/include/TcpServer.h"
+#include "TestUtil.h"
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+
+constexpr uint16_t K_PORT = 7785;
+constexpr int K_SHORT_CONNECTIONS = 100;
+
+// 应答"<name>:<请求>"
+void ServeEcho(Cloo::TcpServer& server, const std::string& name)
+{
+    server.SetMessageCallback([name](const Cloo::define::TcpConnectionPtr& conn, Cloo::Buffer* buf, Cloo::define::SystemTimePoint)
+    {
+        conn->Send(name + ":" + buf->RetrieveAllAsString());
+    });
+}
+
+// 失败时返回-1; 读超时2秒, 服务端没有应答时Request返回空串而不是阻塞
+int ConnectWithTimeout()
+{
+    int fd = TestUtil::TryConnect(K_PORT);
+    if(fd < 0)
+    {
+        return -1;
+    }
+    timeval tv {2, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+    return fd;
+}
+
+// 返回应答, 失败时返回空串
+std::string Request(int fd, const std::string& request)
+{
+    if(::write(fd, request.data(), request.size()) != static_cast<ssize_t>(request.size()))
+    {
+        return "";
+    }
+    char buf[64];
+    ssize_t n = ::read(fd, buf, sizeof buf);
+    return n > 0 ? std::string(buf, n) : "";
+}
+
+// 新进程: 取得fds后在同一个监听fd上继续服务, 交接过来的长连接关闭后退出
+int RunNewProcess(const std::string& path)
+{
+    // 让客户端先在旧进程上完成一些请求
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    auto fds = Cloo::FetchHandoverFds(path, 5000);
+    if(fds.size() != 2 || fds[0].kind != Cloo::HandoverFdKind::kListener || fds[1].kind != Cloo::HandoverFdKind::kConnection)
+    {
+        return 1;
+    }
+    auto loop = Cloo::EventLoop::Create();
+    Cloo::TcpServer server(loop, fds[0].fd, "new");
+    ServeEcho(server, "new");
+    server.SetConnectionCallback([&](const Cloo::define::TcpConnectionPtr& conn)
+    {
+        if(conn->Disconnected() && conn->Name() == "new#1")
+        {
+            loop->Quit();
+        }
+    });
+    server.Start();
+    server.AdoptConnection(fds[1].fd);
+    loop->RunAfter(5000, [&] { loop->Quit(); });
+    loop->Loop();
+    return 0;
+}
+
+}
+
+int main()
+{
+    const std::string path = "/tmp/cloo_handover_" + std::to_string(::getpid()) + ".sock";
+    // 在创建任何线程之前fork
+    pid_t child = ::fork();
+    if(child == 0)
+    {
+        ::_exit(RunNewProcess(path));
+    }
+
+    int old_replies = 0;
+    int new_replies = 0;
+    int failures = 0;
+    std::string persistent_before;
+    std::string persistent_after;
+    {
+        auto loop = Cloo::EventLoop::Create();
+        Cloo::TcpServer server(loop, Cloo::SocketAddress(K_PORT), "old");
+        ServeEcho(server, "old");
+        Cloo::define::TcpConnectionPtr persistent;
+        server.SetConnectionCallback([&](const Cloo::define::TcpConnectionPtr& conn)
+        {
+            // 第一条连接是客户端的长连接
+            if(conn->Connected() && !persistent)
+            {
+                persistent = conn;
+            }
+        });
+        server.Start();
+
+        Cloo::HandoverServer handover(loop, path);
+        handover.SetCollectCallback([&]
+        {
+            std::vector<Cloo::HandoverFd> fds {{Cloo::HandoverFdKind::kListener, server.ListenFd()}};
+            Cloo::SocketFd conn_fd = persistent->DetachForHandover();
+            assert(conn_fd != Cloo::SocketFd::invalid);
+            fds.push_back({Cloo::HandoverFdKind::kConnection, conn_fd});
+            persistent.reset();
+            return fds;
+        });
+        handover.SetCompleteCallback([&](bool ok)
+        {
+            assert(ok);
+            server.StopAccepting();
+            // 留一点时间处理已经accept的连接
+            loop->RunAfter(200, [&] { loop->Quit(); });
+        });
+        handover.Listen();
+
+        std::thread client([&]
+        {
+            int persistent_fd = ConnectWithTimeout();
+            persistent_before = Request(persistent_fd, "p");
+            for(int i = 0; i < K_SHORT_CONNECTIONS; ++i)
+            {
+                int fd = ConnectWithTimeout();
+                std::string reply = fd == -1 ? "" : Request(fd, "x");
+                if(reply == "old:x")
+                {
+                    ++old_replies;
+                }
+                else if(reply == "new:x")
+                {
+                    ++new_replies;
+                }
+                else
+                {
+                    ++failures;
+                }
+                if(fd != -1)
+                {
+                    ::close(fd);
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            persistent_after = Request(persistent_fd, "p");
+            ::close(persistent_fd);
+        });
+        loop->Loop();
+        client.join();
+    }
+    int status = 0;
+    ::waitpid(child, &status, 0);
+
+    std::cout << "short connections: old=" << old_replies << " new=" << new_replies << " failed=" << failures << std::endl;
+    std::cout << "persistent connection: before=" << persistent_before << " after=" << persistent_after << std::endl;
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    assert(failures == 0 && old_replies > 0 && new_replies > 0);
+    assert(persistent_before == "old:p" && persistent_after == "new:p");
+}
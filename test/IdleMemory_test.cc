@@ -0,0 +1,199 @@
+// 空闲连接的内存: 缓冲区按需分配, 空闲后释放
+// 服务端开启SetBufferReleaseIdle(K_IDLE_MS), K_CLIENTS个客户端各发送一条消息(一半K_SMALL字节, 一半K_LARGE字节)并收到回显, 然后保持空闲
+// 1. 刚建立、还没有读写的连接没有缓冲区存储, 每条连接占用的内存小于1KiB.
+//    按分配器的增量计算: LoopMemory中的对象与chunk加上堆上分配的字节(mallinfo2), 不依赖TcpConnection::MemoryUsage的估计
+// 2. 回显后: 小消息的连接输入缓冲区是一个LoopMemory的chunk, 大消息的连接按读取大小分配了一块更大的存储
+// 3. 空闲超过K_IDLE_MS后所有缓冲区被释放, chunk全部归还给LoopMemory, 每条连接回到1KiB以下
+// 4. 释放后连接照常工作: 再发送一轮消息, 回显正确
+// 输出各阶段每条连接的平均内存及其构成, 以及TcpConnection::MemoryUsage的值
+
+#include "../net/include/Buffer.h"
+#include "../net/include/EventLoop.h"
+#include "../net/include/LoopMemory.h"
+#include "../net/include/SocketAddress.h"
+#include "../net/include/TcpConnection.h"
+#include "../net/include/TcpServer.h"
+#include "TestUtil.h"
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <malloc.h>
+#include <memory>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+constexpr uint16_t K_PORT = 7791;
+constexpr int K_CLIENTS = 1000;
+constexpr size_t K_SMALL = 200;
+constexpr size_t K_LARGE = 6000;
+constexpr long K_IDLE_MS = 100;
+
+struct Snapshot
+{
+    size_t connections = 0;
+    size_t usage = 0;
+    size_t buffer_bytes = 0;
+    // 堆上已分配的字节数(mallinfo2的uordblks, 含malloc的块头与取整)
+    size_t heap_in_use = 0;
+    Cloo::LoopMemory::Stats memory;
+};
+
+// 相对于没有连接时的baseline, 每条连接实际占用的内存: LoopMemory中的对象与chunk加上堆上的分配.
+// 包括分配器的取整、shared_ptr的控制块、TcpServer连接表的节点、关闭回调等所有随连接分配的内存
+size_t PerConnection(const Snapshot& baseline, const Snapshot& snapshot)
+{
+    const size_t loop_memory = snapshot.memory.objects.bytes_in_use + snapshot.memory.chunks.bytes_in_use
+                               - baseline.memory.objects.bytes_in_use - baseline.memory.chunks.bytes_in_use;
+    return (loop_memory + snapshot.heap_in_use - baseline.heap_in_use) / snapshot.connections;
+}
+
+Snapshot Measure(Cloo::EventLoop* loop, const std::vector<Cloo::define::TcpConnectionPtr>& conns)
+{
+    return TestUtil::InLoop(loop, [loop, &conns]
+    {
+        Snapshot snapshot;
+        for(const auto& conn : conns)
+        {
+            ++snapshot.connections;
+            snapshot.usage += conn->MemoryUsage();
+            snapshot.buffer_bytes += conn->InputBuffer()->AllocatedBytes() + conn->OutputBuffer()->AllocatedBytes();
+        }
+        snapshot.memory = loop->Memory().GetStats();
+        snapshot.heap_in_use = ::mallinfo2().uordblks;
+        return snapshot;
+    });
+}
+
+void Print(const char* phase, const Snapshot& baseline, const Snapshot& snapshot)
+{
+    const size_t objects = snapshot.memory.objects.bytes_in_use - baseline.memory.objects.bytes_in_use;
+    std::cout << phase << ": " << snapshot.connections << " connections, " << PerConnection(baseline, snapshot)
+              << "B/connection (loop memory objects " << objects / snapshot.connections << "B, heap "
+              << (snapshot.heap_in_use - baseline.heap_in_use) / snapshot.connections << "B, buffers "
+              << snapshot.buffer_bytes / snapshot.connections << "B; MemoryUsage " << snapshot.usage / snapshot.connections
+              << "B), chunks in use " << snapshot.memory.chunks.bytes_in_use << "B" << std::endl;
+}
+
+size_t MessageSize(size_t i)
+{
+    return i % 2 == 0 ? K_SMALL : K_LARGE;
+}
+
+void EchoAll(const std::vector<int>& clients)
+{
+    for(size_t i = 0; i < clients.size(); ++i)
+    {
+        std::string message(MessageSize(i), 'm');
+        if(::write(clients[i], message.data(), message.size()) != static_cast<ssize_t>(message.size()))
+        {
+            std::cerr << "write failed" << std::endl;
+            std::abort();
+        }
+    }
+    for(size_t i = 0; i < clients.size(); ++i)
+    {
+        TestUtil::ReadExactly(clients[i], MessageSize(i));
+    }
+}
+
+void RunClients(Cloo::EventLoop* loop, std::vector<Cloo::define::TcpConnectionPtr>* conns)
+{
+    std::vector<int> clients;
+    clients.reserve(K_CLIENTS);
+    const Snapshot baseline = Measure(loop, *conns);
+    for(int i = 0; i < K_CLIENTS; ++i)
+    {
+        clients.push_back(TestUtil::Connect(K_PORT));
+    }
+    while(TestUtil::InLoop(loop, [conns] { return conns->size(); }) < K_CLIENTS)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    Snapshot fresh = Measure(loop, *conns);
+    Print("connected", baseline, fresh);
+    assert(fresh.buffer_bytes == 0 && PerConnection(baseline, fresh) < 1024);
+
+    EchoAll(clients);
+    Snapshot active = Measure(loop, *conns);
+    Print("after echo", baseline, active);
+    // 小消息的连接各有一个chunk的输入缓冲区, 大消息的连接的输入缓冲区不小于消息
+    assert(active.memory.chunks.bytes_in_use == K_CLIENTS / 2 * Cloo::LoopMemory::kBufferChunkSize);
+    assert(active.buffer_bytes >= K_CLIENTS / 2 * (Cloo::LoopMemory::kBufferChunkSize + K_LARGE));
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(K_IDLE_MS * 3));
+    Snapshot idle = Measure(loop, *conns);
+    Print("idle", baseline, idle);
+    assert(idle.buffer_bytes == 0 && idle.memory.chunks.bytes_in_use == 0);
+    assert(PerConnection(baseline, idle) < 1024);
+
+    EchoAll(clients);
+    Print("active again", baseline, Measure(loop, *conns));
+
+    for(int fd : clients)
+    {
+        ::close(fd);
+    }
+    while(TestUtil::InLoop(loop, [conns] { return conns->size(); }) > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    loop->QueueTaskInThisLoop([loop] { loop->Quit(); });
+}
+
+}
+
+int main()
+{
+    // 所有线程共用一个malloc arena, mallinfo2才能统计到IO线程的分配
+    ::mallopt(M_ARENA_MAX, 1);
+    // 客户端与服务端各需要K_CLIENTS个fd
+    rlimit limit;
+    ::getrlimit(RLIMIT_NOFILE, &limit);
+    if(limit.rlim_cur < 2 * K_CLIENTS + 64)
+    {
+        limit.rlim_cur = std::min<rlim_t>(limit.rlim_max, 2 * K_CLIENTS + 64);
+        ::setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    if(limit.rlim_cur < 2 * K_CLIENTS + 64)
+    {
+        std::cout << "RLIMIT_NOFILE too low, skipped" << std::endl;
+        return 0;
+    }
+
+    std::thread server_thread([]
+    {
+        auto loop = Cloo::EventLoop::Create();
+        Cloo::TcpServer server(loop, Cloo::SocketAddress(K_PORT), "idle-memory");
+        server.SetBufferReleaseIdle(K_IDLE_MS);
+        std::vector<Cloo::define::TcpConnectionPtr> conns;
+        conns.reserve(K_CLIENTS);
+        server.SetConnectionCallback([&conns](const Cloo::define::TcpConnectionPtr& conn)
+        {
+            if(conn->Connected())
+            {
+                conns.push_back(conn);
+            }
+            else
+            {
+                std::erase(conns, conn);
+            }
+        });
+        server.SetMessageCallback([](const Cloo::define::TcpConnectionPtr& conn, Cloo::Buffer* buf, Cloo::define::SystemTimePoint)
+        {
+            conn->Send(buf);
+        });
+        server.Start();
+        std::thread client_thread(RunClients, loop.get(), &conns);
+        loop->Loop();
+        client_thread.join();
+    });
+    server_thread.join();
+}
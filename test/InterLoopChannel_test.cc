@@ -0,0 +1,129 @@
+// 多个IO线程向同一个EventLoop发送消息:
+// 分别使用InterLoopChannel(每个发送方一条SPSC队列)和QueueTaskInThisLoop(共享的mutex + std::function),
+// 检查每个发送方的消息按顺序到达, 并比较两者的吞吐量;
+// 最后检查handler中用QueueTaskInThisLoop投递的任务会唤醒EventLoop, 而不是等到Poll超时
+
+#include "../net/include/EventLoop.h"
+#include "../net/include/EventLoopThread.h"
+#include "../net/include/InterLoopChannel.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+constexpr int K_PRODUCERS = 3;
+constexpr uint64_t K_MESSAGES_PER_PRODUCER = 300000;
+
+// 例如accept线程把新连接交给worker线程
+struct HandoffMessage
+{
+    int producer;
+    uint64_t seq;
+    int fd;
+    sockaddr_in peer_addr;
+};
+
+}
+
+int main()
+{
+    auto loop = Cloo::EventLoop::Create();
+    std::vector<std::unique_ptr<Cloo::EventLoopThread>> threads;
+    std::vector<std::shared_ptr<Cloo::EventLoop>> producer_loops;
+    for(int i = 0; i < K_PRODUCERS; ++i)
+    {
+        threads.push_back(std::make_unique<Cloo::EventLoopThread>());
+        producer_loops.push_back(threads.back()->StartLoop());
+    }
+
+    // 1. InterLoopChannel
+    std::vector<uint64_t> next_seq(K_PRODUCERS, 0);
+    uint64_t received = 0;
+    Cloo::InterLoopChannel<HandoffMessage> channel {loop.get(), 1024, [&](const HandoffMessage& msg)
+    {
+        assert(msg.seq == next_seq[msg.producer]);
+        next_seq[msg.producer]++;
+        if(++received == K_PRODUCERS * K_MESSAGES_PER_PRODUCER)
+        {
+            loop->Quit();
+        }
+    }};
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < K_PRODUCERS; ++i)
+    {
+        auto* producer = channel.MakeProducer();
+        producer_loops[i]->RunTaskInThisLoop([producer, i]
+        {
+            HandoffMessage batch[32];
+            uint64_t seq = 0;
+            while(seq < K_MESSAGES_PER_PRODUCER)
+            {
+                size_t count = 0;
+                for(; count < 32 && seq + count < K_MESSAGES_PER_PRODUCER; ++count)
+                {
+                    batch[count] = HandoffMessage{i, seq + count, -1, {}};
+                }
+                size_t sent = producer->SendBatch(batch, count);
+                seq += sent;
+                if(sent < count)
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    loop->Loop();
+    auto channel_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // 2. QueueTaskInThisLoop
+    std::fill(next_seq.begin(), next_seq.end(), 0);
+    received = 0;
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < K_PRODUCERS; ++i)
+    {
+        producer_loops[i]->RunTaskInThisLoop([&, i]
+        {
+            for(uint64_t seq = 0; seq < K_MESSAGES_PER_PRODUCER; ++seq)
+            {
+                HandoffMessage msg{i, seq, -1, {}};
+                loop->QueueTaskInThisLoop([&, msg]
+                {
+                    assert(msg.seq == next_seq[msg.producer]);
+                    next_seq[msg.producer]++;
+                    if(++received == K_PRODUCERS * K_MESSAGES_PER_PRODUCER)
+                    {
+                        loop->Quit();
+                    }
+                });
+            }
+        });
+    }
+    loop->Loop();
+    auto queue_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double total = static_cast<double>(K_PRODUCERS) * K_MESSAGES_PER_PRODUCER;
+    std::cout << "InterLoopChannel:    " << total / channel_seconds / 1e6 << " M msg/s" << std::endl;
+    std::cout << "QueueTaskInThisLoop: " << total / queue_seconds / 1e6 << " M msg/s" << std::endl;
+
+    // 3. handler在迭代末尾的钩子中运行, 其中投递的任务之后再没有别的事件唤醒EventLoop
+    std::chrono::steady_clock::time_point handled;
+    Cloo::InterLoopChannel<int> forward {loop.get(), 16, [&](const int&)
+    {
+        handled = std::chrono::steady_clock::now();
+        loop->QueueTaskInThisLoop([&]{ loop->Quit(); });
+    }};
+    auto* forward_producer = forward.MakeProducer();
+    producer_loops[0]->RunTaskInThisLoop([forward_producer]{ forward_producer->Send(1); });
+    loop->Loop();
+    auto forward_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - handled).count();
+    std::cout << "task queued from handler ran after " << forward_ms << " ms" << std::endl;
+    assert(forward_ms < 1000);
+}
@@ -0,0 +1,110 @@
+// LoopMemory: 同线程复用、跨线程归还与取回、Channel/Buffer从LoopMemory分配,
+// 以及连接对象(Channel + 两个Buffer)反复创建销毁时与全局operator new的耗时对比
+
+#include "../net/include/Buffer.h"
+#include "../net/include/Channel.h"
+#include "../net/include/EventLoop.h"
+#include "../net/include/LoopMemory.h"
+
+#include <cassert>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+constexpr int K_CHURN = 200000;
+
+void PrintStats(const char* title, const Cloo::LoopMemory::Stats& stats)
+{
+    std::cout << title
+              << ": objects hits=" << stats.objects.hits << " misses=" << stats.objects.misses
+              << " remote_frees=" << stats.objects.remote_frees << " in_use=" << stats.objects.bytes_in_use
+              << "B cached=" << stats.objects.bytes_cached
+              << "B | chunks hits=" << stats.chunks.hits << " misses=" << stats.chunks.misses
+              << " in_use=" << stats.chunks.bytes_in_use
+              << "B | mapped=" << stats.bytes_mapped << "B huge_regions=" << stats.huge_regions << std::endl;
+}
+
+double ChurnNsPerOp(Cloo::EventLoop* loop, bool pooled)
+{
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < K_CHURN; ++i)
+    {
+        // 模拟一个连接的建立与销毁: 一个Channel与输入/输出两个Buffer
+        auto channel = Cloo::Channel::Create(pooled ? loop : nullptr, -1);
+        Cloo::Buffer input(pooled ? loop->MemoryForThisThread() : nullptr);
+        Cloo::Buffer output(pooled ? loop->MemoryForThisThread() : nullptr);
+        input.Append("ping", 4);
+        output.Append(input.Peek(), input.ReadableBytes());
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / K_CHURN;
+}
+
+}
+
+int main()
+{
+    auto loop = Cloo::EventLoop::Create();
+    auto& memory = loop->Memory();
+
+    // 同线程: 释放后的内存被下一次同样大小的分配复用
+    void* first = memory.AllocateObject(200);
+    memory.DeallocateObject(first, 200);
+    void* second = memory.AllocateObject(200);
+    assert(first == second);
+    memory.DeallocateObject(second, 200);
+
+    // 跨线程归还: 其他线程释放的内存在本线程的空闲链表耗尽后被取回
+    std::vector<void*> blocks;
+    for(int i = 0; i < 1000; ++i)
+    {
+        blocks.push_back(memory.AllocateObject(500));
+    }
+    auto before = memory.GetStats();
+    std::thread remote([&] { for(void* block : blocks) memory.DeallocateObject(block, 500); });
+    remote.join();
+    auto after_remote = memory.GetStats();
+    assert(after_remote.objects.remote_frees == before.objects.remote_frees + blocks.size());
+    for(int i = 0; i < 1000; ++i)
+    {
+        blocks[i] = memory.AllocateObject(500);
+    }
+    auto after_reuse = memory.GetStats();
+    assert(after_reuse.objects.misses == after_remote.objects.misses);
+    for(void* block : blocks)
+    {
+        memory.DeallocateObject(block, 500);
+    }
+
+    // 其他线程中MemoryForThisThread()为nullptr, Channel/Buffer退回到全局的operator new
+    std::thread other([&] { assert(loop->MemoryForThisThread() == nullptr); });
+    other.join();
+
+    PrintStats("after unit checks", memory.GetStats());
+    double global_ns = ChurnNsPerOp(loop.get(), false);
+    double pooled_ns = ChurnNsPerOp(loop.get(), true);
+    auto stats = memory.GetStats();
+    PrintStats("after churn", stats);
+    assert(stats.chunks.bytes_in_use == 0);
+    std::cout << std::fixed << std::setprecision(1)
+              << "connection churn: global new " << global_ns << "ns/op, loop memory " << pooled_ns << "ns/op, hit rate "
+              << 100.0 * stats.objects.hits / (stats.objects.hits + stats.objects.misses) << "%" << std::endl;
+
+    // 显式大页: 没有预留大页时退回到THP
+    memory.SetHugePagePolicy(Cloo::HugePagePolicy::kExplicit);
+    std::vector<void*> chunks;
+    for(size_t i = 0; i < 2 * Cloo::LoopMemory::kRegionSize / Cloo::LoopMemory::kBufferChunkSize; ++i)
+    {
+        chunks.push_back(memory.AllocateChunk());
+    }
+    for(void* chunk : chunks)
+    {
+        memory.DeallocateChunk(chunk);
+    }
+    PrintStats("after hugepage regions", memory.GetStats());
+}
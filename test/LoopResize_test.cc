@@ -0,0 +1,205 @@
+// IO线程池的运行时伸缩与连接迁移
+// 回显服务器起始有2个IO线程, K_CLIENTS个长连接客户端:
+// 1. AddIoLoop后RebalanceConnections: 连接在3个IO线程间均分(4/4/4), 迁移后的连接上回显正常
+// 2. RetireIoLoop迁移退役线程上的连接: 退役线程上的连接全部迁走后线程退出, 剩下的2个线程各有6条连接, 回显正常
+// 3. 迁移时还没被MessageCallback取走的输入留在连接的输入缓冲区中: 服务端收齐K_REQUEST_SIZE字节才回复, 客户端在迁移前只发送一半
+// 4. 迁移的是同一个连接对象: ConnectionCallback只在建立与最终关闭时各回调一次, 连接上开启的接收时间戳在迁移后仍然有效,
+//    建立时得到的句柄在迁移后仍然可以发送, 没有数据被丢弃
+// 5. 迁移走的连接对象仍在退役线程的LoopMemory中, 连接全部关闭后这块LoopMemory被释放
+
+#include "../net/include/Buffer.h"
+#include "../net/include/ConnectionTable.h"
+#include "../net/include/EventLoop.h"
+#include "../net/include/EventLoopThreadPool.h"
+#include "../net/include/LoopMemory.h"
+#include "../net/include/SocketAddress.h"
+#include "../net/include/TcpConnection.h"
+#include "../net/include/TcpServer.h"
+#include "TestUtil.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+constexpr uint16_t K_PORT = 7789;
+constexpr int K_CLIENTS = 12;
+constexpr size_t K_REQUEST_SIZE = 64;
+
+std::atomic<int> connects {0};
+std::atomic<int> disconnects {0};
+// 没有内核接收时间戳的MessageCallback次数
+std::atomic<int> untimestamped {0};
+std::mutex handles_mutex;
+std::vector<Cloo::ConnectionHandle> handles;
+
+// 每个IO线程上的连接数, 从小到大
+std::vector<size_t> Distribution(Cloo::TcpServer& server, Cloo::EventLoop* loop)
+{
+    return TestUtil::InLoop(loop, [&server]
+    {
+        std::vector<size_t> counts;
+        for(const auto& io_loop : server.ThreadPool()->Loops())
+        {
+            auto iter = server.LoopConnections().find(io_loop.get());
+            counts.push_back(iter == server.LoopConnections().end() ? 0 : iter->second);
+        }
+        std::sort(counts.begin(), counts.end());
+        return counts;
+    });
+}
+
+void WriteAll(int fd, const std::string& data)
+{
+    if(::write(fd, data.data(), data.size()) != static_cast<ssize_t>(data.size()))
+    {
+        std::cerr << "write failed" << std::endl;
+        std::abort();
+    }
+}
+
+void EchoAll(const std::vector<int>& clients, char tag)
+{
+    for(size_t i = 0; i < clients.size(); ++i)
+    {
+        std::string request(K_REQUEST_SIZE, static_cast<char>(tag + i));
+        WriteAll(clients[i], request);
+        [[maybe_unused]] std::string reply = TestUtil::ReadExactly(clients[i], K_REQUEST_SIZE);
+        assert(reply == request);
+    }
+}
+
+void RunClients(Cloo::TcpServer& server, Cloo::EventLoop* loop)
+{
+    std::vector<int> clients;
+    for(int i = 0; i < K_CLIENTS; ++i)
+    {
+        clients.push_back(TestUtil::Connect(K_PORT));
+    }
+    // ConnectionCallback开启接收时间戳之前到达的数据没有时间戳
+    TestUtil::WaitFor([] { return connects.load() == K_CLIENTS; });
+    EchoAll(clients, 'a');
+    std::cout << "initial: " << Distribution(server, loop).size() << " loops" << std::endl;
+
+    // 1. 扩容并均衡, 迁移前每个客户端先发送半个请求
+    for(size_t i = 0; i < clients.size(); ++i)
+    {
+        WriteAll(clients[i], std::string(K_REQUEST_SIZE / 2, static_cast<char>('A' + i)));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    size_t migrated = TestUtil::InLoop(loop, [&server]
+    {
+        server.AddIoLoop();
+        return server.RebalanceConnections();
+    });
+    TestUtil::WaitFor([&] { return Distribution(server, loop) == std::vector<size_t>{4, 4, 4}; });
+    TestUtil::WaitFor([&] { return TestUtil::InLoop(loop, [&server] { return server.GetResizeStats().migrations; }) == migrated; });
+    for(size_t i = 0; i < clients.size(); ++i)
+    {
+        std::string expected(K_REQUEST_SIZE, static_cast<char>('A' + i));
+        WriteAll(clients[i], expected.substr(K_REQUEST_SIZE / 2));
+        [[maybe_unused]] std::string reply = TestUtil::ReadExactly(clients[i], K_REQUEST_SIZE);
+        assert(reply == expected);
+    }
+    EchoAll(clients, 'k');
+    std::cout << "after AddIoLoop + Rebalance: migrated " << migrated << ", 4/4/4" << std::endl;
+
+    // 2. 退役一个IO线程, 其上的连接迁移到剩下的线程
+    [[maybe_unused]] bool retiring = TestUtil::InLoop(loop, [&server] { return server.RetireIoLoop(server.ThreadPool()->Loops().front().get()); });
+    assert(retiring);
+    TestUtil::WaitFor([&] { return TestUtil::InLoop(loop, [&server] { return server.GetResizeStats().loops_retired; }) == 1; });
+    [[maybe_unused]] auto counts = Distribution(server, loop);
+    assert((counts == std::vector<size_t>{6, 6}));
+    EchoAll(clients, 'u');
+    auto stats = TestUtil::InLoop(loop, [&server] { return server.GetResizeStats(); });
+    std::cout << "after RetireIoLoop: 6/6, loops added " << stats.loops_added << ", retired " << stats.loops_retired
+              << ", migrations " << stats.migrations << std::endl;
+
+    // 4. 连接没有被重建, 选项与句柄都随连接迁移
+    std::cout << "connection callbacks: " << connects.load() << " up, " << disconnects.load() << " down, untimestamped messages "
+              << untimestamped.load() << std::endl;
+    assert(connects.load() == K_CLIENTS && disconnects.load() == 0);
+    assert(untimestamped.load() == 0);
+    const std::string pushed(K_REQUEST_SIZE, 'h');
+    std::thread([&]
+    {
+        std::lock_guard<std::mutex> lg(handles_mutex);
+        for(const auto& handle : handles)
+        {
+            Cloo::Send(handle, pushed);
+        }
+    }).join();
+    for(int fd : clients)
+    {
+        [[maybe_unused]] std::string data = TestUtil::ReadExactly(fd, K_REQUEST_SIZE);
+        assert(data == pushed);
+    }
+    assert(server.GetConnectionTable().DroppedSends() == 0);
+    // 退役线程已经退出, 它的LoopMemory还被迁移走的连接占用
+    assert(Cloo::LoopMemory::LiveInstances() == 4);
+
+    for(int fd : clients)
+    {
+        ::close(fd);
+    }
+    TestUtil::WaitFor([&] { return Distribution(server, loop) == std::vector<size_t>{0, 0}; });
+    assert(disconnects.load() == K_CLIENTS);
+    // 5. 只剩下base loop与2个IO线程的LoopMemory
+    TestUtil::WaitFor([] { return Cloo::LoopMemory::LiveInstances() == 3; });
+    std::cout << "live LoopMemory after close: " << Cloo::LoopMemory::LiveInstances() << std::endl;
+    loop->QueueTaskInThisLoop([loop] { loop->Quit(); });
+}
+
+}
+
+int main()
+{
+    std::thread server_thread([]
+    {
+        auto loop = Cloo::EventLoop::Create();
+        Cloo::TcpServer server(loop, Cloo::SocketAddress(K_PORT), "loop-resize");
+        server.SetThreadNum(2);
+        server.SetConnectionCallback([](const Cloo::define::TcpConnectionPtr& conn)
+        {
+            if(conn->Connected())
+            {
+                conn->SetRxTimestamping(true);
+                std::lock_guard<std::mutex> lg(handles_mutex);
+                handles.push_back(conn->Handle());
+                ++connects;
+            }
+            else
+            {
+                ++disconnects;
+            }
+        });
+        // 收齐一个完整的请求才回复, 不完整的部分留在输入缓冲区中
+        server.SetMessageCallback([](const Cloo::define::TcpConnectionPtr& conn, Cloo::Buffer* buf, Cloo::define::SystemTimePoint)
+        {
+            if(conn->LastKernelReceiveTime() == Cloo::define::SystemTimePoint())
+            {
+                ++untimestamped;
+            }
+            while(buf->ReadableBytes() >= K_REQUEST_SIZE)
+            {
+                conn->Send(buf->RetrieveAsString(K_REQUEST_SIZE));
+            }
+        });
+        server.Start();
+        std::thread client_thread(RunClients, std::ref(server), loop.get());
+        loop->Loop();
+        client_thread.join();
+    });
+    server_thread.join();
+}
@@ -0,0 +1,180 @@
+// 发送限速: 连接的pacing(内核SO_MAX_PACING_RATE / 用户态令牌桶)与EventLoop的bulk总带宽
+// 客户端发送一个命令字节, 服务端回复K_BYTES字节:
+//  'K': 连接限速K_RATE, 优先使用内核pacing
+//  'U': 连接限速K_RATE, 强制使用用户态令牌桶
+//  'B': bulk连接, 受EventLoop的总带宽K_BULK_RATE约束
+//  其他数据原样回显(交互式连接, 不限速)
+// 检查:
+//  1. 'U'(以及内核pacing生效时的'K')用时约为K_BYTES / K_RATE
+//  2. 两条并发的bulk连接平分总带宽, 完成时间接近; 同时进行的一问一答延迟不受影响
+
+#include "../net/include/Buffer.h"
+#include "../net/include/EventLoop.h"
+#include "../net/include/SocketAddress.h"
+#include "../net/include/TcpConnection.h"
+#include "../net/include/TcpServer.h"
+#include "TestUtil.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+constexpr uint16_t K_PORT = 7792;
+constexpr size_t K_BYTES = 1024 * 1024;
+constexpr uint64_t K_RATE = 2 * 1024 * 1024;
+constexpr uint64_t K_BULK_RATE = 4 * 1024 * 1024;
+constexpr int K_PINGS = 200;
+
+int ConnectNoDelay()
+{
+    int fd = TestUtil::Connect(K_PORT);
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+    return fd;
+}
+
+// 发送命令并读完K_BYTES字节, 返回用时(秒)
+double Fetch(char command)
+{
+    int fd = ConnectNoDelay();
+    auto start = std::chrono::steady_clock::now();
+    if(::write(fd, &command, 1) != 1)
+    {
+        std::abort();
+    }
+    std::vector<char> data(64 * 1024);
+    size_t received = 0;
+    while(received < K_BYTES)
+    {
+        ssize_t n = ::read(fd, data.data(), data.size());
+        if(n <= 0)
+        {
+            std::cerr << "read failed" << std::endl;
+            std::abort();
+        }
+        received += n;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ::close(fd);
+    return seconds;
+}
+
+// 一问一答K_PINGS次, 返回最大的往返时间(毫秒)
+double Ping()
+{
+    int fd = ConnectNoDelay();
+    double max_ms = 0;
+    char byte = 'x';
+    for(int i = 0; i < K_PINGS; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        if(::write(fd, &byte, 1) != 1 || ::read(fd, &byte, 1) != 1)
+        {
+            std::cerr << "ping failed" << std::endl;
+            std::abort();
+        }
+        max_ms = std::max(max_ms, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    ::close(fd);
+    return max_ms;
+}
+
+}
+
+int main()
+{
+    bool kernel_pacing = false;
+    double kernel_seconds = 0;
+    double user_seconds = 0;
+    double bulk_seconds[2] = {0, 0};
+    double ping_max_ms = 0;
+    std::thread server_thread([&]
+    {
+        auto loop = Cloo::EventLoop::Create();
+        loop->SetBulkBandwidthLimit(K_BULK_RATE);
+        Cloo::TcpServer server(loop, Cloo::SocketAddress(K_PORT), "pacing");
+        server.SetMessageCallback([&](const Cloo::define::TcpConnectionPtr& conn, Cloo::Buffer* buf, Cloo::define::SystemTimePoint)
+        {
+            std::string data = buf->RetrieveAllAsString();
+            Cloo::PacingOptions options;
+            if(data == "K" || data == "U")
+            {
+                options.rate_bytes_per_sec = K_RATE;
+                options.kernel = data == "K";
+            }
+            else if(data == "B")
+            {
+                options.bulk = true;
+            }
+            else
+            {
+                conn->Send(data);
+                return;
+            }
+            conn->SetPacing(options);
+            if(data == "K")
+            {
+                kernel_pacing = conn->KernelPacing();
+            }
+            conn->Send(std::string(K_BYTES, data[0]));
+        });
+        server.Start();
+        auto* raw_loop = loop.get();
+        std::thread client_thread([&, raw_loop]
+        {
+            kernel_seconds = Fetch('K');
+            user_seconds = Fetch('U');
+            std::thread bulk0([&] { bulk_seconds[0] = Fetch('B'); });
+            std::thread bulk1([&] { bulk_seconds[1] = Fetch('B'); });
+            ping_max_ms = Ping();
+            bulk0.join();
+            bulk1.join();
+            raw_loop->QueueTaskInThisLoop([raw_loop] { raw_loop->Quit(); });
+        });
+        loop->Loop();
+        client_thread.join();
+    });
+    server_thread.join();
+
+    const double expected = static_cast<double>(K_BYTES) / K_RATE;
+    const double bulk_expected = 2.0 * K_BYTES / K_BULK_RATE;
+    std::cout << "pacing " << K_BYTES / 1024 << "KiB at " << K_RATE / 1024 << "KiB/s (expected ~" << expected * 1000 << "ms)\n"
+              << "  kernel (" << (kernel_pacing ? "SO_MAX_PACING_RATE" : "fallback to token bucket") << "): "
+              << kernel_seconds * 1000 << "ms\n"
+              << "  token bucket: " << user_seconds * 1000 << "ms\n"
+              << "bulk cap " << K_BULK_RATE / 1024 << "KiB/s shared by 2 connections (expected ~" << bulk_expected * 1000 << "ms): "
+              << bulk_seconds[0] * 1000 << "ms / " << bulk_seconds[1] * 1000 << "ms\n"
+              << "interactive max rtt during bulk: " << ping_max_ms << "ms" << std::endl;
+
+    // 令牌桶开始时是满的, 允许一个burst(20ms的量)立即发出
+    assert(user_seconds >= expected * 0.8 && user_seconds <= expected * 2);
+    if(kernel_pacing)
+    {
+        // 内核pacing不按字节精确计算(初始窗口、TSO帧的大小), 只检查确实被限速了
+        assert(kernel_seconds >= expected * 0.5 && kernel_seconds <= expected * 2);
+    }
+    else
+    {
+        assert(kernel_seconds >= expected * 0.8 && kernel_seconds <= expected * 2);
+    }
+    for(double seconds : bulk_seconds)
+    {
+        assert(seconds >= bulk_expected * 0.8 && seconds <= bulk_expected * 2);
+    }
+    assert(std::fabs(bulk_seconds[0] - bulk_seconds[1]) <= bulk_expected * 0.25);
+    assert(ping_max_ms < 50);
+}
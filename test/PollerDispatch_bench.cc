@@ -0,0 +1,108 @@
+// Poller分发开销基准测试
+// 若干个始终可读的eventfd注册到一个独立的EPollPoller中, 每轮以0超时Poll并分发全部事件, 比较两种调用方式下每个事件的耗时:
+//  virtual: 通过Poller*调用, 编译器看不到具体类型, Poll是一次间接调用, 不能内联(即EventLoop原来的做法)
+//  policy : 通过EPollPoller*调用, 与EventLoop::LoopWith<EPollPoller>相同, Poll与fillActiveChannels内联进循环
+// 分别测试每轮只有1个事件(虚调用的开销落在每个事件上)与每轮K_MAX_CHANNELS个事件两种情况;
+// epoll_wait本身的开销对两种方式相同
+
+#include "../net/include/Channel.h"
+#include "../net/include/EPollPoller.h"
+#include "../net/include/EventLoop.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+constexpr int K_MAX_CHANNELS = 256;
+constexpr long K_EVENTS_PER_CASE = 5000000;
+
+// Channel::Index()记录channel在EPollPoller中的状态, 见EPollPoller.cc
+constexpr int K_NEW = -1;
+constexpr int K_DELETED = 2;
+
+template <typename PollerT>
+double NsPerEvent(PollerT* poller)
+{
+    Cloo::Poller::ChannelList active;
+    active.reserve(K_MAX_CHANNELS);
+    long events = 0;
+    auto start = std::chrono::steady_clock::now();
+    while(events < K_EVENTS_PER_CASE)
+    {
+        active.clear();
+        poller->Poll(0, &active);
+        for(Cloo::Channel* channel : active)
+        {
+            channel->HandleEvent();
+        }
+        events += static_cast<long>(active.size());
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return ns / static_cast<double>(events);
+}
+
+void RunCase(const std::shared_ptr<Cloo::EventLoop>& loop, int num_channels)
+{
+    Cloo::EPollPoller poller(loop.get());
+    long dispatched = 0;
+    std::vector<std::shared_ptr<Cloo::Channel>> channels;
+    for(int i = 0; i < num_channels; ++i)
+    {
+        int fd = ::eventfd(1, EFD_NONBLOCK | EFD_CLOEXEC);
+        auto channel = Cloo::Channel::Create(loop, fd);
+        channel->SetReadCallBack([&dispatched] { ++dispatched; });
+        // EnableReading把channel注册到loop自己的Poller中, 再以K_NEW的状态把它加入独立的poller
+        channel->EnableReading();
+        channel->SetIndex(K_NEW);
+        poller.UpdateChannel(channel.get());
+        channels.push_back(channel);
+    }
+
+    Cloo::EPollPoller* typed = &poller;
+    // volatile阻止编译器推断出具体类型而去虚化
+    Cloo::Poller* volatile erased = &poller;
+    // 预热
+    NsPerEvent(typed);
+    double virtual_ns = 0;
+    double policy_ns = 0;
+    // 交替运行, 减小频率变化等因素的影响
+    for(int repeat = 0; repeat < 3; ++repeat)
+    {
+        virtual_ns += NsPerEvent<Cloo::Poller>(erased);
+        policy_ns += NsPerEvent(typed);
+    }
+    virtual_ns /= 3;
+    policy_ns /= 3;
+    std::cout << std::fixed << std::setprecision(2)
+              << "ready channels per poll=" << std::setw(3) << num_channels
+              << "  virtual: " << virtual_ns << " ns/event"
+              << "  policy: " << policy_ns << " ns/event"
+              << "  saved: " << (virtual_ns - policy_ns) << " ns/event"
+              << "  (dispatched " << dispatched << ")" << std::endl;
+
+    for(auto& channel : channels)
+    {
+        channel->DisableAll();
+        poller.RemoveChannel(channel.get());
+        // 恢复channel在loop的Poller中的状态后再注销
+        channel->SetIndex(K_DELETED);
+        channel->Remove();
+        ::close(channel->Fd());
+    }
+}
+
+}
+
+int main()
+{
+    auto loop = Cloo::EventLoop::Create();
+    RunCase(loop, 1);
+    RunCase(loop, K_MAX_CHANNELS);
+}
@@ -0,0 +1,164 @@
+// 异步主机名解析(Resolver), 只用/etc/hosts中的localhost与不存在的名字, 不需要网络
+//  1. 合并: K_THREADS个线程同时解析localhost, 只调用一次getaddrinfo, 回调都在发起请求的EventLoop中执行
+//  2. 缓存: 之后的解析直接命中缓存, 端口按每次请求设置; 数字地址不经过getaddrinfo
+//  3. 负缓存: 不存在的名字解析失败, 在negative_ttl内再次解析直接返回缓存的错误;
+//     没有可用的DNS服务器时得到的是暂时性的失败(EAI_AGAIN), 不缓存, 再次解析重新调用getaddrinfo
+//  4. TTL: positive_ttl过期后重新调用getaddrinfo
+//  5. 析构: 还在排队的请求以EAI_CANCELED回调, 每个请求都得到回调
+
+#include "../net/include/EventLoop.h"
+#include "../net/include/Resolver.h"
+#include "../net/include/SocketAddress.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <netdb.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+constexpr int K_THREADS = 4;
+constexpr int K_REQUESTS_PER_THREAD = 5;
+const std::string K_MISSING_HOST = "cloo-no-such-host.invalid";
+
+// 由issue发起requests个解析, 运行loop直到全部回调, 返回结果
+std::vector<Cloo::ResolveResult> ResolveAll(Cloo::EventLoop* loop, int requests,
+                                            const std::function<void(const Cloo::Resolver::ResolveCallback&)>& issue)
+{
+    std::vector<Cloo::ResolveResult> results;
+    bool all_in_loop = true;
+    Cloo::Resolver::ResolveCallback cb = [&](const Cloo::ResolveResult& result)
+    {
+        all_in_loop = all_in_loop && loop->IsInLoopThread();
+        results.push_back(result);
+        if(static_cast<int>(results.size()) == requests)
+        {
+            loop->Quit();
+        }
+    };
+    // 从其他线程发起, 缓存命中时的QueueTaskInThisLoop会唤醒loop
+    std::thread issuer([&] { issue(cb); });
+    loop->Loop();
+    issuer.join();
+    assert(all_in_loop);
+    return results;
+}
+
+std::string Address(const Cloo::ResolveResult& result)
+{
+    assert(!result.addresses.empty());
+    return Cloo::SocketAddress(result.addresses.front()).ToHostPort();
+}
+
+}
+
+int main()
+{
+    // nameserver不可达时尽快失败
+    ::setenv("RES_OPTIONS", "timeout:1 attempts:1", 1);
+    auto loop = Cloo::EventLoop::Create();
+    Cloo::Resolver resolver;
+
+    // 1. 合并
+    auto results = ResolveAll(loop.get(), K_THREADS * K_REQUESTS_PER_THREAD, [&](const Cloo::Resolver::ResolveCallback& cb)
+    {
+        std::vector<std::thread> threads;
+        for(int i = 0; i < K_THREADS; ++i)
+        {
+            threads.emplace_back([&]
+            {
+                for(int j = 0; j < K_REQUESTS_PER_THREAD; ++j)
+                {
+                    resolver.Resolve(loop.get(), "localhost", 80, cb);
+                }
+            });
+        }
+        for(auto& t : threads)
+        {
+            t.join();
+        }
+    });
+    for(const auto& result : results)
+    {
+        assert(result.error == 0 && Address(result) == "127.0.0.1 : 80");
+    }
+    std::cout << "localhost x" << results.size() << ": getaddrinfo=" << resolver.Lookups() << " coalesced=" << resolver.Coalesced()
+              << " cache hits=" << resolver.CacheHits() << std::endl;
+    assert(resolver.Lookups() == 1);
+    assert(resolver.Coalesced() + resolver.CacheHits() == results.size() - 1);
+
+    // 2. 缓存与数字地址
+    results = ResolveAll(loop.get(), 2, [&](const Cloo::Resolver::ResolveCallback& cb)
+    {
+        resolver.Resolve(loop.get(), "localhost", 443, cb);
+        resolver.Resolve(loop.get(), "10.1.2.3", 8080, cb);
+    });
+    assert(results[0].from_cache && Address(results[0]) == "127.0.0.1 : 443");
+    assert(results[1].from_cache && Address(results[1]) == "10.1.2.3 : 8080");
+    assert(resolver.Lookups() == 1);
+
+    // 3. 负缓存
+    bool permanent = false;
+    for(int i = 0; i < 2; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        results = ResolveAll(loop.get(), 1, [&](const Cloo::Resolver::ResolveCallback& cb)
+        {
+            resolver.Resolve(loop.get(), K_MISSING_HOST, 80, cb);
+        });
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << K_MISSING_HOST << ": " << ::gai_strerror(results[0].error) << (results[0].from_cache ? " (cached)" : "")
+                  << " in " << ms << "ms" << std::endl;
+        assert(results[0].error != 0 && results[0].addresses.empty());
+        permanent = Cloo::Resolver::IsPermanentError(results[0].error);
+        assert(results[0].from_cache == (i == 1 && permanent));
+    }
+    assert(resolver.Lookups() == (permanent ? 2u : 3u));
+
+    // 4. TTL
+    Cloo::Resolver::Options options;
+    options.positive_ttl = std::chrono::milliseconds(50);
+    Cloo::Resolver short_ttl(options);
+    for(int i = 0; i < 2; ++i)
+    {
+        results = ResolveAll(loop.get(), 1, [&](const Cloo::Resolver::ResolveCallback& cb)
+        {
+            short_ttl.Resolve(loop.get(), "localhost", 80, cb);
+        });
+        assert(!results[0].from_cache && results[0].error == 0);
+        Cloo::ResolveResult cached;
+        [[maybe_unused]] bool hit = short_ttl.Lookup("localhost", 80, &cached);
+        assert(hit && cached.from_cache);
+        std::this_thread::sleep_for(std::chrono::milliseconds(80));
+        hit = short_ttl.Lookup("localhost", 80, &cached);
+        assert(!hit);
+    }
+    assert(short_ttl.Lookups() == 2);
+    std::cout << "ttl expiry: getaddrinfo=" << short_ttl.Lookups() << std::endl;
+
+    // 5. 析构: 一个helper线程, 大量不同的名字排队时析构Resolver
+    constexpr int K_QUEUED = 200;
+    int canceled = 0;
+    results = ResolveAll(loop.get(), K_QUEUED, [&](const Cloo::Resolver::ResolveCallback& cb)
+    {
+        Cloo::Resolver::Options single;
+        single.num_threads = 1;
+        Cloo::Resolver doomed(single);
+        for(int i = 0; i < K_QUEUED; ++i)
+        {
+            doomed.Resolve(loop.get(), "cloo-queued-" + std::to_string(i) + ".invalid", 80, cb);
+        }
+    });
+    for(const auto& result : results)
+    {
+        assert(result.error != 0);
+        canceled += result.error == EAI_CANCELED;
+    }
+    std::cout << "destroyed with " << K_QUEUED << " queued: " << results.size() << " callbacks, " << canceled << " canceled" << std::endl;
+}
@@ -0,0 +1,112 @@
+// 内核接收时间戳(SO_TIMESTAMPING)与延迟直方图
+// 一个客户端与开启了接收时间戳的服务端做K_REQUESTS次一问一答, 服务端处理每个请求时忙等K_HANDLER_US微秒再回复;
+// 每K_BLOCK_EVERY个请求之前客户端先投递一个占用IO线程K_BLOCK_US微秒的任务, 请求在内核中排队直到任务结束.
+// 检查:
+//  1. MessageCallback的receive_time是内核时间戳, 不晚于分发时间, 与LastKernelReceiveTime()一致
+//  2. kernel_to_dispatch的最大值反映了IO线程被占用的时间, 而dispatch_to_reply的p50反映了处理请求的时间
+
+#include "../net/include/EventLoop.h"
+#include "../net/include/LatencyHistogram.h"
+#include "../net/include/SocketAddress.h"
+#include "../net/include/TcpConnection.h"
+#include "../net/include/TcpServer.h"
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+
+constexpr uint16_t K_PORT = 7786;
+constexpr int K_REQUESTS = 500;
+constexpr int K_BLOCK_EVERY = 10;
+constexpr long K_HANDLER_US = 100;
+constexpr long K_BLOCK_US = 2000;
+
+void BusyWait(std::chrono::microseconds duration)
+{
+    auto until = std::chrono::steady_clock::now() + duration;
+    while(std::chrono::steady_clock::now() < until) {}
+}
+
+void RunClient(Cloo::EventLoop* loop)
+{
+    Cloo::SocketAddress addr("127.0.0.1", K_PORT);
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+    if(::connect(fd, reinterpret_cast<const sockaddr*>(&addr.ToSockAddrIn()), sizeof(sockaddr_in)) != 0)
+    {
+        std::cerr << "connect failed" << std::endl;
+        std::abort();
+    }
+    char byte = 'x';
+    for(int i = 0; i < K_REQUESTS; ++i)
+    {
+        if(i % K_BLOCK_EVERY == 0)
+        {
+            loop->QueueTaskInThisLoop([] { BusyWait(std::chrono::microseconds(K_BLOCK_US)); });
+            // 等任务开始执行后再发送请求
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        if(::write(fd, &byte, 1) != 1 || ::read(fd, &byte, 1) != 1)
+        {
+            std::cerr << "request " << i << " failed" << std::endl;
+            std::abort();
+        }
+    }
+    ::close(fd);
+    loop->QueueTaskInThisLoop([loop] { loop->Quit(); });
+}
+
+}
+
+int main()
+{
+    Cloo::RxLatencyStats latency;
+    int dispatched = 0;
+    bool timestamps_ok = true;
+    std::thread server_thread([&]
+    {
+        auto loop = Cloo::EventLoop::Create();
+        Cloo::TcpServer server(loop, Cloo::SocketAddress(K_PORT), "rx-timestamp");
+        server.SetConnectionCallback([](const Cloo::define::TcpConnectionPtr& conn)
+        {
+            if(conn->Connected())
+            {
+                conn->SetTcpNoDelay(true);
+                conn->SetRxTimestamping(true);
+            }
+        });
+        server.SetMessageCallback([&](const Cloo::define::TcpConnectionPtr& conn, Cloo::Buffer* buf, Cloo::define::SystemTimePoint receive_time)
+        {
+            ++dispatched;
+            timestamps_ok = timestamps_ok && receive_time == conn->LastKernelReceiveTime()
+                            && receive_time != Cloo::define::SystemTimePoint()
+                            && receive_time <= std::chrono::system_clock::now();
+            BusyWait(std::chrono::microseconds(K_HANDLER_US));
+            conn->Send(buf->RetrieveAllAsString());
+        });
+        server.Start();
+        std::thread client_thread(RunClient, loop.get());
+        loop->Loop();
+        client_thread.join();
+        latency = loop->RxLatency();
+    });
+    server_thread.join();
+
+    std::cout << "kernel->dispatch: " << latency.kernel_to_dispatch.Summary() << "\n"
+              << "dispatch->reply : " << latency.dispatch_to_reply.Summary() << std::endl;
+    assert(timestamps_ok);
+    assert(dispatched == K_REQUESTS);
+    assert(latency.kernel_to_dispatch.Count() == K_REQUESTS && latency.dispatch_to_reply.Count() == K_REQUESTS);
+    assert(latency.kernel_to_dispatch.Max() >= (K_BLOCK_US / 2) * 1000);
+    assert(latency.dispatch_to_reply.Percentile(50) >= K_HANDLER_US * 1000);
+}
@@ -0,0 +1,148 @@
+// 任务洪泛(task flood)下的IO延迟基准测试
+// 洪泛线程周期性地向IO线程投递一大批耗时约1us的任务, 探测线程每隔一段时间向pipe写入发送时刻,
+// 同时投递一个kControl优先级的探测任务, 分别统计IO事件与控制类任务从投递到被处理的延迟,
+// 对比不限制每轮任务预算与限制时间预算、洪泛任务走kControl或kBulk时的p50/p99/max延迟
+
+#include "../net/include/EventLoop.h"
+#include "../net/include/Channel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fcntl.h>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+constexpr int K_PROBES = 500;
+constexpr auto K_PROBE_GAP = std::chrono::microseconds(1000);
+constexpr int K_FLOOD_BATCH = 5000;
+constexpr auto K_FLOOD_GAP = std::chrono::milliseconds(20);
+constexpr auto K_TASK_COST = std::chrono::microseconds(1);
+
+int64_t SteadyNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void BurnCpu(std::chrono::steady_clock::duration cost)
+{
+    auto end = std::chrono::steady_clock::now() + cost;
+    while(std::chrono::steady_clock::now() < end)
+    {
+    }
+}
+
+std::string Summary(std::vector<int64_t>& latencies)
+{
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) { return latencies[static_cast<size_t>(p * (latencies.size() - 1))] / 1000.0; };
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1)
+        << "p50=" << std::setw(8) << percentile(0.50) << "us"
+        << " p99=" << std::setw(8) << percentile(0.99) << "us"
+        << " max=" << std::setw(8) << latencies.back() / 1000.0 << "us";
+    return out.str();
+}
+
+void RunCase(const char* name, std::chrono::microseconds task_budget, Cloo::TaskPriority flood_priority)
+{
+    int fds[2];
+    if(::pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0)
+    {
+        std::cerr << "pipe2 failed" << std::endl;
+        return;
+    }
+
+    std::vector<int64_t> io_latencies;
+    std::vector<int64_t> control_latencies;
+    io_latencies.reserve(K_PROBES);
+    control_latencies.reserve(K_PROBES);
+    std::atomic<long> flood_done {0};
+    std::promise<std::shared_ptr<Cloo::EventLoop>> ready;
+
+    std::thread io_thread([&]
+    {
+        auto loop = Cloo::EventLoop::Create();
+        loop->SetPendingTaskBudget(0, task_budget);
+        auto channel = Cloo::Channel::Create(loop, fds[0]);
+        channel->SetReadCallBack([&]
+        {
+            int64_t sent_ns;
+            while(::read(fds[0], &sent_ns, sizeof sent_ns) == sizeof sent_ns)
+            {
+                io_latencies.push_back(SteadyNowNs() - sent_ns);
+            }
+        });
+        channel->EnableReading();
+        ready.set_value(loop);
+        loop->Loop();
+        channel->DisableAll();
+        channel->Remove();
+    });
+
+    auto loop = ready.get_future().get();
+    std::atomic<bool> stop_flood {false};
+    std::thread flood_thread([&]
+    {
+        while(!stop_flood.load(std::memory_order_relaxed))
+        {
+            for(int i = 0; i < K_FLOOD_BATCH; ++i)
+            {
+                loop->QueueTaskInThisLoop([&flood_done]
+                {
+                    BurnCpu(K_TASK_COST);
+                    flood_done.fetch_add(1, std::memory_order_relaxed);
+                }, flood_priority);
+            }
+            std::this_thread::sleep_for(K_FLOOD_GAP);
+        }
+    });
+
+    for(int i = 0; i < K_PROBES; ++i)
+    {
+        std::this_thread::sleep_for(K_PROBE_GAP);
+        int64_t now_ns = SteadyNowNs();
+        ::write(fds[1], &now_ns, sizeof now_ns);
+        loop->QueueTaskInThisLoop([&control_latencies, now_ns]
+        {
+            control_latencies.push_back(SteadyNowNs() - now_ns);
+        });
+    }
+    // 探测结束后等待所有探测都被处理, 再停止洪泛与EventLoop
+    std::promise<void> drained;
+    loop->QueueTaskInThisLoop([&] { drained.set_value(); });
+    drained.get_future().wait();
+    stop_flood = true;
+    flood_thread.join();
+    loop->Quit();
+    io_thread.join();
+    ::close(fds[0]);
+    ::close(fds[1]);
+
+    std::cout << std::left << std::setw(34) << name << std::right
+              << " io: " << Summary(io_latencies)
+              << " | control: " << Summary(control_latencies)
+              << " | flood tasks=" << flood_done.load() << std::endl;
+}
+
+}
+
+int main()
+{
+    using Cloo::TaskPriority;
+    RunCase("unbounded, flood as control", std::chrono::microseconds(0), TaskPriority::kControl);
+    RunCase("budget 200us, flood as control", std::chrono::microseconds(200), TaskPriority::kControl);
+    RunCase("budget 200us, flood as bulk", std::chrono::microseconds(200), TaskPriority::kBulk);
+}
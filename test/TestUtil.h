@@ -0,0 +1,93 @@
+#pragma once
+
+// 网络测试共用的辅助函数. 以.h结尾, 不会被当作一个单独的测试编译
+// 出错时直接abort: 测试没有别的恢复手段, 也不依赖NDEBUG下会被去掉的assert
+
+#include "../net/include/EventLoop.h"
+#include "../net/include/SocketAddress.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+namespace TestUtil
+{
+
+// 在loop中执行f并等待结果
+template <typename F>
+auto InLoop(Cloo::EventLoop* loop, F f) -> decltype(f())
+{
+    auto task = std::make_shared<std::packaged_task<decltype(f())()>>(std::move(f));
+    auto result = task->get_future();
+    loop->QueueTaskInThisLoop([task] { (*task)(); });
+    return result.get();
+}
+
+// 轮询等待condition成立, 5秒内不成立时abort
+inline void WaitFor(const std::function<bool()>& condition)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while(!condition())
+    {
+        if(std::chrono::steady_clock::now() > deadline)
+        {
+            std::cerr << "timed out" << std::endl;
+            std::abort();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+}
+
+// 阻塞地连接127.0.0.1:port, 失败时返回-1
+inline int TryConnect(uint16_t port)
+{
+    Cloo::SocketAddress addr("127.0.0.1", port);
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if(::connect(fd, reinterpret_cast<const sockaddr*>(&addr.ToSockAddrIn()), sizeof(sockaddr_in)) != 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 同TryConnect, 失败时abort
+inline int Connect(uint16_t port)
+{
+    int fd = TryConnect(port);
+    if(fd < 0)
+    {
+        std::cerr << "connect failed" << std::endl;
+        std::abort();
+    }
+    return fd;
+}
+
+// 阻塞地读满len字节, 出错或读到EOF时abort
+inline std::string ReadExactly(int fd, size_t len)
+{
+    std::string data(len, '\0');
+    size_t done = 0;
+    while(done < len)
+    {
+        ssize_t n = ::read(fd, &data[done], len - done);
+        if(n <= 0)
+        {
+            std::cerr << "read failed" << std::endl;
+            std::abort();
+        }
+        done += n;
+    }
+    return data;
+}
+
+} // end namespace TestUtil
@@ -0,0 +1,81 @@
+// 定时器分发方式基准测试: timerfd vs poll超时驱动
+// 一个定时器在到期回调中以1ms的超时重新加入自己, 共K_CYCLES个周期,
+// 统计每个周期IO线程的CPU耗时以及相对于精确到期时间的延迟
+
+#include "../net/include/EventLoop.h"
+#include "../net/include/TimerQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+constexpr int K_CYCLES = 2000;
+constexpr long K_TIMEOUT_MS = 1;
+
+double ThreadCpuSeconds()
+{
+    timespec ts {};
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void RunCase(bool poll_driven)
+{
+    std::thread io_thread([poll_driven]
+    {
+        auto loop = Cloo::EventLoop::Create();
+        loop->SetPollDrivenTimers(poll_driven);
+        std::vector<int64_t> lateness_us;
+        lateness_us.reserve(K_CYCLES);
+
+        std::function<void()> arm = [&]
+        {
+            auto due = std::chrono::system_clock::now() + std::chrono::milliseconds(K_TIMEOUT_MS);
+            loop->RunAfter(K_TIMEOUT_MS, [&, due]
+            {
+                lateness_us.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::system_clock::now() - due).count());
+                if(static_cast<int>(lateness_us.size()) < K_CYCLES)
+                {
+                    arm();
+                }
+                else
+                {
+                    loop->Quit();
+                }
+            });
+        };
+        arm();
+        double cpu_start = ThreadCpuSeconds();
+        loop->Loop();
+        double cpu_seconds = ThreadCpuSeconds() - cpu_start;
+
+        std::sort(lateness_us.begin(), lateness_us.end());
+        auto percentile = [&](double p) { return lateness_us[static_cast<size_t>(p * (lateness_us.size() - 1))]; };
+        std::cout << std::fixed << std::setprecision(2)
+                  << (poll_driven ? "poll timeout" : "timerfd     ")
+                  << "  cpu/cycle=" << std::setw(6) << cpu_seconds * 1e6 / K_CYCLES << "us"
+                  << "  late p50=" << std::setw(5) << percentile(0.50) << "us"
+                  << "  p99=" << std::setw(5) << percentile(0.99) << "us"
+                  << "  wakeups=" << loop->TimerStats().wakeups
+                  << "  rearms=" << loop->TimerStats().rearms << std::endl;
+    });
+    io_thread.join();
+}
+
+}
+
+int main()
+{
+    RunCase(false);
+    RunCase(true);
+}
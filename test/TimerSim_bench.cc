@@ -0,0 +1,113 @@
+// 虚拟时钟仿真: EventLoop::CreateSimulated使用VirtualClock与SimPoller, 没有任何睡眠与系统调用
+// 1. 回放1小时的定时器活动: K_ONESHOT_TIMERS个到期时间随机分布在1小时内的一次性定时器, 加上K_REPEATING_TIMERS个每秒触发的周期定时器,
+//    检查每个定时器都按虚拟时间准时触发, 统计真实耗时与每次定时回调的平均开销(纯数据结构开销)
+//    一次性定时器的数量可以通过第一个命令行参数修改, 例如 TimerSim_bench 10000000
+// 2. 通过SimPoller::Inject注入的就绪事件在注入后的下一轮迭代中分发, 虚拟时间不前进
+
+#include "../net/include/Channel.h"
+#include "../net/include/Clock.h"
+#include "../net/include/EventLoop.h"
+#include "../net/include/SimPoller.h"
+#include "../net/include/TimerQueue.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <poll.h>
+#include <random>
+#include <sys/eventfd.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+constexpr long K_ONESHOT_TIMERS = 1000000;
+constexpr int K_REPEATING_TIMERS = 1000;
+constexpr long K_HORIZON_MS = 3600 * 1000;
+
+void ReplayOneHour(long oneshot_timers)
+{
+    auto clock = std::make_shared<Cloo::VirtualClock>(Cloo::define::SystemTimePoint(std::chrono::seconds(1000000)));
+    auto loop = Cloo::EventLoop::CreateSimulated(clock);
+    const auto start = clock->Now();
+    long oneshot_fired = 0;
+    long repeating_fired = 0;
+    auto max_late = std::chrono::nanoseconds::zero();
+
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<long> delay(1, K_HORIZON_MS);
+    auto add_start = std::chrono::steady_clock::now();
+    for(long i = 0; i < oneshot_timers; ++i)
+    {
+        const auto due = start + std::chrono::milliseconds(delay(rng));
+        loop->RunAt(due, [&, due]
+        {
+            ++oneshot_fired;
+            max_late = std::max<std::chrono::nanoseconds>(max_late, loop->Now() - due);
+        });
+    }
+    for(int i = 0; i < K_REPEATING_TIMERS; ++i)
+    {
+        loop->RunEvery(1000, [&] { ++repeating_fired; });
+    }
+    auto add_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - add_start).count();
+    loop->RunAt(start + std::chrono::milliseconds(K_HORIZON_MS) + std::chrono::microseconds(500), [&] { loop->Quit(); });
+
+    auto run_start = std::chrono::steady_clock::now();
+    loop->Loop();
+    auto run_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+
+    const long fired = oneshot_fired + repeating_fired;
+    const double virtual_hours = std::chrono::duration<double>(clock->Now() - start).count() / 3600;
+    const auto& stats = loop->TimerStats();
+    std::cout << "replayed " << virtual_hours << "h of virtual time in " << run_seconds * 1000 << "ms"
+              << " (adding " << oneshot_timers << " timers took " << add_seconds * 1000 << "ms)\n"
+              << "  callbacks=" << fired << " (one-shot " << oneshot_fired << ", repeating " << repeating_fired << ")"
+              << "  " << run_seconds * 1e9 / fired << " ns/callback"
+              << "  loop wakeups=" << stats.wakeups << " polls=" << loop->Simulation()->Polls()
+              << "  max lateness=" << max_late.count() << "ns" << std::endl;
+    assert(oneshot_fired == oneshot_timers);
+    assert(repeating_fired == static_cast<long>(K_REPEATING_TIMERS) * (K_HORIZON_MS / 1000));
+    assert(max_late <= std::chrono::milliseconds(1));
+}
+
+void InjectedEvents()
+{
+    auto clock = std::make_shared<Cloo::VirtualClock>();
+    auto loop = Cloo::EventLoop::CreateSimulated(clock);
+    Cloo::SimPoller* sim = loop->Simulation();
+    // fd只用来区分Channel, SimPoller不会读写它
+    int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    auto channel = Cloo::Channel::Create(loop, fd);
+    std::vector<long> dispatched_at_ms;
+    channel->SetReadCallBack([&]
+    {
+        dispatched_at_ms.push_back(std::chrono::duration_cast<std::chrono::milliseconds>(clock->Now().time_since_epoch()).count());
+    });
+    channel->EnableReading();
+    for(long ms : {10, 250, 5000})
+    {
+        loop->RunAfter(ms, [&, sim] { sim->Inject(channel.get(), POLLIN); });
+    }
+    loop->RunAfter(6000, [&] { loop->Quit(); });
+    loop->Loop();
+    channel->DisableAll();
+    channel->Remove();
+    ::close(fd);
+    assert((dispatched_at_ms == std::vector<long> {10, 250, 5000}));
+    std::cout << "injected events dispatched at virtual 10ms, 250ms and 5000ms" << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    long oneshot_timers = argc > 1 ? std::atol(argv[1]) : K_ONESHOT_TIMERS;
+    // 每个用例使用独立的线程, 一个线程只能有一个EventLoop
+    std::thread(ReplayOneHour, oneshot_timers).join();
+    std::thread(InjectedEvents).join();
+}
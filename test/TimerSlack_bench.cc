@@ -0,0 +1,81 @@
+// 定时器合并(timer slack)基准测试
+// 模拟大量连接的空闲超时: K_TIMERS个定时器各自以随机的超时时间到期, 到期后立即以新的随机超时重新加入,
+// 分别统计slack为0与不同slack下每秒的timerfd唤醒次数、重新设置timerfd的次数以及相对于精确到期时间的最大延迟
+
+#include "../net/include/EventLoop.h"
+#include "../net/include/TimerQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+
+namespace
+{
+
+constexpr int K_TIMERS = 100000;
+constexpr long K_MIN_TIMEOUT_MS = 100;
+constexpr long K_MAX_TIMEOUT_MS = 2000;
+constexpr long K_RUN_MS = 3000;
+
+void RunCase(long slack_ms)
+{
+    std::thread io_thread([slack_ms]
+    {
+        auto loop = Cloo::EventLoop::Create();
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<long> timeout_dist(K_MIN_TIMEOUT_MS, K_MAX_TIMEOUT_MS);
+        std::chrono::system_clock::duration max_late {0};
+        // 初始加入的定时器受加入过程本身耗时的影响, 只统计Loop开始后重新加入的定时器的延迟
+        bool measuring = false;
+
+        std::function<void()> arm = [&]
+        {
+            long timeout_ms = timeout_dist(rng);
+            auto due = std::chrono::system_clock::now() + std::chrono::milliseconds(timeout_ms);
+            loop->RunAfter(timeout_ms, [&, due, measure = measuring]
+            {
+                if(measure)
+                {
+                    max_late = std::max(max_late, std::chrono::system_clock::now() - due);
+                }
+                arm();
+            }, slack_ms);
+        };
+        for(int i = 0; i < K_TIMERS; ++i)
+        {
+            arm();
+        }
+        // 统计窗口从所有定时器都加入之后开始
+        Cloo::TimerQueueStats start = loop->TimerStats();
+        auto wall_start = std::chrono::steady_clock::now();
+        loop->RunAfter(K_RUN_MS, [&] { loop->Quit(); });
+        measuring = true;
+        loop->Loop();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+
+        const auto& end = loop->TimerStats();
+        std::cout << std::fixed << std::setprecision(1)
+                  << "slack=" << std::setw(4) << slack_ms << "ms"
+                  << "  wakeups/s=" << std::setw(8) << (end.wakeups - start.wakeups) / seconds
+                  << "  rearms/s=" << std::setw(8) << (end.rearms - start.rearms) / seconds
+                  << "  fired/s=" << std::setw(9) << (end.fired - start.fired) / seconds
+                  << "  max_late=" << std::setw(6)
+                  << std::chrono::duration<double, std::milli>(max_late).count() << "ms" << std::endl;
+    });
+    io_thread.join();
+}
+
+}
+
+int main()
+{
+    for(long slack_ms : {0L, 10L, 100L, 300L})
+    {
+        RunCase(slack_ms);
+    }
+}
@@ -0,0 +1,262 @@
+// TLS: 用户空间握手 + kTLS(内核不支持时退回用户空间加密)
+// 测试开始时生成一个自签名证书, 服务端是使用TlsContext的TcpServer, 客户端是阻塞socket上的OpenSSL(用该证书校验服务端)
+// 1. 回显: K_MESSAGES条大小随机(最大64KiB)的消息, 客户端收到的内容与发送的相同
+// 2. SendFile: 服务端在两段普通数据之间发送一个K_FILE_SIZE字节文件的一部分, 远大于socket缓冲区, 剩余部分作为文件段进入输出链;
+//    客户端收到的字节流顺序与内容正确. 分别在TLS连接与明文连接上测试
+// 输出协商出的协议与密码套件, 以及发送/接收方向是否由kTLS处理
+
+#include "../net/include/Buffer.h"
+#include "../net/include/EventLoop.h"
+#include "../net/include/SocketAddress.h"
+#include "../net/include/TcpConnection.h"
+#include "../net/include/TcpServer.h"
+#include "../net/include/TlsContext.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <random>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+#ifdef CLOO_WITH_OPENSSL
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+namespace
+{
+
+constexpr uint16_t K_TLS_PORT = 7787;
+constexpr uint16_t K_PLAIN_PORT = 7788;
+constexpr int K_MESSAGES = 200;
+constexpr size_t K_FILE_SIZE = 8 * 1024 * 1024;
+constexpr off_t K_FILE_OFFSET = 1000;
+constexpr size_t K_FILE_COUNT = K_FILE_SIZE - 2000;
+const std::string K_HEADER = "HDR\n";
+const std::string K_TRAILER = "END\n";
+
+char FileByte(size_t i)
+{
+    return static_cast<char>(i * 31 % 251);
+}
+
+// 生成一个CN=localhost的自签名证书与私钥(P-256)
+void WriteSelfSignedCert(const std::string& cert_path, const std::string& key_path)
+{
+    EVP_PKEY* key = EVP_EC_gen("P-256");
+    X509* cert = X509_new();
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+    X509_set_pubkey(cert, key);
+    X509_NAME* name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    X509_sign(cert, key, EVP_sha256());
+    FILE* cert_file = std::fopen(cert_path.c_str(), "w");
+    FILE* key_file = std::fopen(key_path.c_str(), "w");
+    PEM_write_X509(cert_file, cert);
+    PEM_write_PrivateKey(key_file, key, nullptr, nullptr, 0, nullptr, nullptr);
+    std::fclose(cert_file);
+    std::fclose(key_file);
+    X509_free(cert);
+    EVP_PKEY_free(key);
+}
+
+std::string WriteTestFile()
+{
+    std::string path = "/tmp/cloo_tls_file_" + std::to_string(::getpid());
+    std::string content(K_FILE_SIZE, '\0');
+    for(size_t i = 0; i < K_FILE_SIZE; ++i)
+    {
+        content[i] = FileByte(i);
+    }
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    assert(fd >= 0);
+    [[maybe_unused]] ssize_t n = ::write(fd, content.data(), content.size());
+    assert(n == static_cast<ssize_t>(content.size()));
+    ::close(fd);
+    return path;
+}
+
+// 客户端一侧的阻塞连接, ssl为nullptr时是明文
+struct Client
+{
+    int fd;
+    SSL* ssl;
+
+    void WriteAll(const std::string& data)
+    {
+        size_t done = 0;
+        while(done < data.size())
+        {
+            int n = ssl ? SSL_write(ssl, data.data() + done, static_cast<int>(data.size() - done))
+                        : static_cast<int>(::write(fd, data.data() + done, data.size() - done));
+            assert(n > 0);
+            done += n;
+        }
+    }
+
+    std::string ReadExactly(size_t len)
+    {
+        std::string data(len, '\0');
+        size_t done = 0;
+        while(done < len)
+        {
+            int n = ssl ? SSL_read(ssl, &data[done], static_cast<int>(len - done))
+                        : static_cast<int>(::read(fd, &data[done], len - done));
+            assert(n > 0);
+            done += n;
+        }
+        return data;
+    }
+};
+
+Client Connect(uint16_t port, const std::shared_ptr<Cloo::TlsContext>& client_context)
+{
+    Cloo::SocketAddress addr("127.0.0.1", port);
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if(::connect(fd, reinterpret_cast<const sockaddr*>(&addr.ToSockAddrIn()), sizeof(sockaddr_in)) != 0)
+    {
+        std::cerr << "connect failed" << std::endl;
+        std::abort();
+    }
+    SSL* ssl = nullptr;
+    if(client_context)
+    {
+        ssl = SSL_new(client_context->Native());
+        SSL_set_fd(ssl, fd);
+        if(SSL_connect(ssl) != 1)
+        {
+            std::cerr << "SSL_connect failed" << std::endl;
+            std::abort();
+        }
+    }
+    return Client{fd, ssl};
+}
+
+void Echo(Client& client)
+{
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<size_t> size(1, 64 * 1024);
+    for(int i = 0; i < K_MESSAGES; ++i)
+    {
+        std::string message(size(rng), static_cast<char>('a' + i % 26));
+        client.WriteAll(message);
+        [[maybe_unused]] std::string reply = client.ReadExactly(message.size());
+        assert(reply == message);
+    }
+}
+
+double FetchFile(Client& client)
+{
+    auto start = std::chrono::steady_clock::now();
+    client.WriteAll("GET\n");
+    [[maybe_unused]] std::string header = client.ReadExactly(K_HEADER.size());
+    assert(header == K_HEADER);
+    std::string body = client.ReadExactly(K_FILE_COUNT);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for(size_t i = 0; i < K_FILE_COUNT; ++i)
+    {
+        assert(body[i] == FileByte(K_FILE_OFFSET + i));
+    }
+    [[maybe_unused]] std::string trailer = client.ReadExactly(K_TRAILER.size());
+    assert(trailer == K_TRAILER);
+    return seconds;
+}
+
+// 服务端: "GET\n"开头的请求回复头部 + 文件 + 尾部, 其他数据原样回显
+void RunCase(const char* label, uint16_t port, const std::shared_ptr<Cloo::TlsContext>& server_context,
+             const std::shared_ptr<Cloo::TlsContext>& client_context, const std::string& file_path)
+{
+    std::string tls_info = "plaintext";
+    double seconds = 0;
+    std::thread server_thread([&]
+    {
+        auto loop = Cloo::EventLoop::Create();
+        Cloo::TcpServer server(loop, Cloo::SocketAddress(port), label);
+        if(server_context)
+        {
+            server.SetTlsContext(server_context);
+        }
+        int file_fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+        server.SetMessageCallback([&](const Cloo::define::TcpConnectionPtr& conn, Cloo::Buffer* buf, Cloo::define::SystemTimePoint)
+        {
+            if(conn->Tls() != nullptr)
+            {
+                const Cloo::TlsSession* tls = conn->Tls();
+                tls_info = tls->Version() + " " + tls->Cipher() + " ktls-tx=" + (tls->KernelSend() ? "yes" : "no")
+                           + " ktls-rx=" + (tls->KernelRecv() ? "yes" : "no");
+            }
+            std::string data = buf->RetrieveAllAsString();
+            if(data == "GET\n")
+            {
+                conn->Send(K_HEADER);
+                conn->SendFile(file_fd, K_FILE_OFFSET, K_FILE_COUNT);
+                conn->Send(K_TRAILER);
+            }
+            else
+            {
+                conn->Send(data);
+            }
+        });
+        server.Start();
+        auto* raw_loop = loop.get();
+        std::thread client_thread([&, raw_loop]
+        {
+            Client client = Connect(port, client_context);
+            Echo(client);
+            seconds = FetchFile(client);
+            if(client.ssl)
+            {
+                SSL_free(client.ssl);
+            }
+            ::close(client.fd);
+            raw_loop->QueueTaskInThisLoop([raw_loop] { raw_loop->Quit(); });
+        });
+        loop->Loop();
+        client_thread.join();
+        ::close(file_fd);
+    });
+    server_thread.join();
+    std::cout << label << ": echoed " << K_MESSAGES << " messages, sent " << K_FILE_COUNT / (1024 * 1024) << "MiB file in "
+              << seconds * 1000 << "ms (" << tls_info << ")" << std::endl;
+}
+
+}
+
+int main()
+{
+    const std::string cert_path = "/tmp/cloo_tls_cert_" + std::to_string(::getpid()) + ".pem";
+    const std::string key_path = "/tmp/cloo_tls_key_" + std::to_string(::getpid()) + ".pem";
+    WriteSelfSignedCert(cert_path, key_path);
+    const std::string file_path = WriteTestFile();
+
+    auto server_context = Cloo::TlsContext::CreateServer(cert_path, key_path);
+    auto client_context = Cloo::TlsContext::CreateClient(cert_path);
+    RunCase("tls", K_TLS_PORT, server_context, client_context, file_path);
+    RunCase("plain", K_PLAIN_PORT, nullptr, nullptr, file_path);
+
+    ::unlink(cert_path.c_str());
+    ::unlink(key_path.c_str());
+    ::unlink(file_path.c_str());
+}
+
+#else
+
+int main()
+{
+    std::cout << "built without OpenSSL, skipped" << std::endl;
+}
+
+#endif
@@ -0,0 +1,203 @@
+// Tracer: EventLoop迭代的trace-event导出
+// 1. 一个IO线程处理pipe上的读事件、其他线程投递的任务(唤醒)与定时器, 导出的JSON中包含所有种类的span, 事件span带有fd
+// 2. 每4轮采样一轮时, 记录的poll span约为迭代数的1/4
+// 3. 每个span的记录开销, 以及关闭/未采样时的开销
+// 4. 收到SIGUSR2后后台线程把trace写入文件
+
+#include "../net/include/Channel.h"
+#include "../net/include/EventLoop.h"
+#include "../net/include/Tracer.h"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <csignal>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+
+// 统计线程tid的名为name的span数, 导出的JSON中每个span占一行
+size_t CountSpans(const std::string& json, const std::string& name, pid_t tid)
+{
+    std::istringstream lines(json);
+    std::string line;
+    size_t count = 0;
+    const std::string name_key = "\"name\":\"" + name + "\"";
+    const std::string tid_key = "\"tid\":" + std::to_string(tid) + ",";
+    while(std::getline(lines, line))
+    {
+        if(line.find(name_key) != std::string::npos && line.find(tid_key) != std::string::npos)
+        {
+            ++count;
+        }
+    }
+    return count;
+}
+
+std::string Dump()
+{
+    std::ostringstream out;
+    Cloo::Tracer::DumpChromeJson(out);
+    return out.str();
+}
+
+void AllSpanKinds()
+{
+    Cloo::Tracer::Start();
+    int fds[2];
+    if(::pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0)
+    {
+        std::cerr << "pipe2 failed" << std::endl;
+        std::abort();
+    }
+    pid_t tid = 0;
+    std::thread io_thread([&]
+    {
+        tid = ::gettid();
+        auto loop = Cloo::EventLoop::Create();
+        auto channel = Cloo::Channel::Create(loop, fds[0]);
+        channel->SetReadCallBack([&]
+        {
+            char buf[16];
+            while(::read(fds[0], buf, sizeof buf) > 0) {}
+        });
+        channel->EnableReading();
+        int ticks = 0;
+        loop->RunEvery(2, [&]
+        {
+            [[maybe_unused]] auto n = ::write(fds[1], "x", 1);
+            if(++ticks == 20)
+            {
+                loop->Quit();
+            }
+        });
+        auto* raw_loop = loop.get();
+        std::thread poster([raw_loop]
+        {
+            for(int i = 0; i < 10; ++i)
+            {
+                raw_loop->QueueTaskInThisLoop([] {});
+                std::this_thread::sleep_for(std::chrono::milliseconds(3));
+            }
+        });
+        loop->Loop();
+        poster.join();
+        channel->DisableAll();
+        channel->Remove();
+    });
+    io_thread.join();
+    ::close(fds[0]);
+    ::close(fds[1]);
+
+    std::string json = Dump();
+    std::cout << "spans: poll=" << CountSpans(json, "poll", tid) << " event=" << CountSpans(json, "event", tid)
+              << " task=" << CountSpans(json, "task", tid) << " timer=" << CountSpans(json, "timer", tid)
+              << " wakeup=" << CountSpans(json, "wakeup", tid) << std::endl;
+    assert(json.find("\"traceEvents\"") != std::string::npos);
+    assert(CountSpans(json, "poll", tid) > 0 && CountSpans(json, "timer", tid) == 20);
+    assert(CountSpans(json, "task", tid) >= 10 && CountSpans(json, "wakeup", tid) > 0);
+    assert(json.find("\"fd\":" + std::to_string(fds[0])) != std::string::npos);
+    Cloo::Tracer::Stop();
+}
+
+void Sampling()
+{
+    Cloo::TraceOptions options;
+    options.sample_every = 4;
+    Cloo::Tracer::Start(options);
+    pid_t tid = 0;
+    int iterations = 0;
+    std::thread io_thread([&]
+    {
+        tid = ::gettid();
+        auto loop = Cloo::EventLoop::Create();
+        loop->AddIterationHook([&]
+        {
+            if(++iterations == 400)
+            {
+                loop->Quit();
+            }
+            else
+            {
+                // 推迟一个任务让下一轮迭代不阻塞
+                loop->DeferToNextIteration([] {});
+            }
+        });
+        loop->Loop();
+    });
+    io_thread.join();
+    size_t polls = CountSpans(Dump(), "poll", tid);
+    std::cout << "sample 1/4: " << polls << " poll spans in " << iterations << " iterations" << std::endl;
+    assert(polls == 100);
+    Cloo::Tracer::Stop();
+}
+
+void Overhead()
+{
+    constexpr int kSpans = 1000000;
+    auto measure = []
+    {
+        auto start = std::chrono::steady_clock::now();
+        for(int i = 0; i < kSpans; ++i)
+        {
+            Cloo::TraceSpan span(Cloo::TraceKind::kTask);
+        }
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / kSpans;
+    };
+    double recording = 0;
+    double not_sampled = 0;
+    double disabled = 0;
+    std::thread([&]
+    {
+        Cloo::TraceOptions options;
+        options.sample_every = 2;
+        Cloo::Tracer::Start(options);
+        Cloo::Tracer::BeginIteration();
+        if(!Cloo::Tracer::Recording())
+        {
+            Cloo::Tracer::BeginIteration();
+        }
+        recording = measure();
+        Cloo::Tracer::BeginIteration();
+        not_sampled = measure();
+        Cloo::Tracer::Stop();
+        disabled = measure();
+    }).join();
+    std::cout << "per span: recording=" << recording << "ns not-sampled=" << not_sampled << "ns disabled=" << disabled << "ns" << std::endl;
+}
+
+void DumpOnSignal()
+{
+    const std::string path = "/tmp/cloo_trace_" + std::to_string(::getpid()) + ".json";
+    ::unlink(path.c_str());
+    Cloo::Tracer::InstallDumpSignal(SIGUSR2, path);
+    ::raise(SIGUSR2);
+    std::string content;
+    for(int i = 0; i < 200 && content.find("]}") == std::string::npos; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        std::ifstream in(path);
+        content.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    std::cout << "signal dump: " << content.size() << " bytes written to " << path << std::endl;
+    assert(content.find("\"traceEvents\"") != std::string::npos && content.find("]}") != std::string::npos);
+    ::unlink(path.c_str());
+}
+
+}
+
+int main()
+{
+    AllSpanKinds();
+    Sampling();
+    Overhead();
+    DumpOnSignal();
+}
@@ -0,0 +1,181 @@
+// 写合并(EventLoop::SetWriteCoalescing)
+// 客户端与服务端做K_REQUESTS次一问一答, 每个回复由服务端分三次发送(头部、正文、尾部), 最后一个请求的回复之后服务端Shutdown.
+// 统计服务端写socket的系统调用次数(TcpConnection::WriteCalls)、设置TCP_CORK的setsockopt次数(TcpConnection::CorkCalls)
+// 与客户端收到的数据报文数(TCP_INFO的tcpi_data_segs_in):
+// 1. 关闭写合并: 每个回复3次write、3个报文
+// 2. 开启写合并: 每个回复1次writev、1个报文
+// 3. 同2并开启TCP_CORK: 一次writev就能写完, 不cork, 没有setsockopt
+// 4. 开启写合并, 正文改为SendFile: 每个回复writev + sendfile + writev共3次调用, 不cork时3个报文
+// 5. 同4并开启TCP_CORK: 每个回复3次写加2次setsockopt共5次系统调用, 1个报文
+// 所有情况下客户端收到的内容正确, 并且在最后一个回复之后读到EOF
+
+#include "../net/include/Buffer.h"
+#include "../net/include/EventLoop.h"
+#include "../net/include/SocketAddress.h"
+#include "../net/include/TcpConnection.h"
+#include "../net/include/TcpServer.h"
+#include "TestUtil.h"
+
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/tcp.h>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+
+constexpr uint16_t K_PORT = 7790;
+constexpr int K_REQUESTS = 500;
+constexpr size_t K_BODY_SIZE = 1000;
+const std::string K_HEADER = "HTTP/1.1 200 OK\r\nContent-Length: 1000\r\n\r\n";
+const std::string K_TRAILER = "\r\n";
+
+struct Result
+{
+    uint64_t write_calls = 0;
+    uint64_t cork_calls = 0;
+    uint32_t segments = 0;
+    double seconds = 0;
+};
+
+std::string Body()
+{
+    return std::string(K_BODY_SIZE, 'b');
+}
+
+uint32_t DataSegmentsIn(int fd)
+{
+    tcp_info info {};
+    socklen_t len = sizeof info;
+    ::getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len);
+    return info.tcpi_data_segs_in;
+}
+
+void RunClient(Result* result)
+{
+    int fd = TestUtil::Connect(K_PORT);
+    const std::string expected = K_HEADER + Body() + K_TRAILER;
+    uint32_t segments_before = DataSegmentsIn(fd);
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < K_REQUESTS; ++i)
+    {
+        const char request = i + 1 == K_REQUESTS ? 'q' : 'r';
+        if(::write(fd, &request, 1) != 1)
+        {
+            std::cerr << "write failed" << std::endl;
+            std::abort();
+        }
+        [[maybe_unused]] std::string reply = TestUtil::ReadExactly(fd, expected.size());
+        assert(reply == expected);
+    }
+    result->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result->segments = DataSegmentsIn(fd) - segments_before;
+    char byte;
+    [[maybe_unused]] ssize_t n = ::read(fd, &byte, 1);
+    assert(n == 0);
+    ::close(fd);
+}
+
+std::string WriteBodyFile()
+{
+    std::string path = "/tmp/cloo_coalescing_body_" + std::to_string(::getpid());
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    std::string body = Body();
+    [[maybe_unused]] ssize_t n = ::write(fd, body.data(), body.size());
+    assert(n == static_cast<ssize_t>(body.size()));
+    ::close(fd);
+    return path;
+}
+
+Result RunCase(const char* label, bool coalescing, bool cork, const std::string& body_file)
+{
+    Result result;
+    std::thread server_thread([&]
+    {
+        auto loop = Cloo::EventLoop::Create();
+        loop->SetWriteCoalescing(coalescing, cork);
+        Cloo::TcpServer server(loop, Cloo::SocketAddress(K_PORT), label);
+        int file_fd = body_file.empty() ? -1 : ::open(body_file.c_str(), O_RDONLY | O_CLOEXEC);
+        const std::string body = Body();
+        server.SetConnectionCallback([&](const Cloo::define::TcpConnectionPtr& conn)
+        {
+            if(conn->Connected())
+            {
+                conn->SetTcpNoDelay(true);
+            }
+            else
+            {
+                result.write_calls = conn->WriteCalls();
+                result.cork_calls = conn->CorkCalls();
+                loop->Quit();
+            }
+        });
+        server.SetMessageCallback([&](const Cloo::define::TcpConnectionPtr& conn, Cloo::Buffer* buf, Cloo::define::SystemTimePoint)
+        {
+            while(buf->ReadableBytes() > 0)
+            {
+                std::string request = buf->RetrieveAsString(1);
+                conn->Send(K_HEADER);
+                if(file_fd >= 0)
+                {
+                    conn->SendFile(file_fd, 0, body.size());
+                }
+                else
+                {
+                    conn->Send(body);
+                }
+                conn->Send(K_TRAILER);
+                if(request == "q")
+                {
+                    conn->Shutdown();
+                }
+            }
+        });
+        server.Start();
+        std::thread client_thread(RunClient, &result);
+        loop->Loop();
+        client_thread.join();
+        if(file_fd >= 0)
+        {
+            ::close(file_fd);
+        }
+    });
+    server_thread.join();
+    std::printf("%-26s syscalls/reply %.2f (write %.2f, setsockopt %.2f)  segments/reply %.2f  %.1fus/request\n", label,
+                static_cast<double>(result.write_calls + result.cork_calls) / K_REQUESTS,
+                static_cast<double>(result.write_calls) / K_REQUESTS, static_cast<double>(result.cork_calls) / K_REQUESTS,
+                static_cast<double>(result.segments) / K_REQUESTS, result.seconds * 1e6 / K_REQUESTS);
+    return result;
+}
+
+}
+
+int main()
+{
+    const std::string body_file = WriteBodyFile();
+    Result plain = RunCase("off", false, false, "");
+    Result coalesced = RunCase("coalescing", true, false, "");
+    Result coalesced_cork = RunCase("coalescing+cork", true, true, "");
+    Result file = RunCase("coalescing+sendfile", true, false, body_file);
+    Result corked = RunCase("coalescing+sendfile+cork", true, true, body_file);
+    ::unlink(body_file.c_str());
+
+    assert(plain.write_calls == 3 * K_REQUESTS);
+    assert(coalesced.write_calls == K_REQUESTS);
+    assert(coalesced_cork.write_calls == K_REQUESTS && coalesced_cork.cork_calls == 0);
+    assert(file.write_calls == 3 * K_REQUESTS && file.cork_calls == 0);
+    assert(corked.write_calls == 3 * K_REQUESTS && corked.cork_calls == 2 * K_REQUESTS);
+    // 回环接口上报文数取决于写的次数: 不合并时每次写一个报文, 合并或cork后每个回复一个报文
+    assert(plain.segments >= 2 * K_REQUESTS);
+    assert(coalesced.segments <= K_REQUESTS + K_REQUESTS / 10);
+    assert(coalesced_cork.segments <= K_REQUESTS + K_REQUESTS / 10);
+    assert(corked.segments <= K_REQUESTS + K_REQUESTS / 10);
+    assert(file.segments > corked.segments);
+}